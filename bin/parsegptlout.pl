@@ -12,6 +12,10 @@ our ($numthreads);    # number of threads
 
 my ($fn);             # file name
 my ($fnroot) = "timing";
+my ($collfile);       # single file written by GPTLpr_collective
+my (@offsets);        # byte offset of each rank's report in $collfile
+my (@lengths);        # byte length of each rank's report in $collfile
+my ($text);           # one rank's report read from $collfile
 my ($target);         # region to search for
 my ($arg);            # element of @ARGV
 my ($started);        # flag indicates initial "Stats for thread" found
@@ -37,6 +41,8 @@ my (@headinglist);    # list of headings in input files
 while ($arg = shift (@ARGV)) {
     if ($arg eq "-f") {
 	$fnroot = shift (@ARGV);    # change root of file name
+    } elsif ($arg eq "-c") {
+	$collfile = shift (@ARGV);  # read all tasks from a single collective file
     } elsif ($arg eq "-h") {
 	$heading = shift (@ARGV);   # change heading to search for
     } elsif ($arg eq "-v") {
@@ -55,11 +61,22 @@ die_usemsg ("Target region name not defined\n") if ( ! defined $target );
 &initstats();     # Initialize stats
 $found = 0;       # false
 
-# Loop through output files
+&read_index ($collfile) if (defined $collfile);
 
-for ($task = 0; -e "${fnroot}.$task"; $task++) {
-    $fn = "${fnroot}.$task";
-    open (FILE, "<$fn") || die ("Can't open $fn for reading\n");
+# Loop through output files, or through the per-rank reports of a collective file
+
+for ($task = 0; defined $collfile ? $task <= $#offsets : -e "${fnroot}.$task"; $task++) {
+    if (defined $collfile) {
+	$fn = "$collfile rank $task";
+	open (COLL, "<$collfile") || die ("Can't open $collfile for reading\n");
+	seek (COLL, $offsets[$task], 0) || die ("Can't seek in $collfile\n");
+	(read (COLL, $text, $lengths[$task]) == $lengths[$task]) || die ("Short read from $fn\n");
+	close (COLL);
+	open (FILE, "<", \$text) || die ("Can't open $fn for reading\n");
+    } else {
+	$fn = "${fnroot}.$task";
+	open (FILE, "<$fn") || die ("Can't open $fn for reading\n");
+    }
     $started = 0;
 
 # Read all the lines in the file, looking for "Stats for thread", followed by
@@ -148,10 +165,36 @@ sub initstats {
     $threadmin = -1;
 }
 
+# Read the index block of a file written by GPTLpr_collective into @offsets and @lengths
+sub read_index {
+    my ($file) = $_[0];
+    my ($hdr);          # header line
+    my ($nranks);       # number of ranks in the file
+    my ($hdrbytes);     # length of header line
+    my ($idxbytes);     # length of each index line
+    my ($entry);        # one index line
+    my ($r);            # rank
+
+    open (COLL, "<$file") || die ("Can't open $file for reading\n");
+    $hdr = <COLL>;
+    ($hdr =~ /nranks=(\d+) header_bytes=(\d+) index_bytes=(\d+)/) ||
+	die ("$file was not written by GPTLpr_collective\n");
+    ($nranks, $hdrbytes, $idxbytes) = ($1, $2, $3);
+    for ($r = 0; $r < $nranks; $r++) {
+	seek (COLL, $hdrbytes + $r*$idxbytes, 0) || die ("Can't seek in $file\n");
+	read (COLL, $entry, $idxbytes);
+	($entry =~ /^\s*(\d+)\s+(\d+)\s+(\d+)/ && $1 == $r) || die ("Bad index entry for rank $r\n");
+	$offsets[$r] = $2;
+	$lengths[$r] = $3;
+    }
+    close (COLL);
+}
+
 sub die_usemsg {
     defined $_[0] && print (STDOUT "$_[0]");
-    print (STDOUT "Usage: $0 [-v] [-f file-root] [-h heading] region\n",
+    print (STDOUT "Usage: $0 [-v] [-f file-root | -c file] [-h heading] region\n",
 	   " -f file-root => look for files named <file-root>.<taskid> (default file-root is 'timing')\n",
+	   " -c file      => read all tasks from <file> written by GPTLpr_collective\n",
 	   " -h heading   => use <heading> as the default search target (default is Wallclock)\n",
 	   " -v           => verbose\n",
 	   " region       => region name to search for\n");
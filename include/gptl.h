@@ -37,6 +37,18 @@ typedef enum {
   GPTLmaxthreads      = 51, // maximum number of threads
   GPTLonlyprint_rank0 = 52, // Restrict printout to rank 0 when MPI enabled
   GPTLmem_growth      = 53, // Print info when mem usage (RSS) has grown by more than some percent
+  GPTLdopr_imbalance  = 28, // Print cross-rank load imbalance in GPTLpr_summary (true)
+  GPTLmem_sample_msec = 54, // Memory sampler interval in milliseconds (10)
+  GPTLcollapse_indexed = 55, // Print GPTLstart_indexed variants as one name[*] row (false)
+  GPTLhotspot_rows    = 56, // Rows in the hotspot section of GPTLpr_file, 0 to omit it (20)
+  GPTLcct             = 57, // One timer per call path (calling context tree) instead of per name (false)
+  GPTLsample_usec     = 58, // Sample each thread every N usec of its CPU time, 0 for off (0)
+  GPTLthrottle_calls  = 59, // Stop timing auto-profiled functions after this many short calls, 0 for never (0)
+  GPTLthrottle_nsec   = 60, // Mean duration (nsec) below which GPTLthrottle_calls applies (1000)
+  GPTLpatch           = 61, // Time functions built with -fpatchable-function-entry=5 by patching them (false)
+  GPTLcallsites       = 62, // Count and time auto-profiled functions per call site (false)
+  GPTLthread_cpu      = 72, // GPTLcpu counts CPU time of the calling thread (false)
+  GPTLcallsite_lines  = 73, // Name call sites by file:line, via addr2line (false)
 
   // These are derived counters based on PAPI counters. All default to false
   GPTL_IPC           = 17, // Instructions per cycle
@@ -45,7 +57,18 @@ typedef enum {
   GPTL_LSTPDCM       = 23, // Load-stores per L1 miss
   GPTL_L2MRT         = 24, // L2 miss rate (fraction)
   GPTL_LSTPL2M       = 25, // Load-stores per L2 miss
-  GPTL_L3MRT         = 26  // L3 read miss rate (fraction)
+  GPTL_L3MRT         = 26, // L3 read miss rate (fraction)
+
+  // These are Linux perf_event_open counters, which need no PAPI. All default to false
+  GPTLperf_task_clock     = 63, // CPU time of the thread (nsec)
+  GPTLperf_ctx_switches   = 64, // Context switches
+  GPTLperf_cpu_migrations = 65, // Migrations to another CPU
+  GPTLperf_page_faults    = 66, // Page faults
+  GPTLperf_cycles         = 67, // CPU cycles (hardware)
+  GPTLperf_instructions   = 68, // Instructions retired (hardware)
+  GPTLperf_cache_misses   = 69, // Last level cache misses (hardware)
+  GPTLperf_branch_misses  = 70, // Mispredicted branches (hardware)
+  GPTLperf_ipc            = 71  // Derived: instructions per cycle (hardware)
 } GPTLoption;
 
 /*
@@ -70,6 +93,13 @@ typedef enum {
   GPTLfull_tree     = 4   // complete call tree
 } GPTLMethod;
 
+// Context for a timer which may be stopped on a different thread than the one which started
+// it (see GPTLstart_async). Contents are private to GPTL.
+typedef struct {
+  int region;      // index of async region, or -1 if nothing was started
+  double start;    // start time
+} GPTLasync_token;
+
 // User-callable function prototypes: all require C linkage
 #ifdef __cplusplus
 extern "C" {
@@ -79,12 +109,20 @@ extern int GPTLsetoption (const int, const int);
 extern int GPTLinitialize (void);
 extern int GPTLstart (const char *);
 extern int GPTLinit_handle (const char *, int *);
+extern int GPTLinit_handle_hash (unsigned int, int *);
 extern int GPTLstart_handle (const char *, int *);
 extern int GPTLstop (const char *);
 extern int GPTLstop_handle (const char *, int *);
+extern int GPTLstop_top (const char *);
+extern int GPTLstart_indexed (const char *, int);
+extern int GPTLstop_indexed (const char *, int);
+extern int GPTLstart_indexed_handle (const char *, int, int *);
+extern int GPTLstop_indexed_handle (const char *, int, int *);
 extern int GPTLstamp (double *, double *, double *);
+extern int GPTLget_walltime (double *);
 extern int GPTLpr (const int);
 extern int GPTLpr_file (const char *);
+extern int GPTLpr_folded (const char *);
 extern int GPTLreset (void);
 extern int GPTLreset_timer (const char *);
 extern int GPTLfinalize (void);
@@ -110,6 +148,9 @@ extern int GPTLget_eventvalue (const char *, const char *, int, double *);
 extern int GPTLnum_errors (void);
 extern int GPTLnum_warn (void);
 extern int GPTLget_count (const char *, int, int *);
+extern int GPTLstart_async (const char *, GPTLasync_token *);
+extern int GPTLstop_async (GPTLasync_token *);
+extern int GPTLquery_async (const char *, int *, int *, double *, double *, double *);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,137 @@
+/*
+** gptl.hpp
+**
+** Author: Jim Rosinski
+**
+** Header-only C++ layer over the GPTL C API:
+**
+**   gptl::ScopedTimer   RAII timer. The destructor stops it on every way out of a scope,
+**                       including early returns and exceptions, so timers are never left on.
+**   GPTL_SCOPE("name")  Time the rest of the enclosing scope. The name must be a non-empty
+**                       string literal: its hash sum is computed at compile time, and only
+**                       the modulo by the current table size is left for run time. This
+**                       stays right across GPTLfinalize and a GPTLinitialize with a new
+**                       GPTLtablesize.
+**   gptl::wallclock     std::chrono clock over the underlying timing routine of GPTL
+**   gptl::cpuclock      std::chrono clock over user+system CPU time
+**
+** Use gptl::ScopedTimer directly for names which are not literals.
+*/
+
+#ifndef GPTL_HPP
+#define GPTL_HPP
+
+#include "gptl.h"
+#include <chrono>
+#include <cstddef>
+#include <ratio>
+#include <string>
+#include <type_traits>
+
+namespace gptl {
+
+namespace detail {
+// Must match MAX_CHARS and genhashidx in gptl.c
+const unsigned int max_chars = 63;
+
+constexpr unsigned int hashsum_last (const char *name, unsigned int lastidx)
+{
+  return max_chars * (unsigned char) name[0]
+    + (max_chars - lastidx/2) * (unsigned char) name[lastidx/2]
+    + (max_chars - lastidx) * (unsigned char) name[lastidx];
+}
+
+// Hash sum of a string literal, before the modulo by the run-time table size
+template <std::size_t N>
+constexpr unsigned int literal_hash (const char (&name)[N])
+{
+  static_assert (N > 1, "GPTL timer names must not be empty");
+  return N > 1 ? hashsum_last (name, (unsigned int) (N - 2)) : 0;
+}
+
+inline int handle_from_hash (unsigned int sum)
+{
+  int handle = 0;   // 0 makes GPTLstart_handle fall back to hashing the name
+  (void) GPTLinit_handle_hash (sum, &handle);
+  return handle;
+}
+} // namespace detail
+
+class ScopedTimer {
+public:
+  explicit ScopedTimer (const char *name) : name_ (name), handle_ (0)
+  {
+    (void) GPTLstart_handle (name_, &handle_);
+  }
+
+  // handle as returned by GPTLinit_handle, or 0
+  ScopedTimer (const char *name, int handle) : name_ (name), handle_ (handle)
+  {
+    (void) GPTLstart_handle (name_, &handle_);
+  }
+
+  explicit ScopedTimer (const std::string &name) : owned_ (name), name_ (owned_.c_str ()),
+						   handle_ (0)
+  {
+    (void) GPTLstart_handle (name_, &handle_);
+  }
+
+  ~ScopedTimer ()
+  {
+    (void) GPTLstop_handle (name_, &handle_);
+  }
+
+  ScopedTimer (const ScopedTimer &) = delete;
+  ScopedTimer &operator= (const ScopedTimer &) = delete;
+
+private:
+  std::string owned_;   // copy of a std::string name, which must outlive the timer
+  const char *name_;
+  int handle_;
+};
+
+// Seconds from the same routine used by all GPTL timers (see GPTLsetutr)
+struct wallclock {
+  typedef double rep;
+  typedef std::ratio<1> period;
+  typedef std::chrono::duration<rep, period> duration;
+  typedef std::chrono::time_point<wallclock> time_point;
+  static const bool is_steady = false;
+
+  static time_point now () noexcept
+  {
+    double wall = 0.;
+    (void) GPTLget_walltime (&wall);
+    return time_point (duration (wall));
+  }
+};
+
+// Process user+system CPU seconds, at the resolution of times()
+struct cpuclock {
+  typedef double rep;
+  typedef std::ratio<1> period;
+  typedef std::chrono::duration<rep, period> duration;
+  typedef std::chrono::time_point<cpuclock> time_point;
+  static const bool is_steady = false;
+
+  static time_point now () noexcept
+  {
+    double wall = 0., usr = 0., sys = 0.;
+    (void) GPTLstamp (&wall, &usr, &sys);
+    return time_point (duration (usr + sys));
+  }
+};
+
+} // namespace gptl
+
+#define GPTL_CONCAT_(a,b) a##b
+#define GPTL_CONCAT(a,b) GPTL_CONCAT_(a,b)
+
+// Time the rest of the enclosing scope under the string literal name. The handle is not
+// cached: the table size it depends on can change between GPTLinitialize calls
+#define GPTL_SCOPE(name)						\
+  ::gptl::ScopedTimer GPTL_CONCAT(gptl_scope_, __LINE__)		\
+    (name, ::gptl::detail::handle_from_hash (std::integral_constant<unsigned int, \
+					     ::gptl::detail::literal_hash (name)>::value))
+
+#endif
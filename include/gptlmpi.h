@@ -9,7 +9,10 @@ extern "C" {
 
 extern int GPTLpr_summary (MPI_Comm);
 extern int GPTLpr_summary_file (MPI_Comm, const char *);
+extern int GPTLpr_collective (MPI_Comm, const char *);
 extern int GPTLbarrier (MPI_Comm, const char *);
+extern int GPTLclock_sync (MPI_Comm);
+extern int GPTLget_clocksync (double *, double *);
 
 #ifdef __cplusplus
 }
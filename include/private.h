@@ -12,6 +12,30 @@
 #include <stdio.h>
 #include <sys/time.h>
 
+// Interposition layers which charge work to the innermost active region
+#if ( defined ENABLE_ALLOCPROF || defined ENABLE_IOPROF || defined ENABLE_LOCKPROF )
+#define HAVE_INTERPOSE
+#endif
+
+// With --enable-allocprof, GPTL's own heap use goes directly to the real allocator so that
+// it is not charged to the user's regions (allocprof.c itself defines the wrappers)
+#if ( defined ENABLE_ALLOCPROF && ! defined GPTL_ALLOCPROF_WRAPPERS )
+#include <stdlib.h>
+extern void *__libc_malloc (size_t);
+extern void *__libc_calloc (size_t, size_t);
+extern void *__libc_realloc (void *, size_t);
+extern void __libc_free (void *);
+#define malloc(n) __libc_malloc (n)
+#define calloc(n,s) __libc_calloc (n, s)
+#define realloc(p,n) __libc_realloc (p, n)
+#define free(p) __libc_free (p)
+#endif
+
+// Linux perf_event_open counters need no library (perfevents.c)
+#if ( defined HAVE_LINUX_PERF_EVENT_H && defined __linux__ )
+#define HAVE_PERFEVENTS
+#endif
+
 #ifndef MIN
 #define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
 #endif
@@ -28,6 +52,9 @@
 // Maximum allowed callstack depth
 #define MAX_STACK 128
 
+// Ids passed to GPTLstart_indexed must be less than this
+#define MAX_VARIANTS 1048576
+
 // longest timer name allowed (probably safe to just change)
 #define MAX_CHARS 63
 
@@ -40,6 +67,9 @@
 // max allowable number of PAPI counters, or derived events.
 #define MAX_AUX 3
 
+// max allowable number of perf_event_open counters, including those only needed for derived events
+#define MAX_PERF 8
+
 typedef enum {false = 0, true = 1} bool;  // mimic C++
 
 typedef struct {
@@ -48,16 +78,21 @@ typedef struct {
 } Nofalse; 
 
 typedef struct {
-  long last_utime;          // saved usr time from "start"
+  long last_utime;          // saved usr time from "start" (thread CPU time with GPTLthread_cpu)
   long last_stime;          // saved sys time from "start"
   long accum_utime;         // accumulator for usr time
   long accum_stime;         // accumulator for sys time
+  long last_nvcsw;          // voluntary context switches from "start" (GPTLthread_cpu only)
+  long last_nivcsw;         // involuntary context switches from "start"
+  long accum_nvcsw;         // accumulator for voluntary context switches
+  long accum_nivcsw;        // accumulator for involuntary context switches
 } Cpustats;
 
 typedef struct {
   double last;              // timestamp from last call
   double latest;            // most recent delta
   double accum;             // accumulated time
+  double child;             // part of accum spent in timers started while this one was innermost
   float max;                // longest time for start/stop pair
   float min;                // shortest time for start/stop pair
 } Wallstats;
@@ -66,22 +101,75 @@ typedef struct {
   long long last[MAX_AUX];  // array of saved counters from "start"
   long long accum[MAX_AUX]; // accumulator for counters
 } Papistats;
+
+typedef struct {
+  long long last[MAX_PERF]; // counter values from "start"
+  long long accum[MAX_PERF];// accumulator for counters
+} Perfstats;
+
+typedef struct {
+  unsigned long count;      // number of heap allocations
+  double bytes;             // bytes requested
+  double time;              // time spent in the allocator, including free
+} Allocstats;
+
+typedef struct {
+  unsigned long ncontend;   // number of lock acquires which had to wait
+  double wait;              // time spent waiting for locks
+} Lockstats;
+
+// Number of power-of-2 bins in I/O transfer size histograms
+#define NIOBINS 32
+
+typedef struct {
+  unsigned long ncalls;     // number of I/O calls
+  double bytes;             // bytes transferred
+  double time;              // time spent in I/O calls
+  unsigned long hist[NIOBINS]; // transfer count by log2(bytes)
+} Iostats;
+
+typedef struct {
+  float rss_peak;           // highest RSS (MB) sampled while region was top of callstack
+  float rss_growth;         // RSS growth (MB) between consecutive samples charged to region
+  unsigned long nsamples;   // number of RSS samples charged to region
+} Memsamples;
+  
+typedef struct {
+  void *site;               // return address in the caller (NULL if the slot is empty)
+  unsigned long count;      // number of calls from site
+  double wall;              // wallclock time of the calls from site (outermost if recursive)
+} Callsite;
   
 typedef struct TIMER {
 #ifdef ENABLE_PMPI
   double nbytes;            // number of bytes for MPI call
 #endif
+#ifdef ENABLE_ALLOCPROF
+  Allocstats alloc;         // heap allocation stats
+#endif
+#ifdef ENABLE_IOPROF
+  Iostats io;               // I/O stats
+#endif
+#ifdef ENABLE_LOCKPROF
+  Lockstats lock;           // lock contention stats
+#endif
 #ifdef HAVE_PAPI
   Papistats aux;            // PAPI stats 
 #endif 
+#ifdef HAVE_PERFEVENTS
+  Perfstats perf;           // perf_event_open counters
+#endif
   Cpustats cpu;             // cpu stats
   Wallstats wall;           // wallclock stats
+  Memsamples mem;           // background RSS samples
+  unsigned long cpusamples; // SIGPROF samples taken while this timer was innermost
   unsigned long count;      // number of start/stop calls
   unsigned long nrecurse;   // number of recursive start/stop calls
 #ifdef COLLIDE
   unsigned long collide;    // number of extra comparisons due to collision
 #endif
   void *address;            // address of timer: used only by _instr routines
+  bool resolved;            // auto-profiled: name has been looked up from address
   struct TIMER *next;       // next timer in linked list
   struct TIMER **parent;    // array of parents
   struct TIMER **children;  // array of children
@@ -91,8 +179,22 @@ typedef struct TIMER {
   unsigned int nparent;     // number of parents
   unsigned int norphan;     // number of times this timer was an orphan
   bool onflg;               // timer currently on or off
+  bool throttled;           // auto-profiled timer no longer timed (GPTLthrottle_calls)
+  bool excluded;            // auto-profiled function rejected by GPTL_FILTER: in addrmap only
+  unsigned long nthrottled; // calls counted but not timed since being throttled
   char name[MAX_CHARS+1];   // timer name (user input)
-  char *longname;           // For autoprofiled names, full name for diagnostic printing
+  char *longname;           // auto-profiled names longer than MAX_CHARS: full name for printing
+  struct TIMER *base;       // GPTLstart_indexed variant: timer holding all variants of the name
+  struct TIMER **variants;  // GPTLstart_indexed base: variants indexed by id (NULL if not yet used)
+  unsigned int nvariants;   // size of variants array
+  struct TIMER **ctxkids;   // GPTLcct mode: children by name hash, open addressing (NULL if none)
+  unsigned int nctxkids;    // number of entries in ctxkids
+  unsigned int ctxkidsize;  // size of ctxkids (power of 2)
+  unsigned int hash;        // GPTLcct mode: hash index of name, the key in the parent's ctxkids
+  Callsite *sites;          // GPTLcallsites mode: calls by call site, open addressing (NULL if none)
+  unsigned int nsites;      // number of entries in sites
+  unsigned int sitesize;    // size of sites (power of 2)
+  unsigned int cursite;     // index in sites of the site of the outermost running call
 } Timer;
 
 typedef struct {
@@ -100,6 +202,24 @@ typedef struct {
   unsigned int nument;      // number of entries hashed to the same value
 } Hashentry;
 
+// Auto-profiled functions are looked up by address in a per-thread map: open addressing with
+// linear probing (size a power of 2), with a small direct-mapped cache in front of it
+#define ADDRCACHE 16                  // entries in the cache (power of 2)
+#define ADDRMAP_LOG2SIZE 8            // log2 of the initial size of the map
+
+typedef struct {
+  void *address;            // function address (NULL if the slot is empty)
+  Timer *ptr;               // timer of the function
+} Addrslot;
+
+typedef struct {
+  Addrslot cache[ADDRCACHE];  // most recently missed functions, indexed by address bits
+  Addrslot *slots;            // the map, indexed by a multiplicative hash of the address
+  unsigned int size;          // number of slots (0 until the first function is added)
+  unsigned int nused;         // number of slots in use
+  int shift;                  // the hash is the top log2(size) bits of a 64-bit product
+} Addrmap;
+
 // Function prototypes
 extern int GPTLerror (const char *, ...);                  // print error msg and return
 extern void GPTLwarn (const char *, ...);                  // print warning msg and return
@@ -111,6 +231,7 @@ extern void *GPTLallocate (const int, const char *);       // malloc wrapper
 extern int GPTLstart_instr (void *);                       // auto-instrumented start
 extern int GPTLstop_instr (void *);                        // auto-instrumented stop
 extern int GPTLis_initialized (void);                      // needed by MPI_Init wrapper
+extern int GPTLis_disabled (void);                         // needed by async timers
 extern int GPTLget_overhead (FILE *,                       // file descriptor
 			     double (*)(),                 // UTR()
 			     Timer *(const Hashentry *, const char *, unsigned int), // getentry()
@@ -127,13 +248,95 @@ extern int GPTLget_overhead (FILE *,                       // file descriptor
 extern void GPTLprint_hashstats (FILE *, int, Hashentry **, int);
 extern void GPTLprint_memstats (FILE *, Timer **, int);
 extern Timer **GPTLget_timersaddr (void);
-// For now this one is local to gptl.c but that may change if needs calling from pr_summary
-extern int GPTLrename_duplicate_addresses (void);
+extern int GPTLpr_fp (FILE *);                             // print to an open stream
+extern double GPTLread_utr (void);                         // read underlying timing routine
 
 extern void __cyg_profile_func_enter (void *, void *);
 extern void __cyg_profile_func_exit (void *, void *);
 
 extern bool GPTLonlypr_rank0;     // flag says ignore all stdout/stderr print from non-zero ranks
+extern bool GPTLdopr_imbal;       // flag says print load imbalance analysis in GPTLpr_summary
+
+// Background memory sampler (memsampler.c)
+extern int GPTLmemsampler_start (Timer ***, Nofalse *, int, float);
+extern void GPTLmemsampler_stop (void);
+extern void GPTLmemsampler_set_procsiz (void);
+extern void GPTLprint_memsamples (FILE *, Timer **);
+
+// Sampling profiler (sampler.c)
+extern int GPTLsampler_start (Timer ***, Nofalse *, int);
+extern int GPTLsampler_thread_start (int);
+extern void GPTLsampler_stop (void);
+extern void GPTLreset_samples (void);
+extern void GPTLprint_samples (FILE *, Timer **);
+
+// Names of auto-profiled functions and sampled addresses (symbols.c)
+extern int GPTLresolve_names (Timer **, int);
+extern const char *GPTLsymbol_name (const void *, const void **);
+extern char *GPTLsymbol_copy (const void *);
+extern void GPTLload_symbols (void);
+extern void GPTLfree_symbols (void);
+extern int GPTLsymbol_lines (void * const *, int, char **);
+
+// Per-call-site breakdown of auto-profiled functions (callsites.c)
+extern void GPTLprint_callsites (FILE *, Timer **, int, bool);
+
+// Patching -fpatchable-function-entry functions (patch.c)
+extern int GPTLpatch_init (void);
+extern int GPTLpatch_apply (bool, volatile bool *);
+extern void GPTLpatch_finalize (void);
+
+// Run-time selection of auto-profiled functions (filter.c)
+extern int GPTLfilter_init (void);
+extern bool GPTLfilter_timed (const void *);
+extern void GPTLfilter_free (void);
+
+// Counters from perf_event_open (perfevents.c)
+extern int GPTLperf_setoption (const int, const int);
+extern int GPTLperf_initialize (void);
+extern int GPTLperf_thread_start (int);
+extern void GPTLperf_finalize (void);
+#ifdef HAVE_PERFEVENTS
+extern int GPTLperf_start (const int, Perfstats *);
+extern int GPTLperf_stop (const int, Perfstats *);
+extern void GPTLperf_prstr (FILE *);
+extern void GPTLperf_pr (FILE *, const Perfstats *);
+extern void GPTLperf_add (Perfstats *, const Perfstats *);
+extern void GPTLperf_printenabled (FILE *);
+extern int GPTLperf_get_eventvalue (const char *, const Perfstats *, double *);
+#endif
+
+// Async timers (async.c)
+extern void GPTLprint_async (FILE *);
+extern void GPTLreset_async (void);
+extern void GPTLfinalize_async (void);
+
+#ifdef HAVE_LIBMPI
+extern void GPTLprint_clocksync (FILE *);
+extern void GPTLreset_clocksync (void);
+#endif
+
+#ifdef HAVE_INTERPOSE
+extern Timer *GPTLcurrent_region (void);
+extern void GPTLinterpose_pause (void);
+extern void GPTLinterpose_resume (void);
+#endif
+
+#ifdef ENABLE_IOPROF
+extern void GPTLprint_iohist (FILE *, Timer **, int);
+#endif
+
+#ifdef ENABLE_LOCKPROF
+extern void GPTLprint_lockstats (FILE *);
+extern void GPTLreset_lockstats (bool);
+#endif
+
+#ifdef ENABLE_OMPT
+extern void GPTLompt_init (void);
+extern void GPTLprint_ompt (FILE *);
+extern void GPTLreset_ompt (void);
+extern void GPTLfinalize_ompt (void);
+#endif
 
 #ifdef ENABLE_PMPI
 extern Timer *GPTLgetentry (const char *);
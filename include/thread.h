@@ -16,6 +16,7 @@ extern inline int GPTLget_thread_num (void);
 #else
 extern int GPTLget_thread_num (void);
 #endif
+extern int GPTLknown_thread_num (void);  // like GPTLget_thread_num, but -1 for unknown threads
 
 extern void GPTLprint_threadmapping (FILE *fp);
 
@@ -0,0 +1,162 @@
+/*
+** allocprof.c
+**
+** Author: Jim Rosinski
+**
+** Interpose the C heap allocator to count allocations, bytes requested, and time spent in
+** the allocator for each timed region. Like the PMPI wrappers in pmpi.c, these routines
+** replace the library entry points and forward to the real implementation, which for glibc
+** is available as __libc_malloc and friends. C++ operator new/delete and Fortran ALLOCATE
+** are covered as well since their runtimes call malloc/free.
+**
+** Each allocation is charged to the innermost active timer of the calling thread. Since
+** every thread owns its timers, no locking is needed.
+*/
+
+#include "config.h"      // Must be first include.
+#define GPTL_ALLOCPROF_WRAPPERS
+#include "private.h"
+
+#include <stddef.h>      // size_t
+#include <errno.h>       // EINVAL, ENOMEM
+
+extern void *__libc_malloc (size_t);
+extern void *__libc_calloc (size_t, size_t);
+extern void *__libc_realloc (void *, size_t);
+extern void *__libc_memalign (size_t, size_t);
+extern void __libc_free (void *);
+
+// Set while this thread is inside a wrapper, so allocations made by GPTL itself while
+// looking up the current region (e.g. error messages) pass straight through.
+// initial-exec avoids TLS setup which could itself call malloc.
+static __thread int inside __attribute__ ((tls_model ("initial-exec"))) = 0;
+
+// begin: Return the region to charge, or 0 if this call is not to be recorded
+static inline Timer *begin (void)
+{
+  Timer *region;
+
+  if (inside)
+    return 0;
+
+  inside = 1;
+  if ( ! (region = GPTLcurrent_region ()))
+    inside = 0;
+  return region;
+}
+
+// end: Charge the allocator call which started at t0 to region
+static inline void end (Timer *region, double t0, size_t bytes, bool isalloc)
+{
+  region->alloc.time += GPTLread_utr () - t0;
+  if (isalloc) {
+    ++region->alloc.count;
+    region->alloc.bytes += (double) bytes;
+  }
+  inside = 0;
+}
+
+void *malloc (size_t size)
+{
+  void *ptr;
+  double t0;
+  Timer *region;
+
+  if ( ! (region = begin ()))
+    return __libc_malloc (size);
+
+  t0 = GPTLread_utr ();
+  ptr = __libc_malloc (size);
+  end (region, t0, size, true);
+  return ptr;
+}
+
+void *calloc (size_t nmemb, size_t size)
+{
+  void *ptr;
+  double t0;
+  Timer *region;
+
+  if ( ! (region = begin ()))
+    return __libc_calloc (nmemb, size);
+
+  t0 = GPTLread_utr ();
+  ptr = __libc_calloc (nmemb, size);
+  end (region, t0, nmemb*size, true);
+  return ptr;
+}
+
+// realloc to size 0 frees the memory, so it is not counted as an allocation
+void *realloc (void *oldptr, size_t size)
+{
+  void *ptr;
+  double t0;
+  Timer *region;
+
+  if ( ! (region = begin ()))
+    return __libc_realloc (oldptr, size);
+
+  t0 = GPTLread_utr ();
+  ptr = __libc_realloc (oldptr, size);
+  end (region, t0, size, size > 0);
+  return ptr;
+}
+
+void free (void *ptr)
+{
+  double t0;
+  Timer *region;
+
+  if ( ! ptr || ! (region = begin ())) {
+    __libc_free (ptr);
+    return;
+  }
+
+  t0 = GPTLread_utr ();
+  __libc_free (ptr);
+  end (region, t0, 0, false);
+}
+
+int posix_memalign (void **memptr, size_t alignment, size_t size)
+{
+  void *ptr;
+  double t0;
+  Timer *region;
+
+  // Alignment must be a power of two multiple of sizeof (void *)
+  if (alignment % sizeof (void *) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0)
+    return EINVAL;
+
+  if ( ! (region = begin ())) {
+    ptr = __libc_memalign (alignment, size);
+  } else {
+    t0 = GPTLread_utr ();
+    ptr = __libc_memalign (alignment, size);
+    end (region, t0, size, true);
+  }
+
+  if ( ! ptr)
+    return ENOMEM;
+  *memptr = ptr;
+  return 0;
+}
+
+void *memalign (size_t alignment, size_t size)
+{
+  void *ptr;
+  double t0;
+  Timer *region;
+
+  if ( ! (region = begin ()))
+    return __libc_memalign (alignment, size);
+
+  t0 = GPTLread_utr ();
+  ptr = __libc_memalign (alignment, size);
+  end (region, t0, size, true);
+  return ptr;
+}
+
+void *aligned_alloc (size_t alignment, size_t size)
+{
+  return memalign (alignment, size);
+}
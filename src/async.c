@@ -0,0 +1,289 @@
+/*
+** async.c
+**
+** Author: Jim Rosinski
+**
+** Timers which may be started on one thread and stopped on another: OpenMP tasks which
+** migrate, work-stealing pools, futures and coroutines. GPTLstart_async returns a token which
+** carries the start time and region, so stopping needs no thread-private state. Stats for each
+** named region are accumulated in a global table updated only with atomic operations, and are
+** separate from the per-thread call trees: async regions have no parent or children.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+#include "gptl.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define MAXASYNC 1024    // max distinct async regions: must be a power of 2
+
+typedef struct {
+  volatile int state;       // 0=empty, 1=being claimed, 2=in use
+  char name[MAX_CHARS+1];   // region name
+  unsigned long count;      // number of completed start/stop pairs
+  long inflight;            // started but not yet stopped
+  long maxinflight;         // largest number in flight at once
+  double accum;             // total time of completed pairs
+  double max;               // longest completed pair
+  double min;               // shortest completed pair
+} Asyncregion;
+
+static Asyncregion regions[MAXASYNC];
+static volatile int nregions = 0;
+static bool tablefull = false;   // a region could not be added
+
+// hashname: Index at which to start searching for name
+static inline unsigned int hashname (const char *name)
+{
+  unsigned int hash = 2166136261u;   // FNV-1a
+
+  for ( ; *name; ++name)
+    hash = (hash ^ (unsigned char) *name) * 16777619u;
+  return hash & (MAXASYNC - 1);
+}
+
+// findregion: Return index of the region called name, adding it if create is true. -1 if the
+// region does not exist (or could not be added)
+static int findregion (const char *name, bool create)
+{
+  unsigned int idx;
+  unsigned int n;
+  Asyncregion *region;
+
+  idx = hashname (name);
+  for (n = 0; n < MAXASYNC; ++n) {
+    region = &regions[(idx + n) & (MAXASYNC - 1)];
+    if (__atomic_load_n (&region->state, __ATOMIC_ACQUIRE) == 0) {
+      int expected = 0;
+      if ( ! create)
+	return -1;
+      if (__atomic_compare_exchange_n (&region->state, &expected, 1, false,
+				       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+	strncpy (region->name, name, MAX_CHARS);
+	region->name[MAX_CHARS] = '\0';
+	region->min = 1.e36;
+	__atomic_store_n (&region->state, 2, __ATOMIC_RELEASE);
+	__atomic_fetch_add (&nregions, 1, __ATOMIC_RELAXED);
+	return (idx + n) & (MAXASYNC - 1);
+      }
+    }
+    // Another thread may be filling in this slot right now
+    while (__atomic_load_n (&region->state, __ATOMIC_ACQUIRE) == 1);
+    if (strncmp (region->name, name, MAX_CHARS) == 0)
+      return (idx + n) & (MAXASYNC - 1);
+  }
+  tablefull = true;
+  return -1;
+}
+
+// Lock-free floating point updates: retry until no other thread changed the value in between
+static inline void atomic_add (double *ptr, double val)
+{
+  double old;
+  double new;
+
+  __atomic_load (ptr, &old, __ATOMIC_RELAXED);
+  do {
+    new = old + val;
+  } while ( ! __atomic_compare_exchange (ptr, &old, &new, true, __ATOMIC_RELAXED,
+					 __ATOMIC_RELAXED));
+}
+
+static inline void atomic_max (double *ptr, double val)
+{
+  double old;
+
+  __atomic_load (ptr, &old, __ATOMIC_RELAXED);
+  while (val > old && ! __atomic_compare_exchange (ptr, &old, &val, true, __ATOMIC_RELAXED,
+						    __ATOMIC_RELAXED));
+}
+
+static inline void atomic_min (double *ptr, double val)
+{
+  double old;
+
+  __atomic_load (ptr, &old, __ATOMIC_RELAXED);
+  while (val < old && ! __atomic_compare_exchange (ptr, &old, &val, true, __ATOMIC_RELAXED,
+						    __ATOMIC_RELAXED));
+}
+
+/*
+** GPTLstart_async: Start an async timer
+**
+** Input arguments:
+**   name: region name
+**
+** Output arguments:
+**   token: context to pass to GPTLstop_async, from any thread
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLstart_async (const char *name, GPTLasync_token *token)
+{
+  int idx;
+  long inflight;
+  long maxinflight;
+  static const char *thisfunc = "GPTLstart_async";
+
+  token->region = -1;
+  if ( ! GPTLis_initialized ())
+    return GPTLerror ("%s name=%s: GPTLinitialize has not been called\n", thisfunc, name);
+
+  if (GPTLis_disabled ())
+    return 0;
+
+  if ((idx = findregion (name, true)) < 0)
+    return GPTLerror ("%s: more than %d async regions: %s not added\n", thisfunc, MAXASYNC, name);
+
+  inflight = __atomic_add_fetch (&regions[idx].inflight, 1, __ATOMIC_RELAXED);
+  maxinflight = __atomic_load_n (&regions[idx].maxinflight, __ATOMIC_RELAXED);
+  while (inflight > maxinflight &&
+	 ! __atomic_compare_exchange_n (&regions[idx].maxinflight, &maxinflight, inflight, true,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  token->region = idx;
+  token->start  = GPTLread_utr ();
+  return 0;
+}
+
+/*
+** GPTLstop_async: Stop an async timer. May be called on a different thread than the one
+**   which called GPTLstart_async, but only once per start
+**
+** Input/output arguments:
+**   token: context filled in by GPTLstart_async. Invalidated on return
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLstop_async (GPTLasync_token *token)
+{
+  double delta;
+  Asyncregion *region;
+  static const char *thisfunc = "GPTLstop_async";
+
+  delta = GPTLread_utr ();   // read the clock first to keep overhead out of the timing
+
+  if ( ! GPTLis_initialized ())
+    return GPTLerror ("%s: GPTLinitialize has not been called\n", thisfunc);
+
+  // Nothing was started because timing was disabled
+  if (token->region == -1)
+    return 0;
+
+  if (token->region < 0 || token->region >= MAXASYNC ||
+      __atomic_load_n (&regions[token->region].state, __ATOMIC_ACQUIRE) != 2)
+    return GPTLerror ("%s: token is not from GPTLstart_async or was already stopped\n",
+		      thisfunc);
+
+  region = &regions[token->region];
+  delta -= token->start;
+  token->region = -2;   // catch a second stop with the same token
+
+  __atomic_fetch_add (&region->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_sub (&region->inflight, 1, __ATOMIC_RELAXED);
+  atomic_add (&region->accum, delta);
+  atomic_max (&region->max, delta);
+  atomic_min (&region->min, delta);
+  return 0;
+}
+
+/*
+** GPTLquery_async: Get stats for an async region
+**
+** Input arguments:
+**   name: region name
+**
+** Output arguments:
+**   count:       number of completed start/stop pairs
+**   maxinflight: largest number started but not stopped at once
+**   wall:        total time
+**   max:         longest
+**   min:         shortest
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLquery_async (const char *name, int *count, int *maxinflight, double *wall,
+		     double *max, double *min)
+{
+  int idx;
+  static const char *thisfunc = "GPTLquery_async";
+
+  if ( ! GPTLis_initialized ())
+    return GPTLerror ("%s: GPTLinitialize has not been called\n", thisfunc);
+
+  if ((idx = findregion (name, false)) < 0)
+    return GPTLerror ("%s: async region %s not found\n", thisfunc, name);
+
+  *count       = (int) regions[idx].count;
+  *maxinflight = (int) regions[idx].maxinflight;
+  *wall        = regions[idx].accum;
+  *max         = regions[idx].max;
+  *min         = regions[idx].count > 0 ? regions[idx].min : 0.;
+  return 0;
+}
+
+/*
+** GPTLprint_async: Print stats for all async regions. Called from GPTLpr_fp
+**
+** Input arguments:
+**   fp: output stream
+*/
+void GPTLprint_async (FILE *fp)
+{
+  int n;
+  int width;
+  Asyncregion *region;
+
+  if (nregions == 0)
+    return;
+
+  width = strlen ("Region");
+  for (n = 0; n < MAXASYNC; ++n)
+    if (regions[n].state == 2)
+      width = MAX (width, (int) strlen (regions[n].name));
+
+  fprintf (fp, "\nAsync timers (may start and stop on different threads):\n");
+  if (tablefull)
+    fprintf (fp, "WARNING: more than %d async regions: some were not recorded\n", MAXASYNC);
+  fprintf (fp, "%-*s %10s %9s %9s %12s %12s %12s %12s\n", width, "Region", "Called", "In_flight",
+	   "Max_conc", "Wall", "max", "min", "mean");
+  for (n = 0; n < MAXASYNC; ++n) {
+    region = &regions[n];
+    if (region->state != 2)
+      continue;
+    if (region->count == 0) {
+      fprintf (fp, "%-*s %10lu %9ld %9ld %12s %12s %12s %12s\n", width, region->name,
+	       region->count, region->inflight, region->maxinflight, "-", "-", "-", "-");
+    } else {
+      fprintf (fp, "%-*s %10lu %9ld %9ld %12.3e %12.3e %12.3e %12.3e\n", width, region->name,
+	       region->count, region->inflight, region->maxinflight, region->accum, region->max,
+	       region->min, region->accum / region->count);
+    }
+  }
+}
+
+// GPTLreset_async: Zero the stats of all async regions. Called from GPTLreset
+void GPTLreset_async (void)
+{
+  int n;
+
+  for (n = 0; n < MAXASYNC; ++n) {
+    if (regions[n].state != 2)
+      continue;
+    regions[n].count = 0;
+    regions[n].maxinflight = regions[n].inflight;
+    regions[n].accum = 0.;
+    regions[n].max = 0.;
+    regions[n].min = 1.e36;
+  }
+}
+
+// GPTLfinalize_async: Forget all async regions. Called from GPTLfinalize
+void GPTLfinalize_async (void)
+{
+  memset (regions, 0, sizeof (regions));
+  nregions = 0;
+  tablefull = false;
+}
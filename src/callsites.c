@@ -0,0 +1,231 @@
+/*
+** callsites.c
+**
+** Author: Jim Rosinski
+**
+** Print the GPTLcallsites breakdown of auto-profiled functions: below each function, the
+** places it was called from, most expensive first. While the program runs
+** __cyg_profile_func_enter only counts calls per return address, and __cyg_profile_func_exit
+** charges the wallclock time of each outermost call to the address it was called from. The
+** addresses are shown as caller+offset and, with GPTLcallsite_lines, as file:line from the
+** debug info of the program. That runs addr2line, so it is not done unless asked for.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  void *site;               // return address in the caller
+  char *line;               // file:line of the call (NULL if not looked up or no debug info)
+  const char *caller;       // function containing the call (NULL if unknown)
+  unsigned long offset;     // offset of the call in caller
+} Place;
+
+static Place *places = 0;   // every call site of every thread, sorted by site
+static int nplaces = 0;
+
+static int find_places (Timer **, int, bool);
+static const Place *get_place (const void *);
+static int cmp_place (const void *, const void *);
+static int cmp_timer_wall (const void *, const void *);
+static int cmp_site_cost (const void *, const void *);
+
+/*
+** GPTLprint_callsites: Print calls and wallclock time of each auto-profiled function by call site
+**
+** Input arguments:
+**   fp:       output stream
+**   timers:   per-thread linked lists of timers. Names must already have been resolved
+**   nthreads: number of threads
+**   dolines:  look up file:line of the call sites (GPTLcallsite_lines)
+*/
+void GPTLprint_callsites (FILE *fp, Timer **timers, int nthreads, bool dolines)
+{
+  int t;
+  int n, nfuncs;
+  int width;                // width of the function name column
+  unsigned int i, nsites;
+  Timer *ptr;
+  Timer **funcs;            // functions with call sites, most wallclock time first
+  Callsite *sites;          // call sites of one function, most expensive first
+  const Place *place;
+  const char *name;
+  static const char *thisfunc = "GPTLprint_callsites";
+
+  if (find_places (timers, nthreads, dolines) < 0) {
+    GPTLwarn ("%s: malloc failure\n", thisfunc);
+    return;
+  }
+
+  fprintf (fp, "\nCalls of auto-profiled functions by call site, most wallclock time first.\n");
+  fprintf (fp, "Wall of a site counts the outermost call of a recursion, and %% is its share of"
+	   " the function's Wall\n");
+
+  for (t = 0; t < nthreads; ++t) {
+    nfuncs = 0;
+    width = strlen ("Function");
+    for (ptr = timers[t]; ptr; ptr = ptr->next) {
+      if (ptr->nsites > 0) {
+	++nfuncs;
+	width = MAX (width, (int) strlen (ptr->longname ? ptr->longname : ptr->name));
+      }
+    }
+    if (nfuncs == 0)
+      continue;
+
+    funcs = (Timer **) GPTLallocate (nfuncs * sizeof (Timer *), thisfunc);
+    nfuncs = 0;
+    for (ptr = timers[t]; ptr; ptr = ptr->next)
+      if (ptr->nsites > 0)
+	funcs[nfuncs++] = ptr;
+    qsort (funcs, nfuncs, sizeof (Timer *), cmp_timer_wall);
+
+    fprintf (fp, "\nThread %d:\n", t);
+    fprintf (fp, "%-*s %10s %10s %7s  Call site\n", width, "Function", "Called", "Wall", "%");
+    for (n = 0; n < nfuncs; ++n) {
+      ptr = funcs[n];
+      fprintf (fp, "%-*s %10lu %10.3g\n", width, ptr->longname ? ptr->longname : ptr->name,
+	       ptr->count, ptr->wall.accum);
+
+      sites = (Callsite *) GPTLallocate (ptr->nsites * sizeof (Callsite), thisfunc);
+      for (i = 0, nsites = 0; i < ptr->sitesize; ++i)
+	if (ptr->sites[i].site && ptr->sites[i].count > 0)
+	  sites[nsites++] = ptr->sites[i];
+      qsort (sites, nsites, sizeof (Callsite), cmp_site_cost);
+
+      for (i = 0; i < nsites; ++i) {
+	fprintf (fp, "%-*s %10lu %10.3g %7.2f  ", width, "", sites[i].count, sites[i].wall,
+		 ptr->wall.accum > 0. ? 100. * sites[i].wall / ptr->wall.accum : 0.);
+	place = get_place (sites[i].site);
+	name = (place && place->caller) ? place->caller : 0;
+	if (place && place->line && name)
+	  fprintf (fp, "%s (%s)\n", place->line, name);
+	else if (place && place->line)
+	  fprintf (fp, "%s\n", place->line);
+	else if (name)
+	  fprintf (fp, "%s+0x%lx\n", name, place->offset);
+	else
+	  fprintf (fp, "%p\n", sites[i].site);
+      }
+      free (sites);
+    }
+    free (funcs);
+  }
+
+  for (n = 0; n < nplaces; ++n)
+    free (places[n].line);
+  free (places);
+  places = 0;
+  nplaces = 0;
+}
+
+/*
+** find_places: Look up the calling function, and file:line if asked for, of every call site,
+**   all at once so that addr2line runs once per object rather than once per site
+**
+** Input arguments:
+**   timers:   per-thread linked lists of timers
+**   nthreads: number of threads
+**   dolines:  look up file:line as well
+**
+** Return value: number of distinct call sites, or -1 (malloc failure)
+*/
+static int find_places (Timer **timers, int nthreads, bool dolines)
+{
+  int t;
+  int n, nsites;
+  unsigned int i;
+  Timer *ptr;
+  void **pcs;
+  char **lines;
+  const void *start;
+
+  nsites = 0;
+  for (t = 0; t < nthreads; ++t)
+    for (ptr = timers[t]; ptr; ptr = ptr->next)
+      nsites += ptr->nsites;
+  if (nsites == 0)
+    return 0;
+
+  if ( ! (places = (Place *) calloc (nsites, sizeof (Place))))
+    return -1;
+  for (t = 0; t < nthreads; ++t)
+    for (ptr = timers[t]; ptr; ptr = ptr->next)
+      for (i = 0; i < ptr->sitesize; ++i)
+	if (ptr->sites[i].site)
+	  places[nplaces++].site = ptr->sites[i].site;
+
+  // Threads share call sites
+  qsort (places, nplaces, sizeof (Place), cmp_place);
+  for (n = 1, nsites = MIN (nplaces, 1); n < nplaces; ++n)
+    if (places[n].site != places[nsites-1].site)
+      places[nsites++].site = places[n].site;
+  nplaces = nsites;
+
+  // The return address may be the first instruction of the next line (or function), so look
+  // up the byte before it, which is in the call instruction
+  pcs   = (void **) malloc (nplaces * sizeof (void *));
+  lines = (char **) calloc (nplaces, sizeof (char *));
+  if ( ! pcs || ! lines) {
+    free (pcs);
+    free (lines);
+    return -1;
+  }
+  for (n = 0; n < nplaces; ++n)
+    pcs[n] = (char *) places[n].site - 1;
+  if (dolines)
+    (void) GPTLsymbol_lines (pcs, nplaces, lines);
+
+  for (n = 0; n < nplaces; ++n) {
+    places[n].line = lines[n];
+    if ((places[n].caller = GPTLsymbol_name (pcs[n], &start)))
+      places[n].offset = (unsigned long) ((char *) places[n].site - (const char *) start);
+  }
+  free (pcs);
+  free (lines);
+  return nplaces;
+}
+
+// get_place: Find the Place of a call site by bisection
+static const Place *get_place (const void *site)
+{
+  Place key;
+
+  key.site = (void *) site;
+  return (const Place *) bsearch (&key, places, nplaces, sizeof (Place), cmp_place);
+}
+
+// cmp_place: qsort/bsearch comparator: ascending site address
+static int cmp_place (const void *a, const void *b)
+{
+  const char *x = (const char *) ((const Place *) a)->site;
+  const char *y = (const char *) ((const Place *) b)->site;
+
+  return (x > y) - (x < y);
+}
+
+// cmp_timer_wall: qsort comparator: descending wallclock time, then name
+static int cmp_timer_wall (const void *a, const void *b)
+{
+  const Timer *x = *(Timer * const *) a;
+  const Timer *y = *(Timer * const *) b;
+
+  if (x->wall.accum != y->wall.accum)
+    return x->wall.accum < y->wall.accum ? 1 : -1;
+  return strcmp (x->name, y->name);
+}
+
+// cmp_site_cost: qsort comparator: descending wallclock time, then descending count
+static int cmp_site_cost (const void *a, const void *b)
+{
+  const Callsite *x = (const Callsite *) a;
+  const Callsite *y = (const Callsite *) b;
+
+  if (x->wall != y->wall)
+    return x->wall < y->wall ? 1 : -1;
+  return (x->count < y->count) - (x->count > y->count);
+}
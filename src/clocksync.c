@@ -0,0 +1,157 @@
+/*
+** clocksync.c
+**
+** Author: Jim Rosinski
+**
+** Estimate the offset and drift of this rank's underlying timing routine relative to rank 0
+** so that timestamps gathered on different nodes can be placed on a single timeline.
+** Each sync is a short ping-pong exchange with rank 0. The exchange with the smallest round
+** trip time gives the offset estimate (Cristian's algorithm). Two or more syncs separated in
+** time (e.g. at MPI_Init and MPI_Finalize) additionally give a linear drift estimate.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+#include "gptl.h"
+#include "gptlmpi.h"
+
+#include <stdio.h>
+
+#define NPINGS 16        // number of timed round trips per rank per sync
+
+static int nsync = 0;           // number of completed syncs since GPTLinitialize
+static double tfirst = 0.;      // local time of first sync
+static double offfirst = 0.;    // offset (rank 0 time minus local time) at first sync
+static double tlast = 0.;       // local time of most recent sync
+static double offlast = 0.;     // offset at most recent sync
+static double rttbest = 0.;     // smallest round trip time of most recent sync
+
+/*
+** GPTLclock_sync: Estimate the offset of the local timer relative to rank 0 of comm.
+**                 Collective over comm. Cost is NPINGS round trips per rank, serialized
+**                 through rank 0.
+**
+** Input arguments:
+**   comm: communicator (e.g. MPI_COMM_WORLD)
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLclock_sync (MPI_Comm comm)
+{
+  int ret;             // return code
+  int iam;             // my rank
+  int nranks;          // number of ranks in communicator
+  int p;               // rank index
+  int n;               // round trip index
+  double t0, t1;       // local time at send and receive
+  double troot;        // time on rank 0
+  double rtt;          // round trip time
+  double off = 0.;     // offset estimate from the best round trip
+  double tloc;         // local time associated with the offset estimate
+  MPI_Status status;   // required by MPI_Recv
+  static const int tag = 98790;                     // tag for MPI message
+  static const char *thisfunc = "GPTLclock_sync";   // this function
+
+  if ( ! GPTLis_initialized ())
+    return GPTLerror ("%s: GPTLinitialize() has not been called\n", thisfunc);
+
+  if ((ret = PMPI_Comm_rank (comm, &iam)) != MPI_SUCCESS)
+    return GPTLerror ("%s: Bad return from MPI_Comm_rank=%d\n", thisfunc, ret);
+
+  if ((ret = PMPI_Comm_size (comm, &nranks)) != MPI_SUCCESS)
+    return GPTLerror ("%s rank %d: Bad return from MPI_Comm_size=%d\n", thisfunc, iam, ret);
+
+  // PMPI calls are used directly so the exchange is neither timed by nor slowed by the
+  // GPTL MPI wrappers. Round trip 0 is a warmup whose result is discarded.
+  if (iam == 0) {
+    for (p = 1; p < nranks; ++p) {
+      for (n = 0; n <= NPINGS; ++n) {
+	if ((ret = PMPI_Recv (&troot, 1, MPI_DOUBLE, p, tag, comm, &status)) != MPI_SUCCESS)
+	  return GPTLerror ("%s rank %d: Bad return from MPI_Recv=%d\n", thisfunc, iam, ret);
+	troot = GPTLread_utr ();
+	if ((ret = PMPI_Send (&troot, 1, MPI_DOUBLE, p, tag, comm)) != MPI_SUCCESS)
+	  return GPTLerror ("%s rank %d: Bad return from MPI_Send=%d\n", thisfunc, iam, ret);
+      }
+    }
+    tloc = GPTLread_utr ();
+    rttbest = 0.;
+  } else {
+    rttbest = -1.;
+    tloc = 0.;
+    for (n = 0; n <= NPINGS; ++n) {
+      t0 = GPTLread_utr ();
+      if ((ret = PMPI_Send (&t0, 1, MPI_DOUBLE, 0, tag, comm)) != MPI_SUCCESS)
+	return GPTLerror ("%s rank %d: Bad return from MPI_Send=%d\n", thisfunc, iam, ret);
+      if ((ret = PMPI_Recv (&troot, 1, MPI_DOUBLE, 0, tag, comm, &status)) != MPI_SUCCESS)
+	return GPTLerror ("%s rank %d: Bad return from MPI_Recv=%d\n", thisfunc, iam, ret);
+      t1 = GPTLread_utr ();
+      rtt = t1 - t0;
+      // Assume symmetric latency: rank 0 read its clock halfway through the round trip
+      if (n > 0 && (rttbest < 0. || rtt < rttbest)) {
+	rttbest = rtt;
+	tloc    = 0.5*(t0 + t1);
+	off     = troot - tloc;
+      }
+    }
+  }
+
+  if (nsync == 0) {
+    tfirst   = tloc;
+    offfirst = off;
+  }
+  tlast   = tloc;
+  offlast = off;
+  ++nsync;
+  return 0;
+}
+
+/*
+** GPTLget_clocksync: Return the correction which maps local timer values onto the timeline
+**                    of rank 0: t_rank0 = t_local + offset + drift*t_local
+**
+** Output arguments:
+**   offset: offset (seconds) at local time zero
+**   drift:  rate of change of the offset (seconds per second). Zero unless 2 or more
+**           syncs have been done
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLget_clocksync (double *offset, double *drift)
+{
+  static const char *thisfunc = "GPTLget_clocksync";
+
+  if (nsync < 1)
+    return GPTLerror ("%s: GPTLclock_sync has not been called\n", thisfunc);
+
+  if (nsync > 1 && tlast > tfirst)
+    *drift = (offlast - offfirst) / (tlast - tfirst);
+  else
+    *drift = 0.;
+  *offset = offfirst - *drift * tfirst;
+  return 0;
+}
+
+// GPTLprint_clocksync: Print the clock correction (if any) to the GPTLpr_file output
+void GPTLprint_clocksync (FILE *fp)
+{
+  double offset, drift;
+
+  if (nsync < 1)
+    return;
+
+  (void) GPTLget_clocksync (&offset, &drift);
+  fprintf (fp, "Clock correction to rank 0: offset=%.9f sec drift=%.3e sec/sec "
+	   "(t_rank0 = t + offset + drift*t)\n", offset, drift);
+  fprintf (fp, "  based on %d sync(s), best round trip of last sync=%.3e sec\n", nsync, rttbest);
+}
+
+// GPTLreset_clocksync: Forget all previous syncs. Called from GPTLfinalize
+void GPTLreset_clocksync (void)
+{
+  nsync    = 0;
+  tfirst   = 0.;
+  offfirst = 0.;
+  tlast    = 0.;
+  offlast  = 0.;
+  rttbest  = 0.;
+}
@@ -24,9 +24,13 @@
 #define gptlfinalize gptlfinalize_
 #define gptlpr gptlpr_
 #define gptlpr_file gptlpr_file_
+#define gptlpr_folded gptlpr_folded_
 #define gptlpr_summary gptlpr_summary_
 #define gptlpr_summary_file gptlpr_summary_file_
+#define gptlpr_collective gptlpr_collective_
 #define gptlbarrier gptlbarrier_
+#define gptlclock_sync gptlclock_sync_
+#define gptlget_clocksync gptlget_clocksync_
 #define gptlreset gptlreset_
 #define gptlreset_timer gptlreset_timer_
 #define gptlstamp gptlstamp_
@@ -35,6 +39,11 @@
 #define gptlstart_handle gptlstart_handle_
 #define gptlstop gptlstop_
 #define gptlstop_handle gptlstop_handle_
+#define gptlstop_top gptlstop_top_
+#define gptlstart_indexed gptlstart_indexed_
+#define gptlstop_indexed gptlstop_indexed_
+#define gptlstart_indexed_handle gptlstart_indexed_handle_
+#define gptlstop_indexed_handle gptlstop_indexed_handle_
 #define gptlsetoption gptlsetoption_
 #define gptlenable gptlenable_
 #define gptldisable gptldisable_
@@ -63,9 +72,13 @@
 #define gptlfinalize gptlfinalize_
 #define gptlpr gptlpr_
 #define gptlpr_file gptlpr_file__
+#define gptlpr_folded gptlpr_folded__
 #define gptlpr_summary gptlpr_summary__
 #define gptlpr_summary_file gptlpr_summary_file__
+#define gptlpr_collective gptlpr_collective__
 #define gptlbarrier gptlbarrier_
+#define gptlclock_sync gptlclock_sync__
+#define gptlget_clocksync gptlget_clocksync__
 #define gptlreset gptlreset_
 #define gptlreset_timer gptlreset_timer__
 #define gptlstamp gptlstamp_
@@ -74,6 +87,11 @@
 #define gptlstart_handle gptlstart_handle__
 #define gptlstop gptlstop_
 #define gptlstop_handle gptlstop_handle__
+#define gptlstop_top gptlstop_top__
+#define gptlstart_indexed gptlstart_indexed__
+#define gptlstop_indexed gptlstop_indexed__
+#define gptlstart_indexed_handle gptlstart_indexed_handle__
+#define gptlstop_indexed_handle gptlstop_indexed_handle__
 #define gptlsetoption gptlsetoption_
 #define gptlenable gptlenable_
 #define gptldisable gptldisable_
@@ -106,10 +124,14 @@ int gptlinitialize (void);
 int gptlfinalize (void);
 int gptlpr (int *procid);
 int gptlpr_file (char *file, int nc);
+int gptlpr_folded (char *file, int nc);
 #ifdef HAVE_LIBMPI
 int gptlpr_summary (int *fcomm);
 int gptlpr_summary_file (int *fcomm, char *name, int nc);
+int gptlpr_collective (int *fcomm, char *name, int nc);
 int gptlbarrier (int *fcomm, char *name, int nc);
+int gptlclock_sync (int *fcomm);
+int gptlget_clocksync (double *offset, double *drift);
 #endif
 int gptlreset (void);
 int gptlreset_timer (char *name, int nc);
@@ -119,6 +141,11 @@ int gptlinit_handle (char *name, int *, int nc);
 int gptlstart_handle (char *name, int *, int nc);
 int gptlstop (char *name, int nc);
 int gptlstop_handle (char *name, int *, int nc);
+int gptlstop_top (char *name, int nc);
+int gptlstart_indexed (char *name, int *id, int nc);
+int gptlstop_indexed (char *name, int *id, int nc);
+int gptlstart_indexed_handle (char *name, int *id, int *handle, int nc);
+int gptlstop_indexed_handle (char *name, int *id, int *handle, int nc);
 int gptlsetoption (int *option, int *val);
 int gptlenable (void);
 int gptldisable (void);
@@ -169,6 +196,13 @@ int gptlpr_file (char *file, int nc)
   return GPTLpr_file (locfile);
 }
 
+int gptlpr_folded (char *file, int nc)
+{
+  char locfile[nc+1];
+  snprintf (locfile, nc+1, "%s", file);
+  return GPTLpr_folded (locfile);
+}
+
 #ifdef HAVE_LIBMPI
 int gptlpr_summary (int *fcomm)
 {
@@ -186,6 +220,15 @@ int gptlpr_summary_file (int *fcomm, char *outfile, int nc)
   return GPTLpr_summary_file (ccomm, locfile);
 }
 
+int gptlpr_collective (int *fcomm, char *outfile, int nc)
+{
+  MPI_Comm ccomm;
+  char locfile[nc+1];
+  snprintf (locfile, nc+1, "%s", outfile);
+  ccomm = MPI_Comm_f2c (*fcomm);
+  return GPTLpr_collective (ccomm, locfile);
+}
+
 int gptlbarrier (int *fcomm, char *name, int nc)
 {
   MPI_Comm ccomm;
@@ -199,6 +242,18 @@ int gptlbarrier (int *fcomm, char *name, int nc)
     return GPTLbarrier (ccomm, cname);
   }
 }
+
+int gptlclock_sync (int *fcomm)
+{
+  MPI_Comm ccomm;
+  ccomm = MPI_Comm_f2c (*fcomm);
+  return GPTLclock_sync (ccomm);
+}
+
+int gptlget_clocksync (double *offset, double *drift)
+{
+  return GPTLget_clocksync (offset, drift);
+}
 #endif
 
 int gptlreset (void) {return GPTLreset ();}
@@ -276,6 +331,71 @@ int gptlstop_handle (char *name, int *handle, int nc)
   }
 }
 
+int gptlstop_top (char *name, int nc)
+{
+  char cname[nc+1];
+  // Check for name already null-terminated for efficiency
+  if (name[nc-1] == '\0') {
+    return GPTLstop_top (name);
+  } else {
+    strncpy (cname, name, nc);
+    cname[nc] = '\0';
+    return GPTLstop_top (cname);
+  }
+}
+
+int gptlstart_indexed (char *name, int *id, int nc)
+{
+  char cname[nc+1];
+  // Check for name already null-terminated for efficiency
+  if (name[nc-1] == '\0') {
+    return GPTLstart_indexed (name, *id);
+  } else {
+    strncpy (cname, name, nc);
+    cname[nc] = '\0';
+    return GPTLstart_indexed (cname, *id);
+  }
+}
+
+int gptlstop_indexed (char *name, int *id, int nc)
+{
+  char cname[nc+1];
+  // Check for name already null-terminated for efficiency
+  if (name[nc-1] == '\0') {
+    return GPTLstop_indexed (name, *id);
+  } else {
+    strncpy (cname, name, nc);
+    cname[nc] = '\0';
+    return GPTLstop_indexed (cname, *id);
+  }
+}
+
+int gptlstart_indexed_handle (char *name, int *id, int *handle, int nc)
+{
+  char cname[nc+1];
+  // Check for name already null-terminated for efficiency
+  if (name[nc-1] == '\0') {
+    return GPTLstart_indexed_handle (name, *id, handle);
+  } else {
+    strncpy (cname, name, nc);
+    cname[nc] = '\0';
+    return GPTLstart_indexed_handle (cname, *id, handle);
+  }
+}
+
+int gptlstop_indexed_handle (char *name, int *id, int *handle, int nc)
+{
+  char cname[nc+1];
+  // Check for name already null-terminated for efficiency
+  if (name[nc-1] == '\0') {
+    return GPTLstop_indexed_handle (name, *id, handle);
+  } else {
+    strncpy (cname, name, nc);
+    cname[nc] = '\0';
+    return GPTLstop_indexed_handle (cname, *id, handle);
+  }
+}
+
 int gptlsetoption (int *option, int *val) {return GPTLsetoption (*option, *val);}
 int gptlenable (void) {return GPTLenable ();}
 int gptldisable (void) {return GPTLdisable ();}
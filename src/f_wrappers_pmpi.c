@@ -40,6 +40,9 @@
 #define mpi_alltoallv mpi_alltoallv_
 #define mpi_scatterv mpi_scatterv_
 #define mpi_test mpi_test_
+#define mpi_init mpi_init_
+#define mpi_init_thread mpi_init_thread_
+#define mpi_finalize mpi_finalize_
 
 #elif ( defined FORTRANDOUBLEUNDERSCORE )
 
@@ -67,6 +70,9 @@
 #define mpi_alltoallv mpi_alltoallv__
 #define mpi_scatterv mpi_scatterv__
 #define mpi_test mpi_test__
+#define mpi_init mpi_init__
+#define mpi_init_thread mpi_init_thread__
+#define mpi_finalize mpi_finalize__
 
 #endif
 
@@ -144,6 +150,9 @@ void mpi_scatterv (void *sendbuf, MPI_Fint *sendcnts, MPI_Fint *displs,
 		   MPI_Fint *__ierr );
 void mpi_test (MPI_Fint *request, MPI_Fint *flag, MPI_Fint *status, 
 	       MPI_Fint *__ierr );
+void mpi_init (MPI_Fint *__ierr);
+void mpi_init_thread (MPI_Fint *required, MPI_Fint *provided, MPI_Fint *__ierr);
+void mpi_finalize (MPI_Fint *__ierr);
 
 /*
 ** These routines were adapted from the FPMPI distribution. They ensure profiling of 
@@ -436,6 +445,29 @@ void mpi_test (MPI_Fint *request, MPI_Fint *flag, MPI_Fint *status,
     MPI_Status_c2f (&c_status, status);
   }
 }
+
+/*
+** mpi_init, mpi_init_thread, mpi_finalize: Go through the C wrappers in pmpi.c, so that
+** Fortran codes also get the clock sync right after MPI is up and right before it goes away,
+** which gives the drift estimate. Fortran passes no command line arguments.
+*/
+void mpi_init (MPI_Fint *__ierr)
+{
+  *__ierr = MPI_Init (0, 0);
+}
+
+void mpi_init_thread (MPI_Fint *required, MPI_Fint *provided, MPI_Fint *__ierr)
+{
+  int lprovided;
+
+  *__ierr = MPI_Init_thread (0, 0, (int) *required, &lprovided);
+  *provided = (MPI_Fint) lprovided;
+}
+
+void mpi_finalize (MPI_Fint *__ierr)
+{
+  *__ierr = MPI_Finalize ();
+}
 #endif   /* ENABLE_PMPI */
 #endif   /* HAVE_LIBMPI */
 #ifdef __cplusplus
@@ -0,0 +1,159 @@
+/*
+** filter.c
+**
+** Author: Jim Rosinski
+**
+** Select at run time which auto-profiled functions are timed. Patterns are read at
+** GPTLinitialize from the environment variable GPTL_FILTER (separated by white space) and the
+** file named by GPTL_FILTER_FILE (one per line, '#' starts a comment line). A pattern starting
+** with '-' excludes the functions it matches, and any other pattern (optionally starting with
+** '+') includes them. Patterns are shell globs (fnmatch) matched against the demangled name.
+**
+** A function is timed if it matches no exclude pattern, and either there are no include
+** patterns or it matches one of them. Each function is judged once, the first time it is
+** entered: __cyg_profile_func_enter keeps the verdict in the function's address map entry.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fnmatch.h>
+
+typedef struct {
+  char *glob;               // pattern without its leading '+' or '-'
+  bool exclude;             // '-' pattern
+} Pattern;
+
+static Pattern *patterns = 0;
+static int npatterns = 0;
+static int ninclude = 0;      // number of patterns which are not exclude patterns
+
+static int add_pattern (const char *, size_t);
+
+/*
+** GPTLfilter_init: Read the patterns from GPTL_FILTER and GPTL_FILTER_FILE
+**
+** Return value: number of patterns read (0 means every function is timed), or GPTLerror
+*/
+int GPTLfilter_init (void)
+{
+  const char *env;
+  const char *c;
+  size_t len;
+  char line[1024];
+  FILE *fp;
+  static const char *thisfunc = "GPTLfilter_init";
+
+  if ((env = getenv ("GPTL_FILTER"))) {
+    for (c = env; *c; c += len) {
+      while (*c && isspace ((unsigned char) *c))
+	++c;
+      for (len = 0; c[len] && ! isspace ((unsigned char) c[len]); ++len);
+      if (len > 0 && add_pattern (c, len) != 0)
+	return GPTLerror ("%s: malloc failure\n", thisfunc);
+    }
+  }
+
+  if ((env = getenv ("GPTL_FILTER_FILE")) && *env) {
+    if ( ! (fp = fopen (env, "r")))
+      return GPTLerror ("%s: cannot open GPTL_FILTER_FILE=%s\n", thisfunc, env);
+    while (fgets (line, sizeof (line), fp)) {
+      // Patterns may contain spaces (C++ argument lists), so only the ends are trimmed
+      for (c = line; *c && isspace ((unsigned char) *c); ++c);
+      for (len = strlen (c); len > 0 && isspace ((unsigned char) c[len-1]); --len);
+      if (len > 0 && *c != '#' && add_pattern (c, len) != 0) {
+	fclose (fp);
+	return GPTLerror ("%s: malloc failure\n", thisfunc);
+      }
+    }
+    fclose (fp);
+  }
+
+  // Functions are judged from any thread as they are first entered: the table must be complete
+  if (npatterns > 0)
+    GPTLload_symbols ();
+  return npatterns;
+}
+
+/*
+** GPTLfilter_timed: Judge an auto-profiled function. Called once per function and thread
+**
+** Input arguments:
+**   addr: address of the function
+**
+** Return value: true if the function is to be timed. Functions which cannot be named are timed
+*/
+bool GPTLfilter_timed (const void *addr)
+{
+  char *name;
+  bool timed;
+  int n;
+
+  if (npatterns == 0 || ! (name = GPTLsymbol_copy (addr)))
+    return true;
+
+  timed = (ninclude == 0);
+  for (n = 0; n < npatterns; ++n) {
+    if (fnmatch (patterns[n].glob, name, 0) != 0)
+      continue;
+    if (patterns[n].exclude) {
+      timed = false;
+      break;
+    }
+    timed = true;
+  }
+  free (name);
+  return timed;
+}
+
+// GPTLfilter_free: Forget all patterns
+void GPTLfilter_free (void)
+{
+  int n;
+
+  for (n = 0; n < npatterns; ++n)
+    free (patterns[n].glob);
+  free (patterns);
+  patterns  = 0;
+  npatterns = 0;
+  ninclude  = 0;
+}
+
+/*
+** add_pattern: Append a pattern
+**
+** Input arguments:
+**   str: pattern, possibly starting with '+' or '-'. Need not be nul-terminated
+**   len: number of characters in str
+**
+** Return value: 0 (success) or -1 (malloc failure)
+*/
+static int add_pattern (const char *str, size_t len)
+{
+  Pattern *newpatterns;
+  bool exclude = (*str == '-');
+
+  if (*str == '-' || *str == '+') {
+    ++str;
+    --len;
+  }
+  if (len == 0)
+    return 0;
+
+  if ( ! (newpatterns = (Pattern *) realloc (patterns, (npatterns+1) * sizeof (Pattern))))
+    return -1;
+  patterns = newpatterns;
+  if ( ! (patterns[npatterns].glob = (char *) malloc (len + 1)))
+    return -1;
+  memcpy (patterns[npatterns].glob, str, len);
+  patterns[npatterns].glob[len] = '\0';
+  patterns[npatterns].exclude = exclude;
+  if ( ! exclude)
+    ++ninclude;
+  ++npatterns;
+  return 0;
+}
@@ -10,25 +10,17 @@
 #include "private.h"
 #include "gptl_papi.h"
 
-#ifdef HAVE_LIBUNWIND
-#define UNW_LOCAL_ONLY
-#include <libunwind.h>
-#endif
-
-#ifdef HAVE_BACKTRACE
-#include <execinfo.h>
-#endif
-
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>  // for free()
 
 static bool initialized = true;
 static bool disabled = false;
+static Addrmap addrmap_sim;     // empty address map for getentry_instr_sim
 
 // Local prototypes
 static int gptlstart_sim (char *, int);
-static Timer *getentry_instr_sim (const Hashentry *,void *, unsigned int *, const int);
+static Timer *getentry_instr_sim (Addrmap *, const void *);
 static void misc_sim (Nofalse *, Timer ***, int);
 
 // All routines in this file are non-public
@@ -73,8 +65,7 @@ int GPTLget_overhead (FILE *fp,
   double utr_ohd;            // Underlying timing routine
   double papi_ohd;           // Reading PAPI counters
   double total_ohd;          // Sum of overheads
-  double getentry_instr_ohd; // Finding entry in hash table for auto-instrumented calls
-  double addr2name_ohd;      // Invoking libunwind or backtrace routines from __cyg*enter
+  double getentry_instr_ohd; // Finding entry by address for auto-instrumented calls
   double misc_ohd;           // misc. calcs within start/stop
   int i, n;
   int ret;
@@ -154,46 +145,10 @@ int GPTLget_overhead (FILE *fp,
   papi_ohd = 0.;
 #endif
 
-#ifdef HAVE_LIBUNWIND
-  // libunwind overhead
-  unw_cursor_t cursor;
-  unw_context_t context;
-  unw_word_t offset, pc;
-  char symbol[MAX_SYMBOL_NAME+1];
-
-  t1 = (*ptr2wtimefunc)();
-  for (i = 0; i < 1000; ++i) {
-    // Initialize cursor to current frame for local unwinding.
-    unw_getcontext (&context);
-    unw_init_local (&cursor, &context);
-
-    (void) unw_step (&cursor);
-    unw_get_reg (&cursor, UNW_REG_IP, &pc);
-    (void) unw_get_proc_name (&cursor, symbol, sizeof(symbol), &offset);
-  }
-  t2 = (*ptr2wtimefunc)();
-  addr2name_ohd = 0.001 * (t2 - t1);
-#endif
-
-#ifdef HAVE_BACKTRACE
-  void *buffer[2];
-  int nptrs;
-  char **strings;
-
-  t1 = (*ptr2wtimefunc)();
-  for (i = 0; i < 1000; ++i) {
-    nptrs = backtrace (buffer, 2);
-    strings = backtrace_symbols (buffer, nptrs);
-    free (strings);
-  }
-  t2 = (*ptr2wtimefunc)();
-  addr2name_ohd = 0.001 * (t2 - t1);
-#endif
-
   // getentry_instr overhead
   t1 = (*ptr2wtimefunc)();
   for (i = 0; i < 1000; ++i) {
-    entry = getentry_instr_sim (hashtable, &randomvar, &hashidx, tablesize);
+    entry = getentry_instr_sim (&addrmap_sim, &randomvar);
   }
   t2 = (*ptr2wtimefunc)();
   getentry_instr_ohd = 0.001 * (t2 - t1);
@@ -234,15 +189,10 @@ int GPTLget_overhead (FILE *fp,
   }
 #endif
   fprintf (fp, "\n");
-#ifdef HAVE_LIBUNWIND
-  fprintf (fp, "Overhead of libunwind (invoked once per auto-instrumented start entry)=%g seconds\n", addr2name_ohd);
-#elif defined HAVE_BACKTRACE
-  fprintf (fp, "Overhead of backtrace (invoked once per auto-instrumented start entry)=%g seconds\n", addr2name_ohd);
-#endif
   fprintf (fp, "NOTE: If GPTL is called from C not Fortran, the 'Fortran layer' overhead is zero\n");
   fprintf (fp, "NOTE: For calls to GPTLstart_handle()/GPTLstop_handle(), the 'Generate hash index' overhead is zero\n");
-  fprintf (fp, "NOTE: For auto-instrumented calls, the cost of generating the hash index plus finding\n"
-	  "      the hashtable entry is %7.1e not the %7.1e portion taken by GPTLstart\n", 
+  fprintf (fp, "NOTE: For auto-instrumented calls, the cost of finding the entry by address\n"
+	  "      is %7.1e not the %7.1e portion taken by GPTLstart\n", 
 	  getentry_instr_ohd, genhashidx_ohd + getentry_ohd);
   fprintf (fp, "NOTE: Each hash collision roughly doubles the 'Find hashtable entry' cost of that timer\n");
   *self_ohd   = ftn_ohd + utr_ohd; // In GPTLstop() fortran wrapper is called before utr
@@ -268,24 +218,21 @@ static int gptlstart_sim (char *name, int nc)
 }
 
 /*
-** getentry_instr_sim: Simulate the cost of getentry_instr(), which is invoked only when
-** auto-instrumentation is enabled on non-AIX platforms
+** getentry_instr_sim: Simulate the cost of getentry_addr(), which is invoked only when
+** auto-instrumentation is enabled on non-AIX platforms. Most calls are found in the cache
+** in front of the address map, so only that probe is simulated
 ** 
 ** Input args:
-**   hashtable: hashtable for thread 0
-**   self:      address of function
-**   indx:      hashtable index
-**   tablesize: size of hashtable
+**   map:  address map
+**   self: address of function
 */
-static Timer *getentry_instr_sim (const Hashentry *hashtable, void *self, unsigned int *indx,
-				  const int tablesize)
+static Timer *getentry_instr_sim (Addrmap *map, const void *self)
 {
-  Timer *ptr = 0;
-  *indx = (((unsigned long) self) >> 4) % tablesize;
-  if (hashtable[*indx].nument > 0 && hashtable[*indx].entries[0]->address == self) {
-    ptr = hashtable[*indx].entries[0];
-  }
-  return ptr;
+  Addrslot *cached = &map->cache[(((unsigned long) self) >> 4) & (ADDRCACHE - 1)];
+
+  if (cached->address == self)
+    return cached->ptr;
+  return 0;
 }
 
 /*
@@ -16,6 +16,7 @@
 #include <stdlib.h>        // malloc
 #include <sys/time.h>      // gettimeofday
 #include <sys/times.h>     // times
+#include <sys/resource.h>  // getrusage
 #include <unistd.h>        // gettimeofday, syscall
 #include <stdio.h>
 #include <string.h>        // memset, strcmp (via STRMATCH)
@@ -31,18 +32,14 @@
 #include <time.h>
 #endif
 
-#ifdef _AIX
-#include <sys/systemcfg.h>
-#endif
-
-#ifdef HAVE_LIBUNWIND
-#define UNW_LOCAL_ONLY
-#include <libunwind.h>
+// Per-thread CPU time and context switches (GPTLthread_cpu)
+#if ( defined HAVE_LIBRT && defined HAVE_GETRUSAGE && defined CLOCK_THREAD_CPUTIME_ID && \
+      defined RUSAGE_THREAD )
+#define HAVE_THREAD_CPU
 #endif
 
-#ifdef HAVE_BACKTRACE
-#include <execinfo.h>
-static void extract_name (char *, char **, void *, const int);
+#ifdef _AIX
+#include <sys/systemcfg.h>
 #endif
 
 static Timer **timers = 0;             // linked list of timers
@@ -52,14 +49,29 @@ static int depthlimit = 99999;         // max depth for timers (99999 is effecti
 static volatile bool disabled = false; // Timers disabled?
 static volatile bool initialized = false;        // GPTLinitialize has been called
 static bool dousepapi = false;         // saves a function call if stays false
+static bool douseperf = false;         // a perf_event_open counter is enabled
 static bool verbose = false;           // output verbosity
 static bool percent = false;           // print wallclock also as percent of 1st timers[0]
 static bool dopr_preamble = true;      // whether to print preamble info
 static bool dopr_threadsort = true;    // whether to print sorted thread stats
 static bool dopr_multparent = true;    // whether to print multiple parent info
 static bool dopr_collision = false;    // whether to print hash collision info
-static bool dopr_memusage = false;     // whether to include memusage print on growth
+static bool dopr_memusage = false;     // whether to sample RSS in the background
+static bool collapse_indexed = false;  // whether to print GPTLstart_indexed variants as 1 row
+static int hotspot_rows = 20;          // max rows in the hotspot section (0 means omit it)
+static bool cct = false;               // one timer per call path rather than per name
 static float growth_pct = 0.;          // threshhold % for memory growth print
+#define DEFAULT_MEM_SAMPLE_MSEC 10
+static int mem_sample_msec = DEFAULT_MEM_SAMPLE_MSEC; // interval between RSS samples
+static int sample_usec = 0;            // CPU time between PC samples (0 means no sampling)
+#define DEFAULT_THROTTLE_NSEC 1000
+static unsigned long throttle_calls = 0; // calls before a short auto-profiled timer is throttled
+static double throttle_sec = DEFAULT_THROTTLE_NSEC * 1.e-9; // mean time below which it is
+static bool filtering = false;         // GPTL_FILTER patterns select auto-profiled functions
+static bool dopatch = false;           // patch -fpatchable-function-entry functions at init
+static bool callsites = false;         // count and time auto-profiled functions per call site
+static bool callsite_lines = false;    // name call sites by file:line (runs addr2line)
+static bool thread_cpu = false;        // CPU stats are per thread rather than process-wide
 
 static time_t ref_gettimeofday = -1;   // ref start point for gettimeofday
 static time_t ref_clock_gettime = -1;  // ref start point for clock_gettime
@@ -75,11 +87,15 @@ typedef struct {
 
 // Options, print strings, and default enable flags
 static Settings cpustats =      {GPTLcpu,      "     usr       sys  usr+sys", false};
-static Settings wallstats =     {GPTLwall,     "     Wall      max      min", true };
+static const char *thread_cpu_str = "      CPU     Wait     Vcsw    Ivcsw";
+static const char *process_cpu_str = "     usr       sys  usr+sys";
+static Settings wallstats =     {GPTLwall,     "     Wall      max      min     Self", true };
 static Settings overheadstats = {GPTLoverhead, "   selfOH parentOH"         , true };
 
 static Hashentry **hashtable;    // table of entries
+static Addrmap *addrmap;         // per-thread lookup of auto-profiled functions by address
 static long ticks_per_sec;       // clock ticks per second
+static long cpu_per_sec;         // units of Cpustats times per second
 static Timer ***callstack;       // call stack
 static Nofalse *stackidx;        // index into callstack:
 
@@ -102,6 +118,7 @@ static void print_titles (int, FILE *, Outputfmt *);
 static void add (Timer *, const Timer *);
 static void print_multparentinfo (FILE *, Timer *);
 static inline int get_cpustamp (long *, long *);
+static inline int get_ctxsw (long *, long *);
 static int newchild (Timer *, Timer *);
 static int get_max_namelen (Timer *);
 static int is_descendant (const Timer *, const Timer *);
@@ -137,7 +154,11 @@ static int init_placebo (void);
 static inline double utr_placebo (void);
 
 static inline unsigned int genhashidx (const char *);
-static inline Timer *getentry_instr (const Hashentry *, void *, unsigned int *);
+static inline unsigned int addrhash (const void *, int);
+static inline Timer *getentry_addr (Addrmap *, const void *);
+static int addrmap_insert (Addrmap *, void *, Timer *);
+static inline int callsite_enter (Timer *, void *, bool);
+static int callsite_add (Timer *, void *, bool);
 static inline Timer *getentry (const Hashentry *, const char *, unsigned int);
 static void printself_andchildren (const Timer *, FILE *, int, int, double, double, Outputfmt);
 static inline int update_parent_info (Timer *, Timer **, int);
@@ -145,11 +166,34 @@ static inline int update_stats (Timer *, const double, const long, const long, c
 static int update_ll_hash (Timer *, int, unsigned int);
 static inline int update_ptr (Timer *, const int);
 static int construct_tree (Timer *, GPTLMethod);
-static inline void set_fp_procsiz (void);
-static void check_memusage (const char *, const char *);
-static void translate_truncated_names (int, FILE *);
+static Timer *add_variant (int, const char *, unsigned int, Timer *, int);
+static inline int start_indexed (int, const char *, unsigned int, int, const char *);
+static inline int stop_indexed (int, double, long, long, const char *, unsigned int, int,
+				const char *);
+static void print_collapsed (const Timer *, int, FILE *, int, int, double, double, Outputfmt);
+static inline bool is_unused_base (const Timer *);
+static void print_hotspots (FILE *);
+static void print_throttled (FILE *, double);
+static int count_excluded (void);
+static int cmp_hotspot_name (const void *, const void *);
+static int cmp_hotspot_self (const void *, const void *);
+static inline int cct_start (int, const char *, unsigned int, const char *);
+static inline int cct_stop (int, double, long, long, const char *, const char *);
+static inline Timer *cct_getchild (const Timer *, const char *, unsigned int);
+static Timer *cct_addchild (int, Timer *, const char *, unsigned int);
+static bool same_context (const Timer *, const Timer *);
+static bool same_timer (const Timer *, const Timer *);
+
+// One row of the hotspot section: stats for a timer name summed over threads
+typedef struct {
+  const char *name;
+  unsigned long count;
+  double self;
+  double incl;
+} Hotspot;
 
 bool GPTLonlypr_rank0 = false;    // flag says only print from MPI rank 0 (default false)
+bool GPTLdopr_imbal = true;       // flag says print load imbalance in GPTLpr_summary (default true)
 
 typedef struct {
   const GPTLFuncoption option;
@@ -192,10 +236,18 @@ static int funcidx = 0;                  // default timer is gettimeofday
 static int tablesize = DEFAULT_TABLE_SIZE;  // per-thread size of hash table (settable parameter)
 static int tablesizem1 = DEFAULT_TABLE_SIZE - 1;
 
-static float rssmax = 0;                 // max rss of the process
 static bool imperfect_nest;              // e.g. start(A),start(B),stop(A)
+#ifdef HAVE_INTERPOSE
+static volatile bool interpose_on = false; // callstack valid for attributing interposed calls
+static __thread int interpose_paused __attribute__ ((tls_model ("initial-exec"))) = 0;
+#if ! ( defined UNDERLYING_PTHREADS || defined ENABLE_NESTEDOMP )
+// Threads unknown to the thread layer (e.g. created by an I/O library) get index 0 from
+// omp_get_thread_num or the unthreaded layer. Only the thread which called GPTLinitialize
+// may charge interposed calls to thread 0's timers
+static __thread bool init_thread __attribute__ ((tls_model ("initial-exec"))) = false;
+#endif
+#endif
 static const int indent_chars = 2;       // Number of chars to indent
-static FILE *fp_procsiz = 0;             // process size file pointer: init to 0 to use stderr
 
 // VERBOSE is a debugging ifdef local to the rest of this file
 #undef VERBOSE
@@ -212,6 +264,7 @@ static FILE *fp_procsiz = 0;             // process size file pointer: init to 0
  */
 int GPTLsetoption (const int option, const int val)
 {
+  int ret;
   static const char *thisfunc = "GPTLsetoption";
 
   if (initialized)
@@ -233,6 +286,20 @@ int GPTLsetoption (const int option, const int val)
 #else
     if (val)
       return GPTLerror ("%s: times() not available\n", thisfunc);
+#endif
+    return 0;
+  case GPTLthread_cpu:
+#ifdef HAVE_THREAD_CPU
+    thread_cpu = (bool) val;
+    cpustats.str = thread_cpu ? thread_cpu_str : process_cpu_str;
+    if (thread_cpu)
+      cpustats.enabled = true;
+    if (verbose)
+      printf ("%s: boolean thread_cpu = %d\n", thisfunc, val);
+#else
+    if (val)
+      return GPTLerror ("%s: per-thread CPU time needs CLOCK_THREAD_CPUTIME_ID and "
+			"RUSAGE_THREAD\n", thisfunc);
 #endif
     return 0;
   case GPTLwall:     
@@ -297,6 +364,69 @@ int GPTLsetoption (const int option, const int val)
       printf ("%s: if enabled, memory growth will be printed on increase of %d percent\n",
 	      thisfunc, val);
     return 0;
+  case GPTLcollapse_indexed: 
+    collapse_indexed = (bool) val; 
+    if (verbose)
+      printf ("%s: boolean collapse_indexed = %d\n", thisfunc, val);
+    return 0;
+  case GPTLcct: 
+    cct = (bool) val; 
+    if (verbose)
+      printf ("%s: boolean cct = %d\n", thisfunc, val);
+    return 0;
+  case GPTLpatch:
+    dopatch = (bool) val;
+    if (verbose)
+      printf ("%s: boolean dopatch = %d\n", thisfunc, val);
+    return 0;
+  case GPTLcallsites:
+    callsites = (bool) val;
+    if (verbose)
+      printf ("%s: boolean callsites = %d\n", thisfunc, val);
+    return 0;
+  case GPTLcallsite_lines:
+    callsite_lines = (bool) val;
+    if (verbose)
+      printf ("%s: boolean callsite_lines = %d\n", thisfunc, val);
+    return 0;
+  case GPTLhotspot_rows:
+    if (val < 0)
+      return GPTLerror ("%s: hotspot_rows must be non-negative. %d is invalid\n", thisfunc, val);
+    hotspot_rows = val;
+    if (verbose)
+      printf ("%s: hotspot section will have at most %d rows\n", thisfunc, val);
+    return 0;
+  case GPTLthrottle_calls:
+    if (val < 0)
+      return GPTLerror ("%s: throttle_calls must be non-negative. %d is invalid\n", thisfunc, val);
+    throttle_calls = (unsigned long) val;
+    if (verbose)
+      printf ("%s: if non-zero, auto-profiled timers may be throttled after %d calls\n",
+	      thisfunc, val);
+    return 0;
+  case GPTLthrottle_nsec:
+    if (val < 1)
+      return GPTLerror ("%s: throttle_nsec must be positive. %d is invalid\n", thisfunc, val);
+    throttle_sec = val * 1.e-9;
+    if (verbose)
+      printf ("%s: auto-profiled timers averaging under %d nsec may be throttled\n",
+	      thisfunc, val);
+    return 0;
+  case GPTLsample_usec:
+    if (val < 0)
+      return GPTLerror ("%s: sample_usec must be non-negative. %d is invalid\n", thisfunc, val);
+    sample_usec = val;
+    if (verbose)
+      printf ("%s: if non-zero, threads will be sampled every %d usec of CPU time\n",
+	      thisfunc, val);
+    return 0;
+  case GPTLmem_sample_msec:
+    if (val < 1)
+      return GPTLerror ("%s: mem_sample_msec must be positive. %d is invalid\n", thisfunc, val);
+    mem_sample_msec = val;
+    if (verbose)
+      printf ("%s: if enabled, RSS will be sampled every %d msec\n", thisfunc, val);
+    return 0;
   case GPTLprint_method:
     method = (GPTLMethod) val; 
     if (verbose)
@@ -331,12 +461,25 @@ int GPTLsetoption (const int option, const int val)
     if (verbose)
       printf ("%s: onlypr_rank0 = %d\n", thisfunc, val);
     return 0;
+  case GPTLdopr_imbalance:
+    GPTLdopr_imbal = (bool) val; 
+    if (verbose)
+      printf ("%s: boolean dopr_imbal = %d\n", thisfunc, val);
+    return 0;
     
   case GPTLmultiplex:
     // Allow GPTLmultiplex to fall through because it will be handled by GPTL_PAPIsetoption()
   default:
     break;
   }
+
+  // Counters from perf_event_open. 1 means option is not one of them
+  if ((ret = GPTLperf_setoption (option, val)) != 1) {
+    if (ret == 0 && val)
+      douseperf = true;
+    return ret;
+  }
+
 #ifdef HAVE_PAPI
   if (GPTL_PAPIsetoption (option, val) == 0) {
     if (val)
@@ -392,6 +535,7 @@ int GPTLinitialize (void)
 {
   int i;
   int t;
+  int ret;
   double t1, t2;  // returned from underlying timer
   static const char *thisfunc = "GPTLinitialize";
 
@@ -403,6 +547,12 @@ int GPTLinitialize (void)
 
   if ((ticks_per_sec = sysconf (_SC_CLK_TCK)) == -1)
     return GPTLerror ("%s: failure from sysconf (_SC_CLK_TCK)\n", thisfunc);
+  // get_cpustamp returns nanoseconds of thread CPU time, or ticks from times()
+  cpu_per_sec = thread_cpu ? 1000000000L : ticks_per_sec;
+
+  if ((ret = GPTLfilter_init ()) < 0)
+    return GPTLerror ("%s: Failure from GPTLfilter_init\n", thisfunc);
+  filtering = (ret > 0);
 
   // Allocate space for global arrays
   callstack       = (Timer ***)    GPTLallocate (GPTLmax_threads * sizeof (Timer **), thisfunc);
@@ -410,6 +560,8 @@ int GPTLinitialize (void)
   timers          = (Timer **)     GPTLallocate (GPTLmax_threads * sizeof (Timer *), thisfunc);
   last            = (Timer **)     GPTLallocate (GPTLmax_threads * sizeof (Timer *), thisfunc);
   hashtable       = (Hashentry **) GPTLallocate (GPTLmax_threads * sizeof (Hashentry *), thisfunc);
+  addrmap         = (Addrmap *)    GPTLallocate (GPTLmax_threads * sizeof (Addrmap), thisfunc);
+  memset (addrmap, 0, GPTLmax_threads * sizeof (Addrmap));
 
   // Initialize array values
   for (t = 0; t < GPTLmax_threads; t++) {
@@ -438,6 +590,9 @@ int GPTLinitialize (void)
     return GPTLerror ("%s: Failure from GPTL_PAPIinitialize\n", thisfunc);
 #endif
 
+  if (douseperf && GPTLperf_initialize () < 0)
+    return GPTLerror ("%s: Failure from GPTLperf_initialize\n", thisfunc);
+
   // Call init routine for underlying timing routine
   if ((*funclist[funcidx].funcinit)() < 0) {
     fprintf (stderr, "%s: Failure initializing %s. Reverting underlying timer to %s\n", 
@@ -456,8 +611,29 @@ int GPTLinitialize (void)
     printf ("Underlying wallclock timing routine is %s\n", funclist[funcidx].name);
   }
 
+  // Start RSS sampling last so the sampler never sees partially initialized arrays
+  if (dopr_memusage && GPTLmemsampler_start (callstack, stackidx, mem_sample_msec, growth_pct) < 0)
+    return GPTLerror ("%s: Failure from GPTLmemsampler_start\n", thisfunc);
+
+  if (sample_usec > 0 && GPTLsampler_start (callstack, stackidx, sample_usec) < 0)
+    return GPTLerror ("%s: Failure from GPTLsampler_start\n", thisfunc);
+
+#ifdef ENABLE_OMPT
+  GPTLompt_init ();
+#endif
+
   imperfect_nest = false;
   initialized = true;
+#ifdef HAVE_INTERPOSE
+#if ! ( defined UNDERLYING_PTHREADS || defined ENABLE_NESTEDOMP )
+  init_thread = true;
+#endif
+  interpose_on = true;
+#endif
+
+  // Patched functions may be entered as soon as they are patched, so this comes last
+  if (dopatch && GPTLpatch_init () < 0)
+    return GPTLerror ("%s: Failure from GPTLpatch_init\n", thisfunc);
   return 0;
 }
 
@@ -471,12 +647,29 @@ int GPTLfinalize (void)
 {
   int t;
   int n;
+  unsigned int slot;
   Timer *ptr, *ptrnext;
   static const char *thisfunc = "GPTLfinalize";
 
   if ( ! initialized)
     return GPTLerror ("%s: initialization was not completed\n", thisfunc);
 
+#ifdef HAVE_INTERPOSE
+  // Interposed calls from here on (including free() of the timers) must not be charged
+  interpose_on = false;
+#if ! ( defined UNDERLYING_PTHREADS || defined ENABLE_NESTEDOMP )
+  init_thread = false;
+#endif
+#endif
+
+  // Patched functions entered from here on are not timed. Those already running still return
+  // through exit_tramp, which then only pops its shadow stack
+  GPTLpatch_finalize ();
+
+  // Samplers read callstack and write into timers, so they must be gone before they are freed
+  GPTLmemsampler_stop ();
+  GPTLsampler_stop ();
+
   for (t = 0; t < GPTLmax_threads; ++t) {
     for (n = 0; n < tablesize; ++n) {
       if (hashtable[t][n].nument > 0)
@@ -484,6 +677,11 @@ int GPTLfinalize (void)
     }
     free (hashtable[t]);
     hashtable[t] = NULL;
+    // Functions excluded by GPTL_FILTER are not on the linked list freed below
+    for (slot = 0; slot < addrmap[t].size; ++slot)
+      if (addrmap[t].slots[slot].address && addrmap[t].slots[slot].ptr->excluded)
+	free (addrmap[t].slots[slot].ptr);
+    free (addrmap[t].slots);
     free (callstack[t]);
     for (ptr = timers[t]; ptr; ptr = ptrnext) {
       ptrnext = ptr->next;
@@ -493,6 +691,10 @@ int GPTLfinalize (void)
       }
       if (ptr->nchildren > 0)
         free (ptr->children);
+      free (ptr->variants);
+      free (ptr->ctxkids);
+      free (ptr->sites);
+      free (ptr->longname);
       free (ptr);
     }
   }
@@ -502,6 +704,9 @@ int GPTLfinalize (void)
   free (timers);
   free (last);
   free (hashtable);
+  free (addrmap);
+  GPTLfree_symbols ();
+  GPTLfilter_free ();
 
   GPTLthreadfinalize ();
   GPTLreset_errors ();
@@ -509,6 +714,21 @@ int GPTLfinalize (void)
 #ifdef HAVE_PAPI
   GPTL_PAPIfinalize ();
 #endif
+  GPTLperf_finalize ();
+
+#ifdef HAVE_LIBMPI
+  GPTLreset_clocksync ();
+#endif
+
+#ifdef ENABLE_LOCKPROF
+  GPTLreset_lockstats (true);
+#endif
+
+#ifdef ENABLE_OMPT
+  GPTLfinalize_ompt ();
+#endif
+
+  GPTLfinalize_async ();
 
   // Reset initial values
   timers = 0;
@@ -523,12 +743,27 @@ int GPTLfinalize (void)
   disabled = false;
   initialized = false;
   dousepapi = false;
+  douseperf = false;
   verbose = false;
   percent = false;
   dopr_preamble = true;
   dopr_threadsort = true;
   dopr_multparent = true;
   dopr_collision = false;
+  cct = false;
+  GPTLdopr_imbal = true;
+  dopr_memusage = false;
+  growth_pct = 0.;
+  mem_sample_msec = DEFAULT_MEM_SAMPLE_MSEC;
+  sample_usec = 0;
+  throttle_calls = 0;
+  throttle_sec = DEFAULT_THROTTLE_NSEC * 1.e-9;
+  filtering = false;
+  dopatch = false;
+  callsites = false;
+  callsite_lines = false;
+  thread_cpu = false;
+  cpustats.str = process_cpu_str;
   ref_gettimeofday = -1;
   ref_clock_gettime = -1;
 #ifdef _AIX
@@ -568,8 +803,11 @@ int GPTLstart (const char *name)
   else if (ret != 0)
     return ret;
   
-  // ptr will point to the requested timer in the current list, or NULL if this is a new entry
   indx = genhashidx (name);
+  if (cct)
+    return cct_start (t, name, indx, thisfunc);
+
+  // ptr will point to the requested timer in the current list, or NULL if this is a new entry
   ptr = getentry (hashtable[t], name, indx);
 
   /* 
@@ -582,9 +820,9 @@ int GPTLstart (const char *name)
     return 0;
   }
 
-  // Increment stackidx[t] unconditionally. This is necessary to ensure the correct
-  // behavior when GPTLstop decrements stackidx[t] unconditionally.
-  if (++stackidx[t].val > MAX_STACK-1)
+  // The push itself is done by update_ptr, once the timer is on, so GPTLstop pops exactly
+  // the timers which were pushed
+  if (stackidx[t].val >= MAX_STACK-1)
     return GPTLerror ("%s: stack too big: NOT starting timer for %s\n", thisfunc, name);
 
   if ( ! ptr) {   // Add a new entry and initialize. longname only needed for auto-profiling
@@ -599,15 +837,12 @@ int GPTLstart (const char *name)
       return GPTLerror ("%s: update_ll_hash error\n", thisfunc);
   }
 
-  if (update_parent_info (ptr, callstack[t], stackidx[t].val) != 0)
+  if (update_parent_info (ptr, callstack[t], stackidx[t].val + 1) != 0)
     return GPTLerror ("%s: update_parent_info error\n", thisfunc);
 
   if (update_ptr (ptr, t) != 0)
     return GPTLerror ("%s: update_ptr error\n", thisfunc);
 
-  if (dopr_memusage && t == 0)
-    check_memusage ("Begin", ptr->name);
-
   return 0;
 }
 
@@ -655,6 +890,28 @@ int GPTLinit_handle (const char *name, int *handle)
   return 0;
 }
 
+/*
+** GPTLinit_handle_hash: Like GPTLinit_handle, but from the hash sum of the name computed
+**   ahead of time, e.g. at compile time by gptl.hpp. Only the modulo by the table size,
+**   which can change at run time, is done here.
+**
+** Input arguments:
+**   sum: hash sum of the timer name before the modulo in genhashidx
+**
+** Output arguments:
+**   handle: hash value corresponding to the name
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLinit_handle_hash (unsigned int sum, int *handle)
+{
+  if (disabled)
+    return 0;
+
+  *handle = (int) (sum % tablesizem1 + 1);
+  return 0;
+}
+
 /*
 ** GPTLstart_handle: start a timer based on a handle
 **
@@ -696,6 +953,9 @@ int GPTLstart_handle (const char *name, int *handle)
 		      thisfunc, (unsigned int) *handle, tablesizem1);
   }
 
+  if (cct)
+    return cct_start (t, name, (unsigned int) *handle, thisfunc);
+
   ptr = getentry (hashtable[t], name, (unsigned int) *handle);
   
   /* 
@@ -708,9 +968,9 @@ int GPTLstart_handle (const char *name, int *handle)
     return 0;
   }
 
-  // Increment stackidx[t] unconditionally. This is necessary to ensure the correct
-  // behavior when GPTLstop decrements stackidx[t] unconditionally.
-  if (++stackidx[t].val > MAX_STACK-1)
+  // The push itself is done by update_ptr, once the timer is on, so GPTLstop pops exactly
+  // the timers which were pushed
+  if (stackidx[t].val >= MAX_STACK-1)
     return GPTLerror ("%s: stack too big: NOT starting timer for %s\n", thisfunc, name);
 
   if ( ! ptr) { // Add a new entry and initialize
@@ -732,15 +992,12 @@ int GPTLstart_handle (const char *name, int *handle)
       return GPTLerror ("%s: update_ll_hash error\n", thisfunc);
   }
 
-  if (update_parent_info (ptr, callstack[t], stackidx[t].val) != 0)
+  if (update_parent_info (ptr, callstack[t], stackidx[t].val + 1) != 0)
     return GPTLerror ("%s: update_parent_info error\n", thisfunc);
 
   if (update_ptr (ptr, t) != 0)
     return GPTLerror ("%s: update_ptr error\n", thisfunc);
 
-  if (dopr_memusage && t == 0)
-    check_memusage ("Begin", ptr->name);
-
   return (0);
 }
 
@@ -776,8 +1033,8 @@ static int update_ll_hash (Timer *ptr, int t, unsigned int indx)
 }
 
 /*
-** update_ptr: Update timer contents. Called by GPTLstart, GPTLstart_handle, and
-**             __cyg_profile_func_enter
+** update_ptr: Turn the timer on and push it on the callstack. Called by GPTLstart,
+**             GPTLstart_handle, and __cyg_profile_func_enter
 **
 ** Input arguments:
 **   ptr:  pointer to timer
@@ -787,8 +1044,19 @@ static int update_ll_hash (Timer *ptr, int t, unsigned int indx)
 */
 static inline int update_ptr (Timer *ptr, const int t)
 {
+  int idx = stackidx[t].val + 1;
+
   ptr->onflg = true;
 
+  // Publish the new depth only after its slot is written: the SIGPROF handler and the RSS
+  // sampler read the top of the stack without locking
+  callstack[t][idx] = ptr;
+  __atomic_store_n (&stackidx[t].val, idx, __ATOMIC_RELEASE);
+
+  // Before the clocks are read, so the cost of getrusage is not charged to the timer
+  if (thread_cpu && get_ctxsw (&ptr->cpu.last_nvcsw, &ptr->cpu.last_nivcsw) < 0)
+    return GPTLerror ("update_ptr: get_ctxsw error");
+
   if (cpustats.enabled && get_cpustamp (&ptr->cpu.last_utime, &ptr->cpu.last_stime) < 0)
     return GPTLerror ("update_ptr: get_cpustamp error");
   
@@ -800,6 +1068,10 @@ static inline int update_ptr (Timer *ptr, const int t)
 #ifdef HAVE_PAPI
   if (dousepapi && GPTL_PAPIstart (t, &ptr->aux) < 0)
     return GPTLerror ("update_ptr: error from GPTL_PAPIstart\n");
+#endif
+#ifdef HAVE_PERFEVENTS
+  if (douseperf && GPTLperf_start (t, &ptr->perf) < 0)
+    return GPTLerror ("update_ptr: error from GPTLperf_start\n");
 #endif
   return 0;
 }
@@ -869,6 +1141,222 @@ static inline int update_parent_info (Timer *ptr, Timer **callstackt, int stacki
   return 0;
 }
 
+/*
+** cct_start: GPTLstart in calling context tree mode. The timer is the child named name of the
+**   innermost running timer, found through that timer's ctxkids map. There is no global
+**   lookup and each node has exactly one parent, so nothing like update_parent_info is needed.
+**
+** Input arguments:
+**   t:        thread index
+**   name:     timer name
+**   hash:     hash index of name (genhashidx or a handle)
+**   thisfunc: caller, for error messages
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+static inline int cct_start (int t, const char *name, unsigned int hash, const char *thisfunc)
+{
+  Timer *pptr;   // innermost running timer, or GPTL_ROOT
+  Timer *ptr;
+
+  if ( ! (pptr = callstack[t][stackidx[t].val]))
+    return GPTLerror ("%s: call stack is corrupt: NOT starting timer for %s\n", thisfunc, name);
+
+  // Direct recursion => increment depth in recursion and return (see GPTLstart). Indirect
+  // recursion (A calls B calls A) gives a new node for each level, as the call paths differ
+  if (pptr->onflg && STRMATCH (name, pptr->name)) {
+    ++pptr->recurselvl;
+    return 0;
+  }
+
+  if (stackidx[t].val >= MAX_STACK-1)
+    return GPTLerror ("%s: stack too big: NOT starting timer for %s\n", thisfunc, name);
+
+  if ((ptr = cct_getchild (pptr, name, hash))) {
+    ++ptr->parent_count[0];
+  } else if ( ! (ptr = cct_addchild (t, pptr, name, hash))) {
+    return GPTLerror ("%s: failed to add timer %s\n", thisfunc, name);
+  }
+
+  if (update_ptr (ptr, t) != 0)
+    return GPTLerror ("%s: update_ptr error\n", thisfunc);
+
+  return 0;
+}
+
+/*
+** cct_stop: GPTLstop in calling context tree mode. The timer must be the innermost running
+**   one: with a node per call path there is no way to tell which node an out-of-order stop
+**   refers to.
+**
+** Input arguments:
+**   t:        thread index
+**   tp1:      wallclock stamp from preamble_stop
+**   usr, sys: cpu stamps from preamble_stop
+**   name:     timer name
+**   thisfunc: caller, for error messages
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+static inline int cct_stop (int t, double tp1, long usr, long sys, const char *name,
+			    const char *thisfunc)
+{
+  Timer *ptr;
+
+  if (stackidx[t].val < 1)
+    return GPTLerror ("%s thread %d: timer for %s had not been started.\n", thisfunc, t, name);
+
+  ptr = callstack[t][stackidx[t].val];
+  if ( ! ptr || ! STRMATCH (name, ptr->name))
+    return GPTLerror ("%s: %s is not the innermost running timer (%s). Calling context tree "
+		      "mode requires perfectly nested timers\n", 
+		      thisfunc, name, ptr ? ptr->name : "none");
+
+  if ( ! ptr->onflg )
+    return GPTLerror ("%s: timer %s was already off.\n", thisfunc, ptr->name);
+
+  ++ptr->count;
+
+  // Recursion => decrement depth in recursion and return (see GPTLstop)
+  if (ptr->recurselvl > 0) {
+    ++ptr->nrecurse;
+    --ptr->recurselvl;
+    return 0;
+  }
+
+  if (update_stats (ptr, tp1, usr, sys, t) != 0)
+    return GPTLerror ("%s: error from update_stats\n", thisfunc);
+
+  return 0;
+}
+
+/*
+** cct_getchild: find child name of pptr in its ctxkids map (linear probing)
+**
+** Return value: pointer to the child, or NULL if pptr has never started name
+*/
+static inline Timer *cct_getchild (const Timer *pptr, const char *name, unsigned int hash)
+{
+  unsigned int mask;
+  unsigned int i;
+  Timer *ptr;
+
+  if (pptr->nctxkids == 0)
+    return 0;
+
+  mask = pptr->ctxkidsize - 1;
+  for (i = hash & mask; (ptr = pptr->ctxkids[i]); i = (i + 1) & mask)
+    if (ptr->hash == hash && STRMATCH (name, ptr->name))
+      return ptr;
+  return 0;
+}
+
+/*
+** cct_addchild: create the node for name called from pptr. It goes on the linked list so that
+**   it is printed and freed like any other timer, but only into the hash table if no timer of
+**   that name exists yet: GPTLquery and friends then consistently find the first call path.
+**
+** Input arguments:
+**   t:    thread index
+**   pptr: parent node
+**   name: timer name
+**   hash: hash index of name
+**
+** Return value: pointer to the new node, or NULL on failure
+*/
+static Timer *cct_addchild (int t, Timer *pptr, const char *name, unsigned int hash)
+{
+  Timer *ptr;
+  Timer **kids;
+  unsigned int size;
+  unsigned int mask;
+  unsigned int i, n;
+  int numchars;
+  static const char *thisfunc = "cct_addchild";
+
+  if (hash != genhashidx (name)) {
+    GPTLerror ("%s: expected vs. input handles for name=%s don't match. Possible user error "
+	       "passing wrong handle for name\n", thisfunc, name);
+    return 0;
+  }
+
+  // Keep the load factor at most 3/4 so probe sequences stay short
+  if (4 * (pptr->nctxkids + 1) > 3 * pptr->ctxkidsize) {
+    size = pptr->ctxkidsize > 0 ? 2 * pptr->ctxkidsize : 4;
+    if ( ! (kids = (Timer **) calloc (size, sizeof (Timer *)))) {
+      GPTLerror ("%s: calloc error for %u children of %s\n", thisfunc, size, pptr->name);
+      return 0;
+    }
+    mask = size - 1;
+    for (n = 0; n < pptr->ctxkidsize; ++n) {
+      if (pptr->ctxkids[n]) {
+	for (i = pptr->ctxkids[n]->hash & mask; kids[i]; i = (i + 1) & mask);
+	kids[i] = pptr->ctxkids[n];
+      }
+    }
+    free (pptr->ctxkids);
+    pptr->ctxkids = kids;
+    pptr->ctxkidsize = size;
+  }
+
+  ptr = (Timer *) GPTLallocate (sizeof (Timer), thisfunc);
+  memset (ptr, 0, sizeof (Timer));
+  numchars = MIN (strlen (name), MAX_CHARS);
+  strncpy (ptr->name, name, numchars);
+  ptr->name[numchars] = '\0';
+  ptr->hash = hash;
+
+  ptr->parent = (Timer **) GPTLallocate (sizeof (Timer *), thisfunc);
+  ptr->parent_count = (int *) GPTLallocate (sizeof (int), thisfunc);
+  ptr->nparent = 1;
+  ptr->parent[0] = pptr;
+  ptr->parent_count[0] = 1;
+
+  if (getentry (hashtable[t], name, hash)) {
+    last[t]->next = ptr;
+    last[t] = ptr;
+  } else if (update_ll_hash (ptr, t, hash) != 0) {
+    GPTLerror ("%s: update_ll_hash error\n", thisfunc);
+    return 0;
+  }
+
+  mask = pptr->ctxkidsize - 1;
+  for (i = hash & mask; pptr->ctxkids[i]; i = (i + 1) & mask);
+  pptr->ctxkids[i] = ptr;
+  ++pptr->nctxkids;
+  return ptr;
+}
+
+/*
+** same_context: whether two nodes (normally on different threads) are on the same call path.
+**   In calling context tree mode a name match alone is not enough to pair them up.
+*/
+static bool same_context (const Timer *a, const Timer *b)
+{
+  for ( ; a && b; a = a->parent[0], b = b->parent[0]) {
+    if ( ! same_timer (a, b) || a->nparent != b->nparent)
+      return false;
+    if (a->nparent == 0)
+      return true;
+  }
+  return false;
+}
+
+/*
+** same_timer: whether two timers (normally on different threads) are the same region.
+**   Auto-profiled functions are matched by address: names longer than MAX_CHARS are only
+**   complete in longname, and different functions can share the truncated name.
+*/
+static bool same_timer (const Timer *a, const Timer *b)
+{
+  if (a->address || b->address)
+    return a->address == b->address;
+  if (a->longname || b->longname)
+    return strcmp (a->longname ? a->longname : a->name,
+		   b->longname ? b->longname : b->name) == 0;
+  return STRMATCH (a->name, b->name);
+}
+
 /*
 ** GPTLstop: stop a timer
 **
@@ -894,6 +1382,9 @@ int GPTLstop (const char *name)
   else if (ret != 0)
     return ret;
        
+  if (cct)
+    return cct_stop (t, tp1, usr, sys, name, thisfunc);
+
   indx = genhashidx (name);
   if (! (ptr = getentry (hashtable[t], name, indx)))
     return GPTLerror ("%s thread %d: timer for %s had not been started.\n", thisfunc, t, name);
@@ -917,9 +1408,6 @@ int GPTLstop (const char *name)
   if (update_stats (ptr, tp1, usr, sys, t) != 0)
     return GPTLerror ("%s: error from update_stats\n", thisfunc);
 
-  if (dopr_memusage && t == 0)
-    check_memusage ("End", ptr->name);
-
   return 0;
 }
 
@@ -978,6 +1466,9 @@ int GPTLstop_handle (const char *name, int *handle)
   else if (ret != 0)
     return ret;
        
+  if (cct)
+    return cct_stop (t, tp1, usr, sys, name, thisfunc);
+
   indx = (unsigned int) *handle;
   if (indx == 0 || indx > tablesizem1) 
     return GPTLerror ("%s: bad input handle=%u for timer %s.\n", thisfunc, indx, name);
@@ -1014,69 +1505,404 @@ int GPTLstop_handle (const char *name, int *handle)
   if (update_stats (ptr, tp1, usr, sys, t) != 0)
     return GPTLerror ("%s: error from update_stats\n", thisfunc);
 
-  if (dopr_memusage && t == 0)
-    check_memusage ("End", ptr->name);
-
   return 0;
 }
 
 /*
-** update_stats: update stats inside ptr. Called by GPTLstop, GPTLstop_handle
+** GPTLstop_top: stop the innermost running timer of the calling thread. No name lookup is
+**   needed because for perfectly nested code that timer is at the bottom of the call stack
 **
 ** Input arguments:
-**   ptr: pointer to timer
-**   tp1: input time stamp
-**   usr: user time
-**   sys: system time
-**   t: thread index
+**   name: expected timer name, or NULL. Only checked when GPTLverbose is set
 **
-** Return value: 0 (success) or GPTLerror (failure)
+** Return value: 0 (success) or -1 (failure)
 */
-static inline int update_stats (Timer *ptr, const double tp1, const long usr, const long sys,
-                                const int t)
+int GPTLstop_top (const char *name)
 {
-  double delta;      // wallclock time difference
-  int bidx;          // bottom of call stack
-  Timer *bptr;       // pointer to last entry in call stack
-  static const char *thisfunc = "update_stats";
+  double tp1 = 0.0;          // wallclock time stamp
+  Timer *ptr;
+  int t;
+  int ret;
+  long usr = 0;              // user time (returned from get_cpustamp)
+  long sys = 0;              // system time (returned from get_cpustamp)
+  static const char *thisfunc = "GPTLstop_top";
 
-  ptr->onflg = false;
+  ret = preamble_stop (&t, &tp1, &usr, &sys, thisfunc);
+  if (ret == DONE)
+    return 0;
+  else if (ret != 0)
+    return ret;
 
-#ifdef HAVE_PAPI
-  if (dousepapi && GPTL_PAPIstop (t, &ptr->aux) < 0)
-    return GPTLerror ("%s: error from GPTL_PAPIstop\n", thisfunc);
-#endif
+  // Index 0 is GPTL_ROOT which is never stopped
+  if (stackidx[t].val < 1)
+    return GPTLerror ("%s thread %d: no timer is running\n", thisfunc, t);
 
-  if (wallstats.enabled) {
-    delta = tp1 - ptr->wall.last;
-    ptr->wall.accum += delta;
-    ptr->wall.latest = delta;
+  if (imperfect_nest)
+    return GPTLerror ("%s: call stack is unreliable after an imperfect nest: use GPTLstop\n",
+		      thisfunc);
 
-    if (delta < 0.)
-      fprintf (stderr, "GPTL: %s: negative delta=%g\n", thisfunc, delta);
+  ptr = callstack[t][stackidx[t].val];
 
-    if (ptr->count == 1) {
-      ptr->wall.max = delta;
-      ptr->wall.min = delta;
-    } else {
-      if (delta > ptr->wall.max)
-        ptr->wall.max = delta;
-      if (delta < ptr->wall.min)
-        ptr->wall.min = delta;
-    }
-  }
+  if (verbose && name && strncmp (name, ptr->name, MAX_CHARS) != 0)
+    return GPTLerror ("%s: expected to stop timer %s but innermost running timer is %s\n",
+		      thisfunc, name, ptr->name);
 
-  if (cpustats.enabled) {
-    ptr->cpu.accum_utime += usr - ptr->cpu.last_utime;
-    ptr->cpu.accum_stime += sys - ptr->cpu.last_stime;
-    ptr->cpu.last_utime   = usr;
-    ptr->cpu.last_stime   = sys;
-  }
+  if ( ! ptr->onflg )
+    return GPTLerror ("%s: timer %s was already off.\n", thisfunc, ptr->name);
 
-  // Verify that the timer being stopped is at the bottom of the call stack
-  if ( ! imperfect_nest) {
-    char *name;        //  found name
-    char *bname;       //  expected name
+  ++ptr->count;
+
+  /* 
+  ** Recursion => decrement depth in recursion and return.  We need to return
+  ** because we don't want to stop the timer.  We want the reported time for
+  ** the timer to reflect the outermost layer of recursion.
+  */
+  if (ptr->recurselvl > 0) {
+    ++ptr->nrecurse;
+    --ptr->recurselvl;
+    return 0;
+  }
+
+  if (update_stats (ptr, tp1, usr, sys, t) != 0)
+    return GPTLerror ("%s: error from update_stats\n", thisfunc);
+
+  return 0;
+}
+
+/*
+** GPTLstart_indexed: start variant id of a timer, e.g. one per multigrid level or block.
+**   The variant is reported as name[id] but no string is formatted after the first call:
+**   the lookup is a hash of the base name plus an array index.
+**
+** Input arguments:
+**   name: base timer name
+**   id:   variant (0 <= id < MAX_VARIANTS)
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLstart_indexed (const char *name, int id)
+{
+  int t;
+  int ret;
+  static const char *thisfunc = "GPTLstart_indexed";
+
+  ret = preamble_start (&t, name);
+  if (ret == DONE)
+    return 0;
+  else if (ret != 0)
+    return ret;
+
+  return start_indexed (t, name, genhashidx (name), id, thisfunc);
+}
+
+/*
+** GPTLstart_indexed_handle: start variant id of a timer with a handle for the base name.
+**   Same handle as GPTLinit_handle/GPTLstart_handle would use for name.
+**
+** Input arguments:
+**   name:   base timer name
+**   id:     variant (0 <= id < MAX_VARIANTS)
+**
+** Input/output arguments:
+**   handle: zero on first call, thereafter the hash index of name
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLstart_indexed_handle (const char *name, int id, int *handle)
+{
+  int t;
+  int ret;
+  static const char *thisfunc = "GPTLstart_indexed_handle";
+
+  ret = preamble_start (&t, name);
+  if (ret == DONE)
+    return 0;
+  else if (ret != 0)
+    return ret;
+
+  if (*handle == 0) {
+    *handle = (int) genhashidx (name);
+  } else if ((unsigned int) *handle > tablesizem1) {
+    return GPTLerror ("%s: Bad input handle=%u exceeds tablesizem1=%d\n", 
+		      thisfunc, (unsigned int) *handle, tablesizem1);
+  }
+
+  return start_indexed (t, name, (unsigned int) *handle, id, thisfunc);
+}
+
+// start_indexed: Do the work of GPTLstart_indexed* once the hash index of name is known
+static inline int start_indexed (int t, const char *name, unsigned int indx, int id,
+				 const char *thisfunc)
+{
+  Timer *base;
+  Timer *ptr;
+
+  // Fast path: base and variant already exist
+  base = getentry (hashtable[t], name, indx);
+  if (base && (unsigned int) id < base->nvariants && base->variants[id]) {
+    ptr = base->variants[id];
+  } else if ( ! (ptr = add_variant (t, name, indx, base, id))) {
+    return GPTLerror ("%s: failed to add variant %d of timer %s\n", thisfunc, id, name);
+  }
+
+  // Recursion => increment depth in recursion and return (see GPTLstart)
+  if (ptr->onflg) {
+    ++ptr->recurselvl;
+    return 0;
+  }
+
+  if (stackidx[t].val >= MAX_STACK-1)
+    return GPTLerror ("%s: stack too big: NOT starting timer for %s\n", thisfunc, ptr->name);
+
+  if (update_parent_info (ptr, callstack[t], stackidx[t].val + 1) != 0)
+    return GPTLerror ("%s: update_parent_info error\n", thisfunc);
+
+  if (update_ptr (ptr, t) != 0)
+    return GPTLerror ("%s: update_ptr error\n", thisfunc);
+
+  return 0;
+}
+
+/*
+** add_variant: Create variant id of timer name, and the base timer holding the variants if
+**              it does not exist yet. The base is an ordinary timer: it is only started if
+**              the user also calls GPTLstart (name)
+**
+** Input arguments:
+**   t:    thread index
+**   name: base timer name
+**   indx: hash index of name
+**   base: base timer, or NULL if it does not exist yet
+**   id:   variant
+**
+** Return value: pointer to variant timer, or NULL (failure)
+*/
+static Timer *add_variant (int t, const char *name, unsigned int indx, Timer *base, int id)
+{
+  Timer *ptr;
+  Timer **variants;
+  unsigned int n;
+  unsigned int nvariants;
+  unsigned int vindx;              // hash index of variant name
+  char vname[MAX_CHARS+1];         // variant name: name[id]
+  static const char *thisfunc = "add_variant";
+
+  if (id < 0 || id >= MAX_VARIANTS) {
+    GPTLwarn ("%s: id=%d for timer %s must be between 0 and %d\n",
+	      thisfunc, id, name, MAX_VARIANTS-1);
+    return 0;
+  }
+
+  // A truncated name[id] could be shared by different ids, so refuse it
+  if (snprintf (vname, sizeof (vname), "%s[%d]", name, id) >= (int) sizeof (vname)) {
+    GPTLwarn ("%s: %s[%d] is longer than %d characters\n", thisfunc, name, id, MAX_CHARS);
+    return 0;
+  }
+
+  if ( ! base) {
+    base = (Timer *) GPTLallocate (sizeof (Timer), thisfunc);
+    memset (base, 0, sizeof (Timer));
+    strncpy (base->name, name, MAX_CHARS);
+    base->name[MAX_CHARS] = '\0';
+    if (update_ll_hash (base, t, indx) != 0)
+      return 0;
+  }
+
+  // Grow the variants array geometrically so a loop over increasing ids is cheap
+  if ((unsigned int) id >= base->nvariants) {
+    nvariants = MAX ((unsigned int) id + 1, 2*base->nvariants);
+    nvariants = MIN (nvariants, MAX_VARIANTS);
+    variants = (Timer **) realloc (base->variants, nvariants * sizeof (Timer *));
+    if ( ! variants) {
+      GPTLwarn ("%s: realloc error for %u variants of timer %s\n", thisfunc, nvariants, name);
+      return 0;
+    }
+    for (n = base->nvariants; n < nvariants; ++n)
+      variants[n] = 0;
+    base->variants = variants;
+    base->nvariants = nvariants;
+  }
+
+  // The variant is also an ordinary timer, so GPTLquery etc. work on name[id]. Reuse an
+  // existing timer of that name if the user already created one with GPTLstart
+  vindx = genhashidx (vname);
+  if ( ! (ptr = getentry (hashtable[t], vname, vindx))) {
+    ptr = (Timer *) GPTLallocate (sizeof (Timer), thisfunc);
+    memset (ptr, 0, sizeof (Timer));
+    strcpy (ptr->name, vname);
+    if (update_ll_hash (ptr, t, vindx) != 0)
+      return 0;
+  }
+  ptr->base = base;
+  base->variants[id] = ptr;
+  return ptr;
+}
+
+/*
+** GPTLstop_indexed: stop variant id of a timer started by GPTLstart_indexed*
+**
+** Input arguments:
+**   name: base timer name
+**   id:   variant
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLstop_indexed (const char *name, int id)
+{
+  double tp1 = 0.0;          // wallclock time stamp
+  int t;
+  int ret;
+  long usr = 0;              // user time (returned from get_cpustamp)
+  long sys = 0;              // system time (returned from get_cpustamp)
+  static const char *thisfunc = "GPTLstop_indexed";
+
+  ret = preamble_stop (&t, &tp1, &usr, &sys, thisfunc);
+  if (ret == DONE)
+    return 0;
+  else if (ret != 0)
+    return ret;
+
+  return stop_indexed (t, tp1, usr, sys, name, genhashidx (name), id, thisfunc);
+}
+
+/*
+** GPTLstop_indexed_handle: stop variant id of a timer with a handle for the base name
+**
+** Input arguments:
+**   name:   base timer name
+**   id:     variant
+**   handle: previously generated handle (see GPTLstart_indexed_handle)
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLstop_indexed_handle (const char *name, int id, int *handle)
+{
+  double tp1 = 0.0;          // wallclock time stamp
+  int t;
+  int ret;
+  long usr = 0;              // user time (returned from get_cpustamp)
+  long sys = 0;              // system time (returned from get_cpustamp)
+  unsigned int indx;         // index into hash table
+  static const char *thisfunc = "GPTLstop_indexed_handle";
+
+  ret = preamble_stop (&t, &tp1, &usr, &sys, thisfunc);
+  if (ret == DONE)
+    return 0;
+  else if (ret != 0)
+    return ret;
+
+  indx = (unsigned int) *handle;
+  if (indx == 0 || indx > tablesizem1) 
+    return GPTLerror ("%s: bad input handle=%u for timer %s.\n", thisfunc, indx, name);
+
+  return stop_indexed (t, tp1, usr, sys, name, indx, id, thisfunc);
+}
+
+// stop_indexed: Do the work of GPTLstop_indexed* once the hash index of name is known
+static inline int stop_indexed (int t, double tp1, long usr, long sys, const char *name,
+				unsigned int indx, int id, const char *thisfunc)
+{
+  Timer *base;
+  Timer *ptr;
+
+  base = getentry (hashtable[t], name, indx);
+  if ( ! base || (unsigned int) id >= base->nvariants || ! (ptr = base->variants[id]))
+    return GPTLerror ("%s thread %d: timer for %s[%d] had not been started.\n",
+		      thisfunc, t, name, id);
+
+  if ( ! ptr->onflg )
+    return GPTLerror ("%s: timer %s was already off.\n", thisfunc, ptr->name);
+
+  ++ptr->count;
+
+  // Recursion => decrement depth in recursion and return (see GPTLstop)
+  if (ptr->recurselvl > 0) {
+    ++ptr->nrecurse;
+    --ptr->recurselvl;
+    return 0;
+  }
+
+  if (update_stats (ptr, tp1, usr, sys, t) != 0)
+    return GPTLerror ("%s: error from update_stats\n", thisfunc);
+
+  return 0;
+}
+
+/*
+** update_stats: update stats inside ptr. Called by the GPTLstop* routines
+**
+** Input arguments:
+**   ptr: pointer to timer
+**   tp1: input time stamp
+**   usr: user time
+**   sys: system time
+**   t: thread index
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+static inline int update_stats (Timer *ptr, const double tp1, const long usr, const long sys,
+                                const int t)
+{
+  double delta;      // wallclock time difference
+  int bidx;          // bottom of call stack
+  Timer *bptr;       // pointer to last entry in call stack
+  static const char *thisfunc = "update_stats";
+
+  ptr->onflg = false;
+
+#ifdef HAVE_PAPI
+  if (dousepapi && GPTL_PAPIstop (t, &ptr->aux) < 0)
+    return GPTLerror ("%s: error from GPTL_PAPIstop\n", thisfunc);
+#endif
+#ifdef HAVE_PERFEVENTS
+  if (douseperf && GPTLperf_stop (t, &ptr->perf) < 0)
+    return GPTLerror ("%s: error from GPTLperf_stop\n", thisfunc);
+#endif
+
+  if (wallstats.enabled) {
+    delta = tp1 - ptr->wall.last;
+    ptr->wall.accum += delta;
+    ptr->wall.latest = delta;
+
+    if (delta < 0.)
+      fprintf (stderr, "GPTL: %s: negative delta=%g\n", thisfunc, delta);
+
+    // Charge delta to the caller (GPTL_ROOT at the top level) so its self time excludes it
+    if (stackidx[t].val > 0 && callstack[t][stackidx[t].val - 1])
+      callstack[t][stackidx[t].val - 1]->wall.child += delta;
+
+    if (ptr->count == 1) {
+      ptr->wall.max = delta;
+      ptr->wall.min = delta;
+    } else {
+      if (delta > ptr->wall.max)
+        ptr->wall.max = delta;
+      if (delta < ptr->wall.min)
+        ptr->wall.min = delta;
+    }
+  }
+
+  if (cpustats.enabled) {
+    ptr->cpu.accum_utime += usr - ptr->cpu.last_utime;
+    ptr->cpu.accum_stime += sys - ptr->cpu.last_stime;
+    ptr->cpu.last_utime   = usr;
+    ptr->cpu.last_stime   = sys;
+  }
+
+  if (thread_cpu) {
+    long nvcsw, nivcsw;  // context switches so far
+    if (get_ctxsw (&nvcsw, &nivcsw) < 0)
+      return GPTLerror ("%s: get_ctxsw error\n", thisfunc);
+    ptr->cpu.accum_nvcsw  += nvcsw - ptr->cpu.last_nvcsw;
+    ptr->cpu.accum_nivcsw += nivcsw - ptr->cpu.last_nivcsw;
+    ptr->cpu.last_nvcsw    = nvcsw;
+    ptr->cpu.last_nivcsw   = nivcsw;
+  }
+
+  // Verify that the timer being stopped is at the bottom of the call stack
+  if ( ! imperfect_nest) {
+    char *name;        //  found name
+    char *bname;       //  expected name
 
     bidx = stackidx[t].val;
     bptr = callstack[t][bidx];
@@ -1116,14 +1942,22 @@ static inline int update_stats (Timer *ptr, const double tp1, const long usr, co
 // GPTLenable: enable timers 
 int GPTLenable (void)
 {
-  disabled = false;
+  // With patching, the flag is set under the patching lock so it matches the code
+  if ( ! dopatch)
+    disabled = false;
+  else if (GPTLpatch_apply (true, &disabled) != 0)
+    return GPTLerror ("GPTLenable: cannot patch functions\n");
   return (0);
 }
 
 // GPTLdisable: disable timers
 int GPTLdisable (void)
 {
-  disabled = true;
+  // Restore the NOPs: patched functions cost nothing while disabled
+  if ( ! dopatch)
+    disabled = true;
+  else if (GPTLpatch_apply (false, &disabled) != 0)
+    return GPTLerror ("GPTLdisable: cannot restore patched functions\n");
   return (0);
 }
 
@@ -1158,11 +1992,29 @@ int GPTLstamp (double *wall, double *usr, double *sys)
   return 0;
 }
 
+/*
+** GPTLget_walltime: Read the underlying wallclock timing routine, as used for all timers
+**
+** Output arguments:
+**   wall: wallclock time (seconds)
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLget_walltime (double *wall)
+{
+  if ( ! initialized)
+    return GPTLerror ("GPTLget_walltime: GPTLinitialize has not been called\n");
+
+  *wall = (*ptr2wtimefunc) ();
+  return 0;
+}
+
 // GPTLreset: reset all timers to 0
 // Return value: 0 (success) or GPTLerror (failure)
 int GPTLreset (void)
 {
   int t;
+  unsigned int n;
   Timer *ptr;
   static const char *thisfunc = "GPTLreset";
 
@@ -1175,12 +2027,42 @@ int GPTLreset (void)
       ptr->count = 0;
       memset (&ptr->wall, 0, sizeof (ptr->wall));
       memset (&ptr->cpu, 0, sizeof (ptr->cpu));
+      memset (&ptr->mem, 0, sizeof (ptr->mem));
+      ptr->cpusamples = 0;
+      ptr->nthrottled = 0;
+      for (n = 0; n < ptr->sitesize; ++n) {
+	ptr->sites[n].count = 0;
+	ptr->sites[n].wall  = 0.;
+      }
+#ifdef ENABLE_ALLOCPROF
+      memset (&ptr->alloc, 0, sizeof (ptr->alloc));
+#endif
+#ifdef ENABLE_IOPROF
+      memset (&ptr->io, 0, sizeof (ptr->io));
+#endif
+#ifdef ENABLE_LOCKPROF
+      memset (&ptr->lock, 0, sizeof (ptr->lock));
+#endif
 #ifdef HAVE_PAPI
       memset (&ptr->aux, 0, sizeof (ptr->aux));
+#endif
+#ifdef HAVE_PERFEVENTS
+      memset (&ptr->perf, 0, sizeof (ptr->perf));
 #endif
     }
   }
 
+#ifdef ENABLE_LOCKPROF
+  GPTLreset_lockstats (false);
+#endif
+
+#ifdef ENABLE_OMPT
+  GPTLreset_ompt ();
+#endif
+
+  GPTLreset_async ();
+  GPTLreset_samples ();
+
   if (verbose)
     printf ("%s: accumulators for all timers set to zero\n", thisfunc);
 
@@ -1210,8 +2092,23 @@ int GPTLreset_timer (const char *name)
       ptr->count = 0;
       memset (&ptr->wall, 0, sizeof (ptr->wall));
       memset (&ptr->cpu, 0, sizeof (ptr->cpu));
+      memset (&ptr->mem, 0, sizeof (ptr->mem));
+      ptr->cpusamples = 0;
+      ptr->nthrottled = 0;
+#ifdef ENABLE_ALLOCPROF
+      memset (&ptr->alloc, 0, sizeof (ptr->alloc));
+#endif
+#ifdef ENABLE_IOPROF
+      memset (&ptr->io, 0, sizeof (ptr->io));
+#endif
+#ifdef ENABLE_LOCKPROF
+      memset (&ptr->lock, 0, sizeof (ptr->lock));
+#endif
 #ifdef HAVE_PAPI
       memset (&ptr->aux, 0, sizeof (ptr->aux));
+#endif
+#ifdef HAVE_PERFEVENTS
+      memset (&ptr->perf, 0, sizeof (ptr->perf));
 #endif
     }
   }
@@ -1256,12 +2153,47 @@ int GPTLpr (const int id) // output file will be named "timing.<id>" or stderr i
 int GPTLpr_file (const char *outfile)
 {
   FILE *fp;                 // file handle to write to
+  int ret;                  // return code
+  static const char *thisfunc = "GPTLpr_file";
+
+  if ( ! initialized)
+    return GPTLerror ("%s: GPTLinitialize() has not been called\n", thisfunc);
+
+  // Not great hack to force output to stderr: "output" is the string "stderr"
+  if (STRMATCH (outfile, "stderr") || ! (fp = fopen (outfile, "w")))
+    fp = stderr;
+
+#ifdef HAVE_INTERPOSE
+  // Calls made while writing the report must not add to the timers being printed
+  GPTLinterpose_pause ();
+#endif
+  ret = GPTLpr_fp (fp);
+
+  if (fp != stderr && fclose (fp) != 0)
+    fprintf (stderr, "%s: Attempt to close %s failed\n", thisfunc, outfile);
+#ifdef HAVE_INTERPOSE
+  GPTLinterpose_resume ();
+#endif
+
+  return ret;
+}
+
+/* 
+** GPTLpr_fp: Print values of all timers to an already open stream. NOT a public entry point:
+**            shared by GPTLpr_file and GPTLpr_collective
+**
+** Input arguments:
+**   fp: stream to write to
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLpr_fp (FILE *fp)
+{
   Timer *ptr;               // walk through master thread linked list
   Timer *tptr;              // walk through slave threads linked lists
   Timer sumstats;           // sum of same timer stats over threads
   Outputfmt outputfmt;      // max depth, namelen, chars2pr
   int n, t;                 // indices
-  int ndup;                 // number of duplicate auto-instrumented addresses
   unsigned long totcount;   // total timer invocations
   float *sum;               // sum of overhead values (per thread)
   float osum;               // sum of overhead over threads
@@ -1273,27 +2205,17 @@ int GPTLpr_file (const char *outfile)
   float procsiz, rss;       // returned from GPTLget_procsiz
 
   static const char *gptlversion = GPTL_VERSIONINFO;
-  static const char *thisfunc = "GPTLpr_file";
+  static const char *thisfunc = "GPTLpr_fp";
 
   if ( ! initialized)
     return GPTLerror ("%s: GPTLinitialize() has not been called\n", thisfunc);
 
-  // Not great hack to force output to stderr: "output" is the string "stderr"
-  if (STRMATCH (outfile, "stderr") || ! (fp = fopen (outfile, "w")))
-    fp = stderr;
-
   // Print version info from configure to output file
   fprintf (fp, "GPTL version info: %s\n", gptlversion);
   
-  // Rename auto-instrumented entries with same name but different address due to lopping
-  if ((ndup = GPTLrename_duplicate_addresses ()) > 0) {
-    fprintf (fp, "%d duplicate auto-instrumented addresses were found and @<num> added to name",
-	     ndup);
-    if (ndup > 255) {
-      fprintf (fp, "%d did NOT have @<num> added because there were too many\n", ndup);
-      fprintf (fp, "Consider increasing the value of MAX_CHARS in private.h next run\n");
-    }
-  }
+  // Auto-instrumented entries have only an address until now
+  (void) GPTLresolve_names (timers, GPTLnthreads);
+
   // Print a warning if GPTLerror() was ever called
   if (GPTLnum_errors () > 0) {
     fprintf (fp, "WARNING: GPTLerror was called at least once during the run.\n");
@@ -1359,21 +2281,58 @@ int GPTLpr_file (const char *outfile)
   fprintf (fp, "HAVE_PAPI was false\n");
 #endif
 
+#ifdef HAVE_PERFEVENTS
+  fprintf (fp, "HAVE_PERFEVENTS was true\n");
+  if (douseperf)
+    GPTLperf_printenabled (fp);
+#else
+  fprintf (fp, "HAVE_PERFEVENTS was false\n");
+#endif
+
+#ifdef ENABLE_ALLOCPROF
+  fprintf (fp, "ENABLE_ALLOCPROF was true\n");
+#else
+  fprintf (fp, "ENABLE_ALLOCPROF was false\n");
+#endif
+
+#ifdef ENABLE_IOPROF
+  fprintf (fp, "ENABLE_IOPROF was true\n");
+#else
+  fprintf (fp, "ENABLE_IOPROF was false\n");
+#endif
+
+#ifdef ENABLE_LOCKPROF
+  fprintf (fp, "ENABLE_LOCKPROF was true\n");
+#else
+  fprintf (fp, "ENABLE_LOCKPROF was false\n");
+#endif
+
+#ifdef ENABLE_OMPT
+  fprintf (fp, "ENABLE_OMPT was true\n");
+#else
+  fprintf (fp, "ENABLE_OMPT was false\n");
+#endif
+
 #ifdef ENABLE_NESTEDOMP
   fprintf (fp, "ENABLE_NESTEDOMP was true\n");
 #else
   fprintf (fp, "ENABLE_NESTEDOMP was false\n");
 #endif
 
-#ifdef HAVE_LIBUNWIND
-  fprintf (fp, "Autoprofiling capability was enabled with libunwind\n");
-#elif defined HAVE_BACKTRACE	  
-  fprintf (fp, "Autoprofiling capability was enabled with backtrace\n");
+#if ( defined HAVE_DL_ITERATE_PHDR && defined HAVE_ELF_H && defined HAVE_LINK_H )
+  fprintf (fp, "Autoprofiled functions were named from ELF symbol tables\n");
+#elif defined HAVE_DLADDR
+  fprintf (fp, "Autoprofiled functions were named with dladdr\n");
 #else
-  fprintf (fp, "Autoprofiling capability was NOT enabled\n");
-#endif	   
+  fprintf (fp, "Autoprofiled functions were named by address only\n");
+#endif
 
   fprintf (fp, "Underlying timing routine was %s.\n", funclist[funcidx].name);
+  if (thread_cpu)
+    fprintf (fp, "CPU time and context switches are per thread. Wait is Wall minus CPU.\n");
+#ifdef HAVE_LIBMPI
+  GPTLprint_clocksync (fp);
+#endif
   (void) GPTLget_overhead (fp, ptr2wtimefunc, getentry, genhashidx, GPTLget_thread_num,
 			   stackidx, callstack, hashtable[0], tablesize, dousepapi, imperfect_nest, 
 			   &self_ohd, &parent_ohd);
@@ -1382,14 +2341,37 @@ int GPTLpr_file (const char *outfile)
 	     "self_OH is estimated as 2X the Fortran layer cost (start+stop) plust the cost of \n"
 	     "a single call to the underlying timing routine.\n"
 	     "parent_OH is the overhead for the named timer which is subsumed into its parent.\n"
-	     "It is estimated as the cost of a single GPTLstart()/GPTLstop() pair.\n"
-             "Print method was %s.\n", methodstr (method));
+	     "It is estimated as the cost of a single GPTLstart()/GPTLstop() pair.\n");
+    if (cct)
+      fprintf (fp, "Calling context tree mode: a timer started from more than one call path\n"
+	       "has a separate entry for each path, so the print method does not apply.\n");
+    else
+      fprintf (fp, "Print method was %s.\n", methodstr (method));
 #ifdef ENABLE_PMPI
     fprintf (fp, "\nIf a AVG_MPI_BYTES field is present, it is an estimate of the per-call\n"
              "average number of bytes handled by that process.\n"
              "If timers beginning with sync_ are present, it means MPI synchronization "
              "was turned on.\n");
 #endif
+#ifdef ENABLE_ALLOCPROF
+    fprintf (fp, "\nAllocs, Alloc_bytes and Alloc_sec are the number of heap allocations, bytes\n"
+             "requested and time spent in malloc/free etc. while the timer was innermost on\n"
+             "the calling thread. Allocations made by children are not included.\n");
+#endif
+#ifdef ENABLE_IOPROF
+    fprintf (fp, "\nIO_MB is MB (1e6 bytes) moved by I/O calls made while the timer was innermost\n"
+             "on the calling thread, or by the I/O routine itself for IO_* timers.\n"
+             "IO_MB/s divides that by the time spent inside the I/O calls.\n");
+#endif
+#ifdef ENABLE_LOCKPROF
+    fprintf (fp, "\nContended and Lock_wait are the number of pthread lock acquires (and condition\n"
+             "variable waits) which had to wait, and the time spent waiting, while the timer\n"
+             "was innermost on the calling thread. Per-lock stats appear later in the file.\n");
+#endif
+    if (wallstats.enabled)
+      fprintf (fp, "\nSelf is Wall minus the time spent in timers started while this timer was\n"
+               "innermost, i.e. exclusive time. It is charged at each stop, so it is correct\n"
+               "for timers with multiple parents. The Hotspots section ranks timers by it.\n");
     fprintf (fp, "\nIf a \'%%_of\' field is present, it is w.r.t. the first timer for thread 0.\n"
              "If a \'e6_per_sec\' field is present, it is in millions of PAPI counts per sec.\n\n"
              "A '*' in column 1 below means the timer had multiple parents, though the values\n"
@@ -1397,7 +2379,15 @@ int GPTLpr_file (const char *outfile)
 	     "section titled \'Multiple parent info\'\n"
 	     "A \'!\' in column 1 means the timer is currently ON and the printed timings are only\n"
 	     "valid as of the previous GPTLstop. \'!\' overrides \'*\' if the region had multiple\n"
-	     "parents and was currently ON.\n\n");
+	     "parents and was currently ON.\n");
+    if (throttle_calls > 0)
+      fprintf (fp, "A '~' in column 1 means the auto-profiled timer was throttled: calls after\n"
+	       "the first %lu were counted but not timed. See the section titled 'Throttled'\n",
+	       throttle_calls);
+    if (filtering)
+      fprintf (fp, "Auto-profiled functions were selected by GPTL_FILTER/GPTL_FILTER_FILE: %d\n"
+	       "functions were excluded and are not listed\n", count_excluded ());
+    fprintf (fp, "\n");
   }
 
   // Print the process size at time of call to GPTLpr_file
@@ -1416,7 +2406,8 @@ int GPTLpr_file (const char *outfile)
     */
     if (imperfect_nest) {
       for (ptr = timers[t]->next; ptr; ptr = ptr->next) {
-	printstats (ptr, fp, t, 0, false, self_ohd, parent_ohd, outputfmt);
+	if ( ! is_unused_base (ptr))
+	  printstats (ptr, fp, t, 0, false, self_ohd, parent_ohd, outputfmt);
       }
     } else {
       printself_andchildren (timers[t], fp, t, -1, self_ohd, parent_ohd, outputfmt);
@@ -1438,6 +2429,15 @@ int GPTLpr_file (const char *outfile)
       fprintf (fp, "Total calls  = %9.3e\n", (float) totcount);
   }
 
+  if (wallstats.enabled && hotspot_rows > 0)
+    print_hotspots (fp);
+
+  if (throttle_calls > 0)
+    print_throttled (fp, self_ohd + parent_ohd);
+
+  if (callsites)
+    GPTLprint_callsites (fp, timers, GPTLnthreads, callsite_lines);
+
   // Print per-name stats for all threads
   if (dopr_threadsort && GPTLnthreads > 1) {
     int nblankchars;
@@ -1467,6 +2467,9 @@ int GPTLpr_file (const char *outfile)
 #ifdef HAVE_PAPI
     GPTL_PAPIprstr (fp);
 #endif
+#ifdef HAVE_PERFEVENTS
+    GPTLperf_prstr (fp);
+#endif
 
 #ifdef COLLIDE
     fprintf (fp, "  Collide");
@@ -1475,6 +2478,8 @@ int GPTLpr_file (const char *outfile)
     fprintf (fp, "\n");
     // Start at next to skip GPTL_ROOT
     for (ptr = timers[0]->next; ptr; ptr = ptr->next) {      
+      if (is_unused_base (ptr))
+        continue;
       // To print sum stats, first create a new timer then copy thread 0
       // stats into it. then sum using "add", and finally print.
       foundany = false;
@@ -1483,7 +2488,7 @@ int GPTLpr_file (const char *outfile)
       for (t = 1; t < GPTLnthreads; ++t) {
         found = false;
         for (tptr = timers[t]->next; tptr && ! found; tptr = tptr->next) {
-          if (STRMATCH (ptr->name, tptr->name)) {
+          if (cct ? same_context (ptr, tptr) : same_timer (ptr, tptr)) {
             // Only print thread 0 when this timer found for other threads
             if (first) {
               first = false;
@@ -1518,10 +2523,6 @@ int GPTLpr_file (const char *outfile)
     }
   }
 
-  // For auto-instrumented apps, translate names which have been truncated for output formatting
-  for (t = 0; t < GPTLnthreads; ++t)
-    translate_truncated_names (t, fp);
-  
   // Print info about timers with multiple parents ONLY if imperfect nesting was not discovered
   if (dopr_multparent && ! imperfect_nest) {
     for (t = 0; t < GPTLnthreads; ++t) {
@@ -1551,6 +2552,27 @@ int GPTLpr_file (const char *outfile)
     }
   }
 
+  GPTLprint_async (fp);
+
+#ifdef ENABLE_IOPROF
+  GPTLprint_iohist (fp, timers, GPTLnthreads);
+#endif
+
+#ifdef ENABLE_LOCKPROF
+  GPTLprint_lockstats (fp);
+#endif
+
+#ifdef ENABLE_OMPT
+  GPTLprint_ompt (fp);
+#endif
+
+  // Print per-region RSS stats from the background sampler
+  if (dopr_memusage)
+    GPTLprint_memsamples (fp, timers);
+
+  // Print per-region and per-function CPU time samples
+  GPTLprint_samples (fp, timers);
+
   // Print hash table stats
   if (dopr_collision)
     GPTLprint_hashstats (fp, GPTLnthreads, hashtable, tablesize);
@@ -1559,65 +2581,9 @@ int GPTLpr_file (const char *outfile)
   GPTLprint_memstats (fp, timers, tablesize);
 
   free (sum);
-
-  if (fp != stderr && fclose (fp) != 0)
-    fprintf (stderr, "%s: Attempt to close %s failed\n", thisfunc, outfile);
-
   return 0;
 }
 
-/* 
-** GPTLrename_duplcicate_addresses: Create unique name for auto-profiled entries that are 
-**                                  now duplicates due to truncation
-**
-** Return value: max number of duplicates found
-*/
-int GPTLrename_duplicate_addresses ()
-{
-  Timer *ptr;       // iterate through timers
-  Timer *testptr;   // start at ptr, iterate through remaining timers
-  int nfound = 0;   // number of duplicates found
-  int t;            // thread index
-
-  for (t = 0; t < GPTLnthreads; ++t) {
-    for (ptr = timers[t]; ptr; ptr = ptr->next) {
-      unsigned int idx = 0;
-      // Check only entries with a longname and don't have '@' in their name
-      // The former means auto-instrumented
-      // The latter means the name hasn't yet had the proper '@<number>' appended.
-      if (ptr->longname && ! index (ptr->name, '@')) {
-	for (testptr = ptr->next; testptr; testptr = testptr->next) {
-	  if (testptr->longname && STRMATCH (ptr->name, testptr->name)) {
-	    // Add string "@<idx>" to end of testptr->name to indicate duplicate auto-profiled
-	    // name for multiple addresses. Probable inlining issue.
-	    if (++idx < 4096)    // 4095 is the max integer printable in 3 hex chars
-	      snprintf (&testptr->name[MAX_CHARS-4], 5, "@%X", idx);
-	    else
-	      snprintf (&testptr->name[MAX_CHARS-4], 5, "@MAX");
-	  }
-	}
-	// @<number> has been added to duplicates. Now add @0 to original
-	snprintf (&ptr->name[MAX_CHARS-4], 5, "@%X", 0);
-	nfound = MAX (nfound, idx);
-      }
-    }
-  }
-  return nfound;
-}
-
-// translate_truncated_names: For auto-profiled entries, print to output file the translation of
-//                            truncated names to full signature
-static void translate_truncated_names (int t, FILE *fp)
-{
-  Timer *ptr;
-
-  fprintf (fp, "thread %d long name translations (empty when no auto-instrumentation):\n", t);
-  for (ptr = timers[t]->next; ptr; ptr = ptr->next) {
-    if (ptr->longname)
-      fprintf (fp, "%s = %s\n", ptr->name, ptr->longname);
-  }
-}
-
 // get_longest_omp_namelen: Discover longest name shared across threads
 static int get_longest_omp_namelen (void)
 {
@@ -1631,9 +2597,9 @@ static int get_longest_omp_namelen (void)
     for (t = 1; t < GPTLnthreads; ++t) {
       found = false;
       for (tptr = timers[t]->next; tptr && ! found; tptr = tptr->next) {
-	if (STRMATCH (tptr->name, ptr->name)) {
+	if (same_timer (tptr, ptr)) {
 	  found = true;
-	  longest = MAX (longest, strlen (ptr->name));
+	  longest = MAX (longest, strlen (ptr->longname ? ptr->longname : ptr->name));
 	}
 	if (found) // Found matching name: done with this thread
 	  break;
@@ -1710,10 +2676,22 @@ static void print_titles (int t, FILE *fp, Outputfmt *outputfmt)
 #ifdef ENABLE_PMPI
   fprintf (fp, " AVG_MPI_BYTES");
 #endif
+#ifdef ENABLE_ALLOCPROF
+  fprintf (fp, "   Allocs Alloc_bytes Alloc_sec");
+#endif
+#ifdef ENABLE_IOPROF
+  fprintf (fp, "     IO_MB   IO_MB/s");
+#endif
+#ifdef ENABLE_LOCKPROF
+  fprintf (fp, " Contended Lock_wait");
+#endif
 
 #ifdef HAVE_PAPI
   GPTL_PAPIprstr (fp);
 #endif
+#ifdef HAVE_PERFEVENTS
+  GPTLperf_prstr (fp);
+#endif
 
 #ifdef COLLIDE
     fprintf (fp, "  Collide");
@@ -1864,7 +2842,7 @@ static int get_outputfmt (const Timer *ptr, const int depth, const int indent,
 			  Outputfmt *outputfmt)
 {
   int ret;
-  int namelen  = strlen (ptr->name);
+  int namelen  = strlen (ptr->longname ? ptr->longname : ptr->name);
   int chars2pr = namelen + indent*depth;
   int n;
 
@@ -1907,7 +2885,7 @@ static int get_max_namelen (Timer *timers)
   int max_namelen = 0;   // return value
 
   for (ptr = timers; ptr; ptr = ptr->next) {
-    namelen = strlen (ptr->name);
+    namelen = strlen (ptr->longname ? ptr->longname : ptr->name);
     if (namelen > max_namelen)
       max_namelen = namelen;
   }
@@ -1982,7 +2960,9 @@ static void printstats (const Timer *timer, FILE *fp, int t, int depth, bool doi
   float elapse;        // elapsed time
   float wallmax;       // max wall time
   float wallmin;       // min wall time
+  float self;          // wall time not spent in child timers
   float ratio;         // percentage calc
+  const char *name;    // name to print
   static const char *thisfunc = "printstats";
 
   if (timer->onflg && verbose)
@@ -1993,6 +2973,8 @@ static void printstats (const Timer *timer, FILE *fp, int t, int depth, bool doi
   if (doindent) {
     if (timer->onflg)
       fprintf (fp, "! ");
+    else if (timer->throttled)
+      fprintf (fp, "~ ");
     else if (timer->nparent > 1)
       fprintf (fp, "* ");
     else
@@ -2003,10 +2985,12 @@ static void printstats (const Timer *timer, FILE *fp, int t, int depth, bool doi
       fprintf (fp, " ");
   }
 
-  fprintf (fp, "%s", timer->name);
+  // Auto-profiled names are printed whole
+  name = timer->longname ? timer->longname : timer->name;
+  fprintf (fp, "%s", name);
 
   // Pad to most chars to print
-  extraspace = outputfmt.max_chars2pr - (depth*indent_chars + strlen (timer->name));
+  extraspace = outputfmt.max_chars2pr - (depth*indent_chars + strlen (name));
   for (i = 0; i < extraspace; ++i)
     fprintf (fp, " ");
 
@@ -2022,9 +3006,21 @@ static void printstats (const Timer *timer, FILE *fp, int t, int depth, bool doi
       fprintf (fp, " %8.1e     -   ", (float) timer->count);
   }
 
-  if (cpustats.enabled) {
-    fusr = timer->cpu.accum_utime / (float) ticks_per_sec;
-    fsys = timer->cpu.accum_stime / (float) ticks_per_sec;
+  if (thread_cpu) {
+    // Wait is wallclock time the thread spent not running: blocked, sleeping, or preempted
+    fusr = timer->cpu.accum_utime / (float) cpu_per_sec;
+    fprintf (fp, " %8.1e %8.1e", fusr, MAX (timer->wall.accum - fusr, 0.));
+    if (timer->cpu.accum_nvcsw < PRTHRESH)
+      fprintf (fp, " %8ld", timer->cpu.accum_nvcsw);
+    else
+      fprintf (fp, " %8.1e", (float) timer->cpu.accum_nvcsw);
+    if (timer->cpu.accum_nivcsw < PRTHRESH)
+      fprintf (fp, " %8ld", timer->cpu.accum_nivcsw);
+    else
+      fprintf (fp, " %8.1e", (float) timer->cpu.accum_nivcsw);
+  } else if (cpustats.enabled) {
+    fusr = timer->cpu.accum_utime / (float) cpu_per_sec;
+    fsys = timer->cpu.accum_stime / (float) cpu_per_sec;
     usrsys = fusr + fsys;
     fprintf (fp, " %8.1e %8.1e %8.1e", fusr, fsys, usrsys);
   }
@@ -2049,6 +3045,12 @@ static void printstats (const Timer *timer, FILE *fp, int t, int depth, bool doi
     else
       fprintf (fp, " %8.3f", wallmin);
 
+    self = MAX (0., timer->wall.accum - timer->wall.child);
+    if (self < 0.01)
+      fprintf (fp, " %8.2e", self);
+    else
+      fprintf (fp, " %8.3f", self);
+
     if (percent && timers[0]->next) {
       ratio = 0.;
       if (timers[0]->next->wall.accum > 0.)
@@ -2067,10 +3069,39 @@ static void printstats (const Timer *timer, FILE *fp, int t, int depth, bool doi
   else
     fprintf (fp, "%13.3e ", timer->nbytes / timer->count);
 #endif
+
+#ifdef ENABLE_ALLOCPROF
+  if (timer->alloc.count < PRTHRESH)
+    fprintf (fp, " %8lu", timer->alloc.count);
+  else
+    fprintf (fp, " %8.1e", (float) timer->alloc.count);
+  fprintf (fp, " %11.3e %9.2e", timer->alloc.bytes, timer->alloc.time);
+#endif
+
+#ifdef ENABLE_IOPROF
+  if (timer->io.bytes == 0.)
+    fprintf (fp, "         -         -");
+  else if (timer->io.time > 0.)
+    fprintf (fp, " %9.3f %9.1f", timer->io.bytes * 1.e-6, timer->io.bytes * 1.e-6 / timer->io.time);
+  else
+    fprintf (fp, " %9.3f         -", timer->io.bytes * 1.e-6);
+#endif
+
+#ifdef ENABLE_LOCKPROF
+  if (timer->lock.ncontend == 0)
+    fprintf (fp, "         -         -");
+  else if (timer->lock.ncontend < PRTHRESH)
+    fprintf (fp, " %9lu %9.2e", timer->lock.ncontend, timer->lock.wait);
+  else
+    fprintf (fp, " %9.1e %9.2e", (float) timer->lock.ncontend, timer->lock.wait);
+#endif
   
 #ifdef HAVE_PAPI
   GPTL_PAPIpr (fp, &timer->aux, t, timer->count, timer->wall.accum);
 #endif
+#ifdef HAVE_PERFEVENTS
+  GPTLperf_pr (fp, &timer->perf);
+#endif
 
 #ifdef COLLIDE
   if (timer->collide > PRTHRESH)
@@ -2126,30 +3157,65 @@ static void add (Timer *tout, const Timer *tin)
 
   if (wallstats.enabled) {
     tout->wall.accum += tin->wall.accum;
+    tout->wall.child += tin->wall.child;
     tout->wall.max = MAX (tout->wall.max, tin->wall.max);
     tout->wall.min = MIN (tout->wall.min, tin->wall.min);
   }
 
   if (cpustats.enabled) {
-    tout->cpu.accum_utime += tin->cpu.accum_utime;
-    tout->cpu.accum_stime += tin->cpu.accum_stime;
+    tout->cpu.accum_utime  += tin->cpu.accum_utime;
+    tout->cpu.accum_stime  += tin->cpu.accum_stime;
+    tout->cpu.accum_nvcsw  += tin->cpu.accum_nvcsw;
+    tout->cpu.accum_nivcsw += tin->cpu.accum_nivcsw;
+  }
+#ifdef ENABLE_ALLOCPROF
+  tout->alloc.count += tin->alloc.count;
+  tout->alloc.bytes += tin->alloc.bytes;
+  tout->alloc.time  += tin->alloc.time;
+#endif
+#ifdef ENABLE_IOPROF
+  {
+    int bin;
+    tout->io.ncalls += tin->io.ncalls;
+    tout->io.bytes  += tin->io.bytes;
+    tout->io.time   += tin->io.time;
+    for (bin = 0; bin < NIOBINS; ++bin)
+      tout->io.hist[bin] += tin->io.hist[bin];
   }
+#endif
+#ifdef ENABLE_LOCKPROF
+  tout->lock.ncontend += tin->lock.ncontend;
+  tout->lock.wait     += tin->lock.wait;
+#endif
 #ifdef HAVE_PAPI
   GPTL_PAPIadd (&tout->aux, &tin->aux);
 #endif
+#ifdef HAVE_PERFEVENTS
+  GPTLperf_add (&tout->perf, &tin->perf);
+#endif
 }
 
 /*
 ** get_cpustamp: Invoke the proper system timer and return stats.
 **
 ** Output arguments:
-**   usr: user time
-**   sys: system time
+**   usr: user time (ticks), or CPU time of the calling thread (nsec) with GPTLthread_cpu
+**   sys: system time (ticks), or 0 with GPTLthread_cpu
 **
 ** Return value: 0 (success)
 */
 static inline int get_cpustamp (long *usr, long *sys)
 {
+#ifdef HAVE_THREAD_CPU
+  struct timespec ts;
+
+  if (thread_cpu) {
+    (void) clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+    *usr = ts.tv_sec * 1000000000L + ts.tv_nsec;
+    *sys = 0;
+    return 0;
+  }
+#endif
 #ifdef HAVE_TIMES
   struct tms buf;
 
@@ -2162,6 +3228,30 @@ static inline int get_cpustamp (long *usr, long *sys)
 #endif
 }
 
+/*
+** get_ctxsw: Return context switches of the calling thread so far (GPTLthread_cpu)
+**
+** Output arguments:
+**   nvcsw:  voluntary context switches (blocking, sleeping)
+**   nivcsw: involuntary context switches (preemption)
+**
+** Return value: 0 (success) or -1 (failure)
+*/
+static inline int get_ctxsw (long *nvcsw, long *nivcsw)
+{
+#ifdef HAVE_THREAD_CPU
+  struct rusage usage;
+
+  if (getrusage (RUSAGE_THREAD, &usage) != 0)
+    return -1;
+  *nvcsw  = usage.ru_nvcsw;
+  *nivcsw = usage.ru_nivcsw;
+  return 0;
+#else
+  return -1;
+#endif
+}
+
 /*
 ** GPTLquery: return current status info about a timer. If certain stats are not 
 ** enabled, they should just have zeros in them. If PAPI is not enabled, input
@@ -2207,8 +3297,8 @@ int GPTLquery (const char *name, int t, int *count, int *onflg, double *wallcloc
   *onflg     = ptr->onflg;
   *count     = ptr->count;
   *wallclock = ptr->wall.accum;
-  *dusr      = ptr->cpu.accum_utime / (double) ticks_per_sec;
-  *dsys      = ptr->cpu.accum_stime / (double) ticks_per_sec;
+  *dusr      = ptr->cpu.accum_utime / (double) cpu_per_sec;
+  *dsys      = ptr->cpu.accum_stime / (double) cpu_per_sec;
 #ifdef HAVE_PAPI
   GPTL_PAPIquery (&ptr->aux, papicounters_out, maxcounters);
 #endif
@@ -2497,10 +3587,14 @@ int GPTLget_eventvalue (const char *timername, const char *eventname, int t, dou
     return GPTLerror ("%s: requested timer %s does not exist (or auto-instrumented?)\n",
 		      thisfunc, timername);
 
+#ifdef HAVE_PERFEVENTS
+  if (douseperf && GPTLperf_get_eventvalue (eventname, &ptr->perf, value) == 0)
+    return 0;
+#endif
 #ifdef HAVE_PAPI
   return GPTL_PAPIget_eventvalue (eventname, &ptr->aux, value);
 #else
-  return GPTLerror ("%s: PAPI not enabled\n", thisfunc); 
+  return GPTLerror ("%s: %s is not an enabled event\n", thisfunc, eventname); 
 #endif
 }
 
@@ -2590,53 +3684,178 @@ int GPTLget_regionname (int t, int region, char *name, int nc)
 // Whether GPTL has been initialized
 int GPTLis_initialized (void) {return (int) initialized;}
 
+// Whether timing has been disabled by GPTLdisable
+int GPTLis_disabled (void) {return (int) disabled;}
+
+/*
+** addrhash: slot of an auto-profiled function in an address map
+**
+** Multiplying by 2^64 divided by the golden ratio mixes the address bits into the top bits
+** of the product, so aligned addresses spread out without an integer division
+*/
+static inline unsigned int addrhash (const void *self, int shift)
+{
+  return (unsigned int) (((unsigned long long) (unsigned long) self *
+			  0x9e3779b97f4a7c15ULL) >> shift);
+}
+
 /*
-** getentry_instr: find hash table entry and return a pointer to it
+** getentry_addr: find the timer of an auto-profiled function
+**   A cache hit is one compare and writes nothing. A miss probes the map, and a hit there is
+**   copied into the cache (which is private to the thread)
 **
 ** Input args:
-**   hashtable: the hashtable (array)
-**   self:      input address (from -finstrument-functions)
-** Output args:
-**   indx:      hashtable index
+**   map:  address map of the calling thread
+**   self: input address (from -finstrument-functions)
 **
 ** Return value: pointer to the entry, or NULL if not found
 */
-static inline Timer *getentry_instr (const Hashentry *hashtable, void *self, unsigned int *indx)
+static inline Timer *getentry_addr (Addrmap *map, const void *self)
 {
-  int i;
-  Timer *ptr = NULL;  // init to return value when entry not found
+  // Linkers often align functions on 16-byte boundaries, so the low 4 bits carry no information
+  Addrslot *cached = &map->cache[(((unsigned long) self) >> 4) & (ADDRCACHE - 1)];
+  unsigned int mask;
+  unsigned int i;
 
-  /*
-  ** Hash index is timer address modulo the table size
-  ** On most machines, right-shifting the address helps because linkers often
-  ** align functions on even boundaries
-  */
-  *indx = (((unsigned long) self) >> 4) % tablesize;
-  for (i = 0; i < hashtable[*indx].nument; ++i) {
-    if (hashtable[*indx].entries[i]->address == self) {
-      ptr = hashtable[*indx].entries[i];
-#ifdef COLLIDE
-      if (i > 0)
-	hashtable[*indx].entries[i]->collide += i;
-#endif
-#define SWAP_ON_COUNT
-#ifdef SWAP_ON_COUNT
-      // Swap hashtable position with neighbor to the left (i.e. earlier position in the search
-      // array) if we've been called more frequently
-      // This should minimize the number of tests for "self" in the linear search.
-      if (i > 0) {
-	unsigned long neigh_count = hashtable[*indx].entries[i-1]->count;
-	if (hashtable[*indx].entries[i]->count > neigh_count) {
-	  Timer *tmp                    = hashtable[*indx].entries[i];
-	  hashtable[*indx].entries[i]   = hashtable[*indx].entries[i-1];
-	  hashtable[*indx].entries[i-1] = tmp;
-	}
+  if (cached->address == self)
+    return cached->ptr;
+
+  if (map->nused == 0)
+    return 0;
+  mask = map->size - 1;
+  for (i = addrhash (self, map->shift); map->slots[i].address; i = (i + 1) & mask) {
+    if (map->slots[i].address == self) {
+      *cached = map->slots[i];
+      return cached->ptr;
+    }
+  }
+  return 0;
+}
+
+/*
+** addrmap_insert: add an auto-profiled function to the address map of a thread
+**
+** Input args:
+**   map:  address map of the calling thread
+**   self: function address, not yet in the map
+**   ptr:  its timer
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+static int addrmap_insert (Addrmap *map, void *self, Timer *ptr)
+{
+  Addrslot *slots;
+  unsigned int size;
+  unsigned int mask;
+  unsigned int i, n;
+  int shift;
+  static const char *thisfunc = "addrmap_insert";
+
+  // Keep the load factor at most 3/4 so probe sequences stay short. Cache entries point at
+  // timers, not slots, so they stay valid
+  if (4 * (map->nused + 1) > 3 * map->size) {
+    size  = map->size > 0 ? 2 * map->size : 1U << ADDRMAP_LOG2SIZE;
+    shift = map->size > 0 ? map->shift - 1 : 64 - ADDRMAP_LOG2SIZE;
+    if ( ! (slots = (Addrslot *) calloc (size, sizeof (Addrslot))))
+      return GPTLerror ("%s: calloc error for %u slots\n", thisfunc, size);
+    mask = size - 1;
+    for (n = 0; n < map->size; ++n) {
+      if (map->slots[n].address) {
+	for (i = addrhash (map->slots[n].address, shift); slots[i].address; i = (i + 1) & mask);
+	slots[i] = map->slots[n];
       }
-#endif
-      break;
     }
+    free (map->slots);
+    map->slots = slots;
+    map->size  = size;
+    map->shift = shift;
   }
-  return ptr;
+
+  mask = map->size - 1;
+  for (i = addrhash (self, map->shift); map->slots[i].address; i = (i + 1) & mask);
+  map->slots[i].address = self;
+  map->slots[i].ptr     = ptr;
+  ++map->nused;
+  return 0;
+}
+
+/*
+** callsite_enter: count a call of an auto-profiled function from call_site (GPTLcallsites)
+**
+** Input args:
+**   ptr:       timer of the function
+**   call_site: return address in the caller
+**   outermost: the call is not recursive, so __cyg_profile_func_exit charges its time to call_site
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+static inline int callsite_enter (Timer *ptr, void *call_site, bool outermost)
+{
+  unsigned int mask;
+  unsigned int i;
+
+  if (ptr->nsites > 0) {
+    mask = ptr->sitesize - 1;
+    for (i = addrhash (call_site, 32) & mask; ptr->sites[i].site; i = (i + 1) & mask) {
+      if (ptr->sites[i].site == call_site) {
+	++ptr->sites[i].count;
+	if (outermost)
+	  ptr->cursite = i;
+	return 0;
+      }
+    }
+  }
+  return callsite_add (ptr, call_site, outermost);
+}
+
+/*
+** callsite_add: add the first call of an auto-profiled function from call_site
+**
+** Input args:
+**   ptr:       timer of the function
+**   call_site: return address in the caller, not yet in ptr->sites
+**   outermost: the call is not recursive
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+static int callsite_add (Timer *ptr, void *call_site, bool outermost)
+{
+  Callsite *sites;
+  unsigned int size;
+  unsigned int mask;
+  unsigned int cursite = 0;
+  unsigned int i, n;
+  static const char *thisfunc = "callsite_add";
+
+  // Keep the load factor at most 3/4 so probe sequences stay short. The site of a running
+  // outer call moves with the rehash
+  if (4 * (ptr->nsites + 1) > 3 * ptr->sitesize) {
+    size = ptr->sitesize > 0 ? 2 * ptr->sitesize : 4;
+    if ( ! (sites = (Callsite *) calloc (size, sizeof (Callsite))))
+      return GPTLerror ("%s: calloc error for %u call sites of %s\n", thisfunc, size, ptr->name);
+    mask = size - 1;
+    for (n = 0; n < ptr->sitesize; ++n) {
+      if (ptr->sites[n].site) {
+	for (i = addrhash (ptr->sites[n].site, 32) & mask; sites[i].site; i = (i + 1) & mask);
+	sites[i] = ptr->sites[n];
+	if (n == ptr->cursite)
+	  cursite = i;
+      }
+    }
+    free (ptr->sites);
+    ptr->sites    = sites;
+    ptr->sitesize = size;
+    ptr->cursite  = cursite;
+  }
+
+  mask = ptr->sitesize - 1;
+  for (i = addrhash (call_site, 32) & mask; ptr->sites[i].site; i = (i + 1) & mask);
+  ptr->sites[i].site  = call_site;
+  ptr->sites[i].count = 1;
+  ++ptr->nsites;
+  if (outermost)
+    ptr->cursite = i;
+  return 0;
 }
 
 /*
@@ -2647,6 +3866,7 @@ static inline Timer *getentry_instr (const Hashentry *hashtable, void *self, uns
 **
 ** Return value: hash value
 */
+// gptl.hpp computes the same sum at compile time for string literals: keep the two in sync
 #define NEWWAY
 static inline unsigned int genhashidx (const char *name)
 {
@@ -2735,8 +3955,6 @@ static inline Timer *getentry (const Hashentry *hashtable, const char *name, uns
 void __func_trace_enter (const char *function_name, const char *file_name, int line_number,
                          void **const user_data)
 {
-  if (dopr_memusage && GPTLget_thread_num() == 0)
-    check_memusage ("Begin", function_name);
   (void) GPTLstart (function_name);
 }
   
@@ -2744,27 +3962,17 @@ void __func_trace_exit (const char *function_name, const char *file_name, int li
                         void **const user_data)
 {
   (void) GPTLstop (function_name);
-  if (dopr_memusage && GPTLget_thread_num() == 0)
-    check_memusage ("End", function_name);
 }
   
 #else
 //_AIX not defined
 
-#if ( defined HAVE_LIBUNWIND || defined HAVE_BACKTRACE )
 void __cyg_profile_func_enter (void *this_fn, void *call_site)
 {
   int t;                // thread index
-  int symsize;          // number of characters in symbol
-  char *symnam = NULL;  // symbol name whether using unwind or backtrace
-  int numchars;         // number of characters in function name
-  unsigned int indx;    // hash table index
   Timer *ptr;           // pointer to entry if it already exists
   static const char *thisfunc = "__cyg_profile_func_enter";
 
-  // In debug mode, get symbol name up front to diagnose function name
-  // Otherwise live with "unknown" because getting the symbol name is very expensive
-
   // Call preamble_start rather than just GPTLget_thread_num because preamble_stop is needed for
   // other reasons in __cyg_profile_func_exit, and the preamble* functions need to mirror each
   // other.
@@ -2772,7 +3980,29 @@ void __cyg_profile_func_enter (void *this_fn, void *call_site)
   if (preamble_start (&t, unknown) != 0)
     return;
   
-  ptr = getentry_instr (hashtable[t], this_fn, &indx);
+  ptr = getentry_addr (&addrmap[t], this_fn);
+
+  // First entry of a function with a filter loaded: judge it by name once, and keep the verdict
+  // in an address map entry which is not on the timer list. Excluded functions cost one lookup
+  if ( ! ptr && filtering && ! GPTLfilter_timed (this_fn)) {
+    ptr = (Timer *) GPTLallocate (sizeof (Timer), thisfunc);
+    memset (ptr, 0, sizeof (Timer));
+    snprintf (ptr->name, sizeof (ptr->name), "%p", this_fn);
+    ptr->address  = this_fn;
+    ptr->excluded = true;
+    if (addrmap_insert (&addrmap[t], this_fn, ptr) != 0)
+      GPTLwarn ("%s: addrmap_insert error\n", thisfunc);
+    return;
+  }
+  if (ptr && ptr->excluded)
+    return;
+
+  // Throttled => just count the call. The callstack is not pushed, so anything this function
+  // calls is charged to its caller. __cyg_profile_func_exit returns early to match
+  if (ptr && ptr->throttled) {
+    ++ptr->nthrottled;
+    return;
+  }
 
   /* 
   ** Recursion => increment depth in recursion and return.  We need to return 
@@ -2781,98 +4011,41 @@ void __cyg_profile_func_enter (void *this_fn, void *call_site)
   */
   if (ptr && ptr->onflg) {
     ++ptr->recurselvl;
+    if (callsites && callsite_enter (ptr, call_site, false) != 0)
+      GPTLwarn ("%s: callsite_enter error\n", thisfunc);
     return;
   }
 
-  // Increment stackidx[t] unconditionally. This is necessary to ensure the correct
-  // behavior when GPTLstop_instr decrements stackidx[t] unconditionally.
-  if (++stackidx[t].val > MAX_STACK-1) {
+  // The push itself is done by update_ptr (see GPTLstart)
+  if (stackidx[t].val >= MAX_STACK-1) {
     GPTLwarn ("%s: stack too big\n", thisfunc);
     return;
   }
 
   // Nasty bit of code needs to be this way because separating into functions can cause
   // compilers to inline and screw things up
+  // Only the address is recorded here: looking up the name costs far more than timing the call.
+  // GPTLresolve_names replaces the address with the function name when results are printed
   if ( ! ptr) {     // Add a new entry and initialize
-#if ( defined HAVE_BACKTRACE )
-    char **strings = 0;
-    void *buffer[2];
-    int nptrs;
-    
-    nptrs = backtrace (buffer, 2);
-    if (nptrs != 2) {
-      GPTLwarn ("%s backtrace failed nptrs should be 2 but is %d\n", thisfunc, nptrs);
-      return;
-    }
-
-    if ( ! (strings = backtrace_symbols (buffer, nptrs))) {
-      GPTLwarn ("%s backtrace_symbols failed strings is null\n", thisfunc);
-      return;
-    }
-    // extract_name will malloc space for symnam, and it will be freed below
-    extract_name (strings[1], &symnam, this_fn, t);
-    free (strings);  // backtrace() allocated strings
-
-#elif ( defined HAVE_LIBUNWIND )
-
-    char symbol[MAX_SYMBOL_NAME+1];
-    unw_cursor_t cursor;
-    unw_context_t context;
-    unw_word_t offset, pc;
-    int n;
-    // Initialize cursor to current frame for local unwinding.
-    unw_getcontext (&context);
-    unw_init_local (&cursor, &context);
-
-    if (unw_step (&cursor) <= 0) { // unw_step failed: give up
-      GPTLwarn ("%s: unw_step failed\n", thisfunc);
-      return;
-    }
-
-    unw_get_reg (&cursor, UNW_REG_IP, &pc);
-    if (unw_get_proc_name (&cursor, symbol, sizeof(symbol), &offset) == 0) {
-      int nchars = strlen (symbol);;
-#ifdef APPEND_ADDRESS
-      char addrname[16+2];
-      *symnam = (char *) malloc (nchars+16+2);  // 16 is nchars, +2 is for '#' and '\0'
-      strncpy (*symnam, symbol, nchars+1);
-      snprintf (addrname, 16+2, "#%-16p", this_fn);
-      strcat (*symnam, addrname);
-#else
-      symnam = (char *) malloc (nchars + 1);
-      strncpy (symnam, symbol, nchars+1);
-#endif
-    } else {
-      // Name not found: write function address into symnam. Allow 16 characters to hold address
-      symnam = (char *) malloc (16+1);
-      snprintf (symnam, 16+1, "%-16p", this_fn);
-    }
-#endif
-
-    // Whether backtrace or libunwind, symnam has now been defined
-    symsize = strlen (symnam);
     ptr = (Timer *) GPTLallocate (sizeof (Timer), thisfunc);
     memset (ptr, 0, sizeof (Timer));
-
-    // For names longer than MAX_CHARS, need the full name to avoid misrepresenting
-    // names with stripped off characters as duplicates
-    if (symsize > MAX_CHARS) {
-      ptr->longname = (char *) malloc (symsize+1);
-      strcpy (ptr->longname, symnam);
-    }
-    numchars = MIN (symsize, MAX_CHARS);
-    strncpy (ptr->name, symnam, numchars);
-    ptr->name[numchars] = '\0';
+    snprintf (ptr->name, sizeof (ptr->name), "%p", this_fn);
     ptr->address = this_fn;
-    free (symnam);
 
-    if (update_ll_hash (ptr, t, indx) != 0) {
-      GPTLwarn ("%s: update_ll_hash error\n", thisfunc);
+    last[t]->next = ptr;
+    last[t] = ptr;
+    if (addrmap_insert (&addrmap[t], this_fn, ptr) != 0) {
+      GPTLwarn ("%s: addrmap_insert error\n", thisfunc);
       return;
     }
   }
 
-  if (update_parent_info (ptr, callstack[t], stackidx[t].val) != 0) {
+  if (callsites && callsite_enter (ptr, call_site, true) != 0) {
+    GPTLwarn ("%s: callsite_enter error\n", thisfunc);
+    return;
+  }
+
+  if (update_parent_info (ptr, callstack[t], stackidx[t].val + 1) != 0) {
     GPTLwarn ("%s: update_parent_info error\n", thisfunc);
     return;
   }
@@ -2881,67 +4054,31 @@ void __cyg_profile_func_enter (void *this_fn, void *call_site)
     GPTLwarn ("%s: update_ptr error\n", thisfunc);
     return;
   }
-
-  if (dopr_memusage && t == 0)
-    check_memusage ("Begin", ptr->name);
-}
-
-#ifdef HAVE_BACKTRACE
-// Backtrace strings have a bunch of extra stuff in them.
-// Find the start and end of the function name, and return it in *symnam
-// Note str gets modified by writing \0 after the end of the function name
-static void extract_name (char *str, char **symnam, void *this_fn, const int t)
-{
-  int nchars;
-  char *savetoken;
-  char *saveptr[GPTLnthreads];
-  char *token;
-
-#ifdef __APPLE__
-  token = strtok_r (str, " ", &saveptr[t]);
-  for (int n = 0; n < 3; ++n)
-    token = strtok_r (NULL, " ", &saveptr[t]);
-#else
-  token = strtok_r (str, "(", &saveptr[t]);
-  savetoken = token;
-  if ( ! (token = strtok_r (NULL, "+", &saveptr[t])))
-    token = savetoken;
-#endif
-
-  if ( ! token) {
-    // Name not found: write function address into symnam. Allow 16 characters to hold address
-    *symnam = (char *) malloc (16+1);
-    snprintf (*symnam, 16+1,"%-16p", this_fn);
-  } else {
-    nchars = strlen (token);
-#ifdef APPEND_ADDRESS
-    char addrname[16+2];
-    *symnam = (char *) malloc (nchars+16+2);  // 16 is nchars, +2 is for '#' and '\0'
-    strncpy (*symnam, token, nchars+1);
-    snprintf (addrname, 16+2, "#%-16p", this_fn);
-    strcat (*symnam, addrname);
-#else
-    *symnam = (char *) malloc (nchars + 1);
-    strncpy (*symnam, token, nchars+1);
-#endif
-  }
 }
-#endif   // HAVE_BACKTRACE
 
 void __cyg_profile_func_exit (void *this_fn, void *call_site)
 {
   int t;                     // thread index
-  unsigned int indx;         // hash table index
   Timer *ptr;                // pointer to entry if it already exists
   double tp1 = 0.0;          // time stamp
   long usr = 0;              // user time (returned from get_cpustamp)
   long sys = 0;              // system time (returned from get_cpustamp)
   static const char *thisfunc = "__cyg_profile_func_exit";
 
+  // A throttled or excluded function was not pushed on entry, so leave before preamble_stop
+  // reads the clock: that is most of the cost being saved. Entry only gets as far as those
+  // checks when the depth is below depthlimit, and the depth is unchanged since then
+  if ((throttle_calls > 0 || filtering) && initialized && ! disabled &&
+      (t = GPTLget_thread_num ()) >= 0 && stackidx[t].val < depthlimit) {
+    ptr = getentry_addr (&addrmap[t], this_fn);
+    if (ptr && (ptr->throttled || ptr->excluded))
+      return;
+  }
+
   if (preamble_stop (&t, &tp1, &usr, &sys, unknown) != 0)
     return;
        
-  ptr = getentry_instr (hashtable[t], this_fn, &indx);
+  ptr = getentry_addr (&addrmap[t], this_fn);
 
   if ( ! ptr) {
     GPTLwarn ("%s: timer for %p had not been started.\n", thisfunc, this_fn);
@@ -2971,54 +4108,16 @@ void __cyg_profile_func_exit (void *this_fn, void *call_site)
     return;
   }
 
-  if (dopr_memusage && t == 0)
-    check_memusage ("End", ptr->name);
-}
-#endif // HAVE_LIBUNWIND || HAVE_BACKTRACE
-#endif // _AIX false branch
-
-static void check_memusage (const char *str, const char *funcnam)
-{
-  float rss;
-
-  (void) GPTLget_memusage (&rss);
-  // Notify user when rss has grown by more than some percentage (default 0%)
-  if (rss > rssmax*(1.0 + 0.01*growth_pct)) {
-    rssmax = rss;
-    // Once MPI is initialized, change file pointer for process size to rank-specific file      
-    set_fp_procsiz ();
-    if (fp_procsiz) {
-      fprintf (fp_procsiz, "%s %s RSS grew to %8.2f MB\n", str, funcnam, rss);
-      fflush (fp_procsiz);  // Not clear when this file needs to be closed, so flush
-    } else {
-      fprintf (stderr, "%s %s RSS grew to %8.2f MB\n", str, funcnam, rss);
-    }
-  }
-}
+  // Charge the call to the site of the outermost call (GPTLcallsites)
+  if (callsites && ptr->nsites > 0)
+    ptr->sites[ptr->cursite].wall += ptr->wall.latest;
 
-// set_fp_procsiz: Change file pointer from stderr to point to "procsiz.<rank>" once
-// MPI has been initialized
-static inline void set_fp_procsiz ()
-{
-#ifdef HAVE_LIBMPI
-  int ret;
-  int flag;
-  static bool check_mpi_init = true; // whether to check if MPI has been init (init to true)
-  char outfile[15];
-
-  // Must only open the file once. Also more efficient to only make MPI lib inquiries once
-  if (check_mpi_init) {
-    ret = MPI_Initialized (&flag);
-    if (flag) {
-      int world_iam;
-      check_mpi_init = false;
-      ret = MPI_Comm_rank (MPI_COMM_WORLD, &world_iam);
-      sprintf (outfile, "procsiz.%6.6d", world_iam);
-      fp_procsiz = fopen (outfile, "w");
-    }
-  }
-#endif
+  // Throttle only when the timer is off: no call of it can be outstanding on the callstack
+  if (throttle_calls > 0 && wallstats.enabled && ptr->count >= throttle_calls &&
+      ptr->wall.accum < throttle_sec * ptr->count)
+    ptr->throttled = true;
 }
+#endif // _AIX false branch
 
 #ifdef HAVE_NANOTIME
 // Copied from PAPI library
@@ -3212,8 +4311,229 @@ static void printself_andchildren (const Timer *ptr, FILE *fp, int t, int depth,
   if (depth > -1)     // -1 flag is to avoid printing stats for dummy outer timer
     printstats (ptr, fp, t, depth, true, self_ohd, parent_ohd, outputfmt);
 
-  for (n = 0; n < ptr->nchildren; n++)
-    printself_andchildren (ptr->children[n], fp, t, depth+1, self_ohd, parent_ohd, outputfmt);
+  for (n = 0; n < ptr->nchildren; n++) {
+    if (collapse_indexed && ptr->children[n]->base)
+      print_collapsed (ptr, n, fp, t, depth+1, self_ohd, parent_ohd, outputfmt);
+    else
+      printself_andchildren (ptr->children[n], fp, t, depth+1, self_ohd, parent_ohd, outputfmt);
+  }
+}
+
+/*
+** print_collapsed: Print all GPTLstart_indexed variants of one base among the children of
+**                  parent as a single name[*] row, followed by the union of their children.
+**                  Does nothing unless child n is the first such variant, so that each base
+**                  is printed once per parent. If the union cannot be built the variants are
+**                  printed one by one instead.
+**
+** Input arguments:
+**   parent: timer whose children are being printed
+**   n:      index of the variant in parent->children
+**   fp, t, depth, self_ohd, parent_ohd, outputfmt: as for printself_andchildren
+*/
+static void print_collapsed (const Timer *parent, int n, FILE *fp, int t, int depth,
+			     double self_ohd, double parent_ohd, Outputfmt outputfmt)
+{
+  const Timer *base = parent->children[n]->base;
+  const Timer *variant;
+  Timer sumstats;    // sum over variants, and union of their children
+  int nn, c;
+  static const char *thisfunc = "print_collapsed";
+
+  for (nn = 0; nn < n; ++nn)
+    if (parent->children[nn]->base == base)
+      return;
+
+  memset (&sumstats, 0, sizeof (Timer));
+  snprintf (sumstats.name, sizeof (sumstats.name), "%.*s[*]", MAX_CHARS-3, base->name);
+  sumstats.wall.max = parent->children[n]->wall.max;
+  sumstats.wall.min = parent->children[n]->wall.min;
+  for (nn = n; nn < parent->nchildren; ++nn) {
+    variant = parent->children[nn];
+    if (variant->base != base)
+      continue;
+    add (&sumstats, variant);
+    sumstats.nrecurse += variant->nrecurse;
+    sumstats.onflg = sumstats.onflg || variant->onflg;
+    sumstats.nparent = MAX (sumstats.nparent, variant->nparent);
+    for (c = 0; c < variant->nchildren; ++c) {
+      if (newchild (&sumstats, variant->children[c]) != 0) {
+	GPTLwarn ("%s: cannot collapse variants of %s: printing them separately\n",
+		  thisfunc, base->name);
+	free (sumstats.children);
+	for (nn = n; nn < parent->nchildren; ++nn)
+	  if (parent->children[nn]->base == base)
+	    printself_andchildren (parent->children[nn], fp, t, depth, self_ohd, parent_ohd,
+				   outputfmt);
+	return;
+      }
+    }
+  }
+  printself_andchildren (&sumstats, fp, t, depth, self_ohd, parent_ohd, outputfmt);
+  free (sumstats.children);
+}
+
+/*
+** print_hotspots: Print the timers with the most self (exclusive) time, summed over threads,
+**                 with their share of the total self time of all timers. The total is the
+**                 instrumented time, since every second is self time of exactly one timer.
+**
+** Input arguments:
+**   fp: output stream
+*/
+static void print_hotspots (FILE *fp)
+{
+  Timer *ptr;
+  Hotspot *spots;
+  int t;
+  int n, nn;
+  int nspots = 0;
+  int width;
+  double total = 0.;
+  double cum = 0.;
+  static const char *thisfunc = "print_hotspots";
+
+  for (t = 0; t < GPTLnthreads; ++t)
+    for (ptr = timers[t]->next; ptr; ptr = ptr->next)
+      ++nspots;
+  if (nspots == 0)
+    return;
+
+  spots = (Hotspot *) GPTLallocate (nspots * sizeof (Hotspot), thisfunc);
+  nspots = 0;
+  for (t = 0; t < GPTLnthreads; ++t) {
+    for (ptr = timers[t]->next; ptr; ptr = ptr->next) {
+      if (ptr->count == 0)
+	continue;
+      spots[nspots].name  = ptr->longname ? ptr->longname : ptr->name;
+      spots[nspots].count = ptr->count;
+      spots[nspots].self  = MAX (0., ptr->wall.accum - ptr->wall.child);
+      spots[nspots].incl  = ptr->wall.accum;
+      ++nspots;
+    }
+  }
+
+  // Merge the entries for each name, then rank by self time
+  qsort (spots, nspots, sizeof (Hotspot), cmp_hotspot_name);
+  for (n = 0, nn = 0; n < nspots; ++n) {
+    if (nn > 0 && STRMATCH (spots[n].name, spots[nn-1].name)) {
+      spots[nn-1].count += spots[n].count;
+      spots[nn-1].self  += spots[n].self;
+      spots[nn-1].incl  += spots[n].incl;
+    } else {
+      spots[nn++] = spots[n];
+    }
+  }
+  nspots = nn;
+  qsort (spots, nspots, sizeof (Hotspot), cmp_hotspot_self);
+
+  width = strlen ("Timer");
+  for (n = 0; n < nspots; ++n) {
+    total += spots[n].self;
+    if (n < hotspot_rows)
+      width = MAX (width, (int) strlen (spots[n].name));
+  }
+
+  fprintf (fp, "\nHotspots: timers with the most self time (Wall minus time in child timers)");
+  if (GPTLnthreads > 1)
+    fprintf (fp, ", summed over threads");
+  fprintf (fp, "\n%-*s %10s %12s %12s %7s %7s\n", width, "Timer", "Called", "Self", "Wall",
+	   "%Self", "Cum%");
+  for (n = 0; n < MIN (nspots, hotspot_rows); ++n) {
+    cum += spots[n].self;
+    if (spots[n].count < PRTHRESH)
+      fprintf (fp, "%-*s %10lu", width, spots[n].name, spots[n].count);
+    else
+      fprintf (fp, "%-*s %10.3e", width, spots[n].name, (float) spots[n].count);
+    fprintf (fp, " %12.3e %12.3e %7.2f %7.2f\n", spots[n].self, spots[n].incl,
+	     total > 0. ? 100. * spots[n].self / total : 0.,
+	     total > 0. ? 100. * cum / total : 0.);
+  }
+  if (nspots > hotspot_rows)
+    fprintf (fp, "(%d more timers not shown: see GPTLhotspot_rows)\n", nspots - hotspot_rows);
+
+  free (spots);
+}
+
+// count_excluded: Number of functions excluded by GPTL_FILTER, summed over threads
+static int count_excluded (void)
+{
+  int t;
+  unsigned int n;
+  int nexcluded = 0;
+
+  for (t = 0; t < GPTLnthreads; ++t)
+    for (n = 0; n < addrmap[t].size; ++n)
+      if (addrmap[t].slots[n].address && addrmap[t].slots[n].ptr->excluded)
+	++nexcluded;
+  return nexcluded;
+}
+
+/*
+** print_throttled: Print the auto-profiled timers which stopped being timed, with the
+**                  overhead saved by not timing the remaining calls
+**
+** Input arguments:
+**   fp:       output stream
+**   call_ohd: estimated cost of one timed start/stop pair (self_OH + parent_OH)
+*/
+static void print_throttled (FILE *fp, double call_ohd)
+{
+  Timer *ptr;
+  int t;
+  int width = strlen ("Timer");
+  bool found = false;
+  unsigned long nsaved = 0;
+
+  for (t = 0; t < GPTLnthreads; ++t) {
+    for (ptr = timers[t]->next; ptr; ptr = ptr->next) {
+      if (ptr->throttled) {
+	found = true;
+	width = MAX (width, (int) strlen (ptr->longname ? ptr->longname : ptr->name));
+      }
+    }
+  }
+  if ( ! found)
+    return;
+
+  fprintf (fp, "\nThrottled: auto-profiled timers averaging under %.3g usec after %lu calls.\n"
+	   "Later calls were counted as Untimed, and their time went to the caller.\n"
+	   "Est_OH_saved is Untimed times the overhead of one timed call (%.3g sec)\n",
+	   throttle_sec * 1.e6, throttle_calls, call_ohd);
+  fprintf (fp, "Thd %-*s %10s %12s %10s %12s\n", width, "Timer", "Timed", "Untimed",
+	   "Mean_usec", "Est_OH_saved");
+  for (t = 0; t < GPTLnthreads; ++t) {
+    for (ptr = timers[t]->next; ptr; ptr = ptr->next) {
+      if ( ! ptr->throttled)
+	continue;
+      fprintf (fp, "%3.3d %-*s %10lu %12lu %10.3g %12.3e\n", t, width,
+	       ptr->longname ? ptr->longname : ptr->name, ptr->count, ptr->nthrottled,
+	       ptr->count > 0 ? 1.e6 * ptr->wall.accum / ptr->count : 0.,
+	       ptr->nthrottled * call_ohd);
+      nsaved += ptr->nthrottled;
+    }
+  }
+  fprintf (fp, "Total untimed calls = %lu, est. overhead saved = %9.3g seconds\n",
+	   nsaved, nsaved * call_ohd);
+}
+
+static int cmp_hotspot_name (const void *a, const void *b)
+{
+  return strcmp (((const Hotspot *) a)->name, ((const Hotspot *) b)->name);
+}
+
+// Sort by descending self time
+static int cmp_hotspot_self (const void *a, const void *b)
+{
+  double diff = ((const Hotspot *) b)->self - ((const Hotspot *) a)->self;
+
+  return (diff > 0.) - (diff < 0.);
+}
+
+// is_unused_base: True for a timer created only to hold GPTLstart_indexed variants
+static inline bool is_unused_base (const Timer *ptr)
+{
+  return ptr->nvariants > 0 && ptr->count == 0 && ! ptr->onflg;
 }
 
 static void print_callstack (int t, const char *caller)
@@ -3229,6 +4549,56 @@ static void print_callstack (int t, const char *caller)
 // GPTLget_timersaddr: Return address of timers. NOT a public entry point
 Timer **GPTLget_timersaddr () {return timers;}
 
+// GPTLread_utr: Return current value of the underlying timing routine. NOT a public entry point
+double GPTLread_utr () {return (*ptr2wtimefunc) ();}
+
+#ifdef HAVE_INTERPOSE
+/*
+** GPTLcurrent_region: called ONLY from the interposition layers allocprof.c, ioprof.c and
+**                     lockprof.c (i.e. not a public entry point).
+**                     Returns the innermost active timer of the calling thread
+**
+** Return value: 0 (NULL) if allocations are not currently being attributed, or the caller is
+**               not a thread known to GPTL, else the timer
+*/
+Timer *GPTLcurrent_region (void)
+{
+  int t;
+  int idx;
+
+  if ( ! interpose_on || disabled || interpose_paused)
+    return 0;
+
+  // Interposed calls come from threads which may never call GPTL: look up, never register
+  if ((t = GPTLknown_thread_num ()) < 0)
+    return 0;
+#if ! ( defined UNDERLYING_PTHREADS || defined ENABLE_NESTEDOMP )
+  // Thread 0 of an OpenMP team is the thread which called GPTLinitialize unless the
+  // application starts parallel regions from other threads, which GPTL does not support
+  if (t == 0 && ! init_thread)
+    return 0;
+#endif
+
+  idx = stackidx[t].val;
+  if (idx < 0 || idx >= MAX_STACK)
+    return 0;
+  return callstack[t][idx];
+}
+
+// GPTLinterpose_pause, GPTLinterpose_resume: Stop and restart charging interposed calls made
+// by the calling thread. Used while GPTL writes its own reports, and by GPTL's helper threads
+// (which are not known to the thread layer). Calls nest.
+void GPTLinterpose_pause (void)
+{
+  ++interpose_paused;
+}
+
+void GPTLinterpose_resume (void)
+{
+  --interpose_paused;
+}
+#endif
+
 #ifdef ENABLE_PMPI
 /*
 ** GPTLgetentry: called ONLY from pmpi.c (i.e. not a public entry point). Returns a pointer to the 
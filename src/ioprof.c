@@ -0,0 +1,480 @@
+/*
+** ioprof.c
+**
+** Author: Jim Rosinski
+**
+** Intercept POSIX and stdio I/O routines to time them and count bytes transferred. Like the
+** PMPI wrappers in pmpi.c, each call is timed under a pseudo-timer named after the routine
+** (e.g. "IO_write"), which appears as a child of whatever region was active. In addition
+** time, bytes and a log2 histogram of transfer sizes are accumulated both for that region
+** and for the pseudo-timer. The real routines are found with dlsym (RTLD_NEXT, ...).
+** Programs built with -D_FILE_OFFSET_BITS=64 call the *64 variants (open64, pread64, ...),
+** which are wrapped too.
+*/
+
+#undef _FORTIFY_SOURCE   // fortify inlines of read etc. would clash with the wrappers
+#include "config.h"      // Must be first include.
+#include "private.h"
+#include "gptl.h"
+
+#include <stdio.h>
+#include <stdarg.h>      // open has a variable argument list
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dlfcn.h>       // dlsym
+#include <sys/types.h>
+#include <sys/uio.h>     // readv, writev
+#include <sys/mman.h>    // mmap
+
+static int     (*real_open)   (const char *, int, ...) = 0;
+static int     (*real_close)  (int) = 0;
+static ssize_t (*real_read)   (int, void *, size_t) = 0;
+static ssize_t (*real_write)  (int, const void *, size_t) = 0;
+static ssize_t (*real_pread)  (int, void *, size_t, off_t) = 0;
+static ssize_t (*real_pwrite) (int, const void *, size_t, off_t) = 0;
+static ssize_t (*real_readv)  (int, const struct iovec *, int) = 0;
+static ssize_t (*real_writev) (int, const struct iovec *, int) = 0;
+static int     (*real_fsync)  (int) = 0;
+static void   *(*real_mmap)   (void *, size_t, int, int, int, off_t) = 0;
+static off_t   (*real_lseek)  (int, off_t, int) = 0;
+static int     (*real_open64)   (const char *, int, ...) = 0;
+static ssize_t (*real_pread64)  (int, void *, size_t, off64_t) = 0;
+static ssize_t (*real_pwrite64) (int, const void *, size_t, off64_t) = 0;
+static void   *(*real_mmap64)   (void *, size_t, int, int, int, off64_t) = 0;
+static off64_t (*real_lseek64)  (int, off64_t, int) = 0;
+static size_t  (*real_fread)  (void *, size_t, size_t, FILE *) = 0;
+static size_t  (*real_fwrite) (const void *, size_t, size_t, FILE *) = 0;
+
+// Set while this thread is inside a wrapper, so I/O done by GPTL itself passes straight
+// through. initial-exec avoids TLS setup which could itself do I/O or call malloc.
+static __thread int inside __attribute__ ((tls_model ("initial-exec"))) = 0;
+
+// Look up the real routine the first time a wrapper is called. Concurrent first calls
+// store the same value so no locking is needed.
+#define RESOLVE(fn) \
+  if ( ! real_##fn) \
+    *(void **) (&real_##fn) = dlsym (RTLD_NEXT, #fn)
+
+// The mode argument of open is present only when a file may be created. O_TMPFILE includes
+// the bits of O_DIRECTORY, so all of them must be set (as glibc tests it)
+#ifdef O_TMPFILE
+#define HAS_MODE(flags) (((flags) & O_CREAT) || ((flags) & O_TMPFILE) == O_TMPFILE)
+#else
+#define HAS_MODE(flags) ((flags) & O_CREAT)
+#endif
+
+// begin: If this call is to be recorded, start pseudo-timer "name" and return the region it
+// was called from. *iotimer is set to the pseudo-timer, or 0 if it was not started.
+static inline Timer *begin (const char *name, Timer **iotimer)
+{
+  Timer *region;
+
+  if (inside)
+    return 0;
+
+  inside = 1;
+  if ( ! (region = GPTLcurrent_region ()) || GPTLstart (name) != 0) {
+    inside = 0;
+    return 0;
+  }
+
+  // GPTLstart does nothing beyond the depth limit
+  if ((*iotimer = GPTLcurrent_region ()) == region)
+    *iotimer = 0;
+  return region;
+}
+
+// charge: Add one call of duration dt transferring nbytes (negative means not a transfer)
+static inline void charge (Timer *ptr, double dt, double nbytes)
+{
+  int bin;
+
+  ++ptr->io.ncalls;
+  ptr->io.time += dt;
+  if (nbytes > 0.) {
+    ptr->io.bytes += nbytes;
+    for (bin = 0; bin < NIOBINS-1 && nbytes >= 2.; ++bin)
+      nbytes *= 0.5;
+    ++ptr->io.hist[bin];
+  }
+}
+
+// end: Stop pseudo-timer "name" and charge the call which started at t0. errno from the
+// real routine is preserved.
+static inline void end (const char *name, Timer *region, Timer *iotimer, double t0,
+			double nbytes)
+{
+  int saverr = errno;
+  double dt = GPTLread_utr () - t0;
+
+  (void) GPTLstop (name);
+  charge (region, dt, nbytes);
+  if (iotimer)
+    charge (iotimer, dt, nbytes);
+  inside = 0;
+  errno = saverr;
+}
+
+int open (const char *path, int flags, ...)
+{
+  int ret;
+  mode_t mode = 0;
+  double t0;
+  Timer *region, *iotimer;
+  va_list ap;
+  static const char *name = "IO_open";
+
+  if (HAS_MODE (flags)) {
+    va_start (ap, flags);
+    mode = (mode_t) va_arg (ap, int);
+    va_end (ap);
+  }
+
+  RESOLVE (open);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_open (path, flags, mode);
+
+  t0 = GPTLread_utr ();
+  ret = real_open (path, flags, mode);
+  end (name, region, iotimer, t0, -1.);
+  return ret;
+}
+
+int open64 (const char *path, int flags, ...)
+{
+  int ret;
+  mode_t mode = 0;
+  double t0;
+  Timer *region, *iotimer;
+  va_list ap;
+  static const char *name = "IO_open64";
+
+  if (HAS_MODE (flags)) {
+    va_start (ap, flags);
+    mode = (mode_t) va_arg (ap, int);
+    va_end (ap);
+  }
+
+  RESOLVE (open64);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_open64 (path, flags, mode);
+
+  t0 = GPTLread_utr ();
+  ret = real_open64 (path, flags, mode);
+  end (name, region, iotimer, t0, -1.);
+  return ret;
+}
+
+int close (int fd)
+{
+  int ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_close";
+
+  RESOLVE (close);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_close (fd);
+
+  t0 = GPTLread_utr ();
+  ret = real_close (fd);
+  end (name, region, iotimer, t0, -1.);
+  return ret;
+}
+
+ssize_t read (int fd, void *buf, size_t count)
+{
+  ssize_t ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_read";
+
+  RESOLVE (read);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_read (fd, buf, count);
+
+  t0 = GPTLread_utr ();
+  ret = real_read (fd, buf, count);
+  end (name, region, iotimer, t0, (double) MAX (ret, 0));
+  return ret;
+}
+
+ssize_t write (int fd, const void *buf, size_t count)
+{
+  ssize_t ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_write";
+
+  RESOLVE (write);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_write (fd, buf, count);
+
+  t0 = GPTLread_utr ();
+  ret = real_write (fd, buf, count);
+  end (name, region, iotimer, t0, (double) MAX (ret, 0));
+  return ret;
+}
+
+ssize_t pread (int fd, void *buf, size_t count, off_t offset)
+{
+  ssize_t ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_pread";
+
+  RESOLVE (pread);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_pread (fd, buf, count, offset);
+
+  t0 = GPTLread_utr ();
+  ret = real_pread (fd, buf, count, offset);
+  end (name, region, iotimer, t0, (double) MAX (ret, 0));
+  return ret;
+}
+
+ssize_t pwrite (int fd, const void *buf, size_t count, off_t offset)
+{
+  ssize_t ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_pwrite";
+
+  RESOLVE (pwrite);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_pwrite (fd, buf, count, offset);
+
+  t0 = GPTLread_utr ();
+  ret = real_pwrite (fd, buf, count, offset);
+  end (name, region, iotimer, t0, (double) MAX (ret, 0));
+  return ret;
+}
+
+ssize_t pread64 (int fd, void *buf, size_t count, off64_t offset)
+{
+  ssize_t ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_pread64";
+
+  RESOLVE (pread64);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_pread64 (fd, buf, count, offset);
+
+  t0 = GPTLread_utr ();
+  ret = real_pread64 (fd, buf, count, offset);
+  end (name, region, iotimer, t0, (double) MAX (ret, 0));
+  return ret;
+}
+
+ssize_t pwrite64 (int fd, const void *buf, size_t count, off64_t offset)
+{
+  ssize_t ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_pwrite64";
+
+  RESOLVE (pwrite64);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_pwrite64 (fd, buf, count, offset);
+
+  t0 = GPTLread_utr ();
+  ret = real_pwrite64 (fd, buf, count, offset);
+  end (name, region, iotimer, t0, (double) MAX (ret, 0));
+  return ret;
+}
+
+ssize_t readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  ssize_t ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_readv";
+
+  RESOLVE (readv);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_readv (fd, iov, iovcnt);
+
+  t0 = GPTLread_utr ();
+  ret = real_readv (fd, iov, iovcnt);
+  end (name, region, iotimer, t0, (double) MAX (ret, 0));
+  return ret;
+}
+
+ssize_t writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  ssize_t ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_writev";
+
+  RESOLVE (writev);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_writev (fd, iov, iovcnt);
+
+  t0 = GPTLread_utr ();
+  ret = real_writev (fd, iov, iovcnt);
+  end (name, region, iotimer, t0, (double) MAX (ret, 0));
+  return ret;
+}
+
+int fsync (int fd)
+{
+  int ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_fsync";
+
+  RESOLVE (fsync);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_fsync (fd);
+
+  t0 = GPTLread_utr ();
+  ret = real_fsync (fd);
+  end (name, region, iotimer, t0, -1.);
+  return ret;
+}
+
+// mmap moves no data itself. Its length is recorded as bytes so that the histogram shows
+// the mapping sizes, but MB/s for IO_mmap is not a transfer rate.
+void *mmap (void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+  void *ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_mmap";
+
+  RESOLVE (mmap);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_mmap (addr, length, prot, flags, fd, offset);
+
+  t0 = GPTLread_utr ();
+  ret = real_mmap (addr, length, prot, flags, fd, offset);
+  end (name, region, iotimer, t0, (ret == MAP_FAILED) ? 0. : (double) length);
+  return ret;
+}
+
+void *mmap64 (void *addr, size_t length, int prot, int flags, int fd, off64_t offset)
+{
+  void *ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_mmap64";
+
+  RESOLVE (mmap64);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_mmap64 (addr, length, prot, flags, fd, offset);
+
+  t0 = GPTLread_utr ();
+  ret = real_mmap64 (addr, length, prot, flags, fd, offset);
+  end (name, region, iotimer, t0, (ret == MAP_FAILED) ? 0. : (double) length);
+  return ret;
+}
+
+off_t lseek (int fd, off_t offset, int whence)
+{
+  off_t ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_lseek";
+
+  RESOLVE (lseek);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_lseek (fd, offset, whence);
+
+  t0 = GPTLread_utr ();
+  ret = real_lseek (fd, offset, whence);
+  end (name, region, iotimer, t0, -1.);
+  return ret;
+}
+
+off64_t lseek64 (int fd, off64_t offset, int whence)
+{
+  off64_t ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_lseek64";
+
+  RESOLVE (lseek64);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_lseek64 (fd, offset, whence);
+
+  t0 = GPTLread_utr ();
+  ret = real_lseek64 (fd, offset, whence);
+  end (name, region, iotimer, t0, -1.);
+  return ret;
+}
+
+size_t fread (void *ptr, size_t size, size_t nmemb, FILE *stream)
+{
+  size_t ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_fread";
+
+  RESOLVE (fread);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_fread (ptr, size, nmemb, stream);
+
+  t0 = GPTLread_utr ();
+  ret = real_fread (ptr, size, nmemb, stream);
+  end (name, region, iotimer, t0, (double) ret * size);
+  return ret;
+}
+
+size_t fwrite (const void *ptr, size_t size, size_t nmemb, FILE *stream)
+{
+  size_t ret;
+  double t0;
+  Timer *region, *iotimer;
+  static const char *name = "IO_fwrite";
+
+  RESOLVE (fwrite);
+  if ( ! (region = begin (name, &iotimer)))
+    return real_fwrite (ptr, size, nmemb, stream);
+
+  t0 = GPTLread_utr ();
+  ret = real_fwrite (ptr, size, nmemb, stream);
+  end (name, region, iotimer, t0, (double) ret * size);
+  return ret;
+}
+
+/*
+** GPTLprint_iohist: Print the I/O transfer size histogram of each timer which did I/O
+**
+** Input arguments:
+**   fp:     output stream
+**   timers: per-thread linked lists of timers
+*/
+void GPTLprint_iohist (FILE *fp, Timer **timers, int nthreads)
+{
+  int t;
+  int bin;
+  bool found;
+  Timer *ptr;
+  char label[8];
+  static const char *suffix[] = {"", "K", "M", "G"};
+
+  for (t = 0; t < nthreads; ++t) {
+    found = false;
+    for (ptr = timers[t]->next; ptr; ptr = ptr->next) {
+      if (ptr->io.bytes == 0.)
+	continue;
+      if ( ! found) {
+	fprintf (fp, "\nI/O transfer size histogram for thread %d:\n", t);
+	fprintf (fp, "Entries are <lower bound in bytes>:<number of calls>. Bins are powers "
+		 "of 2\n");
+	found = true;
+      }
+      fprintf (fp, "%s", ptr->name);
+      for (bin = 0; bin < NIOBINS; ++bin) {
+	if (ptr->io.hist[bin] > 0) {
+	  snprintf (label, sizeof (label), "%d%s", 1 << (bin % 10), suffix[bin / 10]);
+	  fprintf (fp, " %s:%lu", label, ptr->io.hist[bin]);
+	}
+      }
+      fprintf (fp, "\n");
+    }
+  }
+}
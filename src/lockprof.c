@@ -0,0 +1,562 @@
+/*
+** lockprof.c
+**
+** Author: Jim Rosinski
+**
+** Intercept pthread mutex, rwlock, condition variable and spin lock routines to measure lock
+** contention. Each acquire is first attempted with the corresponding trylock routine: only if
+** that fails is the acquire counted as contended and the time spent waiting measured, so
+** uncontended locks cost little more than a table lookup. Hold time is measured from the
+** acquire to the matching unlock by the same thread.
+**
+** Stats are kept in a global open-addressing table keyed by (lock address, active region).
+** Slots are claimed with an atomic compare-and-swap. Since timers are per-thread, each slot
+** is only ever updated by one thread and its counters need no locking. Wait time and
+** contention counts are also charged to the region itself for the printstats columns.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+#include "gptl.h"
+
+#include <stdio.h>
+#include <stdlib.h>      // qsort
+#include <stdint.h>      // uintptr_t
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dlfcn.h>
+
+#define TABLESIZE 4096   // lock table slots: must be a power of 2
+#define MAXHELD 32       // max locks held at once by a thread for which hold time is measured
+#define MAXPRINT 20      // number of locks printed in the contention section
+
+typedef enum {KIND_MUTEX = 0, KIND_RWLOCK = 1, KIND_COND = 2, KIND_SPIN = 3} Lockkind;
+static const char *kindstr[] = {"mutex", "rwlock", "cond", "spin"};
+
+typedef struct {
+  volatile int state;       // 0=empty, 1=being claimed, 2=in use
+  const void *addr;         // lock address
+  Timer *region;            // region active when the lock was acquired
+  Lockkind kind;            // type of lock
+  unsigned long nacquire;   // number of acquires (or waits for a condition variable)
+  unsigned long ncontend;   // number of acquires which had to wait
+  double wait;              // total time waiting to acquire
+  double hold;              // total time held
+} Lockentry;
+
+typedef struct {
+  const void *addr;         // lock address
+  Lockentry *entry;         // table slot which will be charged the hold time
+  double tacquire;          // time the lock was acquired
+  unsigned int generation;  // entry is stale unless this matches generation
+} Held;
+
+static Lockentry table[TABLESIZE];
+static volatile int nentries = 0;   // number of slots in use
+static bool tablefull = false;      // table overflowed: some locks not recorded
+static volatile unsigned int maxprobe = 0;   // longest probe sequence of a claimed slot
+static volatile unsigned int generation = 0; // bumped when the table is cleared
+
+// Locks currently held by this thread, innermost last
+static __thread Held held[MAXHELD] __attribute__ ((tls_model ("initial-exec")));
+static __thread int nheld __attribute__ ((tls_model ("initial-exec"))) = 0;
+
+// Set while this thread is inside a wrapper, so locks taken by GPTL itself pass straight
+// through. initial-exec avoids TLS setup which could itself take a lock.
+static __thread int inside __attribute__ ((tls_model ("initial-exec"))) = 0;
+
+static int (*real_mutex_lock)     (pthread_mutex_t *) = 0;
+static int (*real_mutex_trylock)  (pthread_mutex_t *) = 0;
+static int (*real_mutex_unlock)   (pthread_mutex_t *) = 0;
+static int (*real_rwlock_rdlock)  (pthread_rwlock_t *) = 0;
+static int (*real_rwlock_wrlock)  (pthread_rwlock_t *) = 0;
+static int (*real_rwlock_tryrdlock) (pthread_rwlock_t *) = 0;
+static int (*real_rwlock_trywrlock) (pthread_rwlock_t *) = 0;
+static int (*real_rwlock_unlock)  (pthread_rwlock_t *) = 0;
+static int (*real_cond_wait)      (pthread_cond_t *, pthread_mutex_t *) = 0;
+static int (*real_cond_timedwait) (pthread_cond_t *, pthread_mutex_t *,
+				   const struct timespec *) = 0;
+static int (*real_spin_lock)      (pthread_spinlock_t *) = 0;
+static int (*real_spin_trylock)   (pthread_spinlock_t *) = 0;
+static int (*real_spin_unlock)    (pthread_spinlock_t *) = 0;
+
+// Look up the real routine the first time a wrapper is called. Concurrent first calls
+// store the same value so no locking is needed.
+#define RESOLVE(fn) \
+  if ( ! real_##fn) \
+    *(void **) (&real_##fn) = dlsym (RTLD_NEXT, "pthread_" #fn)
+
+// glibc keeps an old pthread_cond_* ABI which plain dlsym may return: ask for the current one
+#define RESOLVE_COND(fn) \
+  if ( ! real_##fn) { \
+    *(void **) (&real_##fn) = dlvsym (RTLD_NEXT, "pthread_" #fn, "GLIBC_2.3.2"); \
+    if ( ! real_##fn) \
+      *(void **) (&real_##fn) = dlsym (RTLD_NEXT, "pthread_" #fn); \
+  }
+
+// getentry: Find or claim the table slot for (addr, region). Returns 0 if the table is full.
+// A slot keyed by region is only claimed by the thread owning region, so once the table is
+// full no slot of this thread lies further than maxprobe from its hash index.
+static Lockentry *getentry (const void *addr, Timer *region, Lockkind kind)
+{
+  unsigned int idx;
+  unsigned int n;
+  unsigned int probe;
+  uintptr_t key;
+  Lockentry *entry;
+
+  key = (uintptr_t) addr ^ ((uintptr_t) region >> 4);
+  idx = (unsigned int) ((key * 0x9E3779B97F4A7C15ULL) >> 40) & (TABLESIZE - 1);
+
+  for (n = 0; n < TABLESIZE; ++n) {
+    if (tablefull && n > maxprobe)
+      break;
+    entry = &table[(idx + n) & (TABLESIZE - 1)];
+    if (__atomic_load_n (&entry->state, __ATOMIC_ACQUIRE) == 0) {
+      int expected = 0;
+      if (__atomic_compare_exchange_n (&entry->state, &expected, 1, false,
+				       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+	entry->addr   = addr;
+	entry->region = region;
+	entry->kind   = kind;
+	probe = __atomic_load_n (&maxprobe, __ATOMIC_RELAXED);
+	while (n > probe && ! __atomic_compare_exchange_n (&maxprobe, &probe, n, false,
+							     __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	__atomic_store_n (&entry->state, 2, __ATOMIC_RELEASE);
+	__atomic_fetch_add (&nentries, 1, __ATOMIC_RELAXED);
+	return entry;
+      }
+    }
+    // Another thread may be filling in this slot right now
+    while (__atomic_load_n (&entry->state, __ATOMIC_ACQUIRE) == 1);
+    if (entry->addr == addr && entry->region == region)
+      return entry;
+  }
+  tablefull = true;
+  return 0;
+}
+
+// begin: Return the slot to charge for this call, or 0 if it is not to be recorded
+static inline Lockentry *begin (const void *addr, Lockkind kind, Timer **region)
+{
+  Lockentry *entry;
+
+  if (inside)
+    return 0;
+
+  inside = 1;
+  if ( ! (*region = GPTLcurrent_region ()) || ! (entry = getentry (addr, *region, kind))) {
+    inside = 0;
+    return 0;
+  }
+  return entry;
+}
+
+// acquired: Record a successful acquire which waited from t0 (negative: did not wait)
+static inline void acquired (Lockentry *entry, Timer *region, const void *addr, double t0)
+{
+  double now = GPTLread_utr ();
+
+  ++entry->nacquire;
+  if (t0 >= 0.) {
+    ++entry->ncontend;
+    entry->wait += now - t0;
+    ++region->lock.ncontend;
+    region->lock.wait += now - t0;
+  }
+  if (nheld < MAXHELD) {
+    held[nheld].addr       = addr;
+    held[nheld].entry      = entry;
+    held[nheld].tacquire   = now;
+    held[nheld].generation = generation;
+    ++nheld;
+  }
+}
+
+// released: Charge hold time for addr, which the calling thread is about to release. Slots
+// from before the table was last cleared may since have been reused, so are not charged.
+static inline void released (const void *addr)
+{
+  int n;
+
+  for (n = nheld - 1; n >= 0; --n) {
+    if (held[n].addr == addr) {
+      if (held[n].generation == generation)
+	held[n].entry->hold += GPTLread_utr () - held[n].tacquire;
+      held[n] = held[--nheld];
+      return;
+    }
+  }
+}
+
+int pthread_mutex_lock (pthread_mutex_t *mutex)
+{
+  int ret;
+  double t0 = -1.;
+  Timer *region;
+  Lockentry *entry;
+
+  RESOLVE (mutex_lock);
+  RESOLVE (mutex_trylock);
+  if ( ! (entry = begin (mutex, KIND_MUTEX, &region)))
+    return real_mutex_lock (mutex);
+
+  // Other errors are returned as they are. EOWNERDEAD (robust mutex) means it was acquired
+  if ((ret = real_mutex_trylock (mutex)) == EBUSY) {
+    t0 = GPTLread_utr ();
+    ret = real_mutex_lock (mutex);
+  }
+  if (ret == 0 || ret == EOWNERDEAD)
+    acquired (entry, region, mutex, t0);
+  inside = 0;
+  return ret;
+}
+
+int pthread_mutex_trylock (pthread_mutex_t *mutex)
+{
+  int ret;
+  Timer *region;
+  Lockentry *entry;
+
+  RESOLVE (mutex_trylock);
+  if ( ! (entry = begin (mutex, KIND_MUTEX, &region)))
+    return real_mutex_trylock (mutex);
+
+  if ((ret = real_mutex_trylock (mutex)) == 0 || ret == EOWNERDEAD)
+    acquired (entry, region, mutex, -1.);
+  else if (ret == EBUSY)
+    ++entry->ncontend;
+  inside = 0;
+  return ret;
+}
+
+int pthread_mutex_unlock (pthread_mutex_t *mutex)
+{
+  RESOLVE (mutex_unlock);
+  if ( ! inside && nheld > 0)
+    released (mutex);
+  return real_mutex_unlock (mutex);
+}
+
+// rwlock_acquire: Shared body of the read and write lock wrappers
+static int rwlock_acquire (pthread_rwlock_t *rwlock, int (*lock) (pthread_rwlock_t *),
+			   int (*trylock) (pthread_rwlock_t *))
+{
+  int ret;
+  double t0 = -1.;
+  Timer *region;
+  Lockentry *entry;
+
+  if ( ! (entry = begin (rwlock, KIND_RWLOCK, &region)))
+    return lock (rwlock);
+
+  if ((ret = trylock (rwlock)) == EBUSY) {
+    t0 = GPTLread_utr ();
+    ret = lock (rwlock);
+  }
+  if (ret == 0)
+    acquired (entry, region, rwlock, t0);
+  inside = 0;
+  return ret;
+}
+
+int pthread_rwlock_rdlock (pthread_rwlock_t *rwlock)
+{
+  RESOLVE (rwlock_rdlock);
+  RESOLVE (rwlock_tryrdlock);
+  return rwlock_acquire (rwlock, real_rwlock_rdlock, real_rwlock_tryrdlock);
+}
+
+int pthread_rwlock_wrlock (pthread_rwlock_t *rwlock)
+{
+  RESOLVE (rwlock_wrlock);
+  RESOLVE (rwlock_trywrlock);
+  return rwlock_acquire (rwlock, real_rwlock_wrlock, real_rwlock_trywrlock);
+}
+
+// rwlock_try: Shared body of the read and write trylock wrappers
+static int rwlock_try (pthread_rwlock_t *rwlock, int (*trylock) (pthread_rwlock_t *))
+{
+  int ret;
+  Timer *region;
+  Lockentry *entry;
+
+  if ( ! (entry = begin (rwlock, KIND_RWLOCK, &region)))
+    return trylock (rwlock);
+
+  if ((ret = trylock (rwlock)) == 0)
+    acquired (entry, region, rwlock, -1.);
+  else if (ret == EBUSY)
+    ++entry->ncontend;
+  inside = 0;
+  return ret;
+}
+
+int pthread_rwlock_tryrdlock (pthread_rwlock_t *rwlock)
+{
+  RESOLVE (rwlock_tryrdlock);
+  return rwlock_try (rwlock, real_rwlock_tryrdlock);
+}
+
+int pthread_rwlock_trywrlock (pthread_rwlock_t *rwlock)
+{
+  RESOLVE (rwlock_trywrlock);
+  return rwlock_try (rwlock, real_rwlock_trywrlock);
+}
+
+int pthread_rwlock_unlock (pthread_rwlock_t *rwlock)
+{
+  RESOLVE (rwlock_unlock);
+  if ( ! inside && nheld > 0)
+    released (rwlock);
+  return real_rwlock_unlock (rwlock);
+}
+
+// cond_wait: Shared body of the condition variable wrappers. The mutex is released for the
+// duration of the wait, so its hold time stops and restarts. All time in the wait is charged
+// to the condition variable, and counted as contended.
+static int cond_wait (pthread_cond_t *cond, pthread_mutex_t *mutex,
+		      const struct timespec *abstime)
+{
+  int ret;
+  int n;
+  double t0;
+  Timer *region;
+  Lockentry *entry;
+  Lockentry *mutexentry = 0;
+  unsigned int mutexgen = 0;
+
+  if ( ! (entry = begin (cond, KIND_COND, &region)))
+    return abstime ? real_cond_timedwait (cond, mutex, abstime) : real_cond_wait (cond, mutex);
+
+  for (n = nheld - 1; n >= 0; --n) {
+    if (held[n].addr == mutex) {
+      mutexentry = held[n].entry;
+      mutexgen   = held[n].generation;
+      break;
+    }
+  }
+  released (mutex);
+
+  t0 = GPTLread_utr ();
+  ret = abstime ? real_cond_timedwait (cond, mutex, abstime) : real_cond_wait (cond, mutex);
+
+  // The mutex is held again whatever the return code
+  acquired (entry, region, cond, t0);
+  released (cond);
+  if (mutexentry && mutexgen == generation && nheld < MAXHELD) {
+    held[nheld].addr       = mutex;
+    held[nheld].entry      = mutexentry;
+    held[nheld].tacquire   = GPTLread_utr ();
+    held[nheld].generation = generation;
+    ++nheld;
+  }
+  inside = 0;
+  return ret;
+}
+
+int pthread_cond_wait (pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+  RESOLVE_COND (cond_wait);
+  RESOLVE_COND (cond_timedwait);
+  return cond_wait (cond, mutex, 0);
+}
+
+int pthread_cond_timedwait (pthread_cond_t *cond, pthread_mutex_t *mutex,
+			    const struct timespec *abstime)
+{
+  RESOLVE_COND (cond_wait);
+  RESOLVE_COND (cond_timedwait);
+  return cond_wait (cond, mutex, abstime);
+}
+
+int pthread_spin_lock (pthread_spinlock_t *lock)
+{
+  int ret;
+  double t0 = -1.;
+  Timer *region;
+  Lockentry *entry;
+
+  RESOLVE (spin_lock);
+  RESOLVE (spin_trylock);
+  if ( ! (entry = begin ((const void *) lock, KIND_SPIN, &region)))
+    return real_spin_lock (lock);
+
+  if ((ret = real_spin_trylock (lock)) == EBUSY) {
+    t0 = GPTLread_utr ();
+    ret = real_spin_lock (lock);
+  }
+  if (ret == 0)
+    acquired (entry, region, (const void *) lock, t0);
+  inside = 0;
+  return ret;
+}
+
+int pthread_spin_unlock (pthread_spinlock_t *lock)
+{
+  RESOLVE (spin_unlock);
+  if ( ! inside && nheld > 0)
+    released ((const void *) lock);
+  return real_spin_unlock (lock);
+}
+
+// Per-lock totals over all regions, used for sorting the report
+typedef struct {
+  const void *addr;
+  Lockkind kind;
+  unsigned long nacquire;
+  unsigned long ncontend;
+  double wait;
+  double hold;
+} Locksum;
+
+static int cmpwait (const void *a, const void *b)
+{
+  const Locksum *x = (const Locksum *) a;
+  const Locksum *y = (const Locksum *) b;
+  return (x->wait < y->wait) ? 1 : (x->wait > y->wait) ? -1 : 0;
+}
+
+/*
+** GPTLprint_lockstats: Print the locks with the most total wait time, and for each of them
+**   the regions in which the waiting was done
+**
+** Input arguments:
+**   fp: output stream
+*/
+void GPTLprint_lockstats (FILE *fp)
+{
+  int i, j, k, m;
+  int nlocks = 0;
+  int nprint;
+  int nslots;       // number of table slots for one lock
+  int *slots;       // indices of those slots
+  Locksum *sums;
+  Dl_info info;
+  char lockname[MAX_CHARS+1];
+  static const char *thisfunc = "GPTLprint_lockstats";
+
+  if (nentries == 0)
+    return;
+
+  if ( ! (sums = (Locksum *) GPTLallocate (nentries * sizeof (Locksum), thisfunc)))
+    return;
+  if ( ! (slots = (int *) GPTLallocate (TABLESIZE * sizeof (int), thisfunc))) {
+    free (sums);
+    return;
+  }
+
+  // Combine the slots of each lock over regions (and threads). Slots unused since
+  // GPTLreset are left out
+  for (i = 0; i < TABLESIZE; ++i) {
+    if (__atomic_load_n (&table[i].state, __ATOMIC_ACQUIRE) != 2 || table[i].nacquire == 0)
+      continue;
+    for (j = 0; j < nlocks; ++j)
+      if (sums[j].addr == table[i].addr)
+	break;
+    if (j == nlocks) {
+      if (nlocks == nentries)
+	continue;   // slot claimed since nentries was read
+      memset (&sums[j], 0, sizeof (Locksum));
+      sums[j].addr = table[i].addr;
+      sums[j].kind = table[i].kind;
+      ++nlocks;
+    }
+    sums[j].nacquire += table[i].nacquire;
+    sums[j].ncontend += table[i].ncontend;
+    sums[j].wait     += table[i].wait;
+    sums[j].hold     += table[i].hold;
+  }
+  if (nlocks == 0) {
+    free (slots);
+    free (sums);
+    return;
+  }
+  qsort (sums, nlocks, sizeof (Locksum), cmpwait);
+
+  fprintf (fp, "\nLock contention: top %d of %d locks by total wait time\n",
+	   MIN (nlocks, MAXPRINT), nlocks);
+  fprintf (fp, "Contended acquires are those which could not be had immediately. For condition\n"
+	   "variables every wait counts as contended. Indented lines split each lock by the\n"
+	   "region in which it was acquired\n");
+  if (tablefull)
+    fprintf (fp, "WARNING: lock table overflowed: some locks were not recorded\n");
+  fprintf (fp, "%-24s %-6s %10s %10s %12s %12s\n",
+	   "Lock", "Type", "Acquires", "Contended", "Wait", "Hold");
+
+  nprint = MIN (nlocks, MAXPRINT);
+  for (j = 0; j < nprint; ++j) {
+    // Locks with static storage can be named if the executable exports its symbols
+    if (dladdr (sums[j].addr, &info) && info.dli_sname && info.dli_saddr == sums[j].addr)
+      snprintf (lockname, sizeof (lockname), "%s", info.dli_sname);
+    else
+      snprintf (lockname, sizeof (lockname), "%p", sums[j].addr);
+
+    fprintf (fp, "%-24s %-6s %10lu %10lu %12.3e %12.3e\n", lockname, kindstr[sums[j].kind],
+	     sums[j].nacquire, sums[j].ncontend, sums[j].wait, sums[j].hold);
+
+    // Slots of this lock, then combined over threads by region name
+    nslots = 0;
+    for (i = 0; i < TABLESIZE; ++i)
+      if (table[i].state == 2 && table[i].nacquire > 0 && table[i].addr == sums[j].addr)
+	slots[nslots++] = i;
+
+    for (m = 0; m < nslots; ++m) {
+      Lockentry *entry = &table[slots[m]];
+      Locksum region;
+      bool seen = false;
+
+      for (k = 0; k < m; ++k)
+	if (STRMATCH (table[slots[k]].region->name, entry->region->name))
+	  seen = true;
+      if (seen)
+	continue;
+
+      memset (&region, 0, sizeof (region));
+      for (k = m; k < nslots; ++k) {
+	if (STRMATCH (table[slots[k]].region->name, entry->region->name)) {
+	  region.nacquire += table[slots[k]].nacquire;
+	  region.ncontend += table[slots[k]].ncontend;
+	  region.wait     += table[slots[k]].wait;
+	  region.hold     += table[slots[k]].hold;
+	}
+      }
+      fprintf (fp, "  %-22s %-6s %10lu %10lu %12.3e %12.3e\n", entry->region->name, "",
+	       region.nacquire, region.ncontend, region.wait, region.hold);
+    }
+  }
+  free (slots);
+  free (sums);
+}
+
+/*
+** GPTLreset_lockstats: Zero the lock stats
+**
+** Input arguments:
+**   forget: also release every slot. Only GPTLfinalize does this: the regions the slots are
+**           keyed by no longer exist, and interposed calls are no longer attributed, so no
+**           thread is claiming slots. GPTLreset may run while other threads are claiming
+**           slots, so it zeroes the counters of each slot in place and keeps its key
+*/
+void GPTLreset_lockstats (bool forget)
+{
+  int i;
+
+  // Other threads may still hold locks whose Held entries point into table: do not charge
+  // them with hold time from before the reset
+  __atomic_fetch_add (&generation, 1, __ATOMIC_RELEASE);
+  if (forget) {
+    memset (table, 0, sizeof (table));
+    nentries = 0;
+    maxprobe = 0;
+    tablefull = false;
+    return;
+  }
+  for (i = 0; i < TABLESIZE; ++i) {
+    table[i].nacquire = 0;
+    table[i].ncontend = 0;
+    table[i].wait     = 0.;
+    table[i].hold     = 0.;
+  }
+}
@@ -0,0 +1,311 @@
+/*
+** memsampler.c
+**
+** Author: Jim Rosinski
+**
+** Background sampling of process memory usage. A helper thread reads the resident set size
+** from /proc/self/statm at a fixed interval and charges each sample to the region at the top
+** of the callstack of every thread. This gives per-region peak RSS and RSS growth without
+** adding any cost to GPTLstart/GPTLstop. Since RSS is a process-wide quantity, when several
+** threads are active each of their current regions is charged with the same sample.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+#include "thread.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if ( defined HAVE_SLASHPROC && defined HAVE_PTHREAD_CREATE )
+#define HAVE_MEMSAMPLER
+#include <pthread.h>
+#include <fcntl.h>       // open
+#include <unistd.h>      // pread, close, sysconf
+#include <errno.h>
+#include <sys/time.h>    // gettimeofday
+#endif
+
+#ifdef HAVE_LIBMPI
+#include <mpi.h>
+#endif
+
+#ifdef HAVE_MEMSAMPLER
+static pthread_t sampler;                                  // the sampling thread
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;   // protects stopflag
+static pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;   // signalled to stop the sampler
+static bool running = false;        // sampler thread has been started
+static bool stopflag = false;       // sampler thread has been asked to exit
+static int fd = -1;                 // descriptor for /proc/self/statm: kept open between samples
+static Timer ***callstack;          // per-thread callstacks owned by gptl.c
+static Nofalse *stackidx;           // per-thread callstack depths owned by gptl.c
+static int msec;                    // interval between samples
+static float convert2mb = 0.;       // pages to MB
+static float growth_pct;            // threshhold % for growth message
+static float rssprev;               // RSS of previous sample
+static float rssprint;              // RSS at the most recent growth message
+static float rsspeak;               // largest RSS sampled
+static unsigned long nsamples;      // number of samples taken
+static FILE *volatile fp_procsiz = 0; // growth message file: init to 0 to use stderr
+
+static void *sample_loop (void *);
+static void take_sample (void);
+static int read_rss (float *);
+#endif
+
+/*
+** GPTLmemsampler_start: Take a first RSS sample and start the sampling thread.
+**                       Called from GPTLinitialize when GPTLdopr_memusage has been set.
+**
+** Input arguments:
+**   callstack_in: per-thread callstacks
+**   stackidx_in:  per-thread callstack depths
+**   msec_in:      interval between samples (milliseconds)
+**   growth_in:    print a message when RSS has grown by more than this percent
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLmemsampler_start (Timer ***callstack_in, Nofalse *stackidx_in, int msec_in,
+			  float growth_in)
+{
+  static const char *thisfunc = "GPTLmemsampler_start";
+#ifdef HAVE_MEMSAMPLER
+  int ret;
+  long pagesize;
+  static const char *file = "/proc/self/statm";
+
+  if (running)
+    return 0;
+
+  if ((fd = open (file, O_RDONLY)) < 0)
+    return GPTLerror ("%s: bad attempt to open %s\n", thisfunc, file);
+
+  if ((pagesize = sysconf (_SC_PAGESIZE)) <= 0) {
+    (void) close (fd);
+    fd = -1;
+    return GPTLerror ("%s: failure from sysconf (_SC_PAGESIZE)\n", thisfunc);
+  }
+
+  convert2mb = pagesize / (1024.*1024.);
+  callstack  = callstack_in;
+  stackidx   = stackidx_in;
+  msec       = msec_in;
+  growth_pct = growth_in;
+  rssprev    = 0.;
+  rssprint   = 0.;
+  rsspeak    = 0.;
+  nsamples   = 0;
+
+  // MPI may already be up, in which case growth messages go to procsiz.<rank>
+  GPTLmemsampler_set_procsiz ();
+
+  // First sample is taken synchronously so there is always a baseline
+  take_sample ();
+
+  stopflag = false;
+  if ((ret = pthread_create (&sampler, NULL, sample_loop, NULL)) != 0) {
+    (void) close (fd);
+    fd = -1;
+    return GPTLerror ("%s: failure from pthread_create=%d\n", thisfunc, ret);
+  }
+  running = true;
+#else
+  GPTLwarn ("%s: background memory sampling needs /proc and pthreads: not enabled\n", thisfunc);
+#endif
+  return 0;
+}
+
+// GPTLmemsampler_stop: Stop and join the sampling thread. Called from GPTLfinalize
+void GPTLmemsampler_stop (void)
+{
+#ifdef HAVE_MEMSAMPLER
+  if ( ! running)
+    return;
+
+  (void) pthread_mutex_lock (&lock);
+  stopflag = true;
+  (void) pthread_cond_signal (&wakeup);
+  (void) pthread_mutex_unlock (&lock);
+  (void) pthread_join (sampler, NULL);
+  running = false;
+
+  (void) close (fd);
+  fd = -1;
+  if (fp_procsiz) {
+    (void) fclose (fp_procsiz);
+    fp_procsiz = 0;
+  }
+#endif
+}
+
+/*
+** GPTLmemsampler_set_procsiz: Once MPI has been initialized, redirect growth messages from
+**   stderr to "procsiz.<rank>". The sampling thread must not make MPI calls, so this is
+**   invoked from the main thread: by GPTLmemsampler_start and by the MPI_Init wrappers.
+*/
+void GPTLmemsampler_set_procsiz (void)
+{
+#if ( defined HAVE_MEMSAMPLER && defined HAVE_LIBMPI )
+  int flag;
+  int world_iam;
+  char outfile[15];
+
+  if ( ! running && fd < 0)
+    return;
+
+  if (fp_procsiz || MPI_Initialized (&flag) != MPI_SUCCESS || ! flag)
+    return;
+
+  if (MPI_Comm_rank (MPI_COMM_WORLD, &world_iam) != MPI_SUCCESS)
+    return;
+
+  sprintf (outfile, "procsiz.%6.6d", world_iam);
+  fp_procsiz = fopen (outfile, "w");
+#endif
+}
+
+/*
+** GPTLprint_memsamples: Print per-region RSS stats gathered by the sampler
+**
+** Input arguments:
+**   fp:     output stream
+**   timers: per-thread linked lists of timers
+*/
+void GPTLprint_memsamples (FILE *fp, Timer **timers)
+{
+#ifdef HAVE_MEMSAMPLER
+  int t;
+  int nthreads;
+  int width;         // width of region name column
+  Timer *ptr;
+
+  if (nsamples == 0)
+    return;
+
+  fprintf (fp, "\nRSS samples every %d msec attributed to the region at the top of each "
+	   "thread's callstack\n", msec);
+  fprintf (fp, "Total samples=%lu process peak RSS=%.2f MB\n", nsamples, rsspeak);
+  fprintf (fp, "Growth is the sum of RSS increases between consecutive samples charged to a "
+	   "region\n");
+
+  nthreads = MAX (GPTLnthreads, 1);
+  for (t = 0; t < nthreads; ++t) {
+    bool found = false;
+    width = strlen ("Region");
+    for (ptr = timers[t]; ptr; ptr = ptr->next)
+      if (ptr->mem.nsamples > 0)
+	width = MAX (width, (int) strlen (ptr->name));
+
+    for (ptr = timers[t]; ptr; ptr = ptr->next) {
+      if (ptr->mem.nsamples == 0)
+	continue;
+      if ( ! found) {
+	fprintf (fp, "\nThread %d:\n", t);
+	fprintf (fp, "%-*s %10s %13s %13s\n", width, "Region", "Samples", "Peak_RSS(MB)",
+		 "Growth(MB)");
+	found = true;
+      }
+      fprintf (fp, "%-*s %10lu %13.2f %13.2f\n", width, ptr->name, ptr->mem.nsamples,
+	       ptr->mem.rss_peak, ptr->mem.rss_growth);
+    }
+  }
+#endif
+}
+
+#ifdef HAVE_MEMSAMPLER
+// sample_loop: Body of the sampling thread. Sleeps on a condition variable so that
+// GPTLmemsampler_stop need not wait out a full interval.
+static void *sample_loop (void *arg)
+{
+  struct timeval now;
+  struct timespec deadline;
+
+#ifdef HAVE_INTERPOSE
+  // This thread is unknown to the thread layer: its reads of /proc must not be recorded
+  GPTLinterpose_pause ();
+#endif
+
+  (void) pthread_mutex_lock (&lock);
+  while ( ! stopflag) {
+    (void) gettimeofday (&now, NULL);
+    deadline.tv_sec  = now.tv_sec + msec / 1000;
+    deadline.tv_nsec = now.tv_usec * 1000L + (msec % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      ++deadline.tv_sec;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    while ( ! stopflag &&
+	    pthread_cond_timedwait (&wakeup, &lock, &deadline) != ETIMEDOUT);
+    if (stopflag)
+      break;
+    (void) pthread_mutex_unlock (&lock);
+    take_sample ();
+    (void) pthread_mutex_lock (&lock);
+  }
+  (void) pthread_mutex_unlock (&lock);
+  return NULL;
+}
+
+// take_sample: Read RSS and charge it to the current region of each thread
+static void take_sample (void)
+{
+  int t;
+  int idx;
+  int nthreads;
+  float rss;
+  float delta;
+  Timer *ptr;
+  FILE *fp;
+
+  if (read_rss (&rss) != 0)
+    return;
+
+  delta = (nsamples > 0) ? rss - rssprev : 0.;
+  rssprev = rss;
+  ++nsamples;
+  if (rss > rsspeak)
+    rsspeak = rss;
+
+  // Callstacks are updated by their owning threads without locking. A sample which races
+  // with a push or pop may be charged to a neighboring region, which is harmless for a
+  // statistical profile. Entries are never freed while the sampler runs.
+  nthreads = MAX (GPTLnthreads, 1);
+  for (t = 0; t < nthreads; ++t) {
+    idx = __atomic_load_n (&stackidx[t].val, __ATOMIC_ACQUIRE);
+    if (idx < 0 || idx >= MAX_STACK || ! (ptr = callstack[t][idx]))
+      continue;
+    ++ptr->mem.nsamples;
+    if (rss > ptr->mem.rss_peak)
+      ptr->mem.rss_peak = rss;
+    if (delta > 0.)
+      ptr->mem.rss_growth += delta;
+  }
+
+  // Notify user when rss has grown by more than some percentage (default 0%)
+  if (rss > rssprint*(1.0 + 0.01*growth_pct)) {
+    rssprint = rss;
+    idx = stackidx[0].val;
+    ptr = (idx >= 0 && idx < MAX_STACK) ? callstack[0][idx] : 0;
+    fp = fp_procsiz ? fp_procsiz : stderr;
+    fprintf (fp, "Sample in %s RSS grew to %8.2f MB\n", ptr ? ptr->name : "unknown", rss);
+    fflush (fp);  // Not clear when this file needs to be closed, so flush
+  }
+}
+
+// read_rss: Read current RSS (MB) from the already open /proc/self/statm
+static int read_rss (float *rss)
+{
+  char buf[128];
+  ssize_t nbytes;
+  long size;
+  long resident;
+
+  if ((nbytes = pread (fd, buf, sizeof (buf) - 1, 0)) <= 0)
+    return -1;
+  buf[nbytes] = '\0';
+  if (sscanf (buf, "%ld %ld", &size, &resident) != 2)
+    return -1;
+  *rss = resident * convert2mb;
+  return 0;
+}
+#endif
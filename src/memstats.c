@@ -28,7 +28,7 @@ void GPTLprint_memstats (FILE *fp, Timer **timers, int tablesize)
     numtimers = 0;
     for (ptr = timers[t]->next; ptr; ptr = ptr->next) {
       ++numtimers;
-      pchmem  += (float) sizeof (Timer *) * (ptr->nchildren + ptr->nparent);
+      pchmem  += (float) sizeof (Timer *) * (ptr->nchildren + ptr->nparent + ptr->ctxkidsize);
     }
     hashmem   += (float) numtimers * sizeof (Timer *);
     regionmem += (float) numtimers * sizeof (Timer);
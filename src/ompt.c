@@ -0,0 +1,418 @@
+/*
+** ompt.c
+**
+** Author: Jim Rosinski
+**
+** OpenMP tool (OMPT) interface: time OpenMP constructs without any user instrumentation.
+** An OMPT-capable runtime (e.g. LLVM libomp) finds ompt_start_tool in libgptl and calls the
+** registered callbacks, which feed ordinary GPTL timers:
+**
+**   omp@<location>     each thread's time in a parallel region up to the closing barrier
+**   OMP_barrier_wait   time waiting in explicit and worksharing barriers, taskwait, taskgroup
+**   OMP_mutex_wait     time waiting to enter a critical section or acquire an OMP lock
+**   OMP_task           time executing explicit tasks
+**
+** <location> is the symbol (or object file) plus offset of the code which opened the region.
+** In addition per-region, per-thread work and wait totals are kept so that GPTLpr_file can
+** report load imbalance for every parallel region, which otherwise needs GPTLget_threadwork.
+**
+** Only outermost parallel regions are tracked. Work of thread t is the time from the start of
+** its implicit task to its arrival at the closing barrier, less any barrier waits inside the
+** region. The closing barrier wait is the time from arrival to the end of the region. That
+** wait is measured from the encountering thread, because runtimes may report the end of a
+** worker's closing barrier only when the worker is next woken up.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+#include "thread.h"
+#include "gptl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>       // dladdr
+#include <omp.h>
+#include <omp-tools.h>
+
+#define MAXREGIONS 256   // max distinct parallel regions tracked
+
+typedef struct {
+  volatile int state;       // 0=empty, 1=being claimed, 2=in use
+  const void *codeptr;      // return address of the code which opened the region
+  char name[MAX_CHARS+1];   // timer name
+  unsigned long ninstance;  // number of times the region was entered
+  int maxteam;              // largest team size seen
+  double tbegin;            // start of current instance
+  double wall;              // total wallclock time of the region on the encountering thread
+  unsigned long ntask;      // explicit tasks created inside the region
+  double *begin;            // per-thread: start of implicit task in current instance
+  double *arrive;           // per-thread: arrival at closing barrier in current instance
+  double *instwait;         // per-thread: barrier wait inside current instance
+  bool *active;             // per-thread: participating in current instance
+  double *work;             // per-thread: total work
+  double *wait;             // per-thread: total barrier wait
+  double *mutexwait;        // per-thread: total critical/lock wait
+} Region;
+
+static Region regions[MAXREGIONS];
+static volatile int nregions = 0;
+static bool regionsfull = false;   // some regions could not be tracked
+static bool activated = false;     // runtime started the tool
+static int nthr = 0;               // size of the per-thread arrays
+
+// Region whose implicit task this thread is executing, and its index in the team
+static __thread Region *cur = 0;
+static __thread int myidx = 0;
+static __thread double t0wait = 0.;   // start of barrier or mutex wait
+static __thread int ntaskon = 0;      // OMP_task timers started by this thread
+
+static const char *barriername = "OMP_barrier_wait";
+static const char *mutexname = "OMP_mutex_wait";
+static const char *taskname = "OMP_task";
+
+// tracking: True if GPTL is initialized and ready to record OMPT events
+static inline bool tracking (void)
+{
+  return GPTLis_initialized () && nthr > 0;
+}
+
+// makename: Name a region by the location of the code which opened it
+static void makename (const void *codeptr, char *name)
+{
+  Dl_info info;
+  const char *base;
+
+  if (codeptr && dladdr (codeptr, &info)) {
+    if (info.dli_sname) {
+      snprintf (name, MAX_CHARS+1, "omp@%s+0x%lx", info.dli_sname,
+		(unsigned long) ((char *) codeptr - (char *) info.dli_saddr));
+      return;
+    } else if (info.dli_fname) {
+      base = strrchr (info.dli_fname, '/');
+      snprintf (name, MAX_CHARS+1, "omp@%s+0x%lx", base ? base+1 : info.dli_fname,
+		(unsigned long) ((char *) codeptr - (char *) info.dli_fbase));
+      return;
+    }
+  }
+  snprintf (name, MAX_CHARS+1, "omp@%p", codeptr);
+}
+
+// getregion: Find or claim the record for the region opened at codeptr. 0 means table full
+static Region *getregion (const void *codeptr)
+{
+  int n;
+  Region *region;
+  static const char *thisfunc = "getregion";
+
+  for (n = 0; n < MAXREGIONS; ++n) {
+    region = &regions[n];
+    if (__atomic_load_n (&region->state, __ATOMIC_ACQUIRE) == 0) {
+      int expected = 0;
+      if (__atomic_compare_exchange_n (&region->state, &expected, 1, false,
+				       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+	region->codeptr   = codeptr;
+	makename (codeptr, region->name);
+	region->begin     = (double *) GPTLallocate (nthr * sizeof (double), thisfunc);
+	region->arrive    = (double *) GPTLallocate (nthr * sizeof (double), thisfunc);
+	region->instwait  = (double *) GPTLallocate (nthr * sizeof (double), thisfunc);
+	region->active    = (bool *)   GPTLallocate (nthr * sizeof (bool), thisfunc);
+	region->work      = (double *) GPTLallocate (nthr * sizeof (double), thisfunc);
+	region->wait      = (double *) GPTLallocate (nthr * sizeof (double), thisfunc);
+	region->mutexwait = (double *) GPTLallocate (nthr * sizeof (double), thisfunc);
+	if ( ! region->begin || ! region->arrive || ! region->instwait || ! region->active ||
+	     ! region->work || ! region->wait || ! region->mutexwait) {
+	  regionsfull = true;
+	  return 0;   // slot stays claimed (state 1) and is never used
+	}
+	memset (region->active, 0, nthr * sizeof (bool));
+	memset (region->instwait, 0, nthr * sizeof (double));
+	memset (region->work, 0, nthr * sizeof (double));
+	memset (region->wait, 0, nthr * sizeof (double));
+	memset (region->mutexwait, 0, nthr * sizeof (double));
+	__atomic_store_n (&region->state, 2, __ATOMIC_RELEASE);
+	__atomic_fetch_add (&nregions, 1, __ATOMIC_RELAXED);
+	return region;
+      }
+    }
+    if (__atomic_load_n (&region->state, __ATOMIC_ACQUIRE) == 2 && region->codeptr == codeptr)
+      return region;
+  }
+  regionsfull = true;
+  return 0;
+}
+
+static void on_parallel_begin (ompt_data_t *encountering_task_data,
+			       const ompt_frame_t *encountering_task_frame,
+			       ompt_data_t *parallel_data, unsigned int requested_parallelism,
+			       int flags, const void *codeptr_ra)
+{
+  Region *region = 0;
+
+  // Nested regions are not tracked: their team indices would collide with the outer team
+  if (tracking () && ! cur && (region = getregion (codeptr_ra)))
+    region->tbegin = GPTLread_utr ();
+  parallel_data->ptr = region;
+}
+
+static void on_parallel_end (ompt_data_t *parallel_data, ompt_data_t *encountering_task_data,
+			     int flags, const void *codeptr_ra)
+{
+  int t;
+  int nteam = 0;
+  double tend;
+  Region *region = (Region *) parallel_data->ptr;
+
+  if ( ! region || ! tracking ())
+    return;
+
+  // All threads have passed the closing barrier, so their arrival times are final
+  tend = GPTLread_utr ();
+  for (t = 0; t < nthr; ++t) {
+    if ( ! region->active[t])
+      continue;
+    region->work[t] += region->arrive[t] - region->begin[t] - region->instwait[t];
+    region->wait[t] += region->instwait[t] + tend - region->arrive[t];
+    region->instwait[t] = 0.;
+    region->active[t] = false;
+    ++nteam;
+  }
+  ++region->ninstance;
+  region->maxteam = MAX (region->maxteam, nteam);
+  region->wall += tend - region->tbegin;
+}
+
+static void on_implicit_task (ompt_scope_endpoint_t endpoint, ompt_data_t *parallel_data,
+			      ompt_data_t *task_data, unsigned int actual_parallelism,
+			      unsigned int index, int flags)
+{
+  Region *region;
+
+  if (endpoint != ompt_scope_begin || (flags & ompt_task_initial) || ! parallel_data ||
+      ! (region = (Region *) parallel_data->ptr) || index >= (unsigned int) nthr || ! tracking ())
+    return;
+
+  cur = region;
+  myidx = index;
+  region->active[index] = true;
+  region->instwait[index] = 0.;
+  region->begin[index] = GPTLread_utr ();
+  region->arrive[index] = region->begin[index];
+  (void) GPTLstart (region->name);
+}
+
+// isclosing: True if this barrier closes the current parallel region. Older runtimes report it
+// as barrier_implicit with either no code pointer (workers) or that of the region (master)
+static inline bool isclosing (ompt_sync_region_t kind, const void *codeptr_ra)
+{
+  return kind == ompt_sync_region_barrier_implicit_parallel ||
+    (kind == ompt_sync_region_barrier_implicit && (! codeptr_ra || codeptr_ra == cur->codeptr));
+}
+
+static void on_sync_region (ompt_sync_region_t kind, ompt_scope_endpoint_t endpoint,
+			    ompt_data_t *parallel_data, ompt_data_t *task_data,
+			    const void *codeptr_ra)
+{
+  if ( ! cur || endpoint != ompt_scope_begin || ! isclosing (kind, codeptr_ra))
+    return;
+
+  // Arrival at the closing barrier ends this thread's part of the region
+  cur->arrive[myidx] = GPTLread_utr ();
+  (void) GPTLstop (cur->name);
+  cur = 0;
+}
+
+static void on_sync_region_wait (ompt_sync_region_t kind, ompt_scope_endpoint_t endpoint,
+				 ompt_data_t *parallel_data, ompt_data_t *task_data,
+				 const void *codeptr_ra)
+{
+  if ( ! cur || isclosing (kind, codeptr_ra))
+    return;
+
+  if (endpoint == ompt_scope_begin) {
+    t0wait = GPTLread_utr ();
+    (void) GPTLstart (barriername);
+  } else {
+    (void) GPTLstop (barriername);
+    cur->instwait[myidx] += GPTLread_utr () - t0wait;
+  }
+}
+
+static void on_mutex_acquire (ompt_mutex_t kind, unsigned int hint, unsigned int impl,
+			      ompt_wait_id_t wait_id, const void *codeptr_ra)
+{
+  if ( ! cur || kind == ompt_mutex_atomic)
+    return;
+  t0wait = GPTLread_utr ();
+  (void) GPTLstart (mutexname);
+}
+
+static void on_mutex_acquired (ompt_mutex_t kind, ompt_wait_id_t wait_id,
+			       const void *codeptr_ra)
+{
+  if ( ! cur || kind == ompt_mutex_atomic)
+    return;
+  (void) GPTLstop (mutexname);
+  cur->mutexwait[myidx] += GPTLread_utr () - t0wait;
+}
+
+static void on_task_create (ompt_data_t *encountering_task_data,
+			    const ompt_frame_t *encountering_task_frame, ompt_data_t *new_task_data,
+			    int flags, int has_dependences, const void *codeptr_ra)
+{
+  new_task_data->value = (uint64_t) flags;   // task_schedule needs to know explicit tasks
+  if (cur && (flags & ompt_task_explicit))
+    __atomic_fetch_add (&cur->ntask, 1, __ATOMIC_RELAXED);
+}
+
+static void on_task_schedule (ompt_data_t *prior_task_data, ompt_task_status_t prior_task_status,
+			      ompt_data_t *next_task_data)
+{
+  if ( ! tracking ())
+    return;
+  if (ntaskon > 0 && prior_task_data && (prior_task_data->value & ompt_task_explicit)) {
+    (void) GPTLstop (taskname);
+    --ntaskon;
+  }
+  if (next_task_data && (next_task_data->value & ompt_task_explicit)) {
+    (void) GPTLstart (taskname);
+    ++ntaskon;
+  }
+}
+
+static int ompt_initialize (ompt_function_lookup_t lookup, int initial_device_num,
+			    ompt_data_t *tool_data)
+{
+  ompt_set_callback_t set_callback;
+
+  if ( ! (set_callback = (ompt_set_callback_t) lookup ("ompt_set_callback")))
+    return 0;
+
+  // Each registration may fail if the runtime does not support that event: carry on without it
+  (void) set_callback (ompt_callback_parallel_begin, (ompt_callback_t) on_parallel_begin);
+  (void) set_callback (ompt_callback_parallel_end, (ompt_callback_t) on_parallel_end);
+  (void) set_callback (ompt_callback_implicit_task, (ompt_callback_t) on_implicit_task);
+  (void) set_callback (ompt_callback_sync_region, (ompt_callback_t) on_sync_region);
+  (void) set_callback (ompt_callback_sync_region_wait, (ompt_callback_t) on_sync_region_wait);
+  (void) set_callback (ompt_callback_mutex_acquire, (ompt_callback_t) on_mutex_acquire);
+  (void) set_callback (ompt_callback_mutex_acquired, (ompt_callback_t) on_mutex_acquired);
+  (void) set_callback (ompt_callback_task_create, (ompt_callback_t) on_task_create);
+  (void) set_callback (ompt_callback_task_schedule, (ompt_callback_t) on_task_schedule);
+  activated = true;
+  return 1;   // non-zero keeps the tool active
+}
+
+static void ompt_finalize (ompt_data_t *tool_data)
+{
+}
+
+/*
+** ompt_start_tool: Entry point looked up by an OMPT-capable OpenMP runtime at startup
+**
+** Return value: callbacks to initialize and finalize the tool
+*/
+ompt_start_tool_result_t *ompt_start_tool (unsigned int omp_version, const char *runtime_version)
+{
+  static ompt_start_tool_result_t result = {ompt_initialize, ompt_finalize, {0}};
+  return &result;
+}
+
+// GPTLompt_init: Size the per-thread arrays. Called from GPTLinitialize once threading is set up
+void GPTLompt_init (void)
+{
+  nthr = MAX (GPTLmax_threads, 1);
+}
+
+/*
+** GPTLprint_ompt: Print work, wait and imbalance of each parallel region
+**
+** Input arguments:
+**   fp: output stream
+*/
+void GPTLprint_ompt (FILE *fp)
+{
+  int n, t;
+  int nactive;
+  double sumwork, maxwork, sumwait, summutex;
+
+  fprintf (fp, "\nOpenMP parallel regions (OMPT):\n");
+  if ( ! activated) {
+    fprintf (fp, "OMPT tool was not started: the OpenMP runtime does not support OMPT\n");
+    return;
+  }
+  fprintf (fp, "Work is time up to the closing barrier less barrier waits inside the region.\n"
+	   "Wait is all barrier wait including the closing barrier. Imbal%% is "
+	   "(max-mean)/max work over threads\n");
+  if (regionsfull)
+    fprintf (fp, "WARNING: more than %d regions: some were not recorded\n", MAXREGIONS);
+  fprintf (fp, "%-32s %8s %7s %10s %10s %10s %10s %10s %6s %8s\n", "Region", "Count", "Threads",
+	   "Wall", "Work_mean", "Work_max", "Wait_mean", "Mutex_wait", "Imbal%", "Tasks");
+
+  for (n = 0; n < MAXREGIONS; ++n) {
+    Region *region = &regions[n];
+    if (__atomic_load_n (&region->state, __ATOMIC_ACQUIRE) != 2 || region->ninstance == 0)
+      continue;
+
+    nactive = 0;
+    sumwork = maxwork = sumwait = summutex = 0.;
+    for (t = 0; t < nthr; ++t) {
+      if (region->work[t] == 0. && region->wait[t] == 0.)
+	continue;
+      ++nactive;
+      sumwork  += region->work[t];
+      maxwork   = MAX (maxwork, region->work[t]);
+      sumwait  += region->wait[t];
+      summutex += region->mutexwait[t];
+    }
+    if (nactive == 0)
+      continue;
+
+    fprintf (fp, "%-32s %8lu %7d %10.3e %10.3e %10.3e %10.3e %10.3e %6.1f %8lu\n",
+	     region->name, region->ninstance, region->maxteam, region->wall,
+	     sumwork / nactive, maxwork, sumwait / nactive, summutex,
+	     maxwork > 0. ? 100. * (maxwork - sumwork / nactive) / maxwork : 0., region->ntask);
+  }
+}
+
+// GPTLreset_ompt: Zero the per-region stats. Called from GPTLreset
+void GPTLreset_ompt (void)
+{
+  int n;
+
+  for (n = 0; n < MAXREGIONS; ++n) {
+    Region *region = &regions[n];
+    if (region->state != 2)
+      continue;
+    region->ninstance = 0;
+    region->maxteam = 0;
+    region->wall = 0.;
+    region->ntask = 0;
+    memset (region->work, 0, nthr * sizeof (double));
+    memset (region->wait, 0, nthr * sizeof (double));
+    memset (region->mutexwait, 0, nthr * sizeof (double));
+  }
+}
+
+// GPTLfinalize_ompt: Forget all regions. Called from GPTLfinalize. The tool stays registered
+// with the runtime, but records nothing until GPTLinitialize is called again
+void GPTLfinalize_ompt (void)
+{
+  int n;
+
+  nthr = 0;
+  for (n = 0; n < MAXREGIONS; ++n) {
+    Region *region = &regions[n];
+    if (region->state == 0)
+      continue;
+    free (region->begin);
+    free (region->arrive);
+    free (region->instwait);
+    free (region->active);
+    free (region->work);
+    free (region->wait);
+    free (region->mutexwait);
+  }
+  memset (regions, 0, sizeof (regions));
+  nregions = 0;
+  regionsfull = false;
+}
@@ -0,0 +1,610 @@
+/*
+** patch.c
+**
+** Author: Jim Rosinski
+**
+** Auto-profiling which costs nothing unless it is switched on. Code compiled with
+** -fpatchable-function-entry=5 starts every function with 5 bytes of NOPs, and the compiler
+** lists their addresses in the __patchable_function_entries section. When the GPTLpatch
+** option is set, GPTLinitialize overwrites each NOP sled with a call to entry_tramp, and
+** GPTLdisable/GPTLfinalize put the NOPs back.
+**
+** entry_tramp saves the argument registers, and with XSAVE the whole SSE/AVX/AVX-512 register
+** state, and passes the sled address (which is the key of the function's timer, exactly as
+** this_fn is for -finstrument-functions) to __cyg_profile_func_enter. It also replaces the return address of the function with
+** exit_tramp, which calls __cyg_profile_func_exit and then returns to the real caller, whose
+** address is kept on a per-thread shadow stack. Tail calls need no special handling: the
+** callee replaces the already replaced return address, and both exits happen in turn.
+**
+** Functions excluded by GPTL_FILTER are not patched at all. Only x86_64 Linux is supported.
+** Each sled is rewritten by one aligned 8-byte store, or by one 16-byte lock cmpxchg16b, so
+** another thread executing it sees either the NOPs or the call. Functions whose sled crosses
+** a 16-byte boundary could be seen half written, so they are not patched.
+** Limitations: a C++ exception or longjmp out of a patched function skips its exit, which
+** leaves the shadow stack out of step; long double return values (x87) are not preserved;
+** and on a CPU without XSAVE only xmm0-7 are saved, so functions which take or return
+** 256- or 512-bit vectors must then be excluded with GPTL_FILTER.
+** Patching is process-wide: the code of a function is shared by all threads, so one thread's
+** GPTLdisable restores it for all of them. A mutex serializes concurrent enables and disables.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if ( defined HAVE_PATCHABLE && defined __x86_64__ && defined __linux__ )
+#define HAVE_PATCHING
+#include <cpuid.h>
+#include <elf.h>
+#include <link.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_PATCHING
+#define SLED 5              // bytes of NOPs: -fpatchable-function-entry=5
+#define CALL 0xe8           // call rel32
+#define NOP 0x90
+#define MAXDEPTH 1024       // patched calls which can be outstanding on one thread
+
+typedef struct {
+  unsigned char *sled;      // first NOP
+  unsigned char call[SLED]; // call to entry_tramp, directly or through a stub
+} Site;
+
+typedef struct {
+  void *ret;                // real return address
+  void *fn;                 // sled of the function
+  int generation;           // generation when the function was entered
+} Frame;
+
+static Site *sites = 0;         // patchable functions not excluded by GPTL_FILTER
+static int nsites = 0;
+static int sitesize = 0;
+static unsigned char **stubs = 0; // pages holding a jump to entry_tramp, near code out of range
+static int nstubs = 0;
+static bool applied = false;    // sites currently hold calls
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; // held while sites are rewritten
+static long pagesize;
+static int generation = 0;      // bumped by GPTLpatch_finalize
+static bool have_cx16 = false;  // cmpxchg16b is available
+unsigned long GPTLpatch_xsize __attribute__ ((visibility ("hidden"))) = 0; // XSAVE area, or 0
+
+static __thread Frame shadow[MAXDEPTH];  // return addresses replaced by exit_tramp
+static __thread int depth = 0;
+
+// The trampolines below, and the C functions they call
+extern void entry_tramp (void) __attribute__ ((visibility ("hidden")));
+extern void exit_tramp (void) __attribute__ ((visibility ("hidden")));
+void GPTLpatch_enter (void *, void **) __attribute__ ((visibility ("hidden")));
+void *GPTLpatch_exit (void) __attribute__ ((visibility ("hidden")));
+
+/*
+** entry_tramp: reached by "call" from a sled, so (%rsp) is the sled address + 5 and 8(%rsp)
+**   holds the return address of the patched function. Everything which may carry arguments
+**   (rax for varargs, r10 for the static chain, the vector registers) is saved around the
+**   call into C
+** exit_tramp: reached by "ret" from a patched function. Return values (rax, rdx and the
+**   vector registers) are saved, and the real return address from GPTLpatch_exit is put where
+**   ret will find it
+** With GPTLpatch_xsize set, the vector registers are saved whole by XSAVE into a 64-byte
+** aligned area on the stack, whose header must be zeroed first for XRSTOR. The mask 0xe6
+** selects SSE, AVX, and the AVX-512 opmask and upper register components. Otherwise only
+** xmm0-7 (entry) or xmm0-1 (exit) are saved
+*/
+__asm__ (
+  "	.text\n"
+  "	.p2align 4\n"
+  "	.globl entry_tramp\n"
+  "	.hidden entry_tramp\n"
+  "	.type entry_tramp, @function\n"
+  "entry_tramp:\n"
+  "	endbr64\n"
+  "	pushq %rbp\n"
+  "	movq %rsp, %rbp\n"
+  "	pushq %rax\n"
+  "	pushq %rdi\n"
+  "	pushq %rsi\n"
+  "	pushq %rdx\n"
+  "	pushq %rcx\n"
+  "	pushq %r8\n"
+  "	pushq %r9\n"
+  "	pushq %r10\n"
+  "	movq GPTLpatch_xsize(%rip), %r11\n"
+  "	testq %r11, %r11\n"
+  "	jz 1f\n"
+  "	subq %r11, %rsp\n"
+  "	andq $-64, %rsp\n"
+  "	xorl %eax, %eax\n"
+  "	movq %rax, 512(%rsp)\n"
+  "	movq %rax, 520(%rsp)\n"
+  "	movq %rax, 528(%rsp)\n"
+  "	movq %rax, 536(%rsp)\n"
+  "	movq %rax, 544(%rsp)\n"
+  "	movq %rax, 552(%rsp)\n"
+  "	movq %rax, 560(%rsp)\n"
+  "	movq %rax, 568(%rsp)\n"
+  "	movl $0xe6, %eax\n"
+  "	xorl %edx, %edx\n"
+  "	xsave64 (%rsp)\n"
+  "	movq 8(%rbp), %rdi\n"
+  "	subq $5, %rdi\n"
+  "	leaq 16(%rbp), %rsi\n"
+  "	call GPTLpatch_enter\n"
+  "	movl $0xe6, %eax\n"
+  "	xorl %edx, %edx\n"
+  "	xrstor64 (%rsp)\n"
+  "	jmp 2f\n"
+  "1:\n"
+  "	subq $128, %rsp\n"
+  "	andq $-16, %rsp\n"
+  "	movdqu %xmm0, 0(%rsp)\n"
+  "	movdqu %xmm1, 16(%rsp)\n"
+  "	movdqu %xmm2, 32(%rsp)\n"
+  "	movdqu %xmm3, 48(%rsp)\n"
+  "	movdqu %xmm4, 64(%rsp)\n"
+  "	movdqu %xmm5, 80(%rsp)\n"
+  "	movdqu %xmm6, 96(%rsp)\n"
+  "	movdqu %xmm7, 112(%rsp)\n"
+  "	movq 8(%rbp), %rdi\n"
+  "	subq $5, %rdi\n"
+  "	leaq 16(%rbp), %rsi\n"
+  "	call GPTLpatch_enter\n"
+  "	movdqu 0(%rsp), %xmm0\n"
+  "	movdqu 16(%rsp), %xmm1\n"
+  "	movdqu 32(%rsp), %xmm2\n"
+  "	movdqu 48(%rsp), %xmm3\n"
+  "	movdqu 64(%rsp), %xmm4\n"
+  "	movdqu 80(%rsp), %xmm5\n"
+  "	movdqu 96(%rsp), %xmm6\n"
+  "	movdqu 112(%rsp), %xmm7\n"
+  "2:\n"
+  "	leaq -64(%rbp), %rsp\n"
+  "	popq %r10\n"
+  "	popq %r9\n"
+  "	popq %r8\n"
+  "	popq %rcx\n"
+  "	popq %rdx\n"
+  "	popq %rsi\n"
+  "	popq %rdi\n"
+  "	popq %rax\n"
+  "	popq %rbp\n"
+  "	ret\n"
+  "	.size entry_tramp, .-entry_tramp\n"
+  "\n"
+  "	.p2align 4\n"
+  "	.globl exit_tramp\n"
+  "	.hidden exit_tramp\n"
+  "	.type exit_tramp, @function\n"
+  "exit_tramp:\n"
+  "	subq $8, %rsp\n"
+  "	pushq %rbp\n"
+  "	movq %rsp, %rbp\n"
+  "	pushq %rax\n"
+  "	pushq %rdx\n"
+  "	movq GPTLpatch_xsize(%rip), %r11\n"
+  "	testq %r11, %r11\n"
+  "	jz 1f\n"
+  "	subq %r11, %rsp\n"
+  "	andq $-64, %rsp\n"
+  "	xorl %eax, %eax\n"
+  "	movq %rax, 512(%rsp)\n"
+  "	movq %rax, 520(%rsp)\n"
+  "	movq %rax, 528(%rsp)\n"
+  "	movq %rax, 536(%rsp)\n"
+  "	movq %rax, 544(%rsp)\n"
+  "	movq %rax, 552(%rsp)\n"
+  "	movq %rax, 560(%rsp)\n"
+  "	movq %rax, 568(%rsp)\n"
+  "	movl $0xe6, %eax\n"
+  "	xorl %edx, %edx\n"
+  "	xsave64 (%rsp)\n"
+  "	call GPTLpatch_exit\n"
+  "	movq %rax, 8(%rbp)\n"
+  "	movl $0xe6, %eax\n"
+  "	xorl %edx, %edx\n"
+  "	xrstor64 (%rsp)\n"
+  "	jmp 2f\n"
+  "1:\n"
+  "	subq $32, %rsp\n"
+  "	andq $-16, %rsp\n"
+  "	movdqu %xmm0, 0(%rsp)\n"
+  "	movdqu %xmm1, 16(%rsp)\n"
+  "	call GPTLpatch_exit\n"
+  "	movq %rax, 8(%rbp)\n"
+  "	movdqu 0(%rsp), %xmm0\n"
+  "	movdqu 16(%rsp), %xmm1\n"
+  "2:\n"
+  "	leaq -16(%rbp), %rsp\n"
+  "	popq %rdx\n"
+  "	popq %rax\n"
+  "	popq %rbp\n"
+  "	ret\n"
+  "	.size exit_tramp, .-exit_tramp\n"
+);
+
+static unsigned long get_xsize (void);
+static inline bool writable (uintptr_t);
+static inline void store16 (uint64_t *, const unsigned char *, uintptr_t);
+static int add_object (struct dl_phdr_info *, size_t, void *);
+static int make_call (Site *);
+static unsigned char *get_stub (unsigned char *);
+static int write_sites (bool);
+static inline bool in_range (const unsigned char *, const unsigned char *);
+static int cmp_site (const void *, const void *);
+
+/*
+** GPTLpatch_enter: Called by entry_tramp on entry to a patched function
+**
+** Input arguments:
+**   fn:      sled of the function: the address its timer is keyed by
+**   retslot: where the function's return address is stored
+*/
+void GPTLpatch_enter (void *fn, void **retslot)
+{
+  // Too deep to remember the return address: this call is not timed
+  if (depth >= MAXDEPTH)
+    return;
+  shadow[depth].ret = *retslot;
+  shadow[depth].fn  = fn;
+  shadow[depth].generation = __atomic_load_n (&generation, __ATOMIC_RELAXED);
+  ++depth;
+  *retslot = (void *) exit_tramp;
+  __cyg_profile_func_enter (fn, shadow[depth-1].ret);
+}
+
+// GPTLpatch_exit: Called by exit_tramp when a patched function returns. Returns the real
+// return address. A function entered before GPTLfinalize (e.g. the one calling it) returns
+// through here too: its timer is gone, so only the shadow stack is popped
+void *GPTLpatch_exit (void)
+{
+  Frame *frame = &shadow[--depth];
+
+  if (frame->generation == __atomic_load_n (&generation, __ATOMIC_RELAXED))
+    __cyg_profile_func_exit (frame->fn, frame->ret);
+  return frame->ret;
+}
+#endif
+
+/*
+** GPTLpatch_init: Find the patchable functions of every loaded object and patch them
+**
+** Return value: number of functions patched, or GPTLerror
+*/
+int GPTLpatch_init (void)
+{
+#ifdef HAVE_PATCHING
+  int n;
+  static const char *thisfunc = "GPTLpatch_init";
+
+  unsigned int eax, ebx, ecx, edx;
+
+  pagesize = sysconf (_SC_PAGESIZE);
+  GPTLpatch_xsize = get_xsize ();
+  have_cx16 = __get_cpuid (1, &eax, &ebx, &ecx, &edx) && (ecx & bit_CMPXCHG16B);
+  (void) dl_iterate_phdr (add_object, 0);
+  if (nsites > 0)
+    qsort (sites, nsites, sizeof (Site), cmp_site);
+  for (n = 0; n < nsites; ++n)
+    if (make_call (&sites[n]) != 0)
+      return GPTLerror ("%s: no stub within reach of %p\n", thisfunc, sites[n].sled);
+  if (GPTLpatch_apply (true, 0) != 0)
+    return GPTLerror ("%s: cannot write to the code of patchable functions\n", thisfunc);
+  return nsites;
+#else
+  GPTLwarn ("GPTLpatch_init: function patching is not available on this system\n");
+  return 0;
+#endif
+}
+
+/*
+** GPTLpatch_apply: Patch (on) or restore (off) all patchable functions
+**
+** Input arguments:
+**   on: patch (true) or restore (false)
+** Output arguments:
+**   disabled: if not null, set to !on under the same lock, so that when threads enable and
+**             disable concurrently, the last one's flag agrees with the state of the code
+**
+** Return value: 0 (success) or -1 (failure)
+*/
+int GPTLpatch_apply (bool on, volatile bool *disabled)
+{
+  int ret = 0;
+
+#ifdef HAVE_PATCHING
+  (void) pthread_mutex_lock (&lock);
+  if (disabled)
+    *disabled = ! on;
+  if (on != applied && nsites > 0) {
+    if (write_sites (on) == 0)
+      applied = on;
+    else
+      ret = -1;
+  }
+  (void) pthread_mutex_unlock (&lock);
+#else
+  if (disabled)
+    *disabled = ! on;
+#endif
+  return ret;
+}
+
+// GPTLpatch_finalize: Restore all patched functions and forget them
+void GPTLpatch_finalize (void)
+{
+#ifdef HAVE_PATCHING
+  int n;
+
+  (void) GPTLpatch_apply (false, 0);
+  __atomic_add_fetch (&generation, 1, __ATOMIC_RELAXED);
+  for (n = 0; n < nstubs; ++n)
+    (void) munmap (stubs[n], pagesize);
+  free (stubs);
+  free (sites);
+  stubs    = 0;
+  nstubs   = 0;
+  sites    = 0;
+  nsites   = 0;
+  sitesize = 0;
+#endif
+}
+
+#ifdef HAVE_PATCHING
+/*
+** get_xsize: Size of the XSAVE area for the register state enabled by the OS, rounded up to
+**   a multiple of 64 bytes, or 0 if XSAVE cannot be used
+*/
+static unsigned long get_xsize (void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if ( ! __get_cpuid (1, &eax, &ebx, &ecx, &edx) || ! (ecx & bit_OSXSAVE))
+    return 0;
+  if ( ! __get_cpuid_count (0xd, 0, &eax, &ebx, &ecx, &edx) || ebx < 576)
+    return 0;
+  return (ebx + 63) & ~63UL;
+}
+
+/*
+** add_object: dl_iterate_phdr callback recording the sleds of one loaded object. The section
+**   header is read from the file, and the list of sleds from memory, where it has been relocated
+**
+** Input arguments:
+**   info: name and load address of the object. The executable has an empty name
+**
+** Return value: 0 (continue with the next object)
+*/
+static int add_object (struct dl_phdr_info *info, size_t size, void *data)
+{
+  const char *path = info->dlpi_name[0] ? info->dlpi_name : "/proc/self/exe";
+  const ElfW(Ehdr) *ehdr;
+  const ElfW(Shdr) *shdr;
+  const char *shstrtab;
+  uintptr_t *entries = 0;
+  size_t nentries = 0;
+  Site *newsites;
+  void *map;
+  struct stat st;
+  size_t n;
+  int fd;
+  int i;
+  int nsplit = 0;             // sleds not patched because no single store can write them
+  unsigned char *sled;
+
+  if ((fd = open (path, O_RDONLY)) < 0)
+    return 0;
+  if (fstat (fd, &st) != 0 || (size_t) st.st_size < sizeof (ElfW(Ehdr))) {
+    (void) close (fd);
+    return 0;
+  }
+  map = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  (void) close (fd);
+  if (map == MAP_FAILED)
+    return 0;
+
+  ehdr = (const ElfW(Ehdr) *) map;
+  if (memcmp (ehdr->e_ident, ELFMAG, SELFMAG) == 0 &&
+      ehdr->e_shentsize == sizeof (ElfW(Shdr)) && ehdr->e_shstrndx < ehdr->e_shnum &&
+      ehdr->e_shoff + (size_t) ehdr->e_shnum * sizeof (ElfW(Shdr)) <= (size_t) st.st_size) {
+    shdr = (const ElfW(Shdr) *) ((const char *) map + ehdr->e_shoff);
+    if (shdr[ehdr->e_shstrndx].sh_offset + shdr[ehdr->e_shstrndx].sh_size <= (size_t) st.st_size) {
+      shstrtab = (const char *) map + shdr[ehdr->e_shstrndx].sh_offset;
+      for (i = 0; i < ehdr->e_shnum; ++i) {
+	if (shdr[i].sh_name < shdr[ehdr->e_shstrndx].sh_size && shdr[i].sh_addr != 0 &&
+	    strcmp (shstrtab + shdr[i].sh_name, "__patchable_function_entries") == 0) {
+	  entries  = (uintptr_t *) (info->dlpi_addr + shdr[i].sh_addr);
+	  nentries = shdr[i].sh_size / sizeof (uintptr_t);
+	  break;
+	}
+      }
+    }
+  }
+  (void) munmap (map, st.st_size);
+
+  for (n = 0; n < nentries; ++n) {
+    sled = (unsigned char *) entries[n];
+    // Entries of functions discarded by the linker are 0. Anything not a NOP sled is left alone
+    if ( ! sled || memcmp (sled, "\x90\x90\x90\x90\x90", SLED) != 0)
+      continue;
+    // An excluded function is never patched
+    if ( ! GPTLfilter_timed (sled))
+      continue;
+    // Not writable by a single store (see write_sites)
+    if ( ! writable ((uintptr_t) sled)) {
+      ++nsplit;
+      continue;
+    }
+    if (nsites == sitesize) {
+      if ( ! (newsites = (Site *) realloc (sites, MAX (256, 2*sitesize) * sizeof (Site)))) {
+	GPTLwarn ("add_object: realloc failure: some functions of %s are not patched\n", path);
+	break;
+      }
+      sites    = newsites;
+      sitesize = MAX (256, 2*sitesize);
+    }
+    sites[nsites++].sled = sled;
+  }
+  if (nsplit > 0)
+    GPTLwarn ("add_object: %d functions of %s not patched: their entry crosses a 16-byte "
+	      "boundary\n", nsplit, path);
+  return 0;
+}
+
+// writable: Whether the sled at addr lies within one aligned word which a single store writes
+static inline bool writable (uintptr_t addr)
+{
+  return (addr & 7) + SLED <= 8 || (have_cx16 && (addr & 15) + SLED <= 16);
+}
+
+// in_range: Whether a call at sled can reach target with a 32-bit displacement
+static inline bool in_range (const unsigned char *sled, const unsigned char *target)
+{
+  long disp = (long) (target - (sled + SLED));
+
+  return disp >= INT32_MIN && disp <= INT32_MAX;
+}
+
+// make_call: Fill in the call instruction of a site
+static int make_call (Site *site)
+{
+  unsigned char *target = (unsigned char *) entry_tramp;
+  int32_t disp;
+
+  if ( ! in_range (site->sled, target) && ! (target = get_stub (site->sled)))
+    return -1;
+  disp = (int32_t) (target - (site->sled + SLED));
+  site->call[0] = CALL;
+  memcpy (&site->call[1], &disp, sizeof (disp));
+  return 0;
+}
+
+/*
+** get_stub: Find or make a jump to entry_tramp within call range of sled. Code in an executable
+**   is usually too far from shared libraries, so a page is mapped near it
+**
+** Return value: address of the stub, or NULL if none could be placed
+*/
+static unsigned char *get_stub (unsigned char *sled)
+{
+  unsigned char **newstubs;
+  unsigned char *page;
+  uintptr_t base, offset, hint;
+  uintptr_t target = (uintptr_t) entry_tramp;
+  int n;
+
+  for (n = 0; n < nstubs; ++n)
+    if (in_range (sled, stubs[n]))
+      return stubs[n];
+
+  if ( ! (newstubs = (unsigned char **) realloc (stubs, (nstubs+1) * sizeof (unsigned char *))))
+    return 0;
+  stubs = newstubs;
+
+  // Try 64 MB below the code, then above, then 128 MB below...
+  for (n = 2; n < 64; ++n) {
+    offset = (uintptr_t) (n / 2) << 26;
+    base   = (uintptr_t) sled & ~((uintptr_t) pagesize - 1);
+    hint   = n % 2 ? base + offset : base - offset;
+    page = (unsigned char *) mmap ((void *) hint, pagesize, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED)
+      continue;
+    if ( ! in_range (sled, page)) {
+      (void) munmap (page, pagesize);
+      continue;
+    }
+    // jmp *0(%rip); .quad entry_tramp
+    memcpy (page, "\xff\x25\x00\x00\x00\x00", 6);
+    memcpy (page + 6, &target, sizeof (target));
+    if (mprotect (page, pagesize, PROT_READ | PROT_EXEC) != 0) {
+      (void) munmap (page, pagesize);
+      return 0;
+    }
+    stubs[nstubs++] = page;
+    return page;
+  }
+  return 0;
+}
+
+/*
+** write_sites: Write the calls (on) or NOPs (off) into all sites. Each page is made writable
+**   only while it is written. Every sled lies within one aligned 8- or 16-byte word (see
+**   add_object) and is replaced by a single store, so a thread executing it sees either the
+**   old or the new instruction
+**
+** Return value: 0 (success) or -1 (a page could not be made writable)
+*/
+static int write_sites (bool on)
+{
+  static const unsigned char nops[SLED] = {NOP, NOP, NOP, NOP, NOP};
+  const unsigned char *bytes;
+  uintptr_t mask = ~((uintptr_t) pagesize - 1);
+  uintptr_t page;
+  uintptr_t lastpage = 0;     // start of the writable pages
+  size_t len = 0;             // length of the writable pages
+  uintptr_t addr;
+  uint64_t word;
+  int n;
+
+  for (n = 0; n < nsites; ++n) {
+    // Make the page(s) spanned by the sled writable. Sites are sorted by address
+    addr = (uintptr_t) sites[n].sled;
+    page = addr & mask;
+    if (page != lastpage || ((addr + SLED - 1) & mask) != page + len - pagesize) {
+      if (len > 0)
+	(void) mprotect ((void *) lastpage, len, PROT_READ | PROT_EXEC);
+      lastpage = page;
+      len      = ((addr + SLED - 1) & mask) - page + pagesize;
+      if (mprotect ((void *) lastpage, len, PROT_READ | PROT_WRITE | PROT_EXEC) != 0)
+	return -1;
+    }
+    bytes = on ? sites[n].call : nops;
+    if ((addr & 7) + SLED <= 8) {
+      word = __atomic_load_n ((uint64_t *) (addr & ~(uintptr_t) 7), __ATOMIC_RELAXED);
+      memcpy ((unsigned char *) &word + (addr & 7), bytes, SLED);
+      __atomic_store_n ((uint64_t *) (addr & ~(uintptr_t) 7), word, __ATOMIC_SEQ_CST);
+    } else {
+      store16 ((uint64_t *) (addr & ~(uintptr_t) 15), bytes, addr & 15);
+    }
+  }
+  if (len > 0)
+    (void) mprotect ((void *) lastpage, len, PROT_READ | PROT_EXEC);
+  return 0;
+}
+
+// store16: Write the sled at offset off of the aligned 16 bytes at p by one lock cmpxchg16b
+static inline void store16 (uint64_t *p, const unsigned char *bytes, uintptr_t off)
+{
+  uint64_t old[2];
+  uint64_t new[2];
+  bool done;
+
+  old[0] = p[0];
+  old[1] = p[1];
+  do {
+    new[0] = old[0];
+    new[1] = old[1];
+    memcpy ((unsigned char *) new + off, bytes, SLED);
+    __asm__ __volatile__ ("lock cmpxchg16b %1"
+			  : "=@ccz" (done), "+m" (*p), "+a" (old[0]), "+d" (old[1])
+			  : "b" (new[0]), "c" (new[1])
+			  : "memory", "cc");
+  } while ( ! done);
+}
+
+static int cmp_site (const void *a, const void *b)
+{
+  const unsigned char *sa = ((const Site *) a)->sled;
+  const unsigned char *sb = ((const Site *) b)->sled;
+
+  return (sa > sb) - (sa < sb);
+}
+#endif
@@ -0,0 +1,567 @@
+/*
+** perfevents.c
+**
+** Author: Jim Rosinski
+**
+** Per-region counters from the Linux perf_event_open system call, for when PAPI is not
+** available. Software events (task-clock, context switches, CPU migrations, page faults) work
+** everywhere the kernel supports perf, virtual machines included, and hardware events where
+** the CPU and the kernel expose them. Each thread opens the enabled events as one group the
+** first time it calls GPTL, counting only itself. Timers read the group at start and stop and
+** accumulate the difference, as is done for PAPI.
+**
+** A read is one rdpmc instruction per counter when every counter is a hardware counter and
+** the kernel allows user space to read it (x86 only), and otherwise one read() of the group.
+** Where perf_event_paranoid forbids counting in the kernel, events count user mode only:
+** context switches and migrations, which happen in the kernel, then read zero.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+#include "thread.h"
+#include "gptl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PERFEVENTS
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#if ( defined __x86_64__ || defined __i386__ )
+#define HAVE_RDPMC
+#endif
+
+typedef struct {
+  int option;               // GPTLsetoption code
+  const char *name;         // event name, as given to GPTLget_eventvalue
+  const char *str8;         // 8-character column heading
+  unsigned int type;        // perf_event_attr type
+  unsigned long long config;// perf_event_attr config
+} Event;
+
+static const Event eventlist[] = {
+  {GPTLperf_task_clock,     "task-clock",       "Task_clk", PERF_TYPE_SOFTWARE,
+   PERF_COUNT_SW_TASK_CLOCK},
+  {GPTLperf_ctx_switches,   "context-switches", "Ctx_swit", PERF_TYPE_SOFTWARE,
+   PERF_COUNT_SW_CONTEXT_SWITCHES},
+  {GPTLperf_cpu_migrations, "cpu-migrations",   "Migrate ", PERF_TYPE_SOFTWARE,
+   PERF_COUNT_SW_CPU_MIGRATIONS},
+  {GPTLperf_page_faults,    "page-faults",      "Pg_fault", PERF_TYPE_SOFTWARE,
+   PERF_COUNT_SW_PAGE_FAULTS},
+  {GPTLperf_cycles,         "cycles",           "Cycles  ", PERF_TYPE_HARDWARE,
+   PERF_COUNT_HW_CPU_CYCLES},
+  {GPTLperf_instructions,   "instructions",     "Instr   ", PERF_TYPE_HARDWARE,
+   PERF_COUNT_HW_INSTRUCTIONS},
+  {GPTLperf_cache_misses,   "cache-misses",     "Cache_ms", PERF_TYPE_HARDWARE,
+   PERF_COUNT_HW_CACHE_MISSES},
+  {GPTLperf_branch_misses,  "branch-misses",    "Br_miss ", PERF_TYPE_HARDWARE,
+   PERF_COUNT_HW_BRANCH_MISSES}
+};
+static const int neventlist = sizeof (eventlist) / sizeof (Event);
+
+// A printed column: one counter, or the ratio of two for a derived event
+typedef struct {
+  const char *name;
+  const char *str8;
+  int numidx;               // counter index of the value, or of the numerator
+  int denomidx;             // counter index of the denominator (-1 if not derived)
+} Column;
+
+static Column columns[MAX_PERF];          // printed, in the order enabled
+static int ncolumns = 0;
+static const Event *counters[MAX_PERF];   // counted, including those needed by derived events
+static bool useronly[MAX_PERF];           // counter excludes kernel mode
+static int ncounters = 0;
+
+typedef struct {
+  int fd[MAX_PERF];                              // fd[0] is the group leader
+  struct perf_event_mmap_page *page[MAX_PERF];   // mapped for rdpmc (NULL if not)
+  bool opened;              // counters are open
+  bool rdpmc;               // every counter can be read with rdpmc
+} Perfthread;
+
+static Perfthread *threads = 0;  // per-thread counters
+static int nthreads = 0;         // size of threads
+static long pagesize = 0;
+
+static const Event *get_event (const int);
+static int add_counter (const Event *);
+static int add_column (const char *, const char *, int, int);
+static int open_event (const Event *, int, bool);
+static inline int read_counters (const int, long long *);
+#ifdef HAVE_RDPMC
+static inline bool read_rdpmc (volatile struct perf_event_mmap_page *, long long *);
+#endif
+#endif
+
+/*
+** GPTLperf_setoption: Enable a perf_event_open counter. Called from GPTLsetoption for
+**   options it does not handle itself. Each event is opened once here to find out whether
+**   it is available, so that a failure is reported to the caller of GPTLsetoption.
+**
+** Input arguments:
+**   option: GPTLsetoption code
+**   val:    true to enable. Counters cannot be disabled once enabled
+**
+** Return value: 0 (success), 1 (not a perf_event_open option) or GPTLerror (failure)
+*/
+int GPTLperf_setoption (const int option, const int val)
+{
+  static const char *thisfunc = "GPTLperf_setoption";
+#ifdef HAVE_PERFEVENTS
+  const Event *event = 0;
+  int n;
+  int num, denom;
+
+  if (option != GPTLperf_ipc && ! (event = get_event (option)))
+    return 1;
+
+  if ( ! val)
+    return 0;
+
+  if (option == GPTLperf_ipc) {
+    if ((num = add_counter (get_event (GPTLperf_instructions))) < 0 ||
+	(denom = add_counter (get_event (GPTLperf_cycles))) < 0)
+      return GPTLerror ("%s: IPC needs instructions and cycles\n", thisfunc);
+    return add_column ("IPC", "IPC     ", num, denom);
+  }
+
+  for (n = 0; n < ncolumns; ++n)
+    if (strcmp (columns[n].name, event->name) == 0)
+      return GPTLerror ("%s: %s is already enabled\n", thisfunc, event->name);
+  if ((num = add_counter (event)) < 0)
+    return num;
+  return add_column (event->name, event->str8, num, -1);
+#else
+  if (option >= GPTLperf_task_clock && option <= GPTLperf_ipc)
+    return GPTLerror ("%s: option %d needs perf_event_open, which is not available\n",
+		      thisfunc, option);
+  return 1;
+#endif
+}
+
+/*
+** GPTLperf_initialize: Allocate per-thread state and open the counters of the calling
+**   thread. Called from GPTLinitialize when a counter has been enabled. Other threads open
+**   theirs in GPTLperf_thread_start on their first GPTL call.
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLperf_initialize (void)
+{
+#ifdef HAVE_PERFEVENTS
+  int t;
+  static const char *thisfunc = "GPTLperf_initialize";
+
+  if (ncounters == 0 || threads)
+    return 0;
+
+  pagesize = sysconf (_SC_PAGESIZE);
+  nthreads = MAX (GPTLmax_threads, 1);
+  threads  = (Perfthread *) GPTLallocate (nthreads * sizeof (Perfthread), thisfunc);
+  memset (threads, 0, nthreads * sizeof (Perfthread));
+
+  if ((t = GPTLget_thread_num ()) < 0 || GPTLperf_thread_start (t) != 0)
+    return GPTLerror ("%s: failed to open counters of the calling thread\n", thisfunc);
+#endif
+  return 0;
+}
+
+/*
+** GPTLperf_thread_start: Open the counters of the calling thread. Called by the threading
+**   layer the first time a thread calls GPTL. Does nothing if no counters are enabled or the
+**   thread has already opened them.
+**
+** Input arguments:
+**   t: GPTL thread index of the calling thread
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLperf_thread_start (int t)
+{
+#ifdef HAVE_PERFEVENTS
+  Perfthread *pt;
+  void *page;
+  int n;
+  int err;
+  const char *name;
+  static const char *thisfunc = "GPTLperf_thread_start";
+
+  if ( ! threads || t < 0 || t >= nthreads || threads[t].opened)
+    return 0;
+
+  pt = &threads[t];
+#ifdef HAVE_RDPMC
+  pt->rdpmc = true;
+#endif
+  for (n = 0; n < ncounters; ++n) {
+    if ((pt->fd[n] = open_event (counters[n], n == 0 ? -1 : pt->fd[0], useronly[n])) < 0) {
+      err = errno;
+      name = counters[n]->name;
+      while (--n >= 0) {
+	if (pt->page[n])
+	  (void) munmap (pt->page[n], pagesize);
+	pt->page[n] = 0;
+	(void) close (pt->fd[n]);
+      }
+      return GPTLerror ("%s: thread %d cannot open %s: %s\n",
+			thisfunc, t, name, strerror (err));
+    }
+#ifdef HAVE_RDPMC
+    // Only hardware counters live in a PMC. The mapped page tells where, and whether rdpmc
+    // is allowed
+    page = MAP_FAILED;
+    if (counters[n]->type == PERF_TYPE_HARDWARE)
+      page = mmap (0, pagesize, PROT_READ, MAP_SHARED, pt->fd[n], 0);
+    if (page == MAP_FAILED) {
+      pt->rdpmc = false;
+    } else {
+      pt->page[n] = (struct perf_event_mmap_page *) page;
+      if ( ! pt->page[n]->cap_user_rdpmc)
+	pt->rdpmc = false;
+    }
+#else
+    (void) page;
+#endif
+  }
+  pt->opened = true;
+#endif
+  return 0;
+}
+
+#ifdef HAVE_PERFEVENTS
+/*
+** GPTLperf_start: Read the counters at the start of a region
+**
+** Input arguments:
+**   t:    thread number
+**
+** Output arguments:
+**   perf: counter values are stored in perf->last
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLperf_start (const int t, Perfstats *perf)
+{
+  if (read_counters (t, perf->last) != 0)
+    return GPTLerror ("GPTLperf_start: read failure on thread %d\n", t);
+  return 0;
+}
+
+/*
+** GPTLperf_stop: Read the counters at the end of a region and accumulate the difference
+**
+** Input arguments:
+**   t:    thread number
+**
+** Input/output arguments:
+**   perf: counter differences are added to perf->accum
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLperf_stop (const int t, Perfstats *perf)
+{
+  long long values[MAX_PERF];
+  int n;
+
+  if (read_counters (t, values) != 0)
+    return GPTLerror ("GPTLperf_stop: read failure on thread %d\n", t);
+
+  for (n = 0; n < ncounters; ++n)
+    perf->accum[n] += values[n] - perf->last[n];
+  return 0;
+}
+
+/*
+** read_counters: Read all counters of a thread. A thread whose counters could not be opened
+**   reads zeros.
+**
+** Input arguments:
+**   t: thread number
+**
+** Output arguments:
+**   values: counter values
+**
+** Return value: 0 (success) or -1 (failure)
+*/
+static inline int read_counters (const int t, long long *values)
+{
+  Perfthread *pt = &threads[t];
+  unsigned long long buf[1+MAX_PERF];   // PERF_FORMAT_GROUP: number of counters, then values
+  int n;
+
+  if ( ! pt->opened) {
+    memset (values, 0, ncounters * sizeof (long long));
+    return 0;
+  }
+
+#ifdef HAVE_RDPMC
+  if (pt->rdpmc) {
+    for (n = 0; n < ncounters; ++n)
+      if ( ! read_rdpmc (pt->page[n], &values[n]))
+	break;
+    if (n == ncounters)
+      return 0;
+  }
+#endif
+
+  if (read (pt->fd[0], buf, (1+ncounters) * sizeof (buf[0])) !=
+      (ssize_t) ((1+ncounters) * sizeof (buf[0])))
+    return -1;
+  for (n = 0; n < ncounters; ++n)
+    values[n] = (long long) buf[1+n];
+  return 0;
+}
+
+#ifdef HAVE_RDPMC
+/*
+** read_rdpmc: Read a hardware counter from user space, per the protocol of
+**   linux/perf_event.h: retry if the kernel updated the page while it was being read
+**
+** Input arguments:
+**   page: mapped page of the counter
+**
+** Output arguments:
+**   value: counter value
+**
+** Return value: true (success) or false (counter is not in a PMC right now: use read())
+*/
+static inline bool read_rdpmc (volatile struct perf_event_mmap_page *page, long long *value)
+{
+  unsigned int seq, idx, width;
+  unsigned int lo, hi;
+  long long count, pmc;
+
+  do {
+    seq = page->lock;
+    __asm__ __volatile__ ("" ::: "memory");
+    idx = page->index;
+    count = page->offset;
+    if (idx == 0 || ! page->cap_user_rdpmc)
+      return false;
+    width = page->pmc_width;
+    __asm__ __volatile__ ("rdpmc" : "=a" (lo), "=d" (hi) : "c" (idx - 1));
+    // Sign extend the pmc_width bits of the PMC
+    pmc = (long long) (((unsigned long long) hi << 32) | lo);
+    pmc <<= 64 - width;
+    pmc >>= 64 - width;
+    count += pmc;
+    __asm__ __volatile__ ("" ::: "memory");
+  } while (page->lock != seq);
+
+  *value = count;
+  return true;
+}
+#endif
+
+// GPTLperf_prstr: Print the column headings of the enabled counters
+void GPTLperf_prstr (FILE *fp)
+{
+  int n;
+
+  for (n = 0; n < ncolumns; ++n)
+    fprintf (fp, " %8.8s", columns[n].str8);
+}
+
+/*
+** GPTLperf_pr: Print the counter values of a timer
+**
+** Input arguments:
+**   fp:   output stream
+**   perf: counters of the timer
+*/
+void GPTLperf_pr (FILE *fp, const Perfstats *perf)
+{
+  int n;
+  long long value;
+  long long denom;
+
+  for (n = 0; n < ncolumns; ++n) {
+    value = perf->accum[columns[n].numidx];
+    if (columns[n].denomidx < 0) {
+      if (value < PRTHRESH)
+	fprintf (fp, " %8lld", value);
+      else
+	fprintf (fp, " %8.2e", (double) value);
+    } else {
+      denom = perf->accum[columns[n].denomidx];
+      fprintf (fp, " %8.3f", denom > 0 ? (double) value / denom : 0.);
+    }
+  }
+}
+
+// GPTLperf_add: Add the counters of tin to those of tout
+void GPTLperf_add (Perfstats *tout, const Perfstats *tin)
+{
+  int n;
+
+  for (n = 0; n < ncounters; ++n)
+    tout->accum[n] += tin->accum[n];
+}
+
+// GPTLperf_printenabled: Describe the enabled counters for the output preamble
+void GPTLperf_printenabled (FILE *fp)
+{
+  int n;
+
+  fprintf (fp, "  perf_event_open counters (read with %s):\n",
+	   (threads && threads[0].rdpmc) ? "rdpmc" : "read()");
+  for (n = 0; n < ncounters; ++n)
+    fprintf (fp, "    %s%s\n", counters[n]->name, useronly[n] ? " (user mode only)" : "");
+  for (n = 0; n < ncolumns; ++n)
+    if (columns[n].denomidx >= 0)
+      fprintf (fp, "    %s = %s / %s\n", columns[n].name,
+	       counters[columns[n].numidx]->name, counters[columns[n].denomidx]->name);
+}
+
+/*
+** GPTLperf_get_eventvalue: Return the value of an enabled counter for a timer
+**
+** Input arguments:
+**   eventname: event name, e.g. "task-clock" or "IPC"
+**   perf:      counters of the timer
+**
+** Output arguments:
+**   value: value of the event
+**
+** Return value: 0 (success) or 1 (eventname is not an enabled perf_event_open counter)
+*/
+int GPTLperf_get_eventvalue (const char *eventname, const Perfstats *perf, double *value)
+{
+  int n;
+  long long denom;
+
+  for (n = 0; n < ncolumns; ++n) {
+    if (strcmp (eventname, columns[n].name) == 0) {
+      if (columns[n].denomidx < 0) {
+	*value = (double) perf->accum[columns[n].numidx];
+      } else {
+	denom = perf->accum[columns[n].denomidx];
+	*value = denom > 0 ? (double) perf->accum[columns[n].numidx] / denom : 0.;
+      }
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// get_event: Find an event by its GPTLsetoption code (NULL if it is not a perf option)
+static const Event *get_event (const int option)
+{
+  int n;
+
+  for (n = 0; n < neventlist; ++n)
+    if (eventlist[n].option == option)
+      return &eventlist[n];
+  return 0;
+}
+
+/*
+** add_counter: Add an event to the counted events unless already there. If counting in the
+**   kernel is not allowed, fall back to counting user mode only
+**
+** Input arguments:
+**   event: event to count
+**
+** Return value: counter index, or GPTLerror (event cannot be opened or too many counters)
+*/
+static int add_counter (const Event *event)
+{
+  int n;
+  int fd;
+  static const char *thisfunc = "add_counter";
+
+  for (n = 0; n < ncounters; ++n)
+    if (counters[n] == event)
+      return n;
+
+  if (ncounters == MAX_PERF)
+    return GPTLerror ("%s: too many counters: max is %d\n", thisfunc, MAX_PERF);
+
+  useronly[ncounters] = false;
+  if ((fd = open_event (event, -1, false)) < 0 && (errno == EACCES || errno == EPERM)) {
+    useronly[ncounters] = true;
+    fd = open_event (event, -1, true);
+  }
+  if (fd < 0)
+    return GPTLerror ("%s: %s is not available: %s\n", thisfunc, event->name, strerror (errno));
+  (void) close (fd);
+
+  counters[ncounters] = event;
+  return ncounters++;
+}
+
+// add_column: Add a printed column. Return value: 0 (success) or GPTLerror (too many)
+static int add_column (const char *name, const char *str8, int numidx, int denomidx)
+{
+  int n;
+  static const char *thisfunc = "add_column";
+
+  for (n = 0; n < ncolumns; ++n)
+    if (strcmp (columns[n].name, name) == 0)
+      return 0;
+
+  if (ncolumns == MAX_PERF)
+    return GPTLerror ("%s: too many counters: max is %d\n", thisfunc, MAX_PERF);
+
+  columns[ncolumns].name     = name;
+  columns[ncolumns].str8     = str8;
+  columns[ncolumns].numidx   = numidx;
+  columns[ncolumns].denomidx = denomidx;
+  ++ncolumns;
+  return 0;
+}
+
+/*
+** open_event: Open a counter of the calling thread, on whatever CPU it runs
+**
+** Input arguments:
+**   event:    event to count
+**   group_fd: group leader, or -1 to open a new group
+**   useronly: exclude kernel mode
+**
+** Return value: file descriptor, or -1 with errno set
+*/
+static int open_event (const Event *event, int group_fd, bool useronly)
+{
+  struct perf_event_attr attr;
+
+  memset (&attr, 0, sizeof (attr));
+  attr.size           = sizeof (attr);
+  attr.type           = event->type;
+  attr.config         = event->config;
+  attr.read_format    = PERF_FORMAT_GROUP;
+  attr.exclude_kernel = useronly;
+  attr.exclude_hv     = 1;
+  return (int) syscall (SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+// GPTLperf_finalize: Close the counters of all threads and forget the enabled events.
+// Called from GPTLfinalize
+void GPTLperf_finalize (void)
+{
+#ifdef HAVE_PERFEVENTS
+  int t, n;
+
+  for (t = 0; t < nthreads; ++t) {
+    if ( ! threads[t].opened)
+      continue;
+    for (n = ncounters-1; n >= 0; --n) {
+      if (threads[t].page[n])
+	(void) munmap (threads[t].page[n], pagesize);
+      (void) close (threads[t].fd[n]);
+    }
+  }
+  free (threads);
+  threads   = 0;
+  nthreads  = 0;
+  ncounters = 0;
+  ncolumns  = 0;
+#endif
+}
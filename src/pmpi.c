@@ -9,10 +9,14 @@
 #include "config.h"  // Must be first include
 #include "private.h"
 #include "gptl.h"
+#include "gptlmpi.h"
 #include <mpi.h>
 
 static bool sync_mpi = false;
 
+// Local prototypes
+static void clock_sync_world (void);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -32,6 +36,59 @@ int GPTLpmpi_setoption (const int option, const int val)
   return retval;
 }
 
+/*
+** MPI_Init, MPI_Init_thread, MPI_Finalize: Estimate the clock offset relative to rank 0 right
+** after MPI is up and again right before it goes away. The pair of estimates gives the drift.
+** Also point memory growth messages at procsiz.<rank> now that the rank is known.
+*/
+int MPI_Init (int *argc, char ***argv)
+{
+  int ret;
+
+  ret = PMPI_Init (argc, argv);
+  if (ret == MPI_SUCCESS) {
+    GPTLmemsampler_set_procsiz ();
+    clock_sync_world ();
+  }
+  return ret;
+}
+
+int MPI_Init_thread (int *argc, char ***argv, int required, int *provided)
+{
+  int ret;
+
+  ret = PMPI_Init_thread (argc, argv, required, provided);
+  if (ret == MPI_SUCCESS) {
+    GPTLmemsampler_set_procsiz ();
+    clock_sync_world ();
+  }
+  return ret;
+}
+
+int MPI_Finalize (void)
+{
+  clock_sync_world ();
+  return PMPI_Finalize ();
+}
+
+/*
+** clock_sync_world: Call GPTLclock_sync only if every rank has called GPTLinitialize, since
+** it is collective and offsets can only be expressed in terms of GPTL's underlying timer.
+** When the underlying timer is MPI_Wtime, GPTLinitialize necessarily comes after MPI_Init
+** so only the MPI_Finalize sync happens (no drift estimate).
+*/
+static void clock_sync_world (void)
+{
+  int ret;
+  int initialized;       // GPTLinitialize has been called on this rank
+  int allinitialized;    // GPTLinitialize has been called on all ranks
+
+  initialized = GPTLis_initialized ();
+  ret = PMPI_Allreduce (&initialized, &allinitialized, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+  if (ret == MPI_SUCCESS && allinitialized)
+    (void) GPTLclock_sync (MPI_COMM_WORLD);
+}
+
 int MPI_Send (const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm)
 {
   int ret;
@@ -0,0 +1,146 @@
+/*
+** pr_collective.c
+**
+** Author: Jim Rosinski
+**
+** Write the GPTLpr_file report of every rank into a single shared file with MPI-IO instead
+** of one file per rank. Only valid for MPI codes.
+**
+** File layout (all text):
+**   Header: one line padded to HDRLEN bytes giving the number of ranks and index layout
+**   Index:  one fixed-width line of IDXLEN bytes per rank: rank, byte offset, byte length
+**   Body:   rank reports in rank order, each starting with a banner line
+** Rank r's index line starts at byte HDRLEN + r*IDXLEN, so a reader can seek directly to it.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+#include "gptl.h"
+#include "gptlmpi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>      // INT_MAX
+
+#define HDRLEN 128       // bytes in the header line (including newline)
+#define IDXLEN 53        // bytes in each index line (including newline)
+
+/*
+** GPTLpr_collective: Collectively write the timing report of every rank in comm into one file.
+**                    Cost is 1 MPI_Exscan plus 2 collective writes regardless of the number
+**                    of ranks, so it avoids creating one file per rank at scale.
+**
+** Input arguments:
+**   comm:    communicator (e.g. MPI_COMM_WORLD)
+**   outfile: name of file to be written
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLpr_collective (MPI_Comm comm, const char *outfile)
+{
+  int ret;                 // return code
+  int iam;                 // my rank
+  int nranks;              // number of ranks in communicator
+  int idxbytes;            // bytes this rank writes into the header+index region
+  char *buf = 0;           // this rank's report, built in memory
+  size_t bufsize = 0;      // size of buf
+  char idxbuf[HDRLEN+IDXLEN+1]; // header (rank 0 only) plus this rank's index line
+  FILE *fp;                // memory stream the report is written to
+  long long mysize;        // size of this rank's report
+  long long myoffset = 0;  // offset of this rank's report from the start of the body
+  long long bodystart;     // offset of the first report from the start of the file
+  MPI_File fh;             // MPI-IO file handle
+  MPI_Offset off;          // offset of this rank's index line
+  MPI_Status status;       // required by MPI_File_write_at_all
+  bool writefail = false;  // a write failed: continue so other ranks do not hang
+  static const char *thisfunc = "GPTLpr_collective";
+
+  if ( ! GPTLis_initialized ())
+    return GPTLerror ("%s: GPTLinitialize() has not been called\n", thisfunc);
+
+  if ((ret = MPI_Comm_rank (comm, &iam)) != MPI_SUCCESS)
+    return GPTLerror ("%s: Bad return from MPI_Comm_rank=%d\n", thisfunc, ret);
+
+  if ((ret = MPI_Comm_size (comm, &nranks)) != MPI_SUCCESS)
+    return GPTLerror ("%s rank %d: Bad return from MPI_Comm_size=%d\n", thisfunc, iam, ret);
+
+  // Build this rank's report in memory. A failure here must not leave other ranks stuck in
+  // the collectives below, so write an empty report instead of returning early.
+  if ((fp = open_memstream (&buf, &bufsize))) {
+    fprintf (fp, "*** GPTL report for rank %d ***\n", iam);
+#ifdef HAVE_INTERPOSE
+    GPTLinterpose_pause ();   // the report must not add to the timers being printed
+#endif
+    if (GPTLpr_fp (fp) != 0)
+      GPTLwarn ("%s rank %d: Error in GPTLpr_fp\n", thisfunc, iam);
+#ifdef HAVE_INTERPOSE
+    GPTLinterpose_resume ();
+#endif
+    if (fclose (fp) != 0)
+      GPTLwarn ("%s rank %d: fclose of memory stream failed\n", thisfunc, iam);
+  } else {
+    GPTLwarn ("%s rank %d: open_memstream failed: report for this rank will be empty\n",
+	      thisfunc, iam);
+  }
+
+  if (bufsize > INT_MAX) {
+    GPTLwarn ("%s rank %d: report of %lu bytes is too large: truncating\n",
+	      thisfunc, iam, (unsigned long) bufsize);
+    bufsize = INT_MAX;
+  }
+
+  // Offset of each report within the body is the sum of the sizes of lower ranks
+  mysize = (long long) bufsize;
+  if ((ret = MPI_Exscan (&mysize, &myoffset, 1, MPI_LONG_LONG, MPI_SUM, comm)) != MPI_SUCCESS) {
+    free (buf);
+    return GPTLerror ("%s rank %d: Bad return from MPI_Exscan=%d\n", thisfunc, iam, ret);
+  }
+  if (iam == 0)
+    myoffset = 0;   // MPI_Exscan leaves the result undefined on rank 0
+  bodystart = HDRLEN + (long long) nranks * IDXLEN;
+
+  // Rank 0 writes the header immediately followed by its own index line
+  idxbytes = 0;
+  if (iam == 0) {
+    snprintf (idxbuf, HDRLEN, "GPTL collective output: nranks=%d header_bytes=%d index_bytes=%d",
+	      nranks, HDRLEN, IDXLEN);
+    memset (idxbuf + strlen (idxbuf), ' ', HDRLEN - strlen (idxbuf));
+    idxbuf[HDRLEN-1] = '\n';
+    idxbytes = HDRLEN;
+  }
+  snprintf (idxbuf + idxbytes, IDXLEN+1, "%10d %20lld %20lld\n",
+	    iam, bodystart + myoffset, mysize);
+  off = (iam == 0) ? 0 : HDRLEN + (MPI_Offset) iam * IDXLEN;
+  idxbytes += IDXLEN;
+
+  ret = MPI_File_open (comm, (char *) outfile, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+		       MPI_INFO_NULL, &fh);
+  if (ret != MPI_SUCCESS) {
+    free (buf);
+    return GPTLerror ("%s rank %d: Bad return from MPI_File_open=%d\n", thisfunc, iam, ret);
+  }
+
+  // Discard any previous contents which may be longer than what is about to be written
+  if ((ret = MPI_File_set_size (fh, 0)) != MPI_SUCCESS)
+    GPTLwarn ("%s rank %d: Bad return from MPI_File_set_size=%d\n", thisfunc, iam, ret);
+
+  ret = MPI_File_write_at_all (fh, off, idxbuf, idxbytes, MPI_CHAR, &status);
+  if (ret != MPI_SUCCESS)
+    writefail = true;
+
+  ret = MPI_File_write_at_all (fh, (MPI_Offset) (bodystart + myoffset), buf ? buf : "",
+			       (int) mysize, MPI_CHAR, &status);
+  if (ret != MPI_SUCCESS)
+    writefail = true;
+
+  free (buf);
+
+  if ((ret = MPI_File_close (&fh)) != MPI_SUCCESS)
+    return GPTLerror ("%s rank %d: Bad return from MPI_File_close=%d\n", thisfunc, iam, ret);
+
+  if (writefail)
+    return GPTLerror ("%s rank %d: Bad return from MPI_File_write_at_all\n", thisfunc, iam);
+
+  return 0;
+}
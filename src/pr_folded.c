@@ -0,0 +1,280 @@
+/*
+** pr_folded.c
+**
+** Author: Jim Rosinski
+**
+** Write the call tree in the "folded stack" format read by flame graph tools (flamegraph.pl,
+** inferno, speedscope): one line per call path, frames separated by ';', followed by the
+** self (exclusive) time of the last frame in microseconds.
+**
+** Timer stats are totals over all parents, so a timer called from several places has its
+** self time (and that of everything below it) split among its parents in proportion to the
+** number of calls each made. This never counts any time twice, unlike printing the subtree
+** under every parent. Edges which would close a loop (A called B at one point, B called A at
+** another) are not followed. In GPTLcct mode every timer has one parent and the split is exact.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+#include "gptl.h"
+#include "thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Paths contributing less than this many seconds are not expanded: in a deep graph with many
+// multiple-parent timers the number of distinct paths can otherwise grow exponentially
+#define MINPATHSEC 5.e-7
+
+typedef struct {
+  int child;         // index of child in nodes
+  double frac;       // fraction of child's calls made by this parent
+} Edge;
+
+typedef struct {
+  Timer **nodes;     // all timers of the thread, sorted by address
+  int nnodes;
+  int *first;        // edges of node i are edges[first[i]] .. edges[first[i+1]-1]
+  Edge *edges;
+  bool *onpath;      // node is on the path being written
+  char *path;        // frames of the path being written
+  size_t pathlen;
+  size_t pathsize;
+} Graph;
+
+static int cmp_addr (const void *, const void *);
+static int nodeidx (const Graph *, const Timer *);
+static int build_graph (Timer *, Graph *);
+static void free_graph (Graph *);
+static void write_paths (FILE *, Graph *, int, double);
+
+/*
+** GPTLpr_folded: Write folded stacks for all threads to a file
+**
+** Input arguments:
+**   outfile: name of file to be written. Stacks from all threads are written without a
+**            thread frame, so identical call paths on different threads appear as separate
+**            lines which flame graph tools add together. If there is more than one thread,
+**            outfile.threads is also written with a thread_<n> root frame for each thread.
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLpr_folded (const char *outfile)
+{
+  Timer **timers;
+  Graph graph;
+  FILE *fp;
+  FILE *fpt = 0;          // per-thread file
+  char *threadfile;
+  char thread[32];
+  int t;
+  int ret = 0;
+  static const char *thisfunc = "GPTLpr_folded";
+
+  if ( ! GPTLis_initialized ())
+    return GPTLerror ("%s: GPTLinitialize() has not been called\n", thisfunc);
+
+  if ( ! (fp = fopen (outfile, "w")))
+    return GPTLerror ("%s: cannot open %s for writing\n", thisfunc, outfile);
+
+  if (GPTLnthreads > 1) {
+    threadfile = (char *) GPTLallocate (strlen (outfile) + 9, thisfunc);
+    sprintf (threadfile, "%s.threads", outfile);
+    if ( ! (fpt = fopen (threadfile, "w")))
+      GPTLwarn ("%s: cannot open %s for writing: per-thread stacks skipped\n",
+		thisfunc, threadfile);
+    free (threadfile);
+  }
+
+#ifdef HAVE_INTERPOSE
+  GPTLinterpose_pause ();   // the output must not add to the timers being printed
+#endif
+  timers = GPTLget_timersaddr ();
+  (void) GPTLresolve_names (timers, GPTLnthreads);
+  for (t = 0; t < GPTLnthreads; ++t) {
+    if (build_graph (timers[t], &graph) != 0) {
+      ret = GPTLerror ("%s: out of memory building graph for thread %d\n", thisfunc, t);
+      break;
+    }
+    // Nodes are sorted by address, so GPTL_ROOT must be looked up
+    graph.pathlen = 0;
+    write_paths (fp, &graph, nodeidx (&graph, timers[t]), 1.);
+    if (fpt) {
+      graph.pathlen = snprintf (thread, sizeof (thread), "thread_%d", t);
+      strcpy (graph.path, thread);
+      write_paths (fpt, &graph, nodeidx (&graph, timers[t]), 1.);
+    }
+    free_graph (&graph);
+  }
+#ifdef HAVE_INTERPOSE
+  GPTLinterpose_resume ();
+#endif
+
+  if (fpt && fclose (fpt) != 0)
+    ret = GPTLerror ("%s: error closing per-thread file\n", thisfunc);
+  if (fclose (fp) != 0)
+    ret = GPTLerror ("%s: error closing %s\n", thisfunc, outfile);
+  return ret;
+}
+
+/*
+** write_paths: Write the line for one node and recurse into its children
+**
+** Input arguments:
+**   fp:     output stream
+**   graph:  graph of the thread. path holds the frames of the callers of node
+**   node:   index of timer to write
+**   weight: fraction of the timer's stats which belongs to this path
+*/
+static void write_paths (FILE *fp, Graph *graph, int node, double weight)
+{
+  const Timer *ptr = graph->nodes[node];
+  const char *name;
+  size_t savelen = graph->pathlen;
+  size_t namelen;
+  long long usec;
+  char *path;
+  char *c;
+  int e;
+
+  // GPTL_ROOT has no parents and is not a frame
+  if (ptr->nparent > 0) {
+    if (ptr->wall.accum * weight < MINPATHSEC)
+      return;
+
+    name = ptr->longname ? ptr->longname : ptr->name;
+    namelen = strlen (name);
+    if (graph->pathlen + namelen + 2 > graph->pathsize) {
+      if ( ! (path = (char *) realloc (graph->path, 2 * (graph->pathlen + namelen + 2)))) {
+	GPTLwarn ("write_paths: realloc error: path through %s not written\n", name);
+	return;
+      }
+      graph->path = path;
+      graph->pathsize = 2 * (graph->pathlen + namelen + 2);
+    }
+    if (graph->pathlen > 0)
+      graph->path[graph->pathlen++] = ';';
+    memcpy (graph->path + graph->pathlen, name, namelen + 1);
+    // ';' separates frames, and a name must not end the line with what looks like a count
+    for (c = graph->path + graph->pathlen; *c; ++c)
+      if (*c == ';' || *c == ' ')
+	*c = '_';
+    graph->pathlen += namelen;
+
+    usec = (long long) (MAX (0., ptr->wall.accum - ptr->wall.child) * weight * 1.e6 + 0.5);
+    if (usec > 0)
+      fprintf (fp, "%s %lld\n", graph->path, usec);
+  }
+
+  graph->onpath[node] = true;
+  for (e = graph->first[node]; e < graph->first[node+1]; ++e)
+    if ( ! graph->onpath[graph->edges[e].child])
+      write_paths (fp, graph, graph->edges[e].child, weight * graph->edges[e].frac);
+
+  graph->pathlen = savelen;
+  graph->path[savelen] = '\0';
+  graph->onpath[node] = false;
+}
+
+/*
+** build_graph: Construct parent->child edges from the parent arrays of every timer. The
+**   children arrays built by construct_tree are not used because depending on the print
+**   method they hold only one parent of each timer.
+**
+** Input arguments:
+**   root: GPTL_ROOT of the thread, followed by its linked list of timers
+**
+** Output arguments:
+**   graph: filled in. Free with free_graph
+**
+** Return value: 0 (success) or -1 (out of memory)
+*/
+static int build_graph (Timer *root, Graph *graph)
+{
+  Timer *ptr;
+  int *fill;
+  int nedges = 0;
+  int n, p, idx;
+  unsigned long ncalls;
+
+  memset (graph, 0, sizeof (Graph));
+  for (ptr = root; ptr; ptr = ptr->next) {
+    ++graph->nnodes;
+    nedges += ptr->nparent;
+  }
+
+  graph->nodes    = (Timer **) malloc (graph->nnodes * sizeof (Timer *));
+  graph->first    = (int *) calloc (graph->nnodes + 1, sizeof (int));
+  graph->edges    = (Edge *) malloc (MAX (1, nedges) * sizeof (Edge));
+  graph->onpath   = (bool *) calloc (graph->nnodes, sizeof (bool));
+  graph->pathsize = 1024;
+  graph->path     = (char *) malloc (graph->pathsize);
+  fill            = (int *) calloc (graph->nnodes + 1, sizeof (int));
+  if ( ! graph->nodes || ! graph->first || ! graph->edges || ! graph->onpath || ! graph->path ||
+       ! fill) {
+    free (fill);
+    free_graph (graph);
+    return -1;
+  }
+  graph->path[0] = '\0';
+
+  n = 0;
+  for (ptr = root; ptr; ptr = ptr->next)
+    graph->nodes[n++] = ptr;
+  qsort (graph->nodes, graph->nnodes, sizeof (Timer *), cmp_addr);
+
+  // Count edges per parent, then place them (compressed sparse row layout)
+  for (n = 0; n < graph->nnodes; ++n) {
+    ptr = graph->nodes[n];
+    for (p = 0; p < ptr->nparent; ++p)
+      if ((idx = nodeidx (graph, ptr->parent[p])) >= 0)
+	++graph->first[idx+1];
+  }
+  for (n = 0; n < graph->nnodes; ++n)
+    graph->first[n+1] += graph->first[n];
+
+  for (n = 0; n < graph->nnodes; ++n) {
+    ptr = graph->nodes[n];
+    ncalls = 0;
+    for (p = 0; p < ptr->nparent; ++p)
+      ncalls += ptr->parent_count[p];
+    for (p = 0; p < ptr->nparent; ++p) {
+      if ((idx = nodeidx (graph, ptr->parent[p])) < 0)
+	continue;
+      graph->edges[graph->first[idx] + fill[idx]].child = n;
+      graph->edges[graph->first[idx] + fill[idx]].frac  =
+	ncalls > 0 ? (double) ptr->parent_count[p] / ncalls : 1. / ptr->nparent;
+      ++fill[idx];
+    }
+  }
+  free (fill);
+  return 0;
+}
+
+static void free_graph (Graph *graph)
+{
+  free (graph->nodes);
+  free (graph->first);
+  free (graph->edges);
+  free (graph->onpath);
+  free (graph->path);
+  memset (graph, 0, sizeof (Graph));
+}
+
+// nodeidx: Index of ptr in graph->nodes, or -1 if not there
+static int nodeidx (const Graph *graph, const Timer *ptr)
+{
+  Timer **found;
+
+  found = (Timer **) bsearch (&ptr, graph->nodes, graph->nnodes, sizeof (Timer *), cmp_addr);
+  return found ? (int) (found - graph->nodes) : -1;
+}
+
+static int cmp_addr (const void *a, const void *b)
+{
+  const Timer *pa = *(Timer * const *) a;
+  const Timer *pb = *(Timer * const *) b;
+
+  return (pa > pb) - (pa < pb);
+}
@@ -19,7 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>        // sqrt
+#include <math.h>        // sqrt, fabs
 
 // MPI summary stats
 typedef struct {
@@ -45,9 +45,32 @@ typedef struct {
   char name[MAX_CHARS+1];  // timer name
 } Global;
 
+// Load imbalance stats for a single region across ranks (rank 0 only)
+typedef struct {
+  int region;              // index into global
+  int nranks;              // number of ranks which invoked the region
+  int maxrank;             // rank producing max
+  float mean;              // mean across ranks of per-rank max time across threads
+  float max;               // max across ranks
+  float min;               // min across ranks
+  float p10;               // 10th percentile across ranks
+  float p50;               // median across ranks
+  float p90;               // 90th percentile across ranks
+  float imbal;             // (max-mean)/max as a percentage
+  float savings;           // max-mean: time saved on the slowest rank if perfectly balanced
+} Imbal;
+
 // Local prototypes
 static void get_threadstats (int, char *, Timer **, Global *);
 static Timer *getentry_slowway (Timer *, char *);
+static int gather_ranktimes (MPI_Comm, int, int, int, const Global *, Timer **, float **);
+static void free_ranktimes (char *, float *, int, float **);
+static float get_ranktime (char *, Timer **);
+static void print_imbalance (FILE *, const char *, int, int, const Global *, const float *, int);
+static int cmpfloat (const void *, const void *);
+static int cmpsavings (const void *, const void *);
+static inline float quantile (const float *, int, float);
+static int pr_summary_file (MPI_Comm, const char *);
 
 /* 
 ** GPTLpr_summary_file: Gather and print MPI summary stats across threads and tasks.
@@ -60,6 +83,22 @@ static Timer *getentry_slowway (Timer *, char *);
 **   outfile: name of file to be written
 */
 int GPTLpr_summary_file (MPI_Comm comm, const char *outfile)
+{
+  int ret;
+
+#ifdef HAVE_INTERPOSE
+  // Calls made while writing the report must not add to the timers being gathered
+  GPTLinterpose_pause ();
+  ret = pr_summary_file (comm, outfile);
+  GPTLinterpose_resume ();
+#else
+  ret = pr_summary_file (comm, outfile);
+#endif
+  return ret;
+}
+
+// pr_summary_file: does the work for GPTLpr_summary_file
+static int pr_summary_file (MPI_Comm comm, const char *outfile)
 {
   int ret;             // return code
   int iam;             // my rank
@@ -90,6 +129,7 @@ int GPTLpr_summary_file (MPI_Comm comm, const char *outfile)
   static const int tag = 98789;                         // tag for MPI message
   static const int nbytes = sizeof (Global);            // number of bytes to be sent/recvd
   FILE *fp = 0;        // file handle to write to
+  float *ranktimes = 0;// per-rank time of every region (rank 0 only)
 #ifdef HAVE_PAPI
   int e;               // event index
 #endif
@@ -106,10 +146,11 @@ int GPTLpr_summary_file (MPI_Comm comm, const char *outfile)
   if ((ret = MPI_Comm_size (comm, &nranks)) != MPI_SUCCESS)
     return GPTLerror ("%s rank %d: Bad return from MPI_Comm_size=%d\n", thisfunc, iam, ret);
 
-  // Examine only thread 0 regions that have not been renamed due to long name (only applies
-  // to auto-profiled routines). The "longname" caveat is important because the naming truncation
-  // algorithm may have named the SAME region differently for different ranks
+  // Examine only thread 0 regions without a long name (only applies to auto-profiled routines).
+  // Regions are matched across ranks by name, and different long names may share the first
+  // MAX_CHARS characters
   timers = GPTLget_timersaddr ();
+  (void) GPTLresolve_names (timers, GPTLnthreads);
   nregions = 0;
   for (ptr = timers[0]->next; ptr; ptr = ptr->next)
     if ( ! ptr->longname)
@@ -260,6 +301,12 @@ int GPTLpr_summary_file (MPI_Comm comm, const char *outfile)
     }                    // End of "if (dorecv) {" block
   }                      // End of "for (incr =..." loop
 
+  // Load imbalance analysis needs the time of every rank for every region
+  if (GPTLdopr_imbal) {
+    if (gather_ranktimes (comm, iam, nranks, nregions, global, timers, &ranktimes) != 0)
+      return GPTLerror ("%s rank %d: Failure from gather_ranktimes\n", thisfunc, iam);
+  }
+
   // Rank 0 contains the final results. Print them
   if (iam == 0) {
     if ( ! (fp = fopen (outfile, "w"))) {
@@ -381,11 +428,17 @@ int GPTLpr_summary_file (MPI_Comm comm, const char *outfile)
 #endif
       fprintf (fp, "\n");
     }
+
+    if (GPTLdopr_imbal)
+      print_imbalance (fp, outfile, nranks, nregions, global, ranktimes, mnl);
+
     if (fp != stderr && fclose (fp) != 0)
       fprintf (stderr, "Attempt to close %s failed\n", outfile);
   }
   if (global)
     free (global);
+  if (ranktimes)
+    free (ranktimes);
   return 0;
 }
 
@@ -477,3 +530,282 @@ static Timer *getentry_slowway (Timer *timer, char *name)
   }
   return ptr;
 }
+
+/*
+** gather_ranktimes: Rank 0 broadcasts the names of all regions found across ranks, then gathers
+**                   the time taken by every rank in each of them. Unlike the tree reduction in
+**                   GPTLpr_summary_file, memory on rank 0 is nranks*nregions floats.
+**
+** Input arguments:
+**   comm:     communicator
+**   iam:      my rank
+**   nranks:   number of ranks in communicator
+**   nregions: number of regions in global (only meaningful on rank 0)
+**   global:   merged region stats (only meaningful on rank 0)
+**   timers:   array of linked lists of timers
+** Output arguments:
+**   ranktimes: rank 0 only: time for region n on rank p is ranktimes[p*nregions+n]. Negative
+**              means rank p never invoked region n
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+static int gather_ranktimes (MPI_Comm comm, int iam, int nranks, int nregions,
+			     const Global *global, Timer **timers, float **ranktimes)
+{
+  int ret;              // return code
+  int ngl;              // number of regions across all ranks (from rank 0)
+  int n;                // region index
+  char *names;          // region names broadcast from rank 0
+  float *mytimes;       // time for each region on this rank
+  static const char *thisfunc = "gather_ranktimes";
+
+  ngl = nregions;
+  if ((ret = MPI_Bcast (&ngl, 1, MPI_INT, 0, comm)) != MPI_SUCCESS)
+    return GPTLerror ("%s rank %d: Bad return from MPI_Bcast=%d\n", thisfunc, iam, ret);
+  if (ngl < 1)
+    return 0;
+
+  names = (char *) GPTLallocate (ngl * (MAX_CHARS+1), thisfunc);
+  mytimes = (float *) GPTLallocate (ngl * sizeof (float), thisfunc);
+  if (iam == 0) {
+    for (n = 0; n < ngl; ++n)
+      memcpy (&names[n*(MAX_CHARS+1)], global[n].name, MAX_CHARS+1);
+    *ranktimes = (float *) GPTLallocate (nranks * ngl * sizeof (float), thisfunc);
+  }
+
+  ret = MPI_Bcast (names, ngl * (MAX_CHARS+1), MPI_CHAR, 0, comm);
+  if (ret != MPI_SUCCESS) {
+    free_ranktimes (names, mytimes, iam, ranktimes);
+    return GPTLerror ("%s rank %d: Bad return from MPI_Bcast=%d\n", thisfunc, iam, ret);
+  }
+
+  for (n = 0; n < ngl; ++n)
+    mytimes[n] = get_ranktime (&names[n*(MAX_CHARS+1)], timers);
+
+  ret = MPI_Gather (mytimes, ngl, MPI_FLOAT, iam == 0 ? *ranktimes : 0, ngl, MPI_FLOAT, 0, comm);
+  if (ret != MPI_SUCCESS) {
+    free_ranktimes (names, mytimes, iam, ranktimes);
+    return GPTLerror ("%s rank %d: Bad return from MPI_Gather=%d\n", thisfunc, iam, ret);
+  }
+
+  free (names);
+  free (mytimes);
+  return 0;
+}
+
+// free_ranktimes: Free the buffers of gather_ranktimes on an error path
+static void free_ranktimes (char *names, float *mytimes, int iam, float **ranktimes)
+{
+  free (names);
+  free (mytimes);
+  if (iam == 0) {
+    free (*ranktimes);
+    *ranktimes = 0;
+  }
+}
+
+// get_ranktime: max time across threads for region "name", or -1 if no thread invoked it
+static float get_ranktime (char *name, Timer **timers)
+{
+  int t;
+  float ranktime = -1.;
+  Timer *ptr;
+
+  for (t = 0; t < GPTLnthreads; ++t)
+    if ((ptr = getentry_slowway (timers[t]->next, name)))
+      ranktime = MAX (ranktime, ptr->wall.accum);
+  return ranktime;
+}
+
+/*
+** print_imbalance: Print regions ranked by the time that would be saved if they were perfectly
+**                  load balanced, and ranks which are consistently slow across regions. Also
+**                  write the same numbers to <outfile>.imbalance as a whitespace-separated table.
+**
+** Input arguments:
+**   fp:        file to print to
+**   outfile:   name of summary file
+**   nranks:    number of ranks
+**   nregions:  number of regions
+**   global:    merged region stats
+**   ranktimes: time for region n on rank p is ranktimes[p*nregions+n]
+**   mnl:       max name length
+*/
+static void print_imbalance (FILE *fp, const char *outfile, int nranks, int nregions,
+			     const Global *global, const float *ranktimes, int mnl)
+{
+  int n, p, i;          // region, rank, and loop indices
+  int m;                // number of ranks which invoked a region
+  int nimbal = 0;       // number of regions analyzed
+  int nflagged;         // number of slow ranks
+  int *nslow;           // number of regions in which a rank was slow
+  int *nseen;           // number of regions analyzed in which a rank participated
+  int *flagged;         // slow ranks sorted by fraction of regions in which they were slow
+  float *sorted;        // times for a region sorted across ranks
+  float *dev;           // absolute deviations from the median
+  float mad;            // median absolute deviation
+  float val;            // time for a region on a rank
+  double sum;           // for mean
+  Imbal *imbal;         // per-region imbalance stats
+  FILE *mfp;            // machine-readable output
+  char *mfile;          // name of machine-readable output file
+  static const float slowfrac = 0.25;  // flag ranks slow in at least this fraction of regions
+  static const char *thisfunc = "print_imbalance";
+
+  if (nregions < 1 || ! ranktimes)
+    return;
+
+  imbal  = (Imbal *) GPTLallocate (nregions * sizeof (Imbal), thisfunc);
+  sorted = (float *) GPTLallocate (nranks * sizeof (float), thisfunc);
+  dev    = (float *) GPTLallocate (nranks * sizeof (float), thisfunc);
+  nslow  = (int *) GPTLallocate (nranks * sizeof (int), thisfunc);
+  nseen  = (int *) GPTLallocate (nranks * sizeof (int), thisfunc);
+  memset (nslow, 0, nranks * sizeof (int));
+  memset (nseen, 0, nranks * sizeof (int));
+
+  for (n = 0; n < nregions; ++n) {
+    // Stats are not trustworthy for regions still ON somewhere
+    if (global[n].notstopped > 0)
+      continue;
+
+    m = 0;
+    sum = 0.;
+    imbal[nimbal].maxrank = 0;
+    imbal[nimbal].max = -1.;
+    for (p = 0; p < nranks; ++p) {
+      val = ranktimes[p*nregions + n];
+      if (val < 0.)
+	continue;
+      sorted[m++] = val;
+      sum += val;
+      if (val > imbal[nimbal].max) {
+	imbal[nimbal].max = val;
+	imbal[nimbal].maxrank = p;
+      }
+    }
+    if (m == 0)
+      continue;
+
+    qsort (sorted, m, sizeof (float), cmpfloat);
+    imbal[nimbal].region  = n;
+    imbal[nimbal].nranks  = m;
+    imbal[nimbal].mean    = sum / m;
+    imbal[nimbal].min     = sorted[0];
+    imbal[nimbal].p10     = quantile (sorted, m, 0.1);
+    imbal[nimbal].p50     = quantile (sorted, m, 0.5);
+    imbal[nimbal].p90     = quantile (sorted, m, 0.9);
+    imbal[nimbal].savings = imbal[nimbal].max - imbal[nimbal].mean;
+    if (imbal[nimbal].max > 0.)
+      imbal[nimbal].imbal = 100. * imbal[nimbal].savings / imbal[nimbal].max;
+    else
+      imbal[nimbal].imbal = 0.;
+
+    // A rank is slow in a region if its time exceeds the median by more than 3 median absolute
+    // deviations and by more than 5%. Median-based so a few sick ranks can't hide themselves.
+    if (m > 2 && imbal[nimbal].p50 > 0.) {
+      for (i = 0; i < m; ++i)
+	dev[i] = fabs (sorted[i] - imbal[nimbal].p50);
+      qsort (dev, m, sizeof (float), cmpfloat);
+      mad = quantile (dev, m, 0.5);
+      for (p = 0; p < nranks; ++p) {
+	val = ranktimes[p*nregions + n];
+	if (val < 0.)
+	  continue;
+	++nseen[p];
+	if (val > imbal[nimbal].p50 + 3.*mad && val > 1.05*imbal[nimbal].p50)
+	  ++nslow[p];
+      }
+    }
+    ++nimbal;
+  }
+
+  qsort (imbal, nimbal, sizeof (Imbal), cmpsavings);
+
+  fprintf (fp, "\nLoad imbalance across ranks, ranked by potential savings if balanced:\n");
+  fprintf (fp, "Times are per-rank max across threads. 'imbal%%' is (max-mean)/max.\n"
+	   "'savings' is max-mean: time the slowest rank would save if all ranks took the mean.\n"
+	   "p10, p50, p90 are quantiles of the distribution across ranks.\n");
+  fprintf (fp, "\nname%*s nranks      mean       max       min       p10       p50       p90 "
+	   "imbal%%   savings maxrank\n", MAX (mnl - (int) strlen ("name"), 0), "");
+  for (i = 0; i < nimbal; ++i) {
+    n = imbal[i].region;
+    fprintf (fp, "%s%*s %6d %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %6.1f %9.3f %7d\n",
+	     global[n].name, MAX (mnl - (int) strlen (global[n].name), 0), "",
+	     imbal[i].nranks, imbal[i].mean, imbal[i].max, imbal[i].min,
+	     imbal[i].p10, imbal[i].p50, imbal[i].p90, imbal[i].imbal, imbal[i].savings,
+	     imbal[i].maxrank);
+  }
+
+  // Sort flagged ranks by fraction of regions in which they were slow
+  flagged = (int *) GPTLallocate (nranks * sizeof (int), thisfunc);
+  nflagged = 0;
+  for (p = 0; p < nranks; ++p) {
+    if (nslow[p] > 1 && nslow[p] >= slowfrac * nseen[p]) {
+      for (i = nflagged; i > 0 && 
+	     (float) nslow[flagged[i-1]] / nseen[flagged[i-1]] < (float) nslow[p] / nseen[p]; --i)
+	flagged[i] = flagged[i-1];
+      flagged[i] = p;
+      ++nflagged;
+    }
+  }
+
+  fprintf (fp, "\nRanks slower than median+3*MAD in at least %d%% of regions (possible sick nodes):\n",
+	   (int) (100.*slowfrac));
+  if (nflagged == 0) {
+    fprintf (fp, "none\n");
+  } else {
+    fprintf (fp, "  rank nslow nregions\n");
+    for (i = 0; i < nflagged; ++i)
+      fprintf (fp, "%6d %5d %8d\n", flagged[i], nslow[flagged[i]], nseen[flagged[i]]);
+  }
+
+  // Machine-readable version. Name comes last since it may contain blanks
+  mfile = (char *) GPTLallocate (strlen (outfile) + strlen (".imbalance") + 1, thisfunc);
+  sprintf (mfile, "%s.imbalance", outfile);
+  if ((mfp = fopen (mfile, "w"))) {
+    fprintf (mfp, "# nranks mean max min p10 p50 p90 imbal_pct savings maxrank name\n");
+    for (i = 0; i < nimbal; ++i) {
+      n = imbal[i].region;
+      fprintf (mfp, "%d %g %g %g %g %g %g %g %g %d %s\n", imbal[i].nranks, imbal[i].mean,
+	       imbal[i].max, imbal[i].min, imbal[i].p10, imbal[i].p50, imbal[i].p90,
+	       imbal[i].imbal, imbal[i].savings, imbal[i].maxrank, global[n].name);
+    }
+    fprintf (mfp, "# slow_rank nslow nregions\n");
+    for (i = 0; i < nflagged; ++i)
+      fprintf (mfp, "%d %d %d\n", flagged[i], nslow[flagged[i]], nseen[flagged[i]]);
+    if (fclose (mfp) != 0)
+      fprintf (stderr, "Attempt to close %s failed\n", mfile);
+  } else {
+    fprintf (stderr, "GPTL: %s: cannot open %s for writing\n", thisfunc, mfile);
+  }
+
+  free (mfile);
+  free (flagged);
+  free (nseen);
+  free (nslow);
+  free (dev);
+  free (sorted);
+  free (imbal);
+}
+
+// quantile: nearest-rank quantile q (0 to 1) of sorted array x of length m
+static inline float quantile (const float *x, int m, float q)
+{
+  return x[(int) (q*(m-1) + 0.5)];
+}
+
+// cmpfloat: ascending order for qsort
+static int cmpfloat (const void *x1, const void *x2)
+{
+  float f1 = *(const float *) x1;
+  float f2 = *(const float *) x2;
+  return (f1 > f2) - (f1 < f2);
+}
+
+// cmpsavings: descending order of potential savings for qsort
+static int cmpsavings (const void *x1, const void *x2)
+{
+  float s1 = ((const Imbal *) x1)->savings;
+  float s2 = ((const Imbal *) x2)->savings;
+  return (s1 < s2) - (s1 > s2);
+}
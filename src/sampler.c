@@ -0,0 +1,466 @@
+/*
+** sampler.c
+**
+** Author: Jim Rosinski
+**
+** Statistical sampling profiler. Each thread known to GPTL gets a POSIX timer on its own CPU
+** time clock which raises SIGPROF on that thread every GPTLsample_usec microseconds of CPU
+** time consumed. The handler charges the sample to the innermost running timer of the thread
+** and records the interrupted program counter in a per-thread table. The cost is independent
+** of how often timers are started and stopped, so it covers code which is too fine grained
+** to instrument, and sample counts give a cross-check on the instrumented CPU times.
+**
+** Everything done in the handler is async-signal-safe: it reads the callstack of its own
+** thread, bumps a counter in the timer, and claims or bumps a slot of a preallocated table.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+#include "thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ( defined HAVE_TIMER_CREATE && defined __linux__ )
+#define HAVE_SAMPLER
+#include <sched.h>         // sched_yield
+#include <signal.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/syscall.h>  // SYS_gettid
+#ifdef HAVE_DLADDR
+#include <dlfcn.h>
+#endif
+#endif
+
+#ifdef HAVE_SAMPLER
+// Older glibc has no name for the thread id member of struct sigevent
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+// Distinct (region, pc) pairs recorded per thread. Must be a power of 2
+#define TABLESIZE 8192
+// Slots claimed before further new pairs are dropped, to keep probe sequences short
+#define MAXFILL (3 * TABLESIZE / 4)
+// Functions listed under each region
+#define MAXFUNCS 10
+
+typedef struct {
+  Timer *region;            // innermost timer when the sample was taken
+  void *pc;                 // interrupted program counter
+  unsigned long count;      // number of samples
+} Sample;
+
+typedef struct {
+  Sample *table;            // TABLESIZE slots, region==0 means empty
+  int nfilled;              // slots in use
+  unsigned long ndropped;   // samples whose pair did not fit in table
+  unsigned long nsamples;   // all samples taken by the thread
+  timer_t timerid;          // CPU time timer of the thread
+  bool armed;               // timerid has been created
+} Threadsamples;
+
+// One output line: samples of a region in one function
+typedef struct {
+  Timer *region;
+  const void *func;         // start of function, or pc if it could not be found
+  const char *name;         // function name, or NULL
+  const char *module;       // shared object or executable containing pc, or NULL
+  unsigned long count;
+} Row;
+
+static volatile bool running = false;  // handler is installed and threads may be armed
+static volatile int nactive = 0;       // handlers in progress, waited for before freeing
+static Threadsamples *threads = 0;     // per-thread tables
+static int nthreads = 0;               // size of threads
+static Timer ***callstack;             // per-thread callstacks owned by gptl.c
+static Nofalse *stackidx;              // per-thread callstack depths owned by gptl.c
+static int usec;                       // CPU time between samples
+static struct sigaction oldact;        // SIGPROF action before GPTLsampler_start
+static __thread int mythread __attribute__ ((tls_model ("initial-exec"))) = -1;
+
+static void handler (int, siginfo_t *, void *);
+static void take_sample (siginfo_t *, void *);
+static inline void *get_pc (void *);
+static void symbolize (Row *, const void *);
+static int cmp_region_func (const void *, const void *);
+static int cmp_region_count (const void *, const void *);
+#endif
+
+/*
+** GPTLsampler_start: Install the SIGPROF handler and start sampling the calling thread.
+**                    Called from GPTLinitialize when GPTLsample_usec has been set. Other
+**                    threads are armed by GPTLsampler_thread_start on their first GPTL call.
+**
+** Input arguments:
+**   callstack_in: per-thread callstacks
+**   stackidx_in:  per-thread callstack depths
+**   usec_in:      CPU time between samples (microseconds)
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLsampler_start (Timer ***callstack_in, Nofalse *stackidx_in, int usec_in)
+{
+  static const char *thisfunc = "GPTLsampler_start";
+#ifdef HAVE_SAMPLER
+  struct sigaction act;
+  int t;
+
+  if (running)
+    return 0;
+
+  // Do not take over a SIGPROF handler which belongs to someone else (e.g. gprof)
+  if (sigaction (SIGPROF, NULL, &oldact) != 0)
+    return GPTLerror ("%s: sigaction query failed\n", thisfunc);
+  if ((oldact.sa_flags & SA_SIGINFO) ||
+      (oldact.sa_handler != SIG_DFL && oldact.sa_handler != SIG_IGN)) {
+    GPTLwarn ("%s: SIGPROF already has a handler: sampling not enabled\n", thisfunc);
+    return 0;
+  }
+
+  nthreads = MAX (GPTLmax_threads, 1);
+  threads  = (Threadsamples *) GPTLallocate (nthreads * sizeof (Threadsamples), thisfunc);
+  memset (threads, 0, nthreads * sizeof (Threadsamples));
+  callstack = callstack_in;
+  stackidx  = stackidx_in;
+  usec      = usec_in;
+
+  memset (&act, 0, sizeof (act));
+  act.sa_sigaction = handler;
+  act.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset (&act.sa_mask);
+  if (sigaction (SIGPROF, &act, NULL) != 0) {
+    free (threads);
+    threads = 0;
+    return GPTLerror ("%s: sigaction failed to install the SIGPROF handler\n", thisfunc);
+  }
+  running = true;
+
+  if ((t = GPTLget_thread_num ()) < 0 || GPTLsampler_thread_start (t) != 0) {
+    GPTLsampler_stop ();
+    return GPTLerror ("%s: failed to start sampling the calling thread\n", thisfunc);
+  }
+#else
+  GPTLwarn ("%s: sampling needs timer_create on Linux: not enabled\n", thisfunc);
+#endif
+  return 0;
+}
+
+/*
+** GPTLsampler_thread_start: Create and start the CPU time timer of the calling thread.
+**   Called by the threading layer the first time a thread calls GPTL. Does nothing if
+**   sampling is off or the thread is already being sampled.
+**
+** Input arguments:
+**   t: GPTL thread index of the calling thread
+**
+** Return value: 0 (success) or GPTLerror (failure)
+*/
+int GPTLsampler_thread_start (int t)
+{
+#ifdef HAVE_SAMPLER
+  struct sigevent sev;
+  struct itimerspec its;
+  Threadsamples *ts;
+  static const char *thisfunc = "GPTLsampler_thread_start";
+
+  if ( ! running || t < 0 || t >= nthreads || threads[t].armed)
+    return 0;
+
+  ts = &threads[t];
+  if ( ! ts->table) {
+    if ( ! (ts->table = (Sample *) calloc (TABLESIZE, sizeof (Sample))))
+      return GPTLerror ("%s: calloc failure for thread %d\n", thisfunc, t);
+  }
+
+  memset (&sev, 0, sizeof (sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo  = SIGPROF;
+  sev.sigev_notify_thread_id = (pid_t) syscall (SYS_gettid);
+  if (timer_create (CLOCK_THREAD_CPUTIME_ID, &sev, &ts->timerid) != 0)
+    return GPTLerror ("%s: timer_create failed for thread %d\n", thisfunc, t);
+
+  mythread = t;
+  ts->armed = true;
+  its.it_interval.tv_sec  = usec / 1000000;
+  its.it_interval.tv_nsec = (usec % 1000000) * 1000L;
+  its.it_value = its.it_interval;
+  if (timer_settime (ts->timerid, 0, &its, NULL) != 0)
+    return GPTLerror ("%s: timer_settime failed for thread %d\n", thisfunc, t);
+#endif
+  return 0;
+}
+
+// GPTLsampler_stop: Delete the timers of all threads and restore the previous SIGPROF action.
+// Called from GPTLfinalize before the timers are freed.
+void GPTLsampler_stop (void)
+{
+#ifdef HAVE_SAMPLER
+  int t;
+
+  if ( ! running)
+    return;
+
+  __atomic_store_n (&running, false, __ATOMIC_SEQ_CST);
+  // timer_delete also discards a signal from the timer which is still pending
+  for (t = 0; t < nthreads; ++t)
+    if (threads[t].armed)
+      (void) timer_delete (threads[t].timerid);
+  (void) sigaction (SIGPROF, &oldact, NULL);
+
+  // A handler on another thread which saw running set may still be using the tables
+  while (__atomic_load_n (&nactive, __ATOMIC_ACQUIRE) > 0)
+    sched_yield ();
+
+  for (t = 0; t < nthreads; ++t)
+    free (threads[t].table);
+  free (threads);
+  threads = 0;
+  nthreads = 0;
+#endif
+}
+
+// GPTLreset_samples: Discard the program counters recorded so far. Called from GPTLreset,
+// which zeros the per-timer sample counts
+void GPTLreset_samples (void)
+{
+#ifdef HAVE_SAMPLER
+  int t;
+
+  for (t = 0; t < nthreads; ++t) {
+    if (threads[t].table)
+      memset (threads[t].table, 0, TABLESIZE * sizeof (Sample));
+    threads[t].nfilled = 0;
+    threads[t].ndropped = 0;
+    threads[t].nsamples = 0;
+  }
+#endif
+}
+
+/*
+** GPTLprint_samples: Print sample counts per region, and within each region per function
+**
+** Input arguments:
+**   fp:     output stream
+**   timers: per-thread linked lists of timers
+*/
+void GPTLprint_samples (FILE *fp, Timer **timers)
+{
+#ifdef HAVE_SAMPLER
+  int t;
+  int n, nrows, nfuncs;
+  int width;          // width of region name column
+  Row *rows;
+  Timer *ptr;
+  Threadsamples *ts;
+  static const char *thisfunc = "GPTLprint_samples";
+
+  if ( ! running)
+    return;
+
+  fprintf (fp, "\nCPU time samples every %d usec of each thread's CPU time, charged to the "
+	   "innermost running timer\n", usec);
+  fprintf (fp, "Est_CPU is samples times the interval. Up to %d functions with the most samples "
+	   "are listed below each region\n", MAXFUNCS);
+
+  for (t = 0; t < MIN (nthreads, MAX (GPTLnthreads, 1)); ++t) {
+    ts = &threads[t];
+    if (ts->nsamples == 0)
+      continue;
+
+    // Copy the table so the thread can keep sampling while it is sorted and printed
+    rows = (Row *) GPTLallocate (MAX (1, ts->nfilled) * sizeof (Row), thisfunc);
+    nrows = 0;
+    for (n = 0; n < TABLESIZE && nrows < ts->nfilled; ++n) {
+      if (ts->table[n].region && ts->table[n].count > 0) {
+	rows[nrows].region = ts->table[n].region;
+	rows[nrows].count  = ts->table[n].count;
+	symbolize (&rows[nrows], ts->table[n].pc);
+	++nrows;
+      }
+    }
+
+    // Merge the program counters of each function
+    qsort (rows, nrows, sizeof (Row), cmp_region_func);
+    for (n = 1, nfuncs = MIN (nrows, 1); n < nrows; ++n) {
+      if (cmp_region_func (&rows[n], &rows[nfuncs-1]) == 0)
+	rows[nfuncs-1].count += rows[n].count;
+      else
+	rows[nfuncs++] = rows[n];
+    }
+    nrows = nfuncs;
+    qsort (rows, nrows, sizeof (Row), cmp_region_count);
+
+    width = strlen ("Region");
+    for (ptr = timers[t]; ptr; ptr = ptr->next)
+      if (ptr->cpusamples > 0)
+	width = MAX (width, (int) strlen (ptr->name));
+
+    fprintf (fp, "\nThread %d: %lu samples", t, ts->nsamples);
+    if (ts->ndropped > 0)
+      fprintf (fp, " (%lu not attributed to a function: table full)", ts->ndropped);
+    fprintf (fp, "\n%-*s %10s %7s %10s\n", width, "Region", "Samples", "%", "Est_CPU");
+
+    for (n = 0; n < nrows; ) {
+      ptr = rows[n].region;
+      fprintf (fp, "%-*s %10lu %7.2f %10.3g\n", width,
+	       ptr == timers[t] ? "(no timer)" : ptr->name, ptr->cpusamples,
+	       100. * ptr->cpusamples / ts->nsamples, ptr->cpusamples * usec * 1.e-6);
+      for (nfuncs = 0; n < nrows && rows[n].region == ptr; ++n, ++nfuncs) {
+	if (nfuncs >= MAXFUNCS)
+	  continue;
+	if (rows[n].name)
+	  fprintf (fp, "    %10lu %s\n", rows[n].count, rows[n].name);
+	else if (rows[n].module)
+	  fprintf (fp, "    %10lu %s+0x%lx\n", rows[n].count, rows[n].module,
+		   (unsigned long) rows[n].func);
+	else
+	  fprintf (fp, "    %10lu %p\n", rows[n].count, rows[n].func);
+      }
+    }
+    free (rows);
+  }
+#endif
+}
+
+#ifdef HAVE_SAMPLER
+// handler: SIGPROF handler. Runs on the thread whose CPU time timer expired. It is counted
+// in nactive before it reads running, so GPTLsampler_stop either stops it or waits for it
+static void handler (int sig, siginfo_t *info, void *ucontext)
+{
+  __atomic_add_fetch (&nactive, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&running, __ATOMIC_SEQ_CST))
+    take_sample (info, ucontext);
+  __atomic_sub_fetch (&nactive, 1, __ATOMIC_RELEASE);
+}
+
+// take_sample: Charge a sample to the innermost running timer of the calling thread
+static void take_sample (siginfo_t *info, void *ucontext)
+{
+  int t = mythread;
+  int idx;
+  int weight;        // intervals represented by this signal
+  unsigned int i;
+  unsigned int probe;
+  void *pc;
+  Timer *ptr;
+  Sample *s;
+  Threadsamples *ts;
+
+  if (t < 0 || t >= nthreads)
+    return;
+
+  ts = &threads[t];
+  // Pairs with the release store in update_ptr, which writes the slot first
+  idx = __atomic_load_n (&stackidx[t].val, __ATOMIC_ACQUIRE);
+  if (idx < 0 || idx >= MAX_STACK || ! (ptr = callstack[t][idx]))
+    return;
+
+  // CPU time timers expire on scheduler ticks, so with a short interval one signal may stand
+  // for several. Counting the overruns keeps Est_CPU right
+  weight = (info && info->si_code == SI_TIMER) ? 1 + MAX (info->si_overrun, 0) : 1;
+  ts->nsamples += weight;
+  ptr->cpusamples += weight;
+
+  pc = get_pc (ucontext);
+  i = (unsigned int) ((((unsigned long) pc >> 2) ^ ((unsigned long) ptr >> 4)) * 2654435761UL);
+  for (probe = 0; probe < TABLESIZE; ++probe) {
+    s = &ts->table[(i + probe) & (TABLESIZE - 1)];
+    if (s->region == ptr && s->pc == pc) {
+      s->count += weight;
+      return;
+    }
+    if ( ! s->region) {
+      if (ts->nfilled >= MAXFILL)
+	break;
+      s->pc = pc;
+      s->count = weight;
+      s->region = ptr;
+      ++ts->nfilled;
+      return;
+    }
+  }
+  ts->ndropped += weight;
+}
+
+// get_pc: Interrupted program counter from the signal context, or 0 if not known here
+static inline void *get_pc (void *ucontext)
+{
+  ucontext_t *uc = (ucontext_t *) ucontext;
+#if ( defined __x86_64__ && defined REG_RIP )
+  return (void *) uc->uc_mcontext.gregs[REG_RIP];
+#elif ( defined __i386__ && defined REG_EIP )
+  return (void *) uc->uc_mcontext.gregs[REG_EIP];
+#elif defined __aarch64__
+  return (void *) uc->uc_mcontext.pc;
+#elif defined __powerpc64__
+  return (void *) uc->uc_mcontext.gp_regs[32];  // NIP
+#else
+  (void) uc;
+  return 0;
+#endif
+}
+
+// symbolize: Fill in function, name and module of row from a program counter
+static void symbolize (Row *row, const void *pc)
+{
+  const char *base;
+  const void *start;
+
+  // Static functions are found too when the symbol table of their object can be read
+  if (pc && (row->name = GPTLsymbol_name (pc, &start))) {
+    row->func   = start;
+    row->module = 0;
+    return;
+  }
+#ifdef HAVE_DLADDR
+  Dl_info info;
+
+  if (pc && dladdr (pc, &info)) {
+    if (info.dli_fname) {
+      // No symbol (e.g. a static function): print the offset into the module
+      base = strrchr (info.dli_fname, '/');
+      row->func   = (const void *) ((const char *) pc - (const char *) info.dli_fbase);
+      row->name   = 0;
+      row->module = base ? base+1 : info.dli_fname;
+      return;
+    }
+  }
+#endif
+  (void) base;
+  row->func   = pc;
+  row->name   = 0;
+  row->module = 0;
+}
+
+// cmp_region_func: qsort comparator grouping rows by region, then by function
+static int cmp_region_func (const void *a, const void *b)
+{
+  const Row *ra = (const Row *) a;
+  const Row *rb = (const Row *) b;
+
+  if (ra->region != rb->region)
+    return ra->region < rb->region ? -1 : 1;
+  if (ra->module != rb->module)
+    return ra->module < rb->module ? -1 : 1;
+  return (ra->func > rb->func) - (ra->func < rb->func);
+}
+
+// cmp_region_count: qsort comparator putting regions with the most samples first, and within
+// each region the functions with the most samples first
+static int cmp_region_count (const void *a, const void *b)
+{
+  const Row *ra = (const Row *) a;
+  const Row *rb = (const Row *) b;
+
+  if (ra->region != rb->region) {
+    if (ra->region->cpusamples != rb->region->cpusamples)
+      return ra->region->cpusamples > rb->region->cpusamples ? -1 : 1;
+    return ra->region < rb->region ? -1 : 1;
+  }
+  return (ra->count < rb->count) - (ra->count > rb->count);
+}
+#endif
@@ -0,0 +1,535 @@
+/*
+** symbols.c
+**
+** Author: Jim Rosinski
+**
+** Name auto-profiled functions and sampled program counters from their addresses. Nothing is
+** looked up while the program runs: __cyg_profile_func_enter records only the function address,
+** and GPTLresolve_names names every such timer in one pass when results are printed.
+**
+** The first lookup reads the function symbols of the executable and every loaded shared object
+** from their ELF files into one table sorted by address, which is then searched by bisection.
+** The full symbol table (.symtab) is used when the file has one, so static functions are named
+** too. Addresses not found there (e.g. in objects opened later, or where ELF is unavailable)
+** are passed to dladdr. C++ names are demangled with __cxa_demangle when first looked up, so
+** only the names actually printed are demangled.
+**
+** GPTLsymbol_name caches what it finds and must be called from one thread at a time.
+** GPTLsymbol_copy may be called from any thread once GPTLload_symbols has built the table.
+** GPTLsymbol_lines gives file:line rather than function names, from the debug info via addr2line.
+*/
+
+#include "config.h"      // Must be first include.
+#include "private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef HAVE_DLADDR
+#include <dlfcn.h>
+#endif
+
+#if ( defined HAVE_DL_ITERATE_PHDR && defined HAVE_ELF_H && defined HAVE_LINK_H )
+#define HAVE_ELFSYMS
+#include <elf.h>
+#include <link.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+#endif
+
+typedef struct {
+  uintptr_t addr;           // run-time address of the function
+  size_t size;              // size in bytes (0 if unknown)
+  const char *name;         // mangled name: points into the string table copy of its object
+  char *demangled;          // demangled name, filled in on first lookup (NULL if not C++)
+  bool triedemangle;        // demangling has been attempted
+} Symbol;
+
+static Symbol *symbols = 0;    // function symbols of all loaded objects, sorted by addr
+static size_t nsymbols = 0;
+static size_t symsize = 0;     // allocated size of symbols
+static char **strtabs = 0;     // string table copies holding the names in symbols
+static int nstrtabs = 0;
+static char **extras = 0;      // demangled names returned from dladdr lookups
+static int nextras = 0;
+static bool built = false;     // symbols has been filled in
+
+#ifdef HAVE_ELFSYMS
+// Addresses passed to one run of addr2line in GPTLsymbol_lines
+#define LINES_PER_RUN 256
+
+typedef struct {
+  const void *pc;           // address to find
+  uintptr_t base;           // load address of the object containing pc
+  char path[PATH_MAX];      // file of the object
+} Object;
+#endif
+
+typedef char *(*Demangler) (const char *, char *, size_t *, int *);
+static Demangler demangler = 0;  // __cxa_demangle if the program has it
+
+static void build_table (void);
+static Symbol *find_symbol (const void *);
+static char *demangle (const char *);
+static int cmp_symbol (const void *, const void *);
+#ifdef HAVE_ELFSYMS
+static int add_object (struct dl_phdr_info *, size_t, void *);
+static int find_object (struct dl_phdr_info *, size_t, void *);
+#endif
+
+/*
+** GPTLresolve_names: Name the auto-profiled timers which only have an address so far. Names
+**   longer than MAX_CHARS are kept whole in longname, and name holds the first MAX_CHARS
+**   characters. A timer whose address cannot be named keeps the address as its name.
+**
+** Input arguments:
+**   timers:   per-thread linked lists of timers
+**   nthreads: number of threads
+**
+** Return value: number of timers named
+*/
+int GPTLresolve_names (Timer **timers, int nthreads)
+{
+  Timer *ptr;
+  const char *name;
+  int t;
+  int nresolved = 0;
+
+  for (t = 0; t < nthreads; ++t) {
+    for (ptr = timers[t]; ptr; ptr = ptr->next) {
+      if ( ! ptr->address || ptr->resolved)
+	continue;
+      ptr->resolved = true;
+      if ( ! (name = GPTLsymbol_name (ptr->address, 0)))
+	continue;
+      if (strlen (name) > MAX_CHARS) {
+	if ( ! (ptr->longname = (char *) malloc (strlen (name) + 1))) {
+	  GPTLwarn ("GPTLresolve_names: malloc failure for name of %p\n", ptr->address);
+	  continue;
+	}
+	strcpy (ptr->longname, name);
+      }
+      strncpy (ptr->name, name, MAX_CHARS);
+      ptr->name[MAX_CHARS] = '\0';
+      ++nresolved;
+    }
+  }
+  return nresolved;
+}
+
+/*
+** GPTLsymbol_name: Find the function containing an address
+**
+** Input arguments:
+**   pc: address
+**
+** Output arguments:
+**   start: if not NULL, start address of the function (set only when found)
+**
+** Return value: demangled name of the function, or NULL if not found. The name remains valid
+**   until GPTLfree_symbols is called
+*/
+const char *GPTLsymbol_name (const void *pc, const void **start)
+{
+  Symbol *sym;
+  char *name;
+
+  if ( ! built)
+    build_table ();
+
+  if ((sym = find_symbol (pc))) {
+    if ( ! sym->triedemangle) {
+      sym->demangled    = demangle (sym->name);
+      sym->triedemangle = true;
+    }
+    if (start)
+      *start = (const void *) sym->addr;
+    return sym->demangled ? sym->demangled : sym->name;
+  }
+
+#ifdef HAVE_DLADDR
+  Dl_info info;
+  char **newextras;
+
+  if (pc && dladdr (pc, &info) && info.dli_sname && info.dli_saddr) {
+    if (start)
+      *start = info.dli_saddr;
+    if ( ! (name = demangle (info.dli_sname)))
+      return info.dli_sname;
+    if ( ! (newextras = (char **) realloc (extras, (nextras+1) * sizeof (char *)))) {
+      free (name);
+      return info.dli_sname;
+    }
+    extras = newextras;
+    extras[nextras++] = name;
+    return name;
+  }
+#endif
+  (void) name;
+  return 0;
+}
+
+/*
+** GPTLsymbol_copy: Thread-safe GPTLsymbol_name: nothing is cached
+**
+** Input arguments:
+**   pc: address
+**
+** Return value: malloc'd demangled name of the function containing pc, or NULL if not found
+*/
+char *GPTLsymbol_copy (const void *pc)
+{
+  Symbol *sym;
+  const char *name = 0;
+  char *copy;
+
+  if ((sym = find_symbol (pc))) {
+    name = sym->name;
+  } else {
+#ifdef HAVE_DLADDR
+    Dl_info info;
+
+    if (pc && dladdr (pc, &info) && info.dli_sname && info.dli_saddr)
+      name = info.dli_sname;
+#endif
+  }
+  if ( ! name)
+    return 0;
+  if ((copy = demangle (name)))
+    return copy;
+  if ((copy = (char *) malloc (strlen (name) + 1)))
+    strcpy (copy, name);
+  return copy;
+}
+
+// GPTLload_symbols: Build the symbol table now, while only one thread can be looking things up
+void GPTLload_symbols (void)
+{
+  if ( ! built)
+    build_table ();
+}
+
+// GPTLfree_symbols: Free the symbol table and every name returned from it
+void GPTLfree_symbols (void)
+{
+  size_t n;
+  int i;
+
+  for (n = 0; n < nsymbols; ++n)
+    free (symbols[n].demangled);
+  free (symbols);
+  for (i = 0; i < nstrtabs; ++i)
+    free (strtabs[i]);
+  free (strtabs);
+  for (i = 0; i < nextras; ++i)
+    free (extras[i]);
+  free (extras);
+
+  symbols  = 0;
+  nsymbols = 0;
+  symsize  = 0;
+  strtabs  = 0;
+  nstrtabs = 0;
+  extras   = 0;
+  nextras  = 0;
+  built    = false;
+}
+
+/*
+** GPTLsymbol_lines: Source file and line of program counters, from the debug info of the
+**   objects containing them. addr2line is run once for each object (and each LINES_PER_RUN
+**   addresses in it), so this is meant for printing results, not for use while timing. It
+**   starts a shell through popen, so callers only use it when the user asked for lines
+**
+** Input arguments:
+**   pcs: addresses
+**   n:   number of addresses
+**
+** Output arguments:
+**   lines: malloc'd "file:line" of each address (file without its directory), or NULL where
+**          there is no debug info or addr2line cannot be run
+**
+** Return value: number of addresses resolved
+*/
+int GPTLsymbol_lines (void * const *pcs, int n, char **lines)
+{
+  int nresolved = 0;
+  int i;
+
+  for (i = 0; i < n; ++i)
+    lines[i] = 0;
+
+#ifdef HAVE_ELFSYMS
+  Object obj;             // object containing pcs[i]
+  Object other;           // object containing a later address
+  int idx[LINES_PER_RUN]; // indices in pcs of the addresses passed to one addr2line
+  char *cmd;
+  char *c;
+  char line[PATH_MAX + 64];
+  FILE *fp;
+  bool *done;
+  int nidx;
+  int j, k;
+
+  if ( ! (done = (bool *) calloc (n, sizeof (bool))))
+    return 0;
+
+  for (i = 0; i < n; ++i) {
+    if (done[i])
+      continue;
+    done[i] = true;
+    obj.pc = pcs[i];
+    // The path is quoted for the shell below
+    if (dl_iterate_phdr (find_object, &obj) == 0 || strchr (obj.path, '\''))
+      continue;
+
+    idx[0] = i;
+    nidx = 1;
+    for (j = i+1; j < n && nidx < LINES_PER_RUN; ++j) {
+      other.pc = pcs[j];
+      if ( ! done[j] && dl_iterate_phdr (find_object, &other) != 0 && other.base == obj.base &&
+	  strcmp (other.path, obj.path) == 0) {
+	done[j] = true;
+	idx[nidx++] = j;
+      }
+    }
+
+    if ( ! (cmd = (char *) malloc (strlen (obj.path) + 64 + 24*nidx)))
+      break;
+    c = cmd + sprintf (cmd, "addr2line -e '%s'", obj.path);
+    for (k = 0; k < nidx; ++k)
+      c += sprintf (c, " 0x%lx", (unsigned long) ((uintptr_t) pcs[idx[k]] - obj.base));
+    strcpy (c, " 2>/dev/null");
+    fp = popen (cmd, "r");
+    free (cmd);
+    if ( ! fp)
+      continue;
+
+    // One output line per address: "path:line", possibly followed by " (discriminator N)".
+    // "??" means no debug info
+    for (k = 0; k < nidx && fgets (line, sizeof (line), fp); ++k) {
+      line[strcspn (line, "\n")] = '\0';
+      if ((c = strstr (line, " (discriminator")))
+	*c = '\0';
+      if (strncmp (line, "??", 2) == 0 || ! (c = strrchr (line, ':')) ||
+	  strcmp (c, ":0") == 0 || strcmp (c, ":?") == 0)
+	continue;
+      c = strrchr (line, '/') ? strrchr (line, '/') + 1 : line;
+      if ((lines[idx[k]] = (char *) malloc (strlen (c) + 1))) {
+	strcpy (lines[idx[k]], c);
+	++nresolved;
+      }
+    }
+    (void) pclose (fp);
+  }
+  free (done);
+#endif
+  return nresolved;
+}
+
+// build_table: Read the function symbols of every loaded object and sort them by address
+static void build_table (void)
+{
+  built = true;
+#ifdef HAVE_DLADDR
+  // Looked up at run time so that C and Fortran programs need not link the C++ runtime
+  demangler = (Demangler) dlsym (RTLD_DEFAULT, "__cxa_demangle");
+#endif
+#ifdef HAVE_ELFSYMS
+  (void) dl_iterate_phdr (add_object, 0);
+#endif
+  if (nsymbols > 0)
+    qsort (symbols, nsymbols, sizeof (Symbol), cmp_symbol);
+}
+
+// find_symbol: Bisect for the last symbol starting at or below pc. NULL if pc is not inside it
+static Symbol *find_symbol (const void *pc)
+{
+  Symbol *sym;
+  size_t lo = 0;
+  size_t hi = nsymbols;
+  size_t mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (symbols[mid].addr <= (uintptr_t) pc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0)
+    return 0;
+  sym = &symbols[lo-1];
+  return (uintptr_t) pc < sym->addr + MAX (sym->size, 1) ? sym : 0;
+}
+
+#ifdef HAVE_ELFSYMS
+/*
+** add_object: dl_iterate_phdr callback adding the function symbols of one loaded object. The
+**   file is mapped only while its symbols are read: the string table is copied
+**
+** Input arguments:
+**   info: name and load address of the object. The executable has an empty name
+**
+** Return value: 0 (continue with the next object)
+*/
+static int add_object (struct dl_phdr_info *info, size_t size, void *data)
+{
+  const char *path = info->dlpi_name[0] ? info->dlpi_name : "/proc/self/exe";
+  const ElfW(Ehdr) *ehdr;
+  const ElfW(Shdr) *shdr;
+  const ElfW(Shdr) *symsec = 0;
+  const ElfW(Shdr) *strsec;
+  const ElfW(Sym) *sym;
+  Symbol *newsymbols;
+  char **newstrtabs;
+  char *strtab;
+  void *map;
+  struct stat st;
+  size_t nsym, n;
+  int fd;
+  int i;
+
+  // The vdso has a name but no file
+  if ((fd = open (path, O_RDONLY)) < 0)
+    return 0;
+  if (fstat (fd, &st) != 0 || (size_t) st.st_size < sizeof (ElfW(Ehdr))) {
+    (void) close (fd);
+    return 0;
+  }
+  map = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  (void) close (fd);
+  if (map == MAP_FAILED)
+    return 0;
+
+  ehdr = (const ElfW(Ehdr) *) map;
+  if (memcmp (ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr->e_shentsize != sizeof (ElfW(Shdr)) ||
+      ehdr->e_shoff + (size_t) ehdr->e_shnum * sizeof (ElfW(Shdr)) > (size_t) st.st_size)
+    goto done;
+
+  // Prefer .symtab: .dynsym has only the exported functions
+  shdr = (const ElfW(Shdr) *) ((const char *) map + ehdr->e_shoff);
+  for (i = 0; i < ehdr->e_shnum; ++i)
+    if (shdr[i].sh_type == SHT_SYMTAB)
+      symsec = &shdr[i];
+  if ( ! symsec)
+    for (i = 0; i < ehdr->e_shnum; ++i)
+      if (shdr[i].sh_type == SHT_DYNSYM)
+	symsec = &shdr[i];
+  if ( ! symsec || symsec->sh_link >= ehdr->e_shnum)
+    goto done;
+  strsec = &shdr[symsec->sh_link];
+  if (symsec->sh_offset + symsec->sh_size > (size_t) st.st_size ||
+      strsec->sh_offset + strsec->sh_size > (size_t) st.st_size || strsec->sh_size == 0)
+    goto done;
+
+  if ( ! (newstrtabs = (char **) realloc (strtabs, (nstrtabs+1) * sizeof (char *))))
+    goto done;
+  strtabs = newstrtabs;
+  if ( ! (strtab = (char *) malloc (strsec->sh_size)))
+    goto done;
+  memcpy (strtab, (const char *) map + strsec->sh_offset, strsec->sh_size);
+  strtab[strsec->sh_size - 1] = '\0';
+  strtabs[nstrtabs++] = strtab;
+
+  sym  = (const ElfW(Sym) *) ((const char *) map + symsec->sh_offset);
+  nsym = symsec->sh_size / sizeof (ElfW(Sym));
+  for (n = 0; n < nsym; ++n) {
+    // Low 4 bits of st_info are the type for both ELF classes
+    if ((sym[n].st_info & 0xf) != STT_FUNC || sym[n].st_shndx == SHN_UNDEF ||
+	sym[n].st_value == 0 || sym[n].st_name >= strsec->sh_size)
+      continue;
+    if (nsymbols == symsize) {
+      if ( ! (newsymbols = (Symbol *) realloc (symbols, MAX (1024, 2*symsize) * sizeof (Symbol))))
+	break;
+      symbols = newsymbols;
+      symsize = MAX (1024, 2*symsize);
+    }
+    symbols[nsymbols].addr         = info->dlpi_addr + sym[n].st_value;
+    symbols[nsymbols].size         = sym[n].st_size;
+    symbols[nsymbols].name         = strtab + sym[n].st_name;
+    symbols[nsymbols].demangled    = 0;
+    symbols[nsymbols].triedemangle = false;
+    ++nsymbols;
+  }
+
+ done:
+  (void) munmap (map, st.st_size);
+  return 0;
+}
+#endif
+
+#ifdef HAVE_ELFSYMS
+/*
+** find_object: dl_iterate_phdr callback: find the object containing an address
+**
+** Input arguments:
+**   info: name, load address and segments of the object. The executable has an empty name
+**   data: Object whose pc is to be found. base and path are filled in when found
+**
+** Return value: 1 (found: stop iterating) or 0 (continue with the next object)
+*/
+static int find_object (struct dl_phdr_info *info, size_t size, void *data)
+{
+  Object *obj = (Object *) data;
+  uintptr_t pc = (uintptr_t) obj->pc;
+  uintptr_t start;
+  ssize_t len;
+  int i;
+
+  for (i = 0; i < info->dlpi_phnum; ++i) {
+    if (info->dlpi_phdr[i].p_type != PT_LOAD)
+      continue;
+    start = info->dlpi_addr + info->dlpi_phdr[i].p_vaddr;
+    if (pc >= start && pc < start + info->dlpi_phdr[i].p_memsz) {
+      obj->base = info->dlpi_addr;
+      // The path is for another process, to which /proc/self/exe would be itself
+      if (info->dlpi_name[0])
+	snprintf (obj->path, sizeof (obj->path), "%s", info->dlpi_name);
+      else if ((len = readlink ("/proc/self/exe", obj->path, sizeof (obj->path) - 1)) > 0)
+	obj->path[len] = '\0';
+      else
+	return 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif
+
+/*
+** demangle: Demangle a C++ name with the __cxa_demangle found by build_table
+**
+** Return value: malloc'd demangled name, or NULL if name is not mangled or cannot be demangled
+*/
+static char *demangle (const char *name)
+{
+  int status;
+  char *result;
+
+  if ( ! demangler || strncmp (name, "_Z", 2) != 0)
+    return 0;
+  result = demangler (name, 0, 0, &status);
+  if (status != 0) {
+    free (result);
+    return 0;
+  }
+  return result;
+}
+
+// cmp_symbol: qsort comparator by address. Aliases of one address are ordered by name
+static int cmp_symbol (const void *a, const void *b)
+{
+  const Symbol *sa = (const Symbol *) a;
+  const Symbol *sb = (const Symbol *) b;
+
+  if (sa->addr != sb->addr)
+    return (sa->addr > sb->addr) - (sa->addr < sb->addr);
+  return strcmp (sa->name, sb->name);
+}
@@ -60,6 +60,12 @@ int GPTLget_thread_num ()
   return GPTLthreadid;
 }
 
+// GPTLknown_thread_num: 0 once GPTLget_thread_num has been called, else -1. Never registers
+int GPTLknown_thread_num (void)
+{
+  return GPTLthreadid;
+}
+
 void GPTLprint_threadmapping (FILE *fp)
 {
   fprintf (fp, "\n");
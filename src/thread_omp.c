@@ -18,6 +18,24 @@ volatile int GPTLmax_threads = -1;     // max num threads
 // make threadid non-static due to this file possibly being inlined
 volatile int *GPTLthreadid = NULL;  // array of thread ids
 
+#ifdef ENABLE_NESTEDOMP
+// With nesting, a thread index belongs to a position in the team hierarchy: the nesting level
+// plus the thread number at each level (the ancestry). Indices are handed out in order of
+// first use, so any nesting depth up to MAX_NEST works. Runtimes start fresh OS threads for
+// inner teams each time a nested region is entered, and such a thread picks up the index of
+// whichever earlier thread held its position. Each thread caches its index in thread-local
+// storage and checks its position against the ancestry of that index on every call.
+#define MAX_NEST 8                  // deepest nesting level supported
+volatile int GPTLnslots = 0;        // thread indices handed out so far
+volatile int GPTLslot_epoch = 0;    // bumped by GPTLthreadinit so stale cached indices are ignored
+int *GPTLnestlevel = NULL;          // per index: nesting level of its position
+int (*GPTLancestry)[MAX_NEST] = NULL; // per index: thread number at each nesting level
+__thread int GPTLmyslot __attribute__ ((tls_model ("initial-exec"))) = -1;  // cached index
+                                                                            // (-1: none left)
+__thread int GPTLmyepoch __attribute__ ((tls_model ("initial-exec"))) = 0;  // epoch of cache
+static int findslot (void);
+#endif
+
 /*
 ** GPTLthreadinit: Allocate and initialize GPTLthreadid; set max number of threads
 **
@@ -56,6 +74,20 @@ int GPTLthreadinit (void)
   // get_thread_num() will fill in the values on first use.
   for (t = 0; t < GPTLmax_threads; ++t)
     GPTLthreadid[t] = -1;
+
+#ifdef ENABLE_NESTEDOMP
+  if ( ! (GPTLnestlevel = (int *) GPTLallocate (GPTLmax_threads * sizeof (int), thisfunc)) ||
+      ! (GPTLancestry = (int (*)[MAX_NEST]) GPTLallocate (GPTLmax_threads * sizeof (int[MAX_NEST]),
+							   thisfunc)))
+    return GPTLerror ("OMP %s: malloc failure for thread ancestry\n", thisfunc);
+
+  // Invalidate indices cached by threads during any previous initialize/finalize cycle,
+  // and give the calling (master) thread index 0
+  GPTLnslots = 0;
+  ++GPTLslot_epoch;
+  if (findslot () != 0)
+    return GPTLerror ("OMP %s: failed to assign index 0 to the master thread\n", thisfunc);
+#endif
 #ifdef VERBOSE
   printf ("GPTL: OMP %s: Set GPTLmax_threads=%d\n", thisfunc, GPTLmax_threads);
 #endif
@@ -72,7 +104,120 @@ void GPTLthreadfinalize ()
 {
   free ((void *) GPTLthreadid);
   GPTLthreadid = NULL;
+#ifdef ENABLE_NESTEDOMP
+  free (GPTLnestlevel);
+  free (GPTLancestry);
+  GPTLnestlevel = NULL;
+  GPTLancestry = NULL;
+#endif
+}
+
+#ifdef ENABLE_NESTEDOMP
+/*
+** position: Get the calling thread's position in the team hierarchy. The master of a team is
+**           the thread which encountered the parallel region, so trailing zeros in the
+**           ancestry are dropped: they name the same thread as the shorter ancestry
+**
+** Output arguments:
+**   anc: thread number at each nesting level, -1 past the returned level
+**
+** Return value: nesting level of the position, or -1 if it is deeper than MAX_NEST
+*/
+static inline int position (int anc[MAX_NEST])
+{
+  int lvl;
+  int l;
+  int num;
+
+  for (l = 0; l < MAX_NEST; ++l)
+    anc[l] = -1;
+  for (lvl = omp_get_level (); lvl > 0; --lvl) {
+    if ((num = omp_get_ancestor_thread_num (lvl)) != 0) {
+      if (lvl > MAX_NEST)
+	return -1;
+      anc[lvl-1] = num;
+      break;
+    }
+  }
+  for (l = 0; l < lvl-1; ++l)
+    anc[l] = omp_get_ancestor_thread_num (l+1);
+  return lvl;
+}
+
+/*
+** same_position: Whether the calling thread sits at the position in the team hierarchy
+**                recorded for thread index t
+**
+** Input arguments:
+**   t: thread index
+*/
+static inline bool same_position (int t)
+{
+  int anc[MAX_NEST];
+  int l;
+
+  if (position (anc) != GPTLnestlevel[t])
+    return false;
+  for (l = 0; l < GPTLnestlevel[t]; ++l)
+    if (anc[l] != GPTLancestry[t][l])
+      return false;
+  return true;
+}
+
+/*
+** findslot: Find the thread index for the calling thread's position in the team hierarchy,
+**           handing out the next free index if no thread has held that position, and cache
+**           it in thread-local storage. A thread for which no index is left caches that too,
+**           so it reports the failure once and GPTLnslots stays bounded
+**
+** Return value: thread index (success) or GPTLerror (failure)
+*/
+static int findslot (void)
+{
+  int t;
+  int lvl;
+  int anc[MAX_NEST];
+  int l;
+  static const char *thisfunc = "findslot";
+
+  if ((lvl = position (anc)) < 0) {
+    GPTLmyslot = -1;
+    GPTLmyepoch = GPTLslot_epoch;
+    return GPTLerror ("OMP %s: GPTL supports only %d nested OMP levels got %d\n",
+		      thisfunc, MAX_NEST, omp_get_level ());
+  }
+
+  // Searching and claiming must be atomic, or two threads new to the same position in
+  // successive teams could each claim an index for it
+#pragma omp critical (GPTL_findslot)
+  {
+    for (t = 0; t < GPTLnslots; ++t) {
+      if (GPTLnestlevel[t] != lvl)
+	continue;
+      for (l = 0; l < lvl && anc[l] == GPTLancestry[t][l]; ++l)
+	;
+      if (l == lvl)
+	break;
+    }
+    if (t == GPTLnslots && t < GPTLmax_threads) {
+      GPTLnestlevel[t] = lvl;
+      for (l = 0; l < MAX_NEST; ++l)
+	GPTLancestry[t][l] = anc[l];
+      __atomic_store_n (&GPTLnslots, t+1, __ATOMIC_RELEASE);
+    }
+  }
+
+  GPTLmyepoch = GPTLslot_epoch;
+  if (t >= GPTLmax_threads) {
+    GPTLmyslot = -1;
+    return GPTLerror ("OMP %s: no thread index left: GPTLmax_threads=%d. Nested codes should "
+		      "set GPTLmaxthreads to the total number of threads\n",
+		      thisfunc, GPTLmax_threads);
+  }
+  GPTLmyslot = t;
+  return t;
 }
+#endif
 
 /*
 ** GPTLget_thread_num: Determine thread number of the calling thread
@@ -83,8 +228,8 @@ void GPTLthreadfinalize ()
 **   GPTLthreadid: Our thread id added to list on 1st call
 **
 ** Return value: thread number (success) or GPTLerror (failure)
-**   5/8/16: Modified to enable 2-level OMP nesting: Fold combination of current and parent
-**   thread info into a single index
+**   With ENABLE_NESTEDOMP, the index belongs to the thread's position in the team hierarchy,
+**   so threads which replace one another at a position share an index
 */
 #ifdef INLINE_THREADING
 inline
@@ -95,28 +240,15 @@ int GPTLget_thread_num (void)
   static const char *thisfunc = "GPTLget_thread_num";
 
 #ifdef ENABLE_NESTEDOMP
-  int myid;            // my thread id
-  int lvl;             // nest level: Currently only 2 nesting levels supported
-  int parentid;        // thread number of parent team
-  int my_nthreads;     // number of threads in the parent team
-
-  myid = omp_get_thread_num ();
-  if (omp_get_nested ()) {         // nesting is "enabled", though not necessarily active
-    lvl = omp_get_active_level (); // lvl=2 => inside 2 #pragma omp regions
-    if (lvl < 2) {
-      // 0 or 1-level deep: simply use thread id as index
-      t = myid;
-    } else if (lvl == 2) {
-      // Create a unique id "t" for indexing into singly-dimensioned thread array
-      parentid    = omp_get_ancestor_thread_num (lvl-1);
-      my_nthreads = omp_get_team_size (lvl);
-      t           = parentid*my_nthreads + myid;
-    } else {
-      return GPTLerror ("OMP %s: GPTL supports only 2 nested OMP levels got %d\n", thisfunc, lvl);
-    }
-  } else {
-    // un-nested case: thread id is index
-    t = myid;
+  if (GPTLmyepoch == GPTLslot_epoch) {
+    // Threads which found no index left have already been told
+    if ((t = GPTLmyslot) < 0)
+      return -1;
+    // A pooled thread may have moved to another position since it cached its index
+    if ( ! same_position (t) && (t = findslot ()) < 0)
+      return t;
+  } else if ((t = findslot ()) < 0) {
+    return t;
   }
 #else
   t = omp_get_thread_num ();
@@ -131,6 +263,8 @@ int GPTLget_thread_num (void)
 
   // Thread id not found. Modify GPTLthreadid with our ID, then start PAPI events if required.
   // Due to the setting of GPTLthreadid, everything below here will only execute once per thread.
+  // With ENABLE_NESTEDOMP that is once per index: PAPI, sampling and perf counters follow
+  // the first OS thread to hold an index, not those which later replace it.
   GPTLthreadid[t] = t;
 
 #ifdef VERBOSE
@@ -152,6 +286,16 @@ int GPTLget_thread_num (void)
   }
 #endif
 
+  // Start sampling the new thread's CPU time if GPTLsample_usec was set
+  if (GPTLsampler_thread_start (t) < 0)
+    return GPTLerror ("GPTL: OMP %s: error from GPTLsampler_thread_start for thread %d\n",
+		      thisfunc, t);
+
+  // Open the new thread's perf_event_open counters if any were enabled
+  if (GPTLperf_thread_start (t) < 0)
+    return GPTLerror ("GPTL: OMP %s: error from GPTLperf_thread_start for thread %d\n",
+		      thisfunc, t);
+
   // nthreads = GPTLmax_threads based on setting in GPTLthreadinit or user call to GPTLsetoption()
   GPTLnthreads = GPTLmax_threads;
 #ifdef VERBOSE
@@ -161,11 +305,62 @@ int GPTLget_thread_num (void)
   return t;
 }
 
+/*
+** GPTLknown_thread_num: Look up the thread index of the calling thread without handing one
+**                       out, for callers such as the interposition layers which run on
+**                       threads that may never call GPTL themselves
+**
+** Return value: thread index, or -1 if the thread is not known to GPTL
+*/
+int GPTLknown_thread_num (void)
+{
+  int t;
+#ifdef ENABLE_NESTEDOMP
+  int anc[MAX_NEST];
+  int lvl;
+  int l;
+#endif
+
+  if ( ! GPTLthreadid)
+    return -1;
+#ifdef ENABLE_NESTEDOMP
+  if (GPTLmyepoch == GPTLslot_epoch && GPTLmyslot >= 0 && same_position (GPTLmyslot))
+    return GPTLmyslot;
+  // Outside any team only the thread which called GPTLinitialize is known. Inside, a thread
+  // which replaced another at a known position inherits its index
+  if ((lvl = position (anc)) <= 0)
+    return -1;
+  for (t = 0; t < __atomic_load_n (&GPTLnslots, __ATOMIC_ACQUIRE); ++t) {
+    if (GPTLnestlevel[t] != lvl)
+      continue;
+    for (l = 0; l < lvl && anc[l] == GPTLancestry[t][l]; ++l)
+      ;
+    if (l == lvl)
+      return GPTLthreadid[t] == t ? t : -1;
+  }
+  return -1;
+#else
+  t = omp_get_thread_num ();
+  return (t < GPTLmax_threads && GPTLthreadid[t] == t) ? t : -1;
+#endif
+}
+
 void GPTLprint_threadmapping (FILE *fp)
 {
   int t;
   fprintf (fp, "\n");
   fprintf (fp, "Thread mapping:\n");
-  for (t = 0; t < GPTLnthreads; ++t)
-    fprintf (fp, "GPTLthreadid[%d] = %d\n", t, GPTLthreadid[t]);
+  for (t = 0; t < GPTLnthreads; ++t) {
+    fprintf (fp, "GPTLthreadid[%d] = %d", t, GPTLthreadid[t]);
+#ifdef ENABLE_NESTEDOMP
+    // Thread number at each nesting level of the position owning the index
+    if (t < GPTLnslots && GPTLnestlevel[t] > 0) {
+      int l;
+      fprintf (fp, " nest level %d ancestry", GPTLnestlevel[t]);
+      for (l = 0; l < MIN (GPTLnestlevel[t], MAX_NEST); ++l)
+	fprintf (fp, "%c%d", l == 0 ? ' ' : '.', GPTLancestry[t][l]);
+    }
+#endif
+    fprintf (fp, "\n");
+  }
 }
@@ -206,9 +206,37 @@ int GPTLget_thread_num (void)
   if (unlock_mutex () < 0)
     return GPTLerror ("GPTL: PTHREADS %s: mutex unlock failure\n", thisfunc);
 
+  // Start sampling the new thread's CPU time if GPTLsample_usec was set
+  if (GPTLsampler_thread_start (retval) < 0)
+    return GPTLerror ("GPTL: PTHREADS %s: error from GPTLsampler_thread_start thread=%d\n",
+		      thisfunc, retval);
+
+  // Open the new thread's perf_event_open counters if any were enabled
+  if (GPTLperf_thread_start (retval) < 0)
+    return GPTLerror ("GPTL: PTHREADS %s: error from GPTLperf_thread_start thread=%d\n",
+		      thisfunc, retval);
+
   return retval;
 }
 
+/*
+** GPTLknown_thread_num: Look up the thread number of the calling thread without adding it to
+**                       the list, for callers such as the interposition layers which run on
+**                       threads that may never call GPTL themselves
+**
+** Return value: thread number, or -1 if the thread is not known to GPTL
+*/
+int GPTLknown_thread_num (void)
+{
+  int t;
+  pthread_t mythreadid = pthread_self ();
+
+  for (t = 0; t < GPTLnthreads; ++t)
+    if (pthread_equal (mythreadid, GPTLthreadid[t]))
+      return t;
+  return -1;
+}
+
 // lock_mutex: lock a mutex for private access
 static int lock_mutex ()
 {
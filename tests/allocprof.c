@@ -0,0 +1,39 @@
+/*
+** Check heap allocation profiling (--enable-allocprof): allocations must be charged to
+** the innermost timer active on the calling thread
+*/
+
+#include "gptl.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NALLOC 1000
+
+int main ()
+{
+  int n;
+  int ret;
+  void *ptrs[NALLOC];
+  void *ptr;
+
+  if ((ret = GPTLinitialize ()) != 0)
+    return 1;
+
+  ret = GPTLstart ("outer");
+  ret = GPTLstart ("allocs");
+  for (n = 0; n < NALLOC; ++n)
+    ptrs[n] = malloc (100);
+  for (n = 0; n < NALLOC; ++n)
+    free (ptrs[n]);
+  ret = GPTLstop ("allocs");
+
+  ptr = calloc (10, 100);
+  free (ptr);
+  ret = GPTLstop ("outer");
+
+  if ((ret = GPTLpr_file ("timing.allocprof")) != 0)
+    return 1;
+  if ((ret = GPTLfinalize ()) != 0)
+    return 1;
+  return 0;
+}
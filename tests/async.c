@@ -0,0 +1,69 @@
+/*
+** Test async timers: tokens started on one thread and stopped on others must be
+** accumulated into one region, and a token may be stopped only once
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+#include <unistd.h>
+#ifdef THREADED_OMP
+#include <omp.h>
+#endif
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+#define NTOKEN 8
+
+int main ()
+{
+  int n;
+  int ret;
+  int nfail = 0;
+  int count, maxinflight;
+  double wall, max, min;
+  GPTLasync_token token[NTOKEN];
+
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+
+  /* Start all tokens on this thread */
+  for (n = 0; n < NTOKEN; ++n)
+    if ((ret = GPTLstart_async ("request", &token[n])) != 0)
+      ERR;
+
+  /* Stop them on whichever threads pick them up */
+#pragma omp parallel for num_threads (4) reduction (+:nfail)
+  for (n = 0; n < NTOKEN; ++n) {
+    usleep (1000);
+    if (GPTLstop_async (&token[n]) != 0)
+      ++nfail;
+  }
+  if (nfail != 0)
+    ERR;
+
+  /* A second stop with the same token is an error */
+  if ((ret = GPTLstop_async (&token[0])) == 0)
+    ERR;
+
+  if ((ret = GPTLquery_async ("request", &count, &maxinflight, &wall, &max, &min)) != 0)
+    ERR;
+  printf ("async: count=%d maxinflight=%d wall=%g max=%g min=%g\n",
+	  count, maxinflight, wall, max, min);
+  if (count != NTOKEN || maxinflight != NTOKEN || min < 0.001 || max < min || wall < NTOKEN*min)
+    ERR;
+
+  if ((ret = GPTLpr (0)) != 0)
+    ERR;
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+  return 0;
+}
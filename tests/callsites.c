@@ -0,0 +1,84 @@
+/*
+** Test GPTLcallsites: a function called from three places is broken down by call site, with
+** each site named by file:line and caller, and the costliest site listed first
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+#include <string.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+#define NITER 10
+
+extern int cheap_line;
+extern int costly_line;
+extern void drive_sites (int);
+
+int main ()
+{
+  int ret;
+  int insection = 0;
+  int inwork = 0;
+  int nsites = 0;
+  unsigned long count;
+  unsigned long counts[3];
+  double wall, pct;
+  char line[1024];
+  char site[3][256];
+  char expect[64];
+  FILE *fp;
+
+  if ((ret = GPTLsetoption (GPTLcallsites, 1)) != 0)
+    ERR;
+  if ((ret = GPTLsetoption (GPTLcallsite_lines, 1)) != 0)
+    ERR;
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+  drive_sites (NITER);
+  if ((ret = GPTLpr_file ("timing.callsites")) != 0)
+    ERR;
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+
+  if ( ! (fp = fopen ("timing.callsites", "r")))
+    ERR;
+  while (fgets (line, sizeof (line), fp)) {
+    if (strncmp (line, "Calls of auto-profiled functions by call site", 45) == 0)
+      insection = 1;
+    if ( ! insection)
+      continue;
+    printf ("%s", line);
+    // Call site rows are indented below their function
+    if (line[0] != ' ') {
+      inwork = (sscanf (line, "work %lu", &count) == 1 && count == 2*NITER + 1);
+      continue;
+    }
+    if (inwork && nsites < 3 &&
+	sscanf (line, "%lu %lf %lf %255[^\n]", &counts[nsites], &wall, &pct, site[nsites]) == 4)
+      ++nsites;
+  }
+  fclose (fp);
+
+  if (nsites != 3)
+    ERR;
+  snprintf (expect, sizeof (expect), "callsitessubs.c:%d (drive_sites)", costly_line);
+  if (counts[0] != NITER || strcmp (site[0], expect) != 0)
+    ERR;
+  snprintf (expect, sizeof (expect), "callsitessubs.c:%d (drive_sites)", cheap_line);
+  if (counts[1] != NITER || strcmp (site[1], expect) != 0)
+    ERR;
+  if (counts[2] != 1 || strncmp (site[2], "callsitessubs.c:", 16) != 0)
+    ERR;
+  printf ("Success\n");
+  return 0;
+}
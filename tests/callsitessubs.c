@@ -0,0 +1,25 @@
+// Compiled with the auto-instrumentation flag and debug info for the callsites test
+#include "config.h"
+
+volatile int callsitesink = 0;
+int cheap_line = 0;       // line of the call of work which costs least per call
+int costly_line = 0;      // line of the call of work which costs most per call
+
+void work (int n)
+{
+  int i;
+
+  for (i = 0; i < n; ++i)
+    ++callsitesink;
+}
+
+void drive_sites (int niter)
+{
+  int n;
+
+  for (n = 0; n < niter; ++n) {
+    work (1000); cheap_line = __LINE__;
+    work (1000000); costly_line = __LINE__;
+  }
+  work (10);
+}
@@ -0,0 +1,165 @@
+/*
+** Test calling context tree mode (GPTLcct): a timer started from two parents gets a separate
+** entry under each with exact stats, handles find the same entries, stops must be perfectly
+** nested, and the per-node child maps keep working when they grow
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+#define NKIDS 20
+
+static int timed (const char *parent, int usec)
+{
+  int ret;
+
+  if ((ret = GPTLstart (parent)) != 0)
+    return ret;
+  if ((ret = GPTLstart ("solve")) != 0)
+    return ret;
+  usleep (usec);
+  if ((ret = GPTLstop ("solve")) != 0)
+    return ret;
+  return GPTLstop (parent);
+}
+
+int main ()
+{
+  int n, iter;
+  int ret;
+  int handle = 0;
+  int count;
+  int onflg;
+  int nsolve = 0;
+  unsigned long ncalls;
+  unsigned long calls[2];
+  long long usec, asolve = 0, bsolve = 0;
+  double wall, usr, sys;
+  long long papicounters[1];
+  char name[64];
+  char line[1024];
+  FILE *fp;
+
+  if ((ret = GPTLsetoption (GPTLcct, 1)) != 0)
+    ERR;
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+
+  // solve under step_a: 3 calls, 6 msec. Under step_b: 1 call, 50 msec. Far enough apart
+  // that oversleeping cannot reverse them, while splitting by call count would
+  for (n = 0; n < 3; ++n)
+    if ((ret = timed ("step_a", 2000)) != 0)
+      ERR;
+  if ((ret = timed ("step_b", 50000)) != 0)
+    ERR;
+
+  // A handle finds the same node under step_a
+  if ((ret = GPTLstart ("step_a")) != 0)
+    ERR;
+  if ((ret = GPTLstart_handle ("solve", &handle)) != 0)
+    ERR;
+  // Direct recursion does not create a node
+  if ((ret = GPTLstart ("solve")) != 0)
+    ERR;
+  if ((ret = GPTLstop ("solve")) != 0)
+    ERR;
+  if ((ret = GPTLstop_handle ("solve", &handle)) != 0)
+    ERR;
+  if ((ret = GPTLstop ("step_a")) != 0)
+    ERR;
+
+  // Error: imperfect nesting. The innermost timer is still running afterwards
+  if ((ret = GPTLstart ("p")) != 0)
+    ERR;
+  if ((ret = GPTLstart ("q")) != 0)
+    ERR;
+  if ((ret = GPTLstop ("p")) == 0)
+    ERR;
+  if ((ret = GPTLstop ("q")) != 0)
+    ERR;
+  if ((ret = GPTLstop ("p")) != 0)
+    ERR;
+
+  // Enough children to grow the child map of "many" several times
+  for (iter = 0; iter < 2; ++iter) {
+    if ((ret = GPTLstart ("many")) != 0)
+      ERR;
+    for (n = 0; n < NKIDS; ++n) {
+      snprintf (name, sizeof (name), "kid%d", n);
+      if ((ret = GPTLstart (name)) != 0)
+	ERR;
+      if ((ret = GPTLstop (name)) != 0)
+	ERR;
+    }
+    if ((ret = GPTLstop ("many")) != 0)
+      ERR;
+  }
+  for (n = 0; n < NKIDS; ++n) {
+    snprintf (name, sizeof (name), "kid%d", n);
+    if ((ret = GPTLquery (name, 0, &count, &onflg, &wall, &usr, &sys, papicounters, 0)) != 0)
+      ERR;
+    if (count != 2 || onflg)
+      ERR;
+  }
+
+  // Query by name finds the first call path: step_a
+  if ((ret = GPTLquery ("solve", 0, &count, &onflg, &wall, &usr, &sys, papicounters, 0)) != 0)
+    ERR;
+  if (count != 5 || onflg)
+    ERR;
+
+  if ((ret = GPTLpr_file ("timing.cct")) != 0)
+    ERR;
+  if ((ret = GPTLpr_folded ("timing.cct.folded")) != 0)
+    ERR;
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+
+  // One row of solve per parent
+  if ( ! (fp = fopen ("timing.cct", "r")))
+    ERR;
+  while (fgets (line, sizeof (line), fp) && strncmp (line, "Hotspots:", 9) != 0) {
+    if (sscanf (line, "%63s %lu", name, &ncalls) == 2 && strcmp (name, "solve") == 0) {
+      printf ("%s", line);
+      if (nsolve < 2)
+	calls[nsolve] = ncalls;
+      ++nsolve;
+    }
+  }
+  fclose (fp);
+  if (nsolve != 2 || calls[0] != 5 || calls[1] != 1)
+    ERR;
+
+  // Folded stacks are exact: splitting by call count would give step_a 5 of solve's 6 calls,
+  // so about 47 of its 56 msec
+  if ( ! (fp = fopen ("timing.cct.folded", "r")))
+    ERR;
+  while (fgets (line, sizeof (line), fp)) {
+    if (sscanf (line, "%63s %lld", name, &usec) != 2)
+      ERR;
+    if (strcmp (name, "step_a;solve") == 0)
+      asolve = usec;
+    else if (strcmp (name, "step_b;solve") == 0)
+      bsolve = usec;
+  }
+  fclose (fp);
+  printf ("step_a;solve %lld step_b;solve %lld\n", asolve, bsolve);
+  if (asolve <= 0 || bsolve <= asolve)
+    ERR;
+
+  printf ("Success\n");
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include "config.h"
+#include <mpi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>  /* usleep */
+#include <math.h>    /* fabs */
+
+#include "gptl.h"
+#include "gptlmpi.h"
+
+int main (int argc, char **argv)
+{
+  int iam;
+  int ret;
+  double offset, drift;
+
+  if (MPI_Init (&argc, &argv) != MPI_SUCCESS) {
+    printf ("Failure from MPI_Init\n");
+    return 1;
+  }
+
+  ret = GPTLinitialize ();
+  ret = MPI_Comm_rank (MPI_COMM_WORLD, &iam);
+
+  // No sync has been done yet so this must fail
+  if (GPTLget_clocksync (&offset, &drift) == 0) {
+    printf ("GPTLget_clocksync should have failed before GPTLclock_sync\n");
+    return 1;
+  }
+
+  if (GPTLclock_sync (MPI_COMM_WORLD) != 0) {
+    printf ("Failure from GPTLclock_sync\n");
+    return 1;
+  }
+  usleep (100000);
+  if (GPTLclock_sync (MPI_COMM_WORLD) != 0) {
+    printf ("Failure from 2nd GPTLclock_sync\n");
+    return 1;
+  }
+
+  if (GPTLget_clocksync (&offset, &drift) != 0) {
+    printf ("Failure from GPTLget_clocksync\n");
+    return 1;
+  }
+  printf ("rank %d: offset=%g drift=%g\n", iam, offset, drift);
+
+  if (iam == 0 && (offset != 0. || drift != 0.)) {
+    printf ("rank 0 offset and drift should be exactly zero\n");
+    return 1;
+  }
+
+  // All ranks share a node here. The underlying timer is referenced to whole seconds at
+  // GPTLinitialize, so offsets can be up to about 1 second but drift must be tiny
+  if (fabs (offset) > 2. || fabs (drift) > 1.e-2) {
+    printf ("rank %d: offset or drift is unreasonably large\n", iam);
+    return 1;
+  }
+
+  if (iam == 1)
+    ret = GPTLpr_file ("timing.clocksync");
+  ret = MPI_Finalize ();
+  return 0;
+}
@@ -0,0 +1,97 @@
+/*
+** Test run-time selection of auto-profiled functions: exclude patterns from GPTL_FILTER, then
+** an include pattern from GPTL_FILTER_FILE
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+#define NITER 10
+
+extern void filtercalls (int);
+
+// profile: Run filtercalls under GPTL and report which functions were timed
+static int profile (int *keep, int *skip, int *calls)
+{
+  int ret;
+  unsigned long count;
+  char line[1024];
+  char name[1024];
+  FILE *fp;
+
+  if ((ret = GPTLinitialize ()) != 0)
+    return ret;
+  filtercalls (NITER);
+  if ((ret = GPTLpr_file ("timing.filter")) != 0)
+    return ret;
+  if ((ret = GPTLfinalize ()) != 0)
+    return ret;
+
+  *keep = *skip = *calls = 0;
+  if ( ! (fp = fopen ("timing.filter", "r")))
+    return -1;
+  while (fgets (line, sizeof (line), fp) && strncmp (line, "Hotspots:", 9) != 0) {
+    if (sscanf (line, " %1023s %lu", name, &count) != 2)
+      continue;
+    if (strcmp (name, "keep_me") == 0 && count == NITER)
+      ++*keep;
+    else if (strncmp (name, "skip_", 5) == 0)
+      ++*skip;
+    else if (strcmp (name, "filtercalls") == 0)
+      ++*calls;
+  }
+  fclose (fp);
+  printf ("keep_me=%d skip_*=%d filtercalls=%d\n", *keep, *skip, *calls);
+  return 0;
+}
+
+int main ()
+{
+  int keep, skip, calls;
+  FILE *fp;
+
+  // Exclude patterns only: everything else is timed
+  if (setenv ("GPTL_FILTER", "-skip_me  -skip_t?o", 1) != 0)
+    ERR;
+  if (profile (&keep, &skip, &calls) != 0)
+    ERR;
+  if (keep != 1 || skip != 0 || calls != 1)
+    ERR;
+
+  // An include pattern: only matching functions are timed
+  if (unsetenv ("GPTL_FILTER") != 0)
+    ERR;
+  if ( ! (fp = fopen ("filter.patterns", "w")))
+    ERR;
+  fprintf (fp, "# functions to time\n  +keep_*  \n");
+  fclose (fp);
+  if (setenv ("GPTL_FILTER_FILE", "filter.patterns", 1) != 0)
+    ERR;
+  if (profile (&keep, &skip, &calls) != 0)
+    ERR;
+  if (keep != 1 || skip != 0 || calls != 0)
+    ERR;
+
+  // A missing file is an error
+  if (setenv ("GPTL_FILTER_FILE", "no_such_file", 1) != 0)
+    ERR;
+  GPTLsetoption (GPTLabort_on_error, 0);
+  if (GPTLinitialize () == 0)
+    ERR;
+
+  printf ("Success\n");
+  return 0;
+}
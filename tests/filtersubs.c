@@ -0,0 +1,30 @@
+// Compiled with the auto-instrumentation flag for the filter test
+#include "config.h"
+
+volatile int filtersink = 0;
+
+void keep_me (void)
+{
+  ++filtersink;
+}
+
+void skip_me (void)
+{
+  ++filtersink;
+}
+
+void skip_too (void)
+{
+  ++filtersink;
+}
+
+void filtercalls (int niter)
+{
+  int n;
+
+  for (n = 0; n < niter; ++n) {
+    keep_me ();
+    skip_me ();
+    skip_too ();
+  }
+}
@@ -0,0 +1,102 @@
+/*
+** Test GPTLpr_folded: the self time of a timer with two parents is split between them by call
+** count, nothing is counted twice, and recursion and caller loops terminate
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+static void timed (const char *name, int usec)
+{
+  (void) GPTLstart (name);
+  usleep (usec);
+  (void) GPTLstop (name);
+}
+
+int main ()
+{
+  int n;
+  int ret;
+  int nlines = 0;
+  long long usec;
+  long long sum = 0;
+  long long awork = 0, bwork = 0;
+  double wall, total = 0.;
+  char line[1024];
+  char path[1024];
+  FILE *fp;
+  static const char *toplevel[] = {"a", "b", "rec"};
+
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+
+  // work has 2 parents: a makes 3 of its 4 calls
+  (void) GPTLstart ("a");
+  for (n = 0; n < 3; ++n)
+    timed ("work", 10000);
+  (void) GPTLstop ("a");
+  (void) GPTLstart ("b");
+  timed ("work", 10000);
+  (void) GPTLstop ("b");
+
+  // Recursion: the inner start/stop only increments a counter
+  (void) GPTLstart ("rec");
+  timed ("rec", 5000);
+  (void) GPTLstop ("rec");
+
+  // Caller loop: x calls y, and at another time y calls x
+  (void) GPTLstart ("x");
+  timed ("y", 5000);
+  (void) GPTLstop ("x");
+  (void) GPTLstart ("y");
+  timed ("x", 5000);
+  (void) GPTLstop ("y");
+
+  if ((ret = GPTLpr_folded ("timing.folded")) != 0)
+    ERR;
+
+  for (n = 0; n < sizeof (toplevel) / sizeof (toplevel[0]); ++n) {
+    if ((ret = GPTLget_wallclock (toplevel[n], 0, &wall)) != 0)
+      ERR;
+    total += wall;
+  }
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+
+  if ( ! (fp = fopen ("timing.folded", "r")))
+    ERR;
+  while (fgets (line, sizeof (line), fp)) {
+    printf ("%s", line);
+    if (sscanf (line, "%1023s %lld", path, &usec) != 2)
+      ERR;
+    ++nlines;
+    if (path[0] != 'x' && path[0] != 'y')
+      sum += usec;
+    if (strcmp (path, "a;work") == 0)
+      awork = usec;
+    else if (strcmp (path, "b;work") == 0)
+      bwork = usec;
+  }
+  fclose (fp);
+
+  if (awork < 2.5 * bwork || awork > 3.5 * bwork)
+    ERR;
+  // Every microsecond below a, b and rec is written once, within rounding
+  if (sum > total * 1.e6 + nlines || sum < total * 1.e6 - nlines)
+    ERR;
+  printf ("Success\n");
+  return 0;
+}
@@ -0,0 +1,82 @@
+/*
+** Test self time and the hotspot section of GPTLpr_file: "work" has two parents and most of
+** the time, so it must be ranked first even though each parent's inclusive time is larger
+** than either half of it
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+static int timed (const char *parent, int parentusec, int workusec)
+{
+  int ret;
+
+  if ((ret = GPTLstart (parent)) != 0)
+    return ret;
+  usleep (parentusec);
+  if ((ret = GPTLstart ("work")) != 0)
+    return ret;
+  usleep (workusec);
+  if ((ret = GPTLstop ("work")) != 0)
+    return ret;
+  return GPTLstop (parent);
+}
+
+int main ()
+{
+  int ret;
+  int nrows = 0;
+  char line[1024];
+  char name[64];
+  char first[64] = "";
+  char last[64] = "";
+  double self, wall, pct, cum = 0.;
+  unsigned long count;
+  FILE *fp;
+
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+  if ((ret = timed ("a", 40000, 100000)) != 0)
+    ERR;
+  if ((ret = timed ("b", 20000, 100000)) != 0)
+    ERR;
+  if ((ret = GPTLpr_file ("timing.hotspots")) != 0)
+    ERR;
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+
+  if ( ! (fp = fopen ("timing.hotspots", "r")))
+    ERR;
+  while (fgets (line, sizeof (line), fp) && strncmp (line, "Hotspots:", 9) != 0);
+  if ( ! fgets (line, sizeof (line), fp))   // column titles
+    ERR;
+  while (fgets (line, sizeof (line), fp) &&
+	 sscanf (line, "%63s %lu %lf %lf %lf %lf", name, &count, &self, &wall, &pct, &cum) == 6) {
+    if (nrows++ == 0)
+      strcpy (first, name);
+    strcpy (last, name);
+    printf ("%s", line);
+  }
+  fclose (fp);
+
+  // Order is work (0.2 sec), a (0.04), b (0.02): all time is self time of some timer
+  if (nrows != 3 || strcmp (first, "work") != 0 || strcmp (last, "b") != 0)
+    ERR;
+  if (cum < 99.9 || cum > 100.1)
+    ERR;
+  printf ("Success\n");
+  return 0;
+}
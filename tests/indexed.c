@@ -0,0 +1,140 @@
+/*
+** Test GPTLstart_indexed/GPTLstop_indexed: each id is a separate timer named name[id], the
+** _handle versions find the same timers, and GPTLcollapse_indexed prints one name[*] row
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+#include <string.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+#define NLEVELS 5
+
+// count_lines: number of lines in file containing str
+static int count_lines (const char *file, const char *str)
+{
+  FILE *fp;
+  char line[1024];
+  int n = 0;
+
+  if ( ! (fp = fopen (file, "r")))
+    return -1;
+  while (fgets (line, sizeof (line), fp))
+    if (strstr (line, str))
+      ++n;
+  fclose (fp);
+  return n;
+}
+
+int main ()
+{
+  int iter, lvl;
+  int ret;
+  int handle = 0;
+  int count;
+  int onflg;
+  double wall, usr, sys;
+  long long papicounters[1];
+
+  // Only the call tree (and the overhead estimate) mention the timers
+  if ((ret = GPTLsetoption (GPTLdopr_multparent, 0)) != 0)
+    ERR;
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+
+  if ((ret = GPTLstart ("total")) != 0)
+    ERR;
+  for (iter = 0; iter < 3; ++iter) {
+    for (lvl = 0; lvl < NLEVELS; ++lvl) {
+      if ((ret = GPTLstart_indexed ("mg_level", lvl)) != 0)
+	ERR;
+      if ((ret = GPTLstart ("smooth")) != 0)
+	ERR;
+      if ((ret = GPTLstop ("smooth")) != 0)
+	ERR;
+      if ((ret = GPTLstop_indexed ("mg_level", lvl)) != 0)
+	ERR;
+    }
+    // Same timers through a handle for the base name
+    for (lvl = NLEVELS-1; lvl >= 0; --lvl) {
+      if ((ret = GPTLstart_indexed_handle ("mg_level", lvl, &handle)) != 0)
+	ERR;
+      if ((ret = GPTLstop_indexed_handle ("mg_level", lvl, &handle)) != 0)
+	ERR;
+    }
+  }
+
+  // Error: never started
+  if ((ret = GPTLstop_indexed ("mg_level", NLEVELS)) == 0)
+    ERR;
+  // Error: negative id
+  if ((ret = GPTLstart_indexed ("mg_level", -1)) == 0)
+    ERR;
+  // Error: 60 characters plus "[100]" would be truncated to 63
+  if ((ret = GPTLstart_indexed ("a_base_name_of_59_characters_which_leaves_no_room_for_the_id",
+				100)) == 0)
+    ERR;
+  if ((ret = GPTLstop ("total")) != 0)
+    ERR;
+
+  // Variants are ordinary timers named name[id]
+  for (lvl = 0; lvl < NLEVELS; ++lvl) {
+    char name[32];
+    snprintf (name, sizeof (name), "mg_level[%d]", lvl);
+    if ((ret = GPTLquery (name, 0, &count, &onflg, &wall, &usr, &sys, papicounters, 0)) != 0)
+      ERR;
+    if (count != 6 || onflg)
+      ERR;
+  }
+
+  // Default: one row per variant, and the unused base timer is not printed
+  if ((ret = GPTLpr_file ("timing.indexed")) != 0)
+    ERR;
+  if (count_lines ("timing.indexed", " mg_level[") != NLEVELS)
+    ERR;
+  if (count_lines ("timing.indexed", " mg_level ") != 0)
+    ERR;
+
+  // Collapsed: one row for all variants, and smooth is printed once below it
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+  if ((ret = GPTLsetoption (GPTLdopr_multparent, 0)) != 0)
+    ERR;
+  if ((ret = GPTLsetoption (GPTLcollapse_indexed, 1)) != 0)
+    ERR;
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+  for (lvl = 0; lvl < NLEVELS; ++lvl) {
+    if ((ret = GPTLstart_indexed ("mg_level", lvl)) != 0)
+      ERR;
+    if ((ret = GPTLstart ("smooth")) != 0)
+      ERR;
+    if ((ret = GPTLstop ("smooth")) != 0)
+      ERR;
+    if ((ret = GPTLstop_indexed ("mg_level", lvl)) != 0)
+      ERR;
+  }
+  if ((ret = GPTLpr_file ("timing.indexed")) != 0)
+    ERR;
+  if (count_lines ("timing.indexed", " mg_level[*]") != 1)
+    ERR;
+  if (count_lines ("timing.indexed", " mg_level[0]") != 0)
+    ERR;
+  if (count_lines ("timing.indexed", " smooth") != 1)
+    ERR;
+
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+  printf ("Success\n");
+  return 0;
+}
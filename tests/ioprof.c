@@ -0,0 +1,62 @@
+/*
+** Check I/O profiling (--enable-ioprof): calls must appear as IO_* timers, and bytes must be
+** charged to the region which made them. Region "reread" uses the *64 calls which programs
+** built with -D_FILE_OFFSET_BITS=64 make
+*/
+
+#define _LARGEFILE64_SOURCE  // open64, pread64, lseek64
+#include "gptl.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define NWRITE 10
+#define BUFSIZE 4096
+
+int main ()
+{
+  int n;
+  int fd;
+  int ret;
+  char buf[BUFSIZE];
+  FILE *fp;
+
+  memset (buf, 0, BUFSIZE);
+  if ((ret = GPTLinitialize ()) != 0)
+    return 1;
+
+  ret = GPTLstart ("dump");
+  if ((fd = open ("ioprof.dat", O_CREAT | O_WRONLY | O_TRUNC, 0644)) < 0)
+    return 1;
+  for (n = 0; n < NWRITE; ++n)
+    if (write (fd, buf, BUFSIZE) != BUFSIZE)
+      return 1;
+  (void) fsync (fd);
+  (void) close (fd);
+  ret = GPTLstop ("dump");
+
+  ret = GPTLstart ("stage");
+  if ( ! (fp = fopen ("ioprof.dat", "r")))
+    return 1;
+  while (fread (buf, 1, BUFSIZE, fp) == BUFSIZE);
+  (void) fclose (fp);
+  ret = GPTLstop ("stage");
+
+  ret = GPTLstart ("reread");
+  if ((fd = open64 ("ioprof.dat", O_RDONLY)) < 0)
+    return 1;
+  for (n = 0; n < NWRITE; ++n)
+    if (pread64 (fd, buf, BUFSIZE, (off64_t) n * BUFSIZE) != BUFSIZE)
+      return 1;
+  if (lseek64 (fd, 0, SEEK_END) != (off64_t) NWRITE * BUFSIZE)
+    return 1;
+  (void) close (fd);
+  ret = GPTLstop ("reread");
+
+  if ((ret = GPTLpr_file ("timing.ioprof")) != 0)
+    return 1;
+  if ((ret = GPTLfinalize ()) != 0)
+    return 1;
+  return 0;
+}
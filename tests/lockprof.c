@@ -0,0 +1,71 @@
+/*
+** Check lock contention profiling (--enable-lockprof): threads which fight over one mutex
+** inside region "critical" must have contended acquires charged to that region. Locking a
+** robust mutex whose owner died must return EOWNERDEAD with the lock held
+*/
+
+#include "gptl.h"
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <omp.h>
+
+#define NITER 100
+
+pthread_mutex_t biglock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t robust;
+
+// die_holding: Take the robust mutex and exit without releasing it
+void *die_holding (void *arg)
+{
+  (void) pthread_mutex_lock (&robust);
+  return arg;
+}
+
+int main ()
+{
+  int ret;
+  int nthreads;
+
+  if ((ret = GPTLinitialize ()) != 0)
+    return 1;
+
+#pragma omp parallel private (ret)
+  {
+    int n;
+    for (n = 0; n < NITER; ++n) {
+      ret = GPTLstart ("critical");
+      (void) pthread_mutex_lock (&biglock);
+      usleep (100);   // hold the lock long enough for the other threads to queue up
+      (void) pthread_mutex_unlock (&biglock);
+      ret = GPTLstop ("critical");
+    }
+  }
+
+  {
+    pthread_mutexattr_t attr;
+    pthread_t tid;
+
+    (void) pthread_mutexattr_init (&attr);
+    (void) pthread_mutexattr_setrobust (&attr, PTHREAD_MUTEX_ROBUST);
+    (void) pthread_mutex_init (&robust, &attr);
+    if (pthread_create (&tid, NULL, die_holding, NULL) != 0 || pthread_join (tid, NULL) != 0)
+      return 1;
+    ret = GPTLstart ("robust");
+    if (pthread_mutex_lock (&robust) != EOWNERDEAD) {
+      printf ("lockprof: locking a robust mutex whose owner died did not return EOWNERDEAD\n");
+      return 1;
+    }
+    (void) pthread_mutex_consistent (&robust);
+    (void) pthread_mutex_unlock (&robust);
+    ret = GPTLstop ("robust");
+  }
+
+  nthreads = omp_get_max_threads ();
+  if ((ret = GPTLpr_file ("timing.lockprof")) != 0)
+    return 1;
+  ret = GPTLfinalize ();
+  printf ("lockprof: ran with %d threads\n", nthreads);
+  return 0;
+}
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 const int onemb = 1024 * 1024;
 void sub (unsigned char *, int);
@@ -16,9 +17,14 @@ int main ()
   int n;
   unsigned char *arr = NULL;
 
-  // Print when process size has grown.
+  // Sample RSS in the background, print when process size has grown, and report
+  // per-region memory stats in GPTLpr_file
   if ((ret = GPTLsetoption (GPTLdopr_memusage, 1)) != 0)
     return -1;
+
+  // Sample every millisecond so the short regions below get samples
+  if ((ret = GPTLsetoption (GPTLmem_sample_msec, 1)) != 0)
+    return -1;
   
   // Only print when the process has grown by 50% or more since the last print
   // (or since the process started)
@@ -28,6 +34,11 @@ int main ()
   ret = GPTLinitialize ();
   for (n = 1; n < 10; ++n)
     sub (arr, n);
+
+  if ((ret = GPTLpr_file ("timing.memusage")) != 0)
+    return -1;
+  if ((ret = GPTLfinalize ()) != 0)
+    return -1;
   return 0;
 }
 
@@ -40,5 +51,6 @@ void sub (unsigned char *arr, int n)
   space = (unsigned char *) realloc (arr, n*onemb*(sizeof (unsigned char)));
   arr = space;
   memset (arr, 0, n*onemb*(sizeof (unsigned char)));
+  usleep (5000);   // give the sampler a chance to see the region
   ret = GPTLstop ("sub");
 }
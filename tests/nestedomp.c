@@ -8,36 +8,53 @@
 
 int main ()
 {
-  int m, n;            /* inner, outer nested loop indices */
+  int k, m, n;         /* innermost, middle, outer nested loop indices */
   int t;               /* linear thread number */
+  int rep;             /* repetition of the nested region */
+  int count;           /* return from GPTLget_count */
+  const int nreps = 50; /* times the nested region is entered: fresh inner threads each time */
   const int msize = 2; /* dimension M */
+  const int ksize = 2; /* dimension K */
   double value;        /* return from GPTLget_wallclock */
   int ret;
   void sub (const int, const int, const int);
   
 #ifdef THREADED_OMP
-  omp_set_num_threads (6);  /* 3 outer x 2 inner threads */
-  omp_set_nested (1);
+  omp_set_num_threads (12);  /* 3 outer x 2 middle x 2 inner threads */
+  omp_set_max_active_levels (3);
 #endif
   ret = GPTLinitialize ();
+  for (rep = 0; rep < nreps; ++rep) {
 #pragma omp parallel for private (n) num_threads(3)
-  for (n = 0; n < 3; ++n) {
-#pragma omp parallel for private (m, ret) num_threads(2)
-    for (m = 0; m < msize; ++m) {
-      ret = GPTLstart ("sub");
-      sub (m, n, msize);
-      ret = GPTLstop ("sub");
+    for (n = 0; n < 3; ++n) {
+#pragma omp parallel for private (m) num_threads(2)
+      for (m = 0; m < msize; ++m) {
+#pragma omp parallel for private (k, ret) num_threads(2)
+	for (k = 0; k < ksize; ++k) {
+	  ret = GPTLstart ("sub");
+	  sub (k, n*msize + m, ksize);
+	  ret = GPTLstop ("sub");
+	}
+      }
     }
   }
+  if (GPTLnum_errors () > 0) {
+    printf ("Failure: GPTL reported %d errors\n", GPTLnum_errors ());
+    return 1;
+  }
 #ifdef THREADED_OMP
-  for (n = 0; n < 3; ++n) {
-    for (m = 0; m < msize; ++m) {
-      t = n*msize + m;
-      ret = GPTLget_wallclock ("sub", t, &value);
-      if (ret != 0) {
-	printf ("Failure to get wallclock for t=%d\n", t);
-	return 1;
-      }
+  /* Each of the 12 positions gets its own index regardless of nesting depth, kept by the
+     threads which replace one another there each time the nested region is entered */
+  for (t = 0; t < 3*msize*ksize; ++t) {
+    ret = GPTLget_wallclock ("sub", t, &value);
+    if (ret != 0) {
+      printf ("Failure to get wallclock for t=%d\n", t);
+      return 1;
+    }
+    ret = GPTLget_count ("sub", t, &count);
+    if (ret != 0 || count != nreps) {
+      printf ("Failure: t=%d called sub %d times expected %d\n", t, count, nreps);
+      return 1;
     }
   }
 #endif
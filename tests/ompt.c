@@ -0,0 +1,37 @@
+/*
+** Check OMPT support (--enable-ompt): a parallel region in which thread 0 does 4 times the
+** work of the others must be timed without instrumentation and reported as imbalanced
+*/
+
+#include "gptl.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <omp.h>
+
+#define NITER 5
+
+int main ()
+{
+  int n;
+  int ret;
+  int ncrit = 0;
+
+  if ((ret = GPTLinitialize ()) != 0)
+    return 1;
+
+  for (n = 0; n < NITER; ++n) {
+#pragma omp parallel num_threads (4)
+    {
+#pragma omp critical
+      ++ncrit;
+#pragma omp barrier
+      usleep (omp_get_thread_num () == 0 ? 40000 : 10000);
+    }
+  }
+
+  if ((ret = GPTLpr_file ("timing.ompt")) != 0)
+    return 1;
+  ret = GPTLfinalize ();
+  printf ("ompt: %d critical section entries\n", ncrit);
+  return 0;
+}
@@ -0,0 +1,163 @@
+/*
+** Test the GPTLpatch option: functions built with -fpatchable-function-entry=5 are timed only
+** while GPTL is enabled, arguments and return values (including AVX vectors) pass through
+** unchanged, threads may disable and enable concurrently while calling patched functions, a
+** patched function may call GPTLfinalize, and the functions still work after GPTLfinalize has
+** restored them
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <immintrin.h>
+#include <stdio.h>
+#include <string.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+#define NITER 10
+#define NTOGGLE 200
+
+typedef struct {
+  long a;
+  long b;
+} Pair;
+
+extern double pmix (int, double, float, long, double, int, double, double, double, double,
+		    double, double, double, int, int, int);
+extern int pint (int);
+extern Pair ppair (long);
+extern long pfact (int);
+extern __m256d pvec (__m256d, __m256d) __attribute__ ((target ("avx")));
+extern int pfinalize (void);
+
+// vcalls: Call the patchable function which takes and returns 256-bit vectors
+__attribute__ ((target ("avx"))) static int vcalls (void)
+{
+  double out[4];
+  __m256d a = _mm256_set_pd (4., 3., 2., 1.);
+  __m256d b = _mm256_set_pd (40., 30., 20., 10.);
+
+  _mm256_storeu_pd (out, pvec (a, b));
+  if (out[0] != 11. || out[1] != 22. || out[2] != 33. || out[3] != 44.)
+    return -1;
+  return 0;
+}
+
+// calls: Call every patchable function and check what comes back
+static int calls (void)
+{
+  Pair pair;
+
+  if (pmix (1, 2., 3.f, 4L, 5., 6, 7., 8., 9., 10., 11., 12., 13., 14, 15, 16) != 136.)
+    return -1;
+  if (pint (41) != 42)
+    return -1;
+  pair = ppair (7);
+  if (pair.a != 7 || pair.b != -7)
+    return -1;
+  if (pfact (10) != 3628800L)
+    return -1;
+  if (__builtin_cpu_supports ("avx") && vcalls () != 0)
+    return -1;
+  return 0;
+}
+
+// toggles: Each thread alternately disables and enables while calling patched functions,
+// which other threads are rewriting meanwhile. Returns the number of failures
+static int toggles (void)
+{
+  int nfail = 0;
+
+#pragma omp parallel reduction(+:nfail)
+  {
+    int n;
+
+    for (n = 0; n < NTOGGLE; ++n) {
+      if (GPTLdisable () != 0 || pint (n) != n + 1)
+	++nfail;
+      if (GPTLenable () != 0 || calls () != 0)
+	++nfail;
+    }
+  }
+  return nfail;
+}
+
+int main ()
+{
+  int n;
+  int ret;
+  int npint = 0, npmix = 0;
+  unsigned long count;
+  char line[1024];
+  char name[1024];
+  FILE *fp;
+
+  if (calls () != 0)
+    ERR;
+
+  if ((ret = GPTLsetoption (GPTLpatch, 1)) != 0)
+    ERR;
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+  for (n = 0; n < NITER; ++n)
+    if (calls () != 0)
+      ERR;
+
+  // Not timed while disabled
+  if ((ret = GPTLdisable ()) != 0)
+    ERR;
+  for (n = 0; n < NITER; ++n)
+    if (pint (n) != n + 1)
+      ERR;
+  if ((ret = GPTLenable ()) != 0)
+    ERR;
+  if (pint (0) != 1)
+    ERR;
+
+  if ((ret = GPTLpr_file ("timing.patch")) != 0)
+    ERR;
+
+  // Patching is process-wide: concurrent toggles must neither break calls nor fail
+  if (toggles () != 0)
+    ERR;
+  if (GPTLnum_errors () != 0)
+    ERR;
+  // GPTLfinalize resets the error count, so the return from pfinalize must add none
+  if ((ret = pfinalize ()) != 0)
+    ERR;
+  if (GPTLnum_errors () != 0)
+    ERR;
+  if (calls () != 0)
+    ERR;
+
+  if ( ! (fp = fopen ("timing.patch", "r")))
+    ERR;
+  while (fgets (line, sizeof (line), fp) && strncmp (line, "Hotspots:", 9) != 0) {
+    if (sscanf (line, " %1023s %lu", name, &count) != 2)
+      continue;
+    if (strcmp (name, "pint") == 0) {
+      printf ("%s", line);
+      if (count == NITER + 1)
+	++npint;
+    } else if (strcmp (name, "pmix") == 0) {
+      printf ("%s", line);
+      if (count == NITER)
+	++npmix;
+    } else if (strcmp (name, "pfact") == 0 || strcmp (name, "ppair") == 0) {
+      printf ("%s", line);
+    }
+  }
+  fclose (fp);
+  if (npint != 1 || npmix != 1)
+    ERR;
+  printf ("Success\n");
+  return 0;
+}
@@ -0,0 +1,45 @@
+// Compiled with -fpatchable-function-entry=5 for the patch test
+#include "config.h"
+#include "gptl.h"
+#include <immintrin.h>
+
+typedef struct {
+  long a;
+  long b;
+} Pair;
+
+// Arguments in every integer and vector argument register, and on the stack
+double pmix (int i1, double d1, float f1, long l1, double d2, int i2, double d3, double d4,
+	     double d5, double d6, double d7, double d8, double d9, int i3, int i4, int i5)
+{
+  return i1 + d1 + f1 + l1 + d2 + i2 + d3 + d4 + d5 + d6 + d7 + d8 + d9 + i3 + i4 + i5;
+}
+
+int pint (int n)
+{
+  return n + 1;
+}
+
+// Returned in rax and rdx
+Pair ppair (long n)
+{
+  Pair pair = {n, -n};
+  return pair;
+}
+
+long pfact (int n)
+{
+  return n <= 1 ? 1 : n * pfact (n - 1);
+}
+
+// Arguments and return value in ymm registers, whose upper halves the trampolines must keep
+__attribute__ ((target ("avx"))) __m256d pvec (__m256d a, __m256d b)
+{
+  return _mm256_add_pd (a, b);
+}
+
+// Returns through GPTL after the timers are gone
+int pfinalize (void)
+{
+  return GPTLfinalize ();
+}
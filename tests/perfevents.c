@@ -0,0 +1,116 @@
+/*
+** Test the perf_event_open counters (GPTLperf_* options): task-clock of a region which computes
+** is about its CPU time and that of a region which sleeps is about zero, touching new memory
+** takes page faults, and hardware counters and IPC are sane where the machine has them.
+** Skipped (exit 77) where perf_event_open is not available.
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+#define NPAGES 1000
+
+volatile double sink = 0.;
+
+// burn: use about sec seconds of CPU time
+void burn (double sec)
+{
+  clock_t start = clock ();
+  int n;
+
+  while ((double) (clock () - start) / CLOCKS_PER_SEC < sec)
+    for (n = 0; n < 10000; ++n)
+      sink += 1.e-9 * n;
+}
+
+int main ()
+{
+  int ret;
+  int hardware;
+  long pagesize = sysconf (_SC_PAGESIZE);
+  char *mem;
+  double spin, nap, faults, cycles, ipc;
+
+  if (GPTLsetoption (GPTLperf_task_clock, 1) != 0) {
+    printf ("perf_event_open task-clock is not available: skipping\n");
+    return 77;
+  }
+  if ((ret = GPTLsetoption (GPTLperf_page_faults, 1)) != 0)
+    ERR;
+  // Hardware counters are often missing in virtual machines
+  hardware = (GPTLsetoption (GPTLperf_cycles, 1) == 0 && GPTLsetoption (GPTLperf_ipc, 1) == 0);
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+
+  if ((ret = GPTLstart ("spin")) != 0)
+    ERR;
+  burn (0.2);
+  if ((ret = GPTLstop ("spin")) != 0)
+    ERR;
+
+  if ((ret = GPTLstart ("nap")) != 0)
+    ERR;
+  usleep (200000);
+  if ((ret = GPTLstop ("nap")) != 0)
+    ERR;
+
+  if ((ret = GPTLstart ("touch")) != 0)
+    ERR;
+  if ( ! (mem = (char *) malloc (NPAGES * pagesize)))
+    ERR;
+  memset (mem, 1, NPAGES * pagesize);
+  sink += mem[NPAGES * pagesize - 1];
+  if ((ret = GPTLstop ("touch")) != 0)
+    ERR;
+  free (mem);
+
+  if ((ret = GPTLpr_file ("timing.perfevents")) != 0)
+    ERR;
+
+  // task-clock is in nanoseconds
+  if ((ret = GPTLget_eventvalue ("spin", "task-clock", -1, &spin)) != 0)
+    ERR;
+  if ((ret = GPTLget_eventvalue ("nap", "task-clock", -1, &nap)) != 0)
+    ERR;
+  if ((ret = GPTLget_eventvalue ("touch", "page-faults", -1, &faults)) != 0)
+    ERR;
+  printf ("task-clock: spin=%g nap=%g  page-faults: touch=%g\n", spin, nap, faults);
+  if (spin < 0.1e9 || spin > 1.e9)
+    ERR;
+  if (nap > 0.01e9)
+    ERR;
+  if (faults < NPAGES / 2)
+    ERR;
+
+  if (hardware) {
+    if ((ret = GPTLget_eventvalue ("spin", "cycles", -1, &cycles)) != 0)
+      ERR;
+    if ((ret = GPTLget_eventvalue ("spin", "IPC", -1, &ipc)) != 0)
+      ERR;
+    printf ("spin: cycles=%g IPC=%g\n", cycles, ipc);
+    if (cycles < 1.e6 || ipc <= 0. || ipc > 10.)
+      ERR;
+  }
+
+  if ((ret = GPTLget_eventvalue ("spin", "no-such-event", -1, &spin)) == 0)
+    ERR;
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+  printf ("Success\n");
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include "config.h"
+#include <mpi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gptl.h"
+#include "gptlmpi.h"
+
+// Header and index line lengths must match those in src/pr_collective.c
+#define HDRLEN 128
+#define IDXLEN 53
+
+int main (int argc, char **argv)
+{
+  int iam;
+  int nranks;
+  int nranks_file;
+  int p, rank;
+  int ret;
+  long long offset, nbytes;
+  char line[256];
+  char expect[64];
+  FILE *fp;
+  static const char *outfile = "timing.collective";
+
+  if (MPI_Init (&argc, &argv) != MPI_SUCCESS) {
+    printf ("Failure from MPI_Init\n");
+    return 1;
+  }
+
+  ret = GPTLinitialize ();
+  ret = MPI_Comm_rank (MPI_COMM_WORLD, &iam);
+  ret = MPI_Comm_size (MPI_COMM_WORLD, &nranks);
+
+  ret = GPTLstart ("total");
+  // Give each rank a different report length
+  for (p = 0; p <= iam; ++p) {
+    sprintf (line, "region%d", p);
+    ret = GPTLstart (line);
+    ret = GPTLstop (line);
+  }
+  ret = GPTLstop ("total");
+
+  if (GPTLpr_collective (MPI_COMM_WORLD, outfile) != 0) {
+    printf ("Failure from GPTLpr_collective\n");
+    return 1;
+  }
+
+  // Rank 0 checks that each index entry points at the report for that rank
+  if (iam == 0) {
+    if ( ! (fp = fopen (outfile, "r"))) {
+      printf ("Cannot open %s\n", outfile);
+      return 1;
+    }
+    if ( ! fgets (line, sizeof line, fp) || 
+	 sscanf (line, "GPTL collective output: nranks=%d", &nranks_file) != 1 ||
+	 nranks_file != nranks) {
+      printf ("Bad header line: %s\n", line);
+      return 1;
+    }
+    for (p = 0; p < nranks; ++p) {
+      if (fseek (fp, HDRLEN + (long) p * IDXLEN, SEEK_SET) != 0 ||
+	  fscanf (fp, "%d %lld %lld", &rank, &offset, &nbytes) != 3 || rank != p) {
+	printf ("Bad index entry for rank %d\n", p);
+	return 1;
+      }
+      sprintf (expect, "*** GPTL report for rank %d ***\n", p);
+      if (fseek (fp, (long) offset, SEEK_SET) != 0 || ! fgets (line, sizeof line, fp) ||
+	  strcmp (line, expect) != 0) {
+	printf ("Index entry for rank %d does not point at its report\n", p);
+	return 1;
+      }
+    }
+    fclose (fp);
+    printf ("Index entries for all %d ranks are correct\n", nranks);
+  }
+
+  ret = MPI_Finalize ();
+  return 0;
+}
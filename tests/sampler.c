@@ -0,0 +1,107 @@
+/*
+** Test the sampling profiler (GPTLsample_usec): samples are taken on CPU time, so a region
+** which computes gets about one sample per interval and a region which sleeps gets none,
+** and the program counters of each region are listed below it
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+#define USEC 1000
+
+volatile double sink = 0.;
+
+// burn: use about sec seconds of CPU time
+void burn (double sec)
+{
+  clock_t start = clock ();
+  int n;
+
+  while ((double) (clock () - start) / CLOCKS_PER_SEC < sec)
+    for (n = 0; n < 10000; ++n)
+      sink += 1.e-9 * n;
+}
+
+int main ()
+{
+  int ret;
+  int insection = 0;
+  int inspin = 0;
+  int nfuncs = 0;
+  unsigned long spin = 0, nap = 0;
+  unsigned long count;
+  char line[1024];
+  char name[64];
+  FILE *fp;
+
+  if ((ret = GPTLsetoption (GPTLsample_usec, USEC)) != 0)
+    ERR;
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+
+  if ((ret = GPTLstart ("spin")) != 0)
+    ERR;
+  burn (0.3);
+  if ((ret = GPTLstop ("spin")) != 0)
+    ERR;
+
+  if ((ret = GPTLstart ("nap")) != 0)
+    ERR;
+  usleep (300000);
+  if ((ret = GPTLstop ("nap")) != 0)
+    ERR;
+
+  if ((ret = GPTLpr_file ("timing.sampler")) != 0)
+    ERR;
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+
+  if ( ! (fp = fopen ("timing.sampler", "r")))
+    ERR;
+  while (fgets (line, sizeof (line), fp)) {
+    if (strncmp (line, "CPU time samples", 16) == 0)
+      insection = 1;
+    if ( ! insection)
+      continue;
+    printf ("%s", line);
+    // Function rows are indented below their region
+    if (line[0] == ' ') {
+      nfuncs += inspin;
+      continue;
+    }
+    inspin = 0;
+    if (sscanf (line, "%63s %lu", name, &count) != 2)
+      continue;
+    if (strcmp (name, "spin") == 0) {
+      spin = count;
+      inspin = 1;
+    } else if (strcmp (name, "nap") == 0) {
+      nap = count;
+    }
+  }
+  fclose (fp);
+
+  // 300 samples are expected. Allow for coarse CPU time clocks on loaded machines
+  if (spin < 150 || spin > 600)
+    ERR;
+  if (nap > 10)
+    ERR;
+  if (nfuncs < 1)
+    ERR;
+  printf ("Success\n");
+  return 0;
+}
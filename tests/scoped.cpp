@@ -0,0 +1,115 @@
+/*
+** Test gptl.hpp: scoped timers must be stopped on early return and when an exception
+** propagates, and compile-time handles must match those generated at run time, also
+** after a re-initialization with a different table size
+*/
+
+#include "gptl.hpp"
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+#define NITER 10
+
+static int early (int i)
+{
+  GPTL_SCOPE ("early");
+  if (i % 2)
+    return 1;
+  return 0;
+}
+
+static void thrower ()
+{
+  GPTL_SCOPE ("thrower");
+  throw std::runtime_error ("leaving thrower");
+}
+
+// Timer is on (onflg) and has been called count times on thread 0
+static bool check (const char *name, int count)
+{
+  int cnt, onflg;
+  double wall, usr, sys;
+  long long papi[1];
+
+  if (GPTLquery (name, 0, &cnt, &onflg, &wall, &usr, &sys, papi, 0) != 0)
+    return false;
+  return cnt == count && onflg == 0;
+}
+
+int main ()
+{
+  int i;
+  int handle;
+  int nodd = 0;
+  int ncaught = 0;
+  static const char longname[] =
+    "a_name_which_is_much_longer_than_the_sixty_three_characters_gptl_keeps";
+
+  if (GPTLinitialize () != 0)
+    ERR;
+
+  // Compile-time hash must reproduce genhashidx, including names longer than MAX_CHARS
+  (void) GPTLinit_handle ("early", &handle);
+  if (handle != gptl::detail::handle_from_hash (gptl::detail::literal_hash ("early")))
+    ERR;
+  (void) GPTLinit_handle (longname, &handle);
+  if (handle != gptl::detail::handle_from_hash (gptl::detail::literal_hash (longname)))
+    ERR;
+
+  {
+    GPTL_SCOPE ("main_loop");
+    for (i = 0; i < NITER; ++i) {
+      nodd += early (i);
+      try {
+	thrower ();
+      } catch (const std::runtime_error &) {
+	++ncaught;
+      }
+    }
+  }
+  if (nodd != NITER/2 || ncaught != NITER)
+    ERR;
+
+  {
+    gptl::ScopedTimer timer (std::string ("runtime_") + "name");
+  }
+
+  if ( ! check ("early", NITER) || ! check ("thrower", NITER) || ! check ("main_loop", 1) ||
+       ! check ("runtime_name", 1))
+    ERR;
+
+  gptl::wallclock::time_point t0 = gptl::wallclock::now ();
+  usleep (10000);
+  std::chrono::duration<double> elapsed = gptl::wallclock::now () - t0;
+  if (elapsed.count () < 0.009)
+    ERR;
+
+  if (GPTLpr (0) != 0)
+    ERR;
+  if (GPTLfinalize () != 0)
+    ERR;
+
+  // Handles of the default table would be out of range for a 17-entry table
+  if (GPTLsetoption (GPTLtablesize, 17) != 0)
+    ERR;
+  if (GPTLinitialize () != 0)
+    ERR;
+  for (i = 0; i < NITER; ++i)
+    (void) early (i);
+  if ( ! check ("early", NITER))
+    ERR;
+  if (GPTLfinalize () != 0)
+    ERR;
+  printf ("scoped: all tests passed\n");
+  return 0;
+}
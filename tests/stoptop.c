@@ -0,0 +1,83 @@
+/*
+** Test GPTLstop_top: stopping the innermost running timer must give the same results as
+** stopping it by name, including for recursive timers, and a name mismatch is caught only
+** when GPTLverbose is set
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+int main ()
+{
+  int n;
+  int ret;
+  int count;
+  int onflg;
+  double wall, usr, sys;
+  long long papicounters[1];
+
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+
+  /* Error: nothing is running */
+  if ((ret = GPTLstop_top (0)) == 0)
+    ERR;
+
+  if ((ret = GPTLstart ("outer")) != 0)
+    ERR;
+  for (n = 0; n < 10; ++n) {
+    if ((ret = GPTLstart ("inner")) != 0)
+      ERR;
+    /* Recursion: the inner start does not push the call stack */
+    if ((ret = GPTLstart ("inner")) != 0)
+      ERR;
+    if ((ret = GPTLstop_top ("inner")) != 0)
+      ERR;
+    if ((ret = GPTLstop_top (0)) != 0)
+      ERR;
+  }
+
+  /* Without GPTLverbose a wrong name is not even looked at */
+  if ((ret = GPTLstop_top ("inner")) != 0)
+    ERR;
+
+  /* Both timers are now off */
+  if ((ret = GPTLquery ("outer", 0, &count, &onflg, &wall, &usr, &sys, papicounters, 0)) != 0)
+    ERR;
+  if (count != 1 || onflg)
+    ERR;
+  if ((ret = GPTLquery ("inner", 0, &count, &onflg, &wall, &usr, &sys, papicounters, 0)) != 0)
+    ERR;
+  if (count != 20 || onflg)
+    ERR;
+
+  /* With GPTLverbose a wrong name is an error, and the timer is left running */
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+  if ((ret = GPTLsetoption (GPTLverbose, 1)) != 0)
+    ERR;
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+  if ((ret = GPTLstart ("outer")) != 0)
+    ERR;
+  if ((ret = GPTLstop_top ("inner")) == 0)
+    ERR;
+  if ((ret = GPTLstop_top ("outer")) != 0)
+    ERR;
+
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+  printf ("Success\n");
+  return 0;
+}
@@ -0,0 +1,71 @@
+/*
+** Test naming of auto-profiled functions at print time: static functions are named from the
+** symbol table, long names are printed whole, and no function is left as a bare address
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+#include <string.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+#define NITER 10
+
+extern void symcalls (int);
+
+static const char *longname =
+  "a_function_with_a_name_much_longer_than_the_sixty_three_characters_gptl_keeps";
+
+int main ()
+{
+  int ret;
+  int nlong = 0, nlocal = 0, nsymcalls = 0, naddr = 0;
+  unsigned long count;
+  char line[1024];
+  char name[1024];
+  FILE *fp;
+
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+  symcalls (NITER);
+  if ((ret = GPTLpr_file ("timing.symnames")) != 0)
+    ERR;
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+
+  if ( ! (fp = fopen ("timing.symnames", "r")))
+    ERR;
+  // Stats rows up to the hotspot section: name, then call count
+  while (fgets (line, sizeof (line), fp) && strncmp (line, "Hotspots:", 9) != 0) {
+    if (sscanf (line, " %1023s %lu", name, &count) != 2)
+      continue;
+    if (strcmp (name, longname) == 0 && count == NITER) {
+      printf ("%s", line);
+      ++nlong;
+    } else if (strcmp (name, "local_helper") == 0 && count == NITER) {
+      printf ("%s", line);
+      ++nlocal;
+    } else if (strcmp (name, "symcalls") == 0 && count == 1) {
+      printf ("%s", line);
+      ++nsymcalls;
+    } else if (strncmp (name, "0x", 2) == 0) {
+      printf ("%s", line);
+      ++naddr;
+    }
+  }
+  fclose (fp);
+
+  if (nlong != 1 || nlocal != 1 || nsymcalls != 1 || naddr != 0)
+    ERR;
+  printf ("Success\n");
+  return 0;
+}
@@ -0,0 +1,24 @@
+// Compiled with the auto-instrumentation flag for the symnames test
+#include "config.h"
+
+volatile int symsink = 0;
+
+// Not exported: only found in the full symbol table of the executable
+static int local_helper (int n)
+{
+  return n & 1;
+}
+
+// Longer than MAX_CHARS (63)
+void a_function_with_a_name_much_longer_than_the_sixty_three_characters_gptl_keeps (void)
+{
+  symsink += local_helper (symsink);
+}
+
+void symcalls (int niter)
+{
+  int n;
+
+  for (n = 0; n < niter; ++n)
+    a_function_with_a_name_much_longer_than_the_sixty_three_characters_gptl_keeps ();
+}
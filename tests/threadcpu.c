@@ -0,0 +1,114 @@
+/*
+** Test per-thread CPU accounting (GPTLthread_cpu): CPU time resolves regions much shorter
+** than a times() tick, a region which sleeps has Wait close to its wallclock time and
+** voluntary context switches
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+volatile double sink = 0.;
+
+// burn: use about sec seconds of CPU time of the calling thread
+void burn (double sec)
+{
+  struct timespec ts;
+  double start, now;
+  int n;
+
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+  start = ts.tv_sec + 1.e-9 * ts.tv_nsec;
+  do {
+    for (n = 0; n < 1000; ++n)
+      sink += 1.e-9 * n;
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+    now = ts.tv_sec + 1.e-9 * ts.tv_nsec;
+  } while (now - start < sec);
+}
+
+int main ()
+{
+  int ret;
+  int count, onflg;
+  int found = 0;
+  double wall, usr, sys;
+  double cpu, wait;
+  long nvcsw, nivcsw;
+  char line[1024];
+  char name[64];
+  FILE *fp;
+
+  if ((ret = GPTLsetoption (GPTLthread_cpu, 1)) != 0) {
+    printf ("per-thread CPU time is not available: skipping\n");
+    return 77;
+  }
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+
+  if ((ret = GPTLstart ("spin")) != 0)
+    ERR;
+  burn (0.002);
+  if ((ret = GPTLstop ("spin")) != 0)
+    ERR;
+
+  if ((ret = GPTLstart ("nap")) != 0)
+    ERR;
+  usleep (100000);
+  if ((ret = GPTLstop ("nap")) != 0)
+    ERR;
+
+  // 2 msec of CPU is below the resolution of times()
+  if ((ret = GPTLquery ("spin", -1, &count, &onflg, &wall, &usr, &sys, 0, 0)) != 0)
+    ERR;
+  printf ("spin: wall=%g cpu=%g\n", wall, usr);
+  if (usr < 0.0015 || usr > 0.5 || sys != 0.)
+    ERR;
+  if ((ret = GPTLquery ("nap", -1, &count, &onflg, &wall, &usr, &sys, 0, 0)) != 0)
+    ERR;
+  printf ("nap: wall=%g cpu=%g\n", wall, usr);
+  if (usr > 0.01)
+    ERR;
+
+  if ((ret = GPTLpr_file ("timing.threadcpu")) != 0)
+    ERR;
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+
+  // Rows are name, Called, Recurse, then CPU Wait Vcsw Ivcsw
+  if ( ! (fp = fopen ("timing.threadcpu", "r")))
+    ERR;
+  while (fgets (line, sizeof (line), fp)) {
+    if (sscanf (line, "%63s %d - %lf %lf %ld %ld", name, &count, &cpu, &wait,
+		&nvcsw, &nivcsw) != 6)
+      continue;
+    printf ("%s", line);
+    if (strcmp (name, "nap") == 0) {
+      ++found;
+      if (wait < 0.09 || nvcsw < 1)
+	ERR;
+    } else if (strcmp (name, "spin") == 0) {
+      ++found;
+      if (cpu <= 0.)
+	ERR;
+    }
+  }
+  fclose (fp);
+  if (found < 2)
+    ERR;
+  printf ("Success\n");
+  return 0;
+}
@@ -0,0 +1,91 @@
+/*
+** Test throttling of auto-profiled timers (GPTLthrottle_calls): a function far below the time
+** threshold is timed for the first GPTLthrottle_calls calls and only counted after that, a
+** slow function stays timed, and the callstack stays consistent for the timers around them
+*/
+
+#include "config.h"
+#include "gptl.h"
+#include <stdio.h>
+#include <string.h>
+
+/* This macro prints an error message with line number and name of
+ * test program. */
+#define ERR do { \
+fflush(stdout); /* Make sure our stdout is synced with stderr. */ \
+fprintf(stderr, "Sorry! Unexpected result, %s, line: %d\n", \
+	__FILE__, __LINE__);				    \
+fflush(stderr);                                             \
+return 2;                                                   \
+} while (0)
+
+#define NCALLS 1000
+#define NTINY 100000
+#define NSLOW 20
+
+extern void outer (int, int);
+
+int main ()
+{
+  int ret;
+  int insection = 0;
+  int nthrottled = 0;
+  int marked = 0;
+  int count;
+  int onflg;
+  int thd;
+  unsigned long timed, untimed;
+  double wall, usr, sys;
+  long long papicounters[1];
+  char line[1024];
+  char name[256];
+  FILE *fp;
+
+  if ((ret = GPTLsetoption (GPTLthrottle_calls, NCALLS)) != 0)
+    ERR;
+  if ((ret = GPTLsetoption (GPTLthrottle_nsec, 100000)) != 0)
+    ERR;
+  if ((ret = GPTLinitialize ()) != 0)
+    ERR;
+
+  if ((ret = GPTLstart ("total")) != 0)
+    ERR;
+  outer (NTINY, NSLOW);
+  if ((ret = GPTLstop ("total")) != 0)
+    ERR;
+
+  // total is the innermost timer again, so nothing was left on the callstack
+  if ((ret = GPTLquery ("total", 0, &count, &onflg, &wall, &usr, &sys, papicounters, 0)) != 0)
+    ERR;
+  if (count != 1 || onflg)
+    ERR;
+
+  if ((ret = GPTLpr_file ("timing.throttle")) != 0)
+    ERR;
+  if ((ret = GPTLfinalize ()) != 0)
+    ERR;
+
+  if ( ! (fp = fopen ("timing.throttle", "r")))
+    ERR;
+  while (fgets (line, sizeof (line), fp)) {
+    if (strncmp (line, "~ ", 2) == 0)
+      ++marked;
+    if (strncmp (line, "Throttled:", 10) == 0)
+      insection = 1;
+    if ( ! insection)
+      continue;
+    printf ("%s", line);
+    if (sscanf (line, "%d %255s %lu %lu", &thd, name, &timed, &untimed) != 4)
+      continue;
+    ++nthrottled;
+    // Only tiny qualifies, and it was throttled at the stop which completed call NCALLS
+    if (strcmp (name, "tiny") != 0 || timed != NCALLS || untimed != NTINY - NCALLS)
+      ERR;
+  }
+  fclose (fp);
+
+  if (nthrottled != 1 || marked != 1)
+    ERR;
+  printf ("Success\n");
+  return 0;
+}
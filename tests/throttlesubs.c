@@ -0,0 +1,30 @@
+// Compiled with the auto-instrumentation flag for the throttle test
+#include "config.h"
+#include <unistd.h>
+
+extern int tiny (int);
+extern void slow (void);
+
+volatile int sink = 0;
+
+void outer (int ntiny, int nslow)
+{
+  int n;
+
+  for (n = 0; n < ntiny; ++n)
+    sink += tiny (n);
+  for (n = 0; n < nslow; ++n)
+    slow ();
+}
+
+// Accessor-like: far below the throttle threshold
+int tiny (int n)
+{
+  return n & 1;
+}
+
+// Well above the threshold: must stay timed
+void slow (void)
+{
+  usleep (1000);
+}